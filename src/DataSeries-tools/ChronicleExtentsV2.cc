@@ -201,10 +201,12 @@ const char *EXTENT_CHRONICLE_NFS3_READWRITE =
     "</ExtentType>\n";
 
 const char *EXTENT_CHRONICLE_NFS3_RWCHECKSUM =
-    "<ExtentType name=\"trace::rpc::nfs3::rwchecksum\" namespace=\"atg.netapp.com\" version=\"2.0\">\n"
+    "<ExtentType name=\"trace::rpc::nfs3::rwchecksum\" namespace=\"atg.netapp.com\" version=\"2.1\">\n"
     FIELD_RECORD_ID
     "  <field name=\"offset\" type=\"int64\" comment=\"file offset in bytes\" />\n"
-    "  <field name=\"checksum\" type=\"int64\" print_format=\"%016llx\" comment=\"hash of the 512B block starting at offset\" />\n"
+    "  <field name=\"checksum\" type=\"int64\" print_format=\"%016llx\" comment=\"hash of the block starting at offset\" />\n"
+    "  <field name=\"algorithm\" type=\"variable32\" opt_nullable=\"yes\" pack_unique=\"yes\" comment=\"checksum algorithm (murmur3, crc32c, or xxh3); null means murmur3\" />\n"
+    "  <field name=\"block_size\" type=\"int32\" opt_nullable=\"yes\" comment=\"checksum block size in bytes; null means 512\" />\n"
     "</ExtentType>\n";
 
 // create, mkdir, symlink, mknod
@@ -0,0 +1,300 @@
+#ifndef EXTERNAL_SORT_H
+#define EXTERNAL_SORT_H
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "LoserTree.h"
+
+/*
+ * Building blocks of an external merge sort over opaque records with an
+ * int64 key. Sorted runs are spilled to temporary files as a sequence of
+ * [uint32 payload size][int64 key][payload] records, and are written and
+ * read back with large sequential I/Os.
+ */
+
+/// Writes a sorted run to a file through a large buffer.
+class RunWriter {
+
+    int fd;
+    std::string path;
+    std::vector<char> buffer;
+    size_t used;
+
+    void flush() {
+        size_t done = 0;
+        while(done < used) {
+            ssize_t n = ::write(fd, &buffer[done], used - done);
+            if(n < 0) {
+                if(errno == EINTR)
+                    continue;
+                throw std::runtime_error("cannot write run " + path + ": " + strerror(errno));
+            }
+            done += n;
+        }
+        used = 0;
+    }
+
+    public:
+
+    uint64_t records;
+
+    RunWriter(const std::string &runPath, size_t bufferSize) :
+        path(runPath), buffer(bufferSize), used(0), records(0) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if(fd < 0)
+            throw std::runtime_error("cannot create run " + path + ": " + strerror(errno));
+    }
+
+    ~RunWriter() {
+        close();
+    }
+
+    void append(int64_t key, const char *payload, uint32_t size) {
+        size_t recordSize = sizeof(size) + sizeof(key) + size;
+        if(used + recordSize > buffer.size()) {
+            flush();
+            if(recordSize > buffer.size())
+                buffer.resize(recordSize);
+        }
+        memcpy(&buffer[used], &size, sizeof(size));
+        memcpy(&buffer[used + sizeof(size)], &key, sizeof(key));
+        memcpy(&buffer[used + sizeof(size) + sizeof(key)], payload, size);
+        used += recordSize;
+        ++records;
+    }
+
+    void close() {
+        if(fd < 0)
+            return;
+        flush();
+        ::close(fd);
+        fd = -1;
+    }
+
+    const std::string &getPath() const { return path; }
+};
+
+/// A sink that writes the records it is handed into a run
+class RunSink {
+    RunWriter &run;
+    public:
+    RunSink(RunWriter &writer) : run(writer) { }
+    void operator()(int64_t key, const char *payload, uint32_t size) {
+        run.append(key, payload, size);
+    }
+};
+
+/// Reads back a run written by RunWriter, one record at a time.
+class RunReader {
+
+    int fd;
+    std::string path;
+    std::vector<char> buffer;
+    size_t start, end;          // unread bytes in the buffer
+    bool eof;
+    int64_t curKey;
+    uint32_t curSize;
+    const char *curPayload;
+
+    static const size_t HEADER = sizeof(uint32_t) + sizeof(int64_t);
+
+    /// Make sure at least need bytes are buffered, unless the run ends
+    bool fill(size_t need) {
+        if(end - start >= need)
+            return true;
+        // move the partial record to the front, then read behind it
+        memmove(&buffer[0], &buffer[start], end - start);
+        end -= start;
+        start = 0;
+        if(need > buffer.size())
+            buffer.resize(need);
+        while(!eof && end < buffer.size()) {
+            ssize_t n = ::read(fd, &buffer[end], buffer.size() - end);
+            if(n < 0) {
+                if(errno == EINTR)
+                    continue;
+                throw std::runtime_error("cannot read run " + path + ": " + strerror(errno));
+            }
+            if(n == 0)
+                eof = true;
+            end += n;
+        }
+        return end - start >= need;
+    }
+
+    public:
+
+    RunReader(const std::string &runPath, size_t bufferSize) :
+        path(runPath), buffer(bufferSize), start(0), end(0), eof(false),
+        curKey(0), curSize(0), curPayload(NULL) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            throw std::runtime_error("cannot open run " + path + ": " + strerror(errno));
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    ~RunReader() {
+        ::close(fd);
+    }
+
+    /// Move to the next record. The previous record's payload is no
+    /// longer valid afterwards.
+    /// @returns false at the end of the run
+    bool next() {
+        if(!fill(HEADER)) {
+            if(end != start)
+                throw std::runtime_error("truncated run " + path);
+            return false;
+        }
+        memcpy(&curSize, &buffer[start], sizeof(curSize));
+        memcpy(&curKey, &buffer[start + sizeof(curSize)], sizeof(curKey));
+        if(!fill(HEADER + curSize))
+            throw std::runtime_error("truncated run " + path);
+        curPayload = &buffer[start + HEADER];
+        start += HEADER + curSize;
+        return true;
+    }
+
+    int64_t key() const { return curKey; }
+    const char *payload() const { return curPayload; }
+    uint32_t size() const { return curSize; }
+};
+
+/// Collects records in memory and writes them out sorted by key. Records
+/// with equal keys keep the order they were added in.
+class SortBuffer {
+
+    struct Entry {
+        int64_t key;
+        size_t offset;
+        uint32_t size;
+        bool operator<(const Entry &other) const {
+            return key < other.key || (key == other.key && offset < other.offset);
+        }
+    };
+    std::vector<char> arena;
+    std::vector<Entry> entries;
+
+    public:
+
+    void append(int64_t key, const char *payload, uint32_t size) {
+        Entry e = { key, arena.size(), size };
+        arena.insert(arena.end(), payload, payload + size);
+        entries.push_back(e);
+    }
+
+    /// The memory held, including what the vectors have reserved
+    size_t bytes() const {
+        return arena.capacity() + entries.capacity() * sizeof(Entry);
+    }
+
+    bool empty() const { return entries.empty(); }
+
+    /// Hands the records to sink in key order, as sink(key, payload,
+    /// size), and empties the buffer
+    template <class Sink>
+    void sortInto(Sink &sink) {
+        std::sort(entries.begin(), entries.end());
+        for(std::vector<Entry>::const_iterator e = entries.begin();
+                e != entries.end(); ++e) {
+            sink(e->key, &arena[e->offset], e->size);
+        }
+        clear();
+    }
+
+    void sortAndWrite(RunWriter &run) {
+        RunSink sink(run);
+        sortInto(sink);
+    }
+
+    void clear() {
+        std::vector<char>().swap(arena);
+        std::vector<Entry>().swap(entries);
+    }
+};
+
+/**
+ * Merges sorted runs with a loser tree and hands the records to sink in
+ * key order (ties go to the earlier run). Sink is called as
+ * sink(key, payload, size).
+ */
+template <class Sink>
+uint64_t mergeRuns(const std::vector<std::string> &runs, size_t bufferSize,
+        Sink &sink)
+{
+    // the readers are closed even if the sink throws
+    std::vector<std::unique_ptr<RunReader> > readers;
+    LoserTree tree(runs.size());
+    for(unsigned i = 0; i < runs.size(); ++i) {
+        readers.push_back(std::unique_ptr<RunReader>(new RunReader(runs[i], bufferSize)));
+        if(readers[i]->next())
+            tree.setKey(i, readers[i]->key());
+    }
+    tree.build();
+
+    uint64_t records = 0;
+    while(!tree.empty()) {
+        unsigned index = tree.winner();
+        RunReader *reader = readers[index].get();
+        unsigned runnerUp = tree.runnerUp();
+        do {
+            sink(reader->key(), reader->payload(), reader->size());
+            ++records;
+            if(!reader->next()) {
+                tree.setExhausted(index);
+                break;
+            }
+            tree.setKey(index, reader->key());
+        } while(tree.precedes(index, runnerUp));
+        tree.replay(index);
+    }
+    return records;
+}
+
+/**
+ * Merges runs like mergeRuns, but reads from at most fanIn of them at a
+ * time: while there are more, each group of fanIn consecutive runs is
+ * first merged into a new run (named by newRunPath()), which keeps ties
+ * going to the earlier run. The runs are removed once merged.
+ */
+template <class Sink, class NewRunPath>
+uint64_t mergeRunsInPasses(std::vector<std::string> runs, unsigned fanIn,
+        size_t bufferSize, NewRunPath &newRunPath, Sink &sink)
+{
+    if(fanIn < 2)
+        fanIn = 2;
+    while(runs.size() > fanIn) {
+        std::vector<std::string> merged;
+        for(size_t i = 0; i < runs.size(); i += fanIn) {
+            std::vector<std::string> group(runs.begin() + i,
+                    runs.begin() + std::min(runs.size(), i + fanIn));
+            RunWriter run(newRunPath(), bufferSize);
+            RunSink runSink(run);
+            mergeRuns(group, bufferSize, runSink);
+            run.close();
+            merged.push_back(run.getPath());
+            for(size_t j = 0; j < group.size(); ++j) {
+                unlink(group[j].c_str());
+            }
+        }
+        runs.swap(merged);
+    }
+
+    uint64_t records = mergeRuns(runs, bufferSize, sink);
+    for(size_t i = 0; i < runs.size(); ++i) {
+        unlink(runs[i].c_str());
+    }
+    return records;
+}
+
+#endif // EXTERNAL_SORT_H
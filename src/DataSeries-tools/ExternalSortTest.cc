@@ -0,0 +1,189 @@
+#include "gtest/gtest.h"
+#include "ExternalSort.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <utility>
+
+typedef std::vector<std::pair<int64_t, std::string> > Records;
+
+/// Collects the records it is handed
+struct Collect {
+    Records records;
+    void operator()(int64_t key, const char *payload, uint32_t size) {
+        records.push_back(std::make_pair(key, std::string(payload, size)));
+    }
+};
+
+/// Throws on the n-th record
+struct ThrowAt {
+    unsigned n;
+    void operator()(int64_t, const char *, uint32_t) {
+        if(--n == 0)
+            throw std::runtime_error("sink failed");
+    }
+};
+
+static unsigned
+openFds()
+{
+    unsigned n = 0;
+    DIR *dir = opendir("/proc/self/fd");
+    while(readdir(dir) != NULL)
+        ++n;
+    closedir(dir);
+    return n;
+}
+
+static bool
+exists(const std::string &path)
+{
+    return access(path.c_str(), F_OK) == 0;
+}
+
+class ExternalSortTest : public ::testing::Test {
+    protected:
+    std::string dir;
+    unsigned numRuns;
+
+    void SetUp() {
+        char tmpl[] = "/tmp/ExternalSortTest.XXXXXX";
+        ASSERT_TRUE(mkdtemp(tmpl) != NULL);
+        dir = tmpl;
+        numRuns = 0;
+    }
+    void TearDown() {
+        rmdir(dir.c_str());
+    }
+
+    public:
+
+    /// A fresh run path (for mergeRunsInPasses)
+    std::string operator()() {
+        char name[32];
+        snprintf(name, sizeof(name), "/run.%u", numRuns++);
+        return dir + name;
+    }
+
+    /// Writes the records, which must be sorted, as a run
+    std::string writeRun(const Records &records, size_t bufferSize = 64) {
+        RunWriter run((*this)(), bufferSize);
+        for(size_t i = 0; i < records.size(); ++i) {
+            run.append(records[i].first, records[i].second.data(), records[i].second.size());
+        }
+        run.close();
+        return run.getPath();
+    }
+};
+
+TEST_F(ExternalSortTest, RunRoundTrip) {
+    Records records;
+    for(unsigned i = 0; i < 1000; ++i) {
+        // payloads of 0 bytes up to several times the buffer size
+        records.push_back(std::make_pair((int64_t) i * 3 - 1000, std::string(i % 300, 'a' + i % 26)));
+    }
+    std::string path = writeRun(records);
+
+    RunReader reader(path, 16);
+    for(size_t i = 0; i < records.size(); ++i) {
+        ASSERT_TRUE(reader.next());
+        EXPECT_EQ(records[i].first, reader.key());
+        EXPECT_EQ(records[i].second, std::string(reader.payload(), reader.size()));
+    }
+    EXPECT_FALSE(reader.next());
+    unlink(path.c_str());
+}
+
+TEST_F(ExternalSortTest, SortBufferIsStable) {
+    srandom(1);
+    SortBuffer buffer;
+    Records added;
+    for(unsigned i = 0; i < 5000; ++i) {
+        char payload[16];
+        snprintf(payload, sizeof(payload), "%u", i);
+        int64_t key = random() % 100;
+        buffer.append(key, payload, strlen(payload));
+        added.push_back(std::make_pair(key, std::string(payload)));
+    }
+    EXPECT_GT(buffer.bytes(), 0u);
+    Collect sink;
+    buffer.sortInto(sink);
+    EXPECT_TRUE(buffer.empty());
+
+    // equal keys keep the order they were added in
+    std::stable_sort(added.begin(), added.end(),
+            [](const std::pair<int64_t, std::string> &a,
+               const std::pair<int64_t, std::string> &b) { return a.first < b.first; });
+    EXPECT_EQ(added, sink.records);
+}
+
+TEST_F(ExternalSortTest, MergeTiesGoToTheEarlierRun) {
+    srandom(2);
+    // 7 runs with keys from a small range, tagged with their run and index
+    std::vector<std::string> runs;
+    Records expected;
+    for(unsigned r = 0; r < 7; ++r) {
+        Records records;
+        int64_t key = 0;
+        for(unsigned i = 0; i < 200; ++i) {
+            key += random() % 3;
+            char payload[16];
+            snprintf(payload, sizeof(payload), "%u.%u", r, i);
+            records.push_back(std::make_pair(key, std::string(payload)));
+        }
+        runs.push_back(writeRun(records));
+        expected.insert(expected.end(), records.begin(), records.end());
+    }
+    std::stable_sort(expected.begin(), expected.end(),
+            [](const std::pair<int64_t, std::string> &a,
+               const std::pair<int64_t, std::string> &b) { return a.first < b.first; });
+
+    Collect sink;
+    EXPECT_EQ(expected.size(), mergeRuns(runs, 128, sink));
+    EXPECT_EQ(expected, sink.records);
+
+    // in passes of at most 2 and 3 runs, the order is the same
+    for(unsigned fanIn = 2; fanIn <= 3; ++fanIn) {
+        std::vector<std::string> copies;
+        for(size_t i = 0; i < runs.size(); ++i) {
+            RunReader reader(runs[i], 128);
+            Records records;
+            while(reader.next()) {
+                records.push_back(std::make_pair(reader.key(),
+                                std::string(reader.payload(), reader.size())));
+            }
+            copies.push_back(writeRun(records));
+        }
+        Collect passes;
+        EXPECT_EQ(expected.size(), mergeRunsInPasses(copies, fanIn, 128, *this, passes));
+        EXPECT_EQ(expected, passes.records) << "fan-in " << fanIn;
+        // the copies and the intermediate runs are gone
+        for(unsigned i = runs.size(); i < numRuns; ++i) {
+            char name[32];
+            snprintf(name, sizeof(name), "/run.%u", i);
+            EXPECT_FALSE(exists(dir + name)) << name;
+        }
+    }
+
+    for(size_t i = 0; i < runs.size(); ++i) {
+        unlink(runs[i].c_str());
+    }
+}
+
+TEST_F(ExternalSortTest, MergeClosesRunsWhenTheSinkThrows) {
+    std::vector<std::string> runs;
+    for(unsigned r = 0; r < 4; ++r) {
+        Records records;
+        for(int64_t i = 0; i < 100; ++i) {
+            records.push_back(std::make_pair(i, std::string("x")));
+        }
+        runs.push_back(writeRun(records));
+    }
+    unsigned fds = openFds();
+    ThrowAt sink = { 50 };
+    EXPECT_THROW(mergeRuns(runs, 64, sink), std::runtime_error);
+    EXPECT_EQ(fds, openFds());
+    for(size_t i = 0; i < runs.size(); ++i) {
+        unlink(runs[i].c_str());
+    }
+}
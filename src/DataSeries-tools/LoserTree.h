@@ -0,0 +1,94 @@
+#ifndef LOSER_TREE_H
+#define LOSER_TREE_H
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * A tournament (loser) tree for merging k sorted sources by an int64 key.
+ * Each internal node keeps the source that lost the match played there,
+ * so advancing the winner only replays the log2(k) matches on its path,
+ * with one comparison per level. Ties go to the source with the lower
+ * index, which keeps the merge stable.
+ */
+class LoserTree {
+
+    unsigned k;
+    std::vector<unsigned> tree;     // tree[0] is the winner
+    std::vector<int64_t> keys;
+    std::vector<bool> exhausted;
+
+    unsigned build(unsigned node) {
+        if(node >= k)
+            return node - k;
+        unsigned left = build(2 * node), right = build(2 * node + 1);
+        if(precedes(left, right)) {
+            tree[node] = right;
+            return left;
+        }
+        tree[node] = left;
+        return right;
+    }
+
+    public:
+
+    LoserTree(unsigned numSources) : k(numSources), tree(numSources, 0),
+        keys(numSources, 0), exhausted(numSources, true) { }
+
+    /// Set the next key of a source (before build() or before replaying it)
+    void setKey(unsigned source, int64_t key) {
+        keys[source] = key;
+        exhausted[source] = false;
+    }
+
+    /// Mark a source as having no more records
+    void setExhausted(unsigned source) {
+        exhausted[source] = true;
+    }
+
+    /// Play the whole tournament, once all the first keys are set
+    void build() {
+        if(k > 0)
+            tree[0] = (k > 1) ? build(1) : 0;
+    }
+
+    /// Replay the matches of the winner after its key changed
+    void replay(unsigned source) {
+        unsigned winner = source;
+        for(unsigned node = (source + k) / 2; node > 0; node /= 2) {
+            if(precedes(tree[node], winner)) {
+                unsigned loser = winner;
+                winner = tree[node];
+                tree[node] = loser;
+            }
+        }
+        tree[0] = winner;
+    }
+
+    bool empty() const { return k == 0 || exhausted[tree[0]]; }
+    unsigned winner() const { return tree[0]; }
+    int64_t key(unsigned source) const { return keys[source]; }
+
+    /// The source that would win if the winner left, i.e. the best of
+    /// the sources the winner beat on its way up (k if there is none)
+    unsigned runnerUp() const {
+        unsigned best = k;
+        for(unsigned node = (tree[0] + k) / 2; node > 0; node /= 2) {
+            if(precedes(tree[node], best))
+                best = tree[node];
+        }
+        return best;
+    }
+
+    /// Does source a come before source b in the merged order?
+    /// (b == k stands for an exhausted source)
+    bool precedes(unsigned a, unsigned b) const {
+        if(exhausted[a])
+            return false;
+        if(b >= k || exhausted[b])
+            return true;
+        return keys[a] < keys[b] || (keys[a] == keys[b] && a < b);
+    }
+};
+
+#endif // LOSER_TREE_H
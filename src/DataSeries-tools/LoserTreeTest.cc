@@ -0,0 +1,163 @@
+#include "gtest/gtest.h"
+#include "LoserTree.h"
+#include <stdlib.h>
+#include <algorithm>
+#include <utility>
+
+/// Sorted sources of keys, merged through a LoserTree
+class Sources {
+    std::vector<std::vector<int64_t> > keys;
+    std::vector<size_t> pos;
+    public:
+    LoserTree tree;
+
+    Sources(const std::vector<std::vector<int64_t> > &sourceKeys) :
+        keys(sourceKeys), pos(sourceKeys.size(), 0), tree(sourceKeys.size()) {
+        for(unsigned i = 0; i < keys.size(); ++i) {
+            if(!keys[i].empty())
+                tree.setKey(i, keys[i][0]);
+        }
+        tree.build();
+    }
+
+    /// Takes the winner's key and moves the winner to its next key
+    void advance(unsigned source) {
+        if(++pos[source] < keys[source].size())
+            tree.setKey(source, keys[source][pos[source]]);
+        else
+            tree.setExhausted(source);
+        tree.replay(source);
+    }
+
+    /// Merges what is left, as (key, source) in the order of the tree
+    std::vector<std::pair<int64_t, unsigned> > merge() {
+        std::vector<std::pair<int64_t, unsigned> > out;
+        while(!tree.empty()) {
+            unsigned w = tree.winner();
+            out.push_back(std::make_pair(tree.key(w), w));
+            advance(w);
+        }
+        return out;
+    }
+
+    /// The stable merge of the sources: by key, ties by source
+    std::vector<std::pair<int64_t, unsigned> > expected() const {
+        std::vector<std::pair<int64_t, unsigned> > out;
+        for(unsigned i = 0; i < keys.size(); ++i) {
+            for(size_t j = 0; j < keys[i].size(); ++j) {
+                out.push_back(std::make_pair(keys[i][j], i));
+            }
+        }
+        std::stable_sort(out.begin(), out.end());
+        return out;
+    }
+};
+
+static std::vector<std::vector<int64_t> >
+randomSources(unsigned k, unsigned maxLen, int64_t maxStep)
+{
+    std::vector<std::vector<int64_t> > keys(k);
+    for(unsigned i = 0; i < k; ++i) {
+        int64_t key = random() % 10 - 5;
+        for(unsigned n = random() % (maxLen + 1); n > 0; --n) {
+            key += random() % (maxStep + 1);
+            keys[i].push_back(key);
+        }
+    }
+    return keys;
+}
+
+TEST(LoserTree, EmptyTrees) {
+    LoserTree none(0);
+    none.build();
+    EXPECT_TRUE(none.empty());
+
+    LoserTree exhausted(3);
+    exhausted.build();
+    EXPECT_TRUE(exhausted.empty());
+}
+
+TEST(LoserTree, SingleSource) {
+    std::vector<std::vector<int64_t> > keys(1);
+    keys[0].push_back(-3);
+    keys[0].push_back(7);
+    Sources s(keys);
+    EXPECT_EQ(1u, s.tree.runnerUp());   // no other source
+    EXPECT_EQ(s.expected(), s.merge());
+}
+
+TEST(LoserTree, BuildPicksTheSmallestKey) {
+    for(unsigned k = 1; k <= 9; ++k) {
+        for(unsigned smallest = 0; smallest < k; ++smallest) {
+            std::vector<std::vector<int64_t> > keys(k, std::vector<int64_t>(1, 100));
+            keys[smallest][0] = 1;
+            Sources s(keys);
+            EXPECT_EQ(smallest, s.tree.winner()) << "k " << k;
+            EXPECT_EQ(1, s.tree.key(s.tree.winner()));
+        }
+    }
+}
+
+TEST(LoserTree, TiesGoToTheLowerSource) {
+    // equal keys in all of 5 sources come out by source
+    std::vector<std::vector<int64_t> > keys(5, std::vector<int64_t>(3, 42));
+    Sources s(keys);
+    std::vector<std::pair<int64_t, unsigned> > merged = s.merge();
+    ASSERT_EQ(15u, merged.size());
+    for(unsigned i = 0; i < merged.size(); ++i) {
+        EXPECT_EQ(i / 3, merged[i].second);
+    }
+}
+
+TEST(LoserTree, ExhaustedSourcesNeverWin) {
+    // sources 1 and 3 start exhausted, source 0 runs out first
+    std::vector<std::vector<int64_t> > keys(5);
+    keys[0].push_back(0);
+    keys[2].push_back(5);
+    keys[2].push_back(6);
+    keys[4].push_back(1);
+    Sources s(keys);
+    std::vector<std::pair<int64_t, unsigned> > merged = s.merge();
+    EXPECT_EQ(s.expected(), merged);
+    for(unsigned i = 0; i < merged.size(); ++i) {
+        EXPECT_NE(1u, merged[i].second);
+        EXPECT_NE(3u, merged[i].second);
+    }
+    EXPECT_TRUE(s.tree.empty());
+}
+
+TEST(LoserTree, RunnerUpIsTheNextWinner) {
+    srandom(1);
+    for(unsigned k = 2; k <= 13; ++k) {
+        Sources s(randomSources(k, 20, 3));
+        while(!s.tree.empty()) {
+            unsigned winner = s.tree.winner(), runnerUp = s.tree.runnerUp();
+            // nobody else precedes the runner-up
+            for(unsigned i = 0; i < k; ++i) {
+                if(i != winner && i != runnerUp) {
+                    EXPECT_FALSE(s.tree.precedes(i, runnerUp)) << "k " << k;
+                }
+            }
+            // with the winner exhausted, the runner-up would win
+            LoserTree copy = s.tree;
+            copy.setExhausted(winner);
+            copy.replay(winner);
+            if(copy.empty())
+                EXPECT_EQ(k, runnerUp);
+            else
+                EXPECT_EQ(copy.winner(), runnerUp);
+            s.advance(winner);
+        }
+    }
+}
+
+TEST(LoserTree, MergesRandomSources) {
+    srandom(2);
+    // powers of two and others, with many ties
+    for(unsigned k = 1; k <= 33; ++k) {
+        for(unsigned round = 0; round < 10; ++round) {
+            Sources s(randomSources(k, 50, round % 4));
+            EXPECT_EQ(s.expected(), s.merge()) << "k " << k << ", round " << round;
+        }
+    }
+}
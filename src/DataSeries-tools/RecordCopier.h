@@ -0,0 +1,180 @@
+#ifndef RECORD_COPIER_H
+#define RECORD_COPIER_H
+
+#include <string>
+#include <vector>
+
+#include "DataSeries/ExtentSeries.hpp"
+#include "DataSeries/GeneralField.hpp"
+#include "DataSeries/BoolField.hpp"
+#include "DataSeries/ByteField.hpp"
+#include "DataSeries/Int32Field.hpp"
+#include "DataSeries/Int64Field.hpp"
+#include "DataSeries/DoubleField.hpp"
+#include "DataSeries/Variable32Field.hpp"
+
+/**
+ * Copies the current record of one series into the current record of
+ * another series of the same extent type. The copy plan is built once,
+ * with a typed field per column, so copying a record is a loop over the
+ * columns with no GeneralValue boxing and no virtual call per value.
+ *
+ * A copier can also map between two extent types by column position,
+ * e.g. to convert between trace versions.
+ */
+class RecordCopier {
+
+    struct Column {
+        ExtentType::fieldType type;
+        bool nullable;
+        Field *in, *out;
+    };
+    std::vector<Column> columns;
+    // columns without a typed copy (fixed width, or mapped between
+    // different types) go through GeneralField
+    std::vector<GeneralField *> generalIn, generalOut;
+    // output columns with no source column
+    std::vector<GeneralField *> nullOut;
+
+    template <class FieldType>
+    static Field *newField(ExtentSeries &series, const std::string &name,
+            bool nullable) {
+        return new FieldType(series, name, nullable ? Field::flag_nullable : 0);
+    }
+
+    template <class FieldType>
+    static inline void copyFixed(const Column &c) {
+        FieldType *in = static_cast<FieldType *>(c.in);
+        FieldType *out = static_cast<FieldType *>(c.out);
+        if(c.nullable && in->isNull())
+            out->setNull();
+        else
+            out->set(in->val());
+    }
+
+    /// Add a copy of column inName to column outName
+    void addColumn(const ExtentType::Ptr inType, ExtentSeries &inSeries,
+            const std::string &inName, const ExtentType::Ptr outType,
+            ExtentSeries &outSeries, const std::string &outName) {
+        Column c;
+        c.type = inType->getFieldType(inName);
+        c.nullable = inType->getNullable(inName);
+        if(c.type != outType->getFieldType(outName)
+                || c.nullable != outType->getNullable(outName)) {
+            c.type = ExtentType::ft_fixedwidth;
+        }
+        switch(c.type) {
+            case ExtentType::ft_bool:
+                c.in = newField<BoolField>(inSeries, inName, c.nullable);
+                c.out = newField<BoolField>(outSeries, outName, c.nullable);
+                break;
+            case ExtentType::ft_byte:
+                c.in = newField<ByteField>(inSeries, inName, c.nullable);
+                c.out = newField<ByteField>(outSeries, outName, c.nullable);
+                break;
+            case ExtentType::ft_int32:
+                c.in = newField<Int32Field>(inSeries, inName, c.nullable);
+                c.out = newField<Int32Field>(outSeries, outName, c.nullable);
+                break;
+            case ExtentType::ft_int64:
+                c.in = newField<Int64Field>(inSeries, inName, c.nullable);
+                c.out = newField<Int64Field>(outSeries, outName, c.nullable);
+                break;
+            case ExtentType::ft_double:
+                c.in = newField<DoubleField>(inSeries, inName, c.nullable);
+                c.out = newField<DoubleField>(outSeries, outName, c.nullable);
+                break;
+            case ExtentType::ft_variable32:
+                c.in = newField<Variable32Field>(inSeries, inName, c.nullable);
+                c.out = newField<Variable32Field>(outSeries, outName, c.nullable);
+                break;
+            default:
+                generalIn.push_back(GeneralField::create(NULL, inSeries, inName));
+                generalOut.push_back(GeneralField::create(NULL, outSeries, outName));
+                return;
+        }
+        columns.push_back(c);
+    }
+
+    public:
+
+    /// sourceColumn values for output columns that are not copied
+    enum { nullColumn = -1, skipColumn = -2 };
+
+    RecordCopier(const ExtentType::Ptr extype, ExtentSeries &inSeries,
+            ExtentSeries &outSeries) {
+        for(unsigned i = 0; i < extype->getNFields(); ++i) {
+            const std::string name = extype->getFieldName(i);
+            addColumn(extype, inSeries, name, extype, outSeries, name);
+        }
+    }
+
+    /// Copy input column sourceColumn[i] to output column i. Output
+    /// columns mapped to nullColumn are set to null, and those mapped to
+    /// skipColumn are left for the caller to set.
+    RecordCopier(const ExtentType::Ptr inType, ExtentSeries &inSeries,
+            const ExtentType::Ptr outType, ExtentSeries &outSeries,
+            const std::vector<int> &sourceColumn) {
+        for(unsigned i = 0; i < sourceColumn.size(); ++i) {
+            const std::string outName = outType->getFieldName(i);
+            if(sourceColumn[i] == nullColumn)
+                nullOut.push_back(GeneralField::create(NULL, outSeries, outName));
+            else if(sourceColumn[i] != skipColumn)
+                addColumn(inType, inSeries, inType->getFieldName(sourceColumn[i]),
+                        outType, outSeries, outName);
+        }
+    }
+
+    ~RecordCopier() {
+        for(unsigned i = 0; i < columns.size(); ++i) {
+            delete columns[i].in;
+            delete columns[i].out;
+        }
+        GeneralField::deleteFields(generalIn);
+        GeneralField::deleteFields(generalOut);
+        GeneralField::deleteFields(nullOut);
+    }
+
+    /// Copy the current input record into the current output record
+    void copy() {
+        for(std::vector<Column>::const_iterator c = columns.begin();
+                c != columns.end(); ++c) {
+            switch(c->type) {
+                case ExtentType::ft_bool:
+                    copyFixed<BoolField>(*c);
+                    break;
+                case ExtentType::ft_byte:
+                    copyFixed<ByteField>(*c);
+                    break;
+                case ExtentType::ft_int32:
+                    copyFixed<Int32Field>(*c);
+                    break;
+                case ExtentType::ft_int64:
+                    copyFixed<Int64Field>(*c);
+                    break;
+                case ExtentType::ft_double:
+                    copyFixed<DoubleField>(*c);
+                    break;
+                case ExtentType::ft_variable32: {
+                    Variable32Field *in = static_cast<Variable32Field *>(c->in);
+                    Variable32Field *out = static_cast<Variable32Field *>(c->out);
+                    if(c->nullable && in->isNull())
+                        out->setNull();
+                    else
+                        out->set(in->val(), in->size());
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        for(unsigned i = 0; i < generalIn.size(); ++i) {
+            generalOut[i]->set(generalIn[i]);
+        }
+        for(unsigned i = 0; i < nullOut.size(); ++i) {
+            nullOut[i]->setNull();
+        }
+    }
+};
+
+#endif // RECORD_COPIER_H
@@ -0,0 +1,167 @@
+#ifndef ROW_CODEC_H
+#define ROW_CODEC_H
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "DataSeries/ExtentSeries.hpp"
+#include "DataSeries/BoolField.hpp"
+#include "DataSeries/ByteField.hpp"
+#include "DataSeries/Int32Field.hpp"
+#include "DataSeries/Int64Field.hpp"
+#include "DataSeries/DoubleField.hpp"
+#include "DataSeries/Variable32Field.hpp"
+
+/**
+ * Serializes the current record of a series into a flat byte string and
+ * back, with typed fields. Each column is written in order: a null byte
+ * for nullable columns, then the value (variable32 values prefixed with
+ * their size). Used to spill records to temporary files.
+ */
+class RowCodec {
+
+    struct Column {
+        ExtentType::fieldType type;
+        bool nullable;
+        Field *field;
+    };
+    std::vector<Column> columns;
+
+    template <class FieldType, class T>
+    static void put(std::string &buf, const Field *f) {
+        T v = static_cast<const FieldType *>(f)->val();
+        buf.append(reinterpret_cast<const char *>(&v), sizeof(v));
+    }
+
+    template <class FieldType, class T>
+    static const char *get(const char *p, Field *f) {
+        T v;
+        memcpy(&v, p, sizeof(v));
+        static_cast<FieldType *>(f)->set(v);
+        return p + sizeof(v);
+    }
+
+    public:
+
+    RowCodec(const ExtentType::Ptr extype, ExtentSeries &series) {
+        for(unsigned i = 0; i < extype->getNFields(); ++i) {
+            const std::string name = extype->getFieldName(i);
+            Column c;
+            c.type = extype->getFieldType(name);
+            c.nullable = extype->getNullable(name);
+            int flags = c.nullable ? Field::flag_nullable : 0;
+            switch(c.type) {
+                case ExtentType::ft_bool:
+                    c.field = new BoolField(series, name, flags);
+                    break;
+                case ExtentType::ft_byte:
+                    c.field = new ByteField(series, name, flags);
+                    break;
+                case ExtentType::ft_int32:
+                    c.field = new Int32Field(series, name, flags);
+                    break;
+                case ExtentType::ft_int64:
+                    c.field = new Int64Field(series, name, flags);
+                    break;
+                case ExtentType::ft_double:
+                    c.field = new DoubleField(series, name, flags);
+                    break;
+                case ExtentType::ft_variable32:
+                    c.field = new Variable32Field(series, name, flags);
+                    break;
+                default:
+                    FATAL_ERROR(boost::format("RowCodec: unsupported type for field %s of %s")
+                            % name % extype->getName());
+            }
+            columns.push_back(c);
+        }
+    }
+
+    ~RowCodec() {
+        for(unsigned i = 0; i < columns.size(); ++i) {
+            delete columns[i].field;
+        }
+    }
+
+    /// Append the current record to buf
+    void encode(std::string &buf) const {
+        for(std::vector<Column>::const_iterator c = columns.begin();
+                c != columns.end(); ++c) {
+            if(c->nullable) {
+                bool null = c->field->isNull();
+                buf.push_back(null);
+                if(null)
+                    continue;
+            }
+            switch(c->type) {
+                case ExtentType::ft_bool:
+                    put<BoolField, bool>(buf, c->field);
+                    break;
+                case ExtentType::ft_byte:
+                    put<ByteField, uint8_t>(buf, c->field);
+                    break;
+                case ExtentType::ft_int32:
+                    put<Int32Field, int32_t>(buf, c->field);
+                    break;
+                case ExtentType::ft_int64:
+                    put<Int64Field, int64_t>(buf, c->field);
+                    break;
+                case ExtentType::ft_double:
+                    put<DoubleField, double>(buf, c->field);
+                    break;
+                case ExtentType::ft_variable32: {
+                    const Variable32Field *f = static_cast<const Variable32Field *>(c->field);
+                    int32_t size = f->size();
+                    buf.append(reinterpret_cast<const char *>(&size), sizeof(size));
+                    buf.append(reinterpret_cast<const char *>(f->val()), size);
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+
+    /// Fill the current record from an encoded one
+    /// @returns the end of the encoded record
+    const char *decode(const char *p) const {
+        for(std::vector<Column>::const_iterator c = columns.begin();
+                c != columns.end(); ++c) {
+            if(c->nullable && *p++) {
+                c->field->setNull();
+                continue;
+            }
+            switch(c->type) {
+                case ExtentType::ft_bool:
+                    p = get<BoolField, bool>(p, c->field);
+                    break;
+                case ExtentType::ft_byte:
+                    p = get<ByteField, uint8_t>(p, c->field);
+                    break;
+                case ExtentType::ft_int32:
+                    p = get<Int32Field, int32_t>(p, c->field);
+                    break;
+                case ExtentType::ft_int64:
+                    p = get<Int64Field, int64_t>(p, c->field);
+                    break;
+                case ExtentType::ft_double:
+                    p = get<DoubleField, double>(p, c->field);
+                    break;
+                case ExtentType::ft_variable32: {
+                    int32_t size;
+                    memcpy(&size, p, sizeof(size));
+                    p += sizeof(size);
+                    static_cast<Variable32Field *>(c->field)->set(p, size);
+                    p += size;
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        return p;
+    }
+};
+
+#endif // ROW_CODEC_H
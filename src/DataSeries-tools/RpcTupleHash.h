@@ -0,0 +1,79 @@
+#ifndef RPC_TUPLE_HASH_H
+#define RPC_TUPLE_HASH_H
+
+#include <stdint.h>
+#include <string.h>
+
+namespace rpcTupleHash {
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+}
+
+/// The low 64 bits of MurmurHash3_x64_128 over LEN bytes. The length is
+/// known at compile time, so the block loop unrolls and the tail switch
+/// folds away; the result is the same as the generic function's.
+template<unsigned LEN>
+static inline uint64_t murmurHash3Low64(const void *key, uint32_t seed)
+{
+    using rpcTupleHash::rotl64;
+    const unsigned char *data = static_cast<const unsigned char *>(key);
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    uint64_t h1 = seed, h2 = seed;
+    uint64_t k1, k2;
+
+    for(unsigned i = 0; i < LEN / 16; ++i) {
+        memcpy(&k1, data + 16 * i, sizeof(k1));
+        memcpy(&k2, data + 16 * i + 8, sizeof(k2));
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    // the tail, as little-endian words of up to 8 bytes
+    const unsigned char *tail = data + 16 * (LEN / 16);
+    k1 = k2 = 0;
+    for(unsigned i = LEN % 16; i > 8; --i)
+        k2 |= uint64_t(tail[i - 1]) << (8 * (i - 9));
+    for(unsigned i = LEN % 16 < 8 ? LEN % 16 : 8; i > 0; --i)
+        k1 |= uint64_t(tail[i - 1]) << (8 * (i - 1));
+    if(LEN % 16 > 8) {
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    }
+    if(LEN % 16 > 0) {
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= LEN; h2 ^= LEN;
+    h1 += h2;
+    h2 += h1;
+    h1 = rpcTupleHash::fmix64(h1);
+    h2 = rpcTupleHash::fmix64(h2);
+    return h1 + h2;
+}
+
+/// The hash of the 20-byte RPC tuple (xid, addresses and ports) that
+/// pairs trace::rpc requests with their replies; this runs once per
+/// record, hence the fixed length.
+static inline uint64_t hashRpcTuple(const int32_t tuple[5], uint32_t seed)
+{
+    return murmurHash3Low64<5 * sizeof(int32_t)>(tuple, seed);
+}
+
+#endif // RPC_TUPLE_HASH_H
@@ -0,0 +1,59 @@
+#include "gtest/gtest.h"
+#include "MurmurHash3.h"
+#include "RpcTupleHash.h"
+#include <cstdlib>
+
+static uint64_t
+murmurHash3(const void *key, int len, uint32_t seed)
+{
+    uint64_t out[2];
+    MurmurHash3_x64_128(key, len, seed, out);
+    return out[0];
+}
+
+/// Checks murmurHash3Low64<LEN> for LEN down to 0 against the generic
+/// function, on random keys at all offsets of a buffer
+template<unsigned LEN>
+struct CheckLengths {
+    static void run(const unsigned char *buf, unsigned bufLen) {
+        for(unsigned off = 0; off + LEN <= bufLen; ++off) {
+            uint32_t seed = random();
+            EXPECT_EQ(murmurHash3(buf + off, LEN, seed),
+                      murmurHash3Low64<LEN>(buf + off, seed))
+                << "length " << LEN << ", offset " << off;
+        }
+        CheckLengths<LEN - 1>::run(buf, bufLen);
+    }
+};
+
+template<>
+struct CheckLengths<0> {
+    static void run(const unsigned char *buf, unsigned) {
+        uint32_t seed = random();
+        EXPECT_EQ(murmurHash3(buf, 0, seed), murmurHash3Low64<0>(buf, seed));
+    }
+};
+
+TEST(RpcTupleHash, MatchesMurmurHash3AllTailLengths) {
+    srandom(1);
+    unsigned char buf[64];
+    for(unsigned round = 0; round < 100; ++round) {
+        for(unsigned i = 0; i < sizeof(buf); ++i)
+            buf[i] = random();
+        // every tail length, with one and two 16-byte blocks
+        CheckLengths<40>::run(buf, sizeof(buf));
+    }
+}
+
+TEST(RpcTupleHash, MatchesMurmurHash3OnRandomTuples) {
+    srandom(2);
+    for(unsigned i = 0; i < 100000; ++i) {
+        int32_t tuple[5];
+        for(unsigned j = 0; j < 5; ++j)
+            tuple[j] = random() ^ (random() << 16);
+        // the seed dsconvert uses: src_ip & dest_ip
+        uint32_t seed = tuple[1] & tuple[2];
+        EXPECT_EQ(murmurHash3(tuple, sizeof(tuple), seed),
+                  hashRpcTuple(tuple, seed));
+    }
+}
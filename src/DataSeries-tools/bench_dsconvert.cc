@@ -0,0 +1,154 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "dsconvert_v1_to_v2.h"
+
+#include <unistd.h>
+#include <cstdlib>
+#include <sys/time.h>
+#include <iostream>
+#include <vector>
+
+/// Times the v1 to v2 conversion of the per-operation extents of one
+/// type, once serially and once through an ExtentPipeline. The extents
+/// are read into memory first, so only the conversion is timed.
+
+static double
+getTime()
+{
+    timeval tv;
+    gettimeofday(&tv, 0);
+    double t = tv.tv_sec + tv.tv_usec/1000000.0;
+    return t;
+}
+
+/// Hands out the extents read earlier, in order
+class MemoryModule : public DataSeriesModule {
+public:
+    MemoryModule(const std::vector<Extent::Ptr> &extents) :
+        extents(extents), next(0) { }
+    Extent::Ptr getSharedExtent() {
+        if (next == extents.size())
+            return Extent::Ptr();
+        return extents[next++];
+    }
+private:
+    const std::vector<Extent::Ptr> &extents;
+    size_t next;
+};
+
+static void
+report(const std::string &type, unsigned threads, size_t numExtents,
+       uint64_t rows, double time)
+{
+    std::cout << "dsconvert benchmark"
+              << "  type: " << type
+              << "  threads: " << threads
+              << "  extents: " << numExtents
+              << "  rows: " << rows
+              << "  time: " << time
+              << "  Krows/s: " << rows/time/1000
+              << std::endl;
+}
+
+static void
+usage(const char *progname)
+{
+    std::cout << progname
+              << " [-j <threads>] [-t <extent type>] <v1 ds-file...>"
+              << std::endl
+              << "  -j <threads>: pipeline threads (default: 4)" << std::endl
+              << "  -t <extent type>: v1 per-operation extent type"
+              << " (default: trace::rpc::nfs3::readwrite)" << std::endl;
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned threads = 4;
+    std::string type = "trace::rpc::nfs3::readwrite";
+    int opt;
+    while ((opt = getopt(argc, argv, "j:t:")) != -1) {
+        switch (opt) {
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 't':
+            type = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind >= argc || 0 == threads) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    DataSeriesSource first(argv[optind]);
+    ExtentType::Ptr inType = first.getLibrary().getTypeByNamePtr(type, true);
+    first.closefile();
+    ExtentTypeLibrary lib;
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_ACCESS);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_COMMIT);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_CREATE);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_FSINFO);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_FSSTAT);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_GETATTR);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_LINK);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_LOOKUP);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_PATHCONF);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_READWRITE);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_RWCHECKSUM);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_READDIR);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_READDIR_ENTRIES);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_READLINK);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_REMOVE);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_RENAME);
+    lib.registerTypePtr(EXTENT_CHRONICLE_NFS3_SETATTR);
+    ExtentType::Ptr outType = lib.getTypeByNamePtr(type, true);
+    if (inType == NULL || outType == NULL) {
+        std::cout << "Error: " << type
+                  << " is not a per-operation extent type of the traces"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<Extent::Ptr> extents;
+    uint64_t rows = 0;
+    {
+        TypeIndexModule source(type);
+        for (int i = optind; i < argc; ++i)
+            source.addSource(argv[i]);
+        ExtentSeries series(ExtentSeries::typeLoose);
+        for (Extent::Ptr e; (e = source.getSharedExtent()) != NULL; ) {
+            extents.push_back(e);
+            for (series.setExtent(e); series.morerecords(); ++series)
+                ++rows;
+        }
+    }
+    PerOpConverter convert(inType, outType);
+
+    double startTime = getTime();
+    for (size_t i = 0; i < extents.size(); ++i)
+        convert(extents[i]);
+    double serialTime = getTime() - startTime;
+    report(type, 0, extents.size(), rows, serialTime);
+
+    MemoryModule memory(extents);
+    startTime = getTime();
+    {
+        ExtentPipeline pipeline(memory, convert, threads, 2 * threads);
+        while (pipeline.getSharedExtent() != NULL)
+            ;
+    }
+    double pipelineTime = getTime() - startTime;
+    report(type, threads, extents.size(), rows, pipelineTime);
+
+    std::cout << "speedup: " << serialTime/pipelineTime << std::endl;
+    return EXIT_SUCCESS;
+}
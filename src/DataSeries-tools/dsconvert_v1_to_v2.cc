@@ -1,8 +1,10 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <string.h>
 #include <getopt.h>
 
+#include <atomic>
 #include <cstdint>
 #include <iostream>
 #include <cstdlib>
@@ -17,15 +19,17 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
-#include "MurmurHash3.h"
 #include <pthread.h>
 #include <time.h>
 #include <limits.h>
 #include "dsconvert_v1_to_v2.h"
+#include "RecordCopier.h"
+#include "RpcTupleHash.h"
 
 #define MAX_INT64 ( (int64_t) ( ( ~ ((uint64_t) 0) ) >> 1 ) )
 #define MAX_FILE_SIZE 4000000000
 #define INVALID_REC_ID (-1)
+#define DEFAULT_CONVERT_THREADS 4
 
 using namespace std;
 using namespace boost;
@@ -133,11 +137,14 @@ class DsConvert {
     DataSeriesSink *output;  //DataSink file
     //const char* extentType;
     std::string filePrefix;
-    int64_t sharedVar;
-    int64_t sharedTSVar; // shared timestamp variable, between master, followerCommon
+    // the master's record id and timestamp; followers may read them
+    // without mtx
+    std::atomic<int64_t> sharedVar;
+    std::atomic<int64_t> sharedTSVar; // shared timestamp variable, between master, followerCommon
     std::map<int64_t,int64_t> shared_rr_map; //stores a req-rec-id -> reply-rec-id mapping
 
     int extent_size, extentCount;
+    unsigned convertThreads;    //threads converting the extents of each type
     ConvertExtentType **extConvertors;
     bool masterExited;
     ExtentTypeLibrary lib;  //for DataSink only
@@ -155,7 +162,7 @@ class DsConvert {
     friend void * followerNetIp(void *arg);
     friend void * masterWorker(void *arg);
 
-    DsConvert(vector <std::string> *);
+    DsConvert(vector <std::string> *, unsigned);
     ~DsConvert();
     void setupPerExTypeConvertors(void);
     void waitForWorkers(void);
@@ -236,9 +243,10 @@ void DsConvert::setupPerExTypeConvertors()
 
 
 
-DsConvert::DsConvert(vector <string> *v)
+DsConvert::DsConvert(vector <string> *v, unsigned threads)
 {
     vec = v;
+    convertThreads = threads;
 
     //get the file prefix
     string some_filename = (path(vec->front()).filename()).string();
@@ -285,8 +293,8 @@ DsConvert::DsConvert(vector <string> *v)
     pthread_mutex_init(&mtx, NULL);
     pthread_cond_init (&masterDone, NULL);
     pthread_cond_init (&followerDone, NULL);
-    sharedVar = 0;
-    sharedTSVar = 0;
+    sharedVar.store(0);
+    sharedTSVar.store(0);
     masterExited = false;
 
     writeCallback = new WriteCallback(&curFileOffset);
@@ -372,22 +380,36 @@ ConvertExtentType::ConvertExtentType(DsConvert *dsConvert, const char* fieldName
 
 void display_usage()
 {
-    std::cout << "dsconvert_v1_to_v2 <ds-file-list...>" << std::endl;
+    std::cout << "dsconvert_v1_to_v2 [-j <threads>] <ds-file-list...>" << std::endl;
     cout<< "This tool converts NFSv3 dataseries traces from version 1.0 to version 2.0.\n"
         "The output files are populated in the current/working directory. The output \n"
         "filenames have prefix of the form: <chronicle_timestamp_V2> where timestamp \n"
-        "is the same as the source file"<<endl;
+        "is the same as the source file\n"
+        "-j <threads>: threads converting the extents of each NFS operation type\n"
+        "              (default: " << DEFAULT_CONVERT_THREADS << ")"<<endl;
 }
 
 int main(int argc, char *argv[])
 {
-    if(argc < 2) {
+    unsigned threads = DEFAULT_CONVERT_THREADS;
+    int opt;
+    while((opt = getopt(argc, argv, "j:")) != -1) {
+        switch(opt) {
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            default:
+                display_usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+    if(optind >= argc || threads == 0) {
         display_usage();
         exit(EXIT_FAILURE);
     }
 
     std::vector<std::string> vec;
-    for(int i = 1; i < argc; ++i) {
+    for(int i = optind; i < argc; ++i) {
         if(is_regular_file(path(argv[i])))
             vec.push_back(argv[i]);
         else {
@@ -397,7 +419,7 @@ int main(int argc, char *argv[])
     }
 
 
-    DsConvert convertDsFiles(&vec);
+    DsConvert convertDsFiles(&vec, threads);
     convertDsFiles.setupPerExTypeConvertors();
     convertDsFiles.waitForWorkers();
 
@@ -450,7 +472,7 @@ void * followerChronicleStats(void *arg)
         pthread_mutex_lock(&sharedInfo->mtx);
 
         if(!sharedInfo->masterExited) {
-            while(v.valInt64() > sharedInfo->sharedTSVar) {
+            while(v.valInt64() > sharedInfo->sharedTSVar.load(std::memory_order_acquire)) {
                 (sharedInfo->followerDoneCnt)++;
                 if(sharedInfo->followerDoneCnt == sharedInfo->followerThreadCnt) {
 
@@ -464,7 +486,7 @@ void * followerChronicleStats(void *arg)
         pthread_mutex_unlock(&sharedInfo->mtx);
 
 
-        if(v.valInt64() <= sharedInfo->sharedTSVar) {
+        if(v.valInt64() <= sharedInfo->sharedTSVar.load(std::memory_order_acquire)) {
             //create room for new record in the sink file
             ti->outmodule->newRecord();
             ++output_row_count;
@@ -508,7 +530,9 @@ void * followerCommon(void *arg)
     ConvertExtentType *ti = (ConvertExtentType *)arg;
     DsConvert *sharedInfo = ti->dsConvert;
 
-    SortedSourcePipe *sourcePipes = new SortedSourcePipe(ti->extype);
+    //the pipe hands out records already converted to v2
+    SortedSourcePipe *sourcePipes = new SortedSourcePipe(ti->extype, ti->out_extype,
+            PerOpConverter(ti->extype, ti->out_extype), sharedInfo->convertThreads);
 
 
     for (vector<string>::iterator it(sharedInfo->vec->begin()), it_end(sharedInfo->vec->end()); it != it_end; it++) {
@@ -516,28 +540,16 @@ void * followerCommon(void *arg)
     }
     sourcePipes->startPrefetching();
 
-    vector<GeneralField *> outfields;
-
-    int primaryFieldNum = -1;
-    for(unsigned i = 0; i < ti->extype->getNFields(); ++i) {
-        if(ti->extype->getFieldName(i) == ti->fieldName) {
-            primaryFieldNum = i;
-            cout << "Primary Field number for extent type "<< ti->extype->getName()<< " and field name " << ti->fieldName << ": "<<primaryFieldNum << endl;
-        }
-    }
-    assert(primaryFieldNum != -1);//, boost::format("Couldn't find a field matching %s") % ti->fieldName);
-    for(unsigned i = 0; i < ti->out_extype->getNFields(); ++i) {
-        outfields.push_back(GeneralField::create(NULL, ti->outputseries, ti->out_extype->getFieldName(i)));
-    }
+    //v2.record_id carries the v1 field we merge on
+    Int64Field recordId(*sourcePipes->inputseries, ti->out_extype->getFieldName(0));
+    RecordCopier copier(ti->out_extype, *sourcePipes->inputseries, ti->outputseries);
 
     uint64_t output_row_count = 0;
 
     //Fetch the very first record from the source pipe...
     int64_t current_record_id = INVALID_REC_ID;
     if(sourcePipes->getFirstRecord()) {
-
-        GeneralValue v(sourcePipes->infields[primaryFieldNum]);
-        current_record_id = v.valInt64();
+        current_record_id = recordId.val();
     }
 
     pthread_barrier_wait(&sharedInfo->initBarrier); //wait for all threads to reach here
@@ -548,46 +560,42 @@ void * followerCommon(void *arg)
     int64_t tmp_rec_id = INT64_MIN;
     while(current_record_id != INVALID_REC_ID) {
 
-        GeneralValue v(sourcePipes->infields[primaryFieldNum]);
-
-        pthread_mutex_lock(&sharedInfo->mtx);
-
-        if(v.valInt64() < tmp_rec_id) {
-            std::cerr << "\33[0;31m" << "Extent type: " << ti->extype->getName() << " Current_rec_id = "<< v.valInt64() << " Last Record id was = "<< tmp_rec_id<< "\33[0m"<<endl;
-            assert(sharedInfo->sharedVar > tmp_rec_id);
+        if(current_record_id < tmp_rec_id) {
+            std::cerr << "\33[0;31m" << "Extent type: " << ti->extype->getName() << " Current_rec_id = "<< current_record_id << " Last Record id was = "<< tmp_rec_id<< "\33[0m"<<endl;
+            assert(sharedInfo->sharedVar.load(std::memory_order_acquire) > tmp_rec_id);
          }
-        tmp_rec_id = v.valInt64();
+        tmp_rec_id = current_record_id;
 
+        //sharedVar only moves forward, so records up to it need no lock
+        if(current_record_id > sharedInfo->sharedVar.load(std::memory_order_acquire)) {
+            pthread_mutex_lock(&sharedInfo->mtx);
 
-        if(!sharedInfo->masterExited) {
-            while(v.valInt64() > sharedInfo->sharedVar) {
-                (sharedInfo->followerDoneCnt)++;
-                if(sharedInfo->followerDoneCnt == sharedInfo->followerThreadCnt) {
+            if(!sharedInfo->masterExited) {
+                while(current_record_id > sharedInfo->sharedVar.load(std::memory_order_acquire)) {
+                    (sharedInfo->followerDoneCnt)++;
+                    if(sharedInfo->followerDoneCnt == sharedInfo->followerThreadCnt) {
 
-                    pthread_cond_signal(&sharedInfo->followerDone);
-                    sharedInfo->followerDoneCnt = 0;
+                        pthread_cond_signal(&sharedInfo->followerDone);
+                        sharedInfo->followerDoneCnt = 0;
 
-                }
+                    }
 
-                pthread_cond_wait (&sharedInfo->masterDone, &sharedInfo->mtx);
+                    pthread_cond_wait (&sharedInfo->masterDone, &sharedInfo->mtx);
+                }
             }
+            pthread_mutex_unlock(&sharedInfo->mtx);
         }
-        pthread_mutex_unlock(&sharedInfo->mtx);
 
 
-        if(v.valInt64() <= sharedInfo->sharedVar) {
+        if(current_record_id <= sharedInfo->sharedVar.load(std::memory_order_acquire)) {
             //create room for new record in the sink file
             ti->outmodule->newRecord();
             ++output_row_count;
-            outfields[0]->set(sourcePipes->infields[1]);    // v2.record_id = v1.record_id_reply
-            for(unsigned int i=1; i< outfields.size(); ++i) {
-                outfields[i]->set(sourcePipes->infields[i + 1]);    //copy all other fields
-            }
+            copier.copy();
             current_record_id = INVALID_REC_ID;
             //get next record from the source pipe
             if(sourcePipes->getNextRecord()) {
-                GeneralValue v(sourcePipes->infields[primaryFieldNum]);
-                current_record_id = v.valInt64();
+                current_record_id = recordId.val();
             }
         }
     }
@@ -606,8 +614,6 @@ void * followerCommon(void *arg)
     ti->outmodule->flushExtent();
     ti->outmodule->close();
 
-    GeneralField::deleteFields(outfields);
-
     cout << "Extent type: "<< ti->extype->getName()<< ", Total input rows: " << sourcePipes->input_row_count << ", Total Output rows: " << output_row_count<< "\n";
 
     return 0;
@@ -791,13 +797,13 @@ void * followerNetIp(void *arg)
 
         if(v.valInt64() < tmp_rec_id) {
             std::cerr << "\33[0;31m" << "Extent type: " << ti->extype->getName() << " Current_rec_id = "<< v.valInt64() << " Last Record id was = "<< tmp_rec_id<< "\33[0m"<<endl;
-            assert(sharedInfo->sharedVar < tmp_rec_id);
+            assert(sharedInfo->sharedVar.load(std::memory_order_acquire) < tmp_rec_id);
          }
         tmp_rec_id = v.valInt64();
 
 
         if(!sharedInfo->masterExited) {
-            while(v.valInt64() > sharedInfo->sharedVar) {
+            while(v.valInt64() > sharedInfo->sharedVar.load(std::memory_order_acquire)) {
                 (sharedInfo->followerDoneCnt)++;
                 if(sharedInfo->followerDoneCnt == sharedInfo->followerThreadCnt) {
 
@@ -812,7 +818,7 @@ void * followerNetIp(void *arg)
         pthread_mutex_unlock(&sharedInfo->mtx);
 
 
-        if(v.valInt64() <= sharedInfo->sharedVar) {
+        if(v.valInt64() <= sharedInfo->sharedVar.load(std::memory_order_acquire)) {
             current_record_id = INVALID_REC_ID;
 
             if(!ipTable.is_empty()) {
@@ -856,13 +862,6 @@ void * followerNetIp(void *arg)
 }
 
 
-void MurmurHash3_x64_64(const void* tuple, int len, uint32_t seed, void* out)
-{
-    uint64_t _out[2];
-    MurmurHash3_x64_128(tuple,len,seed,_out);
-    *(uint64_t*)out = _out[0];
-}
-
 //The window of consecutive records within which we hope to find the
 //corresponding reply for a request rpc appearing at the start of the window.
 uint64_t RPC_PAIR_TABLE_SIZE = 20000;
@@ -947,7 +946,7 @@ struct RpcPairs {
             hash_tuple[4] = src_port;
         }
 
-        MurmurHash3_x64_64(hash_tuple, int(sizeof(hash_tuple)), (uint32_t)(src_ip & dest_ip), &hash_val);
+        hash_val = hashRpcTuple(hash_tuple, (uint32_t)(src_ip & dest_ip));
 
         hashed_xid &hx = pairs.get<0>();
         hashed_xid::iterator it = hx.find(hash_val);
@@ -1142,15 +1141,15 @@ void * masterWorker(void *arg)
 
         //Set the state shared between the master/follower threads
         GeneralValue v(outfields[16]); //record_id
-        sharedInfo->sharedVar = v.valInt64();
+        sharedInfo->sharedVar.store(v.valInt64(), std::memory_order_release);
         GeneralValue ts_req(outfields[0]); //trace::rpc request_at (nullable)
         GeneralValue ts_reply(outfields[1]); //trace::rpc reply_at (nullable))
-        sharedInfo->sharedTSVar = (ts_reply.valInt64() > ts_req.valInt64())? ts_reply.valInt64() : ts_req.valInt64(); //pick whichever is greater
-        if(sharedInfo->sharedVar < tmp_rec_id) {
-            std::cerr << "\33[1;36mmbold" << "Extent type: " << ti->extype->getName() << " sharedVar = "<< sharedInfo->sharedVar << " Last Record id was = "<< tmp_rec_id<< "\33[0m"<<endl;
-            assert(sharedInfo->sharedVar > tmp_rec_id);
+        sharedInfo->sharedTSVar.store((ts_reply.valInt64() > ts_req.valInt64())? ts_reply.valInt64() : ts_req.valInt64(), std::memory_order_release); //pick whichever is greater
+        if(v.valInt64() < tmp_rec_id) {
+            std::cerr << "\33[1;36mmbold" << "Extent type: " << ti->extype->getName() << " sharedVar = "<< v.valInt64() << " Last Record id was = "<< tmp_rec_id<< "\33[0m"<<endl;
+            assert(v.valInt64() > tmp_rec_id);
         }
-        tmp_rec_id = sharedInfo->sharedVar;
+        tmp_rec_id = v.valInt64();
 
         //increment the output module
         ti->outmodule->newRecord();
@@ -1208,8 +1207,8 @@ void * masterWorker(void *arg)
 
     pthread_mutex_lock(&sharedInfo->mtx);
     sharedInfo->masterExited = true;
-    sharedInfo->sharedTSVar = MAX_INT64;
-    sharedInfo->sharedVar = MAX_INT64;
+    sharedInfo->sharedTSVar.store(MAX_INT64, std::memory_order_release);
+    sharedInfo->sharedVar.store(MAX_INT64, std::memory_order_release);
     pthread_cond_broadcast(&sharedInfo->masterDone);
     pthread_mutex_unlock(&sharedInfo->mtx);
 
@@ -5,15 +5,56 @@
 #include <DataSeries/TypeIndexModule.hpp>
 #include <DataSeries/SequenceModule.hpp>
 #include <DataSeries/ExtentSeries.hpp>
+#include "ExtentPipeline.h"
 #include "ChronicleExtentsV2.h"
+#include "RecordCopier.h"
 
 using namespace std;
 using boost::format;
 
+/// Converts an extent of a v1 per-operation type to v2: the v1 reply
+/// record id becomes the v2 record id, the other fields move up by one,
+/// and fields added in v2 (e.g., rwchecksum algorithm) are null.
+class PerOpConverter {
+
+    ExtentType::Ptr inType, outType;
+    vector<int> sourceColumn;
+
+    public:
+
+    PerOpConverter(const ExtentType::Ptr in, const ExtentType::Ptr out) :
+        inType(in), outType(out) {
+        sourceColumn.push_back(1);  // v2.record_id = v1.record_id_reply
+        for(unsigned i = 1; i < outType->getNFields(); ++i) {
+            if(i + 1 < inType->getNFields())
+                sourceColumn.push_back(i + 1);
+            else
+                sourceColumn.push_back(RecordCopier::nullColumn);
+        }
+    }
+
+    Extent::Ptr operator()(Extent::Ptr in) const {
+        ExtentSeries inSeries(ExtentSeries::typeLoose), outSeries;
+        inSeries.setType(inType);
+        outSeries.setType(outType);
+        RecordCopier copier(inType, inSeries, outType, outSeries, sourceColumn);
+
+        Extent::Ptr out(new Extent(outType));
+        outSeries.setExtent(out);
+        for(inSeries.setExtent(in); inSeries.morerecords(); ++inSeries) {
+            outSeries.newRecord();
+            copier.copy();
+        }
+        return out;
+    }
+};
+
 class SortedSourcePipe {
 
 public:
     TypeIndexModule *source;
+    ExtentPipeline *pipeline;   //converts source extents, if given a converter
+    DataSeriesModule *extents;  //where the records come from
     ExtentSeries *inputseries; //(ExtentSeries::typeLoose);
     Extent::Ptr inextent;
     uint64_t input_row_count;
@@ -22,23 +63,39 @@ public:
     vector<GeneralField *> infields;
 
     SortedSourcePipe(const ExtentType::Ptr extype) {
-        input_row_count = 0;
-        source = new TypeIndexModule(extype->getName());
-
-        inputseries = new ExtentSeries(ExtentSeries::typeLoose);
-        inputseries->setType(extype);
+        init(extype, extype);
+    }
 
-        for(unsigned i = 0; i < extype->getNFields(); ++i) {
-            infields.push_back(GeneralField::create(NULL, *inputseries, extype->getFieldName(i)));
-        }
+    /// Records are read after convert has turned each source extent into
+    /// an extent of convertedType, on threads extents at a time
+    SortedSourcePipe(const ExtentType::Ptr extype, const ExtentType::Ptr convertedType,
+            const ExtentPipeline::Converter &convert, unsigned threads) {
+        init(extype, convertedType);
+        pipeline = new ExtentPipeline(*source, convert, threads, 2 * threads);
+        extents = pipeline;
     }
 
     ~SortedSourcePipe() {
         GeneralField::deleteFields(infields);
         delete inputseries;
+        delete pipeline;
         delete source;
     }
 
+    void init(const ExtentType::Ptr extype, const ExtentType::Ptr seriesType) {
+        input_row_count = 0;
+        source = new TypeIndexModule(extype->getName());
+        pipeline = NULL;
+        extents = source;
+
+        inputseries = new ExtentSeries(ExtentSeries::typeLoose);
+        inputseries->setType(seriesType);
+
+        for(unsigned i = 0; i < seriesType->getNFields(); ++i) {
+            infields.push_back(GeneralField::create(NULL, *inputseries, seriesType->getFieldName(i)));
+        }
+    }
+
     void addSource(const std::string &filename) {
         INVARIANT(source != NULL, "source module not initialized");
         source->addSource(filename);
@@ -50,7 +107,7 @@ public:
 
     bool getFirstRecord() {
 
-        inextent = source->getSharedExtent();
+        inextent = extents->getSharedExtent();
         if (inextent == NULL)
             return false;
 
@@ -73,7 +130,7 @@ public:
                 return true;
             }
             else {
-                inextent = source->getSharedExtent();
+                inextent = extents->getSharedExtent();
                 if (inextent == NULL)
                     return false;
                 else
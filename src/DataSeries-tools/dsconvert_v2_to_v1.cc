@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <getopt.h>
 
+#include <atomic>
 #include <cstdint>
 #include <iostream>
 #include <cstdlib>
@@ -13,12 +14,15 @@
 #include <time.h>
 #include <limits.h>
 #include "dsconvert_v2_to_v1.h"
+#include "RecordCopier.h"
 
 #define MAX_INT64 ( (int64_t) ( ( ~ ((uint64_t) 0) ) >> 1 ) )
 #define MAX_FILE_SIZE 4000000000
 #define INVALID_REC_ID (-1)
 #define V1_REQ_REC_ID(X) (X*2)
 #define V1_REPLY_REC_ID(X) ((X*2) + 1)
+#define V2_REC_ID(X) ((X) / 2)
+#define DEFAULT_CONVERT_THREADS 4
 
 /// Structure for extent type information
 struct extent_type_info
@@ -119,10 +123,13 @@ class DsConvert {
     DataSeriesSink *output;  //DataSink file
     //const char* extentType;
     std::string filePrefix;
-    int64_t sharedVar;
-	int64_t sharedTSVar; // shared timestamp variable, between master, followerCommon
+    // the master's record id and timestamp; followers may read them
+    // without mtx
+    std::atomic<int64_t> sharedVar;
+	std::atomic<int64_t> sharedTSVar; // shared timestamp variable, between master, followerCommon
 
     int extent_size, extentCount;
+    unsigned convertThreads;    //threads converting the extents of each type
     ConvertExtentType **mergeWorkers;
     bool masterExited;
     ExtentTypeLibrary lib;  //for DataSink only
@@ -139,7 +146,7 @@ class DsConvert {
     friend void * followerCommon(void *arg);
     friend void * masterWorker(void *arg);
 
-    DsConvert(vector <std::string> *);
+    DsConvert(vector <std::string> *, unsigned);
     ~DsConvert();
     void setupPerExtentTypeWorkers(void);
     void waitForWorkers(void);
@@ -221,9 +228,10 @@ void DsConvert::setupPerExtentTypeWorkers()
 
 
 
-DsConvert::DsConvert(vector <string> *v)
+DsConvert::DsConvert(vector <string> *v, unsigned threads)
 {
     vec = v;
+    convertThreads = threads;
 
     //get the file prefix
     string some_filename = vec->front();
@@ -269,8 +277,8 @@ DsConvert::DsConvert(vector <string> *v)
     pthread_mutex_init(&mtx, NULL);
     pthread_cond_init (&masterDone, NULL);
     pthread_cond_init (&followerDone, NULL);
-    sharedVar = 0;
-	sharedTSVar = 0;
+    sharedVar.store(0);
+	sharedTSVar.store(0);
     masterExited = false;
 
     writeCallback = new WriteCallback(&curFileOffset);
@@ -353,23 +361,37 @@ ConvertExtentType::ConvertExtentType(DsConvert *dsMerge, const char* fieldName,
 
 void display_usage()
 {
-    std::cout << "dsconvert <ds-file-list...>" << std::endl;
+    std::cout << "dsconvert [-j <threads>] <ds-file-list...>" << std::endl;
+    std::cout << "-j <threads>: threads converting the extents of each NFS operation type\n"
+        "              (default: " << DEFAULT_CONVERT_THREADS << ")" << std::endl;
 }
 
 int main(int argc, char *argv[])
 {
-    if(argc < 2) {
+    unsigned threads = DEFAULT_CONVERT_THREADS;
+    int opt;
+    while((opt = getopt(argc, argv, "j:")) != -1) {
+        switch(opt) {
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            default:
+                display_usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+    if(optind >= argc || threads == 0) {
         display_usage();
         exit(EXIT_FAILURE);
     }
 
     std::vector<std::string> vec;
-    for(int i = 1; i < argc; ++i) {
+    for(int i = optind; i < argc; ++i) {
         vec.push_back(argv[i]);
     }
 
 
-    DsConvert mergeDsFiles(&vec);
+    DsConvert mergeDsFiles(&vec, threads);
     mergeDsFiles.setupPerExtentTypeWorkers();
     mergeDsFiles.waitForWorkers();
 
@@ -421,7 +443,7 @@ void * followerChronicleStats(void *arg)
         pthread_mutex_lock(&sharedInfo->mtx);
 
         if(!sharedInfo->masterExited) {
-            while(v.valInt64() > sharedInfo->sharedTSVar) {
+            while(v.valInt64() > sharedInfo->sharedTSVar.load(std::memory_order_acquire)) {
                 (sharedInfo->followerDoneCnt)++;
                 if(sharedInfo->followerDoneCnt == sharedInfo->followerThreadCnt) {
 
@@ -435,7 +457,7 @@ void * followerChronicleStats(void *arg)
         pthread_mutex_unlock(&sharedInfo->mtx);
 
 
-        if(v.valInt64() <= sharedInfo->sharedTSVar) {
+        if(v.valInt64() <= sharedInfo->sharedTSVar.load(std::memory_order_acquire)) {
             //create room for new record in the sink file
             ti->outmodule->newRecord();
             ++output_row_count;
@@ -474,12 +496,100 @@ void * followerChronicleStats(void *arg)
 }
 
 
+/// Converts an extent of a v2 per-operation type to v1: the v2 record id
+/// becomes the v1 request and reply record ids, and the other fields move
+/// down by one. v1 has no room for fields added in v2 (e.g., rwchecksum
+/// algorithm).
+class PerOpConverter {
+
+    ExtentType::Ptr inType, outType;
+    vector<int> sourceColumn;
+
+    public:
+
+    PerOpConverter(const ExtentType::Ptr in, const ExtentType::Ptr out) :
+        inType(in), outType(out) {
+        sourceColumn.push_back(RecordCopier::skipColumn);
+        sourceColumn.push_back(RecordCopier::skipColumn);
+        for(unsigned i = 1; i < inType->getNFields() && i + 1 < outType->getNFields(); ++i) {
+            sourceColumn.push_back(i);
+        }
+    }
+
+    Extent::Ptr operator()(Extent::Ptr in) const {
+        ExtentSeries inSeries(ExtentSeries::typeLoose), outSeries;
+        inSeries.setType(inType);
+        outSeries.setType(outType);
+        RecordCopier copier(inType, inSeries, outType, outSeries, sourceColumn);
+        Int64Field recordId(inSeries, inType->getFieldName(0));
+        Int64Field reqRecordId(outSeries, outType->getFieldName(0));
+        Int64Field replyRecordId(outSeries, outType->getFieldName(1));
+
+        Extent::Ptr out(new Extent(outType));
+        outSeries.setExtent(out);
+        for(inSeries.setExtent(in); inSeries.morerecords(); ++inSeries) {
+            outSeries.newRecord();
+            reqRecordId.set(V1_REQ_REC_ID(recordId.val()));
+            replyRecordId.set(V1_REPLY_REC_ID(recordId.val()));
+            copier.copy();
+        }
+        return out;
+    }
+};
+
+/// Converts a trace::net::ip extent to v1, where a packet's record id is
+/// the request or reply record id of its RPC.
+class NetIpConverter {
+
+    ExtentType::Ptr inType, outType;
+    vector<int> sourceColumn;
+
+    public:
+
+    NetIpConverter(const ExtentType::Ptr in, const ExtentType::Ptr out) :
+        inType(in), outType(out) {
+        for(unsigned i = 0; i <= 14; ++i) {
+            sourceColumn.push_back(i);
+        }
+    }
+
+    Extent::Ptr operator()(Extent::Ptr in) const {
+        ExtentSeries inSeries(ExtentSeries::typeLoose), outSeries;
+        inSeries.setType(inType);
+        outSeries.setType(outType);
+        RecordCopier copier(inType, inSeries, outType, outSeries, sourceColumn);
+        Int32Field destPort(inSeries, inType->getFieldName(7));
+        Int64Field recordId(inSeries, inType->getFieldName(15));
+        Int64Field v1RecordId(outSeries, outType->getFieldName(15));
+
+        Extent::Ptr out(new Extent(outType));
+        outSeries.setExtent(out);
+        for(inSeries.setExtent(in); inSeries.morerecords(); ++inSeries) {
+            outSeries.newRecord();
+            if(2049 == destPort.val())  //is request packet?
+                v1RecordId.set(V1_REQ_REC_ID(recordId.val()));
+            else    //is reply packet?
+                v1RecordId.set(V1_REPLY_REC_ID(recordId.val()));
+            copier.copy();
+        }
+        return out;
+    }
+};
+
 void * followerCommon(void *arg)
 {
     ConvertExtentType *ti = (ConvertExtentType *)arg;
     DsConvert *sharedInfo = ti->dsMerge;
 
-    SortedSourcePipe *sourcePipes = new SortedSourcePipe(ti->extype);
+    //the pipe hands out records already converted to v1
+    bool isNetIp = ("trace::net::ip" == ti->extype->getName());
+    SortedSourcePipe *sourcePipes;
+    if(isNetIp)
+        sourcePipes = new SortedSourcePipe(ti->extype, ti->out_extype,
+                NetIpConverter(ti->extype, ti->out_extype), sharedInfo->convertThreads);
+    else
+        sourcePipes = new SortedSourcePipe(ti->extype, ti->out_extype,
+                PerOpConverter(ti->extype, ti->out_extype), sharedInfo->convertThreads);
 
 
     for (vector<string>::iterator it(sharedInfo->vec->begin()), it_end(sharedInfo->vec->end()); it != it_end; it++) {
@@ -487,28 +597,16 @@ void * followerCommon(void *arg)
     }
     sourcePipes->startPrefetching();
 
-    vector<GeneralField *> outfields;
-
-    int primaryFieldNum = -1;
-    for(unsigned i = 0; i < ti->extype->getNFields(); ++i) {
-        if(ti->extype->getFieldName(i) == ti->fieldName) {
-            primaryFieldNum = i;
-            cout << "Primary Field number for extent type "<< ti->extype->getName()<< " and field name " << ti->fieldName << ": "<<primaryFieldNum << endl;
-        }
-    }
-    assert(primaryFieldNum != -1);//, boost::format("Couldn't find a field matching %s") % ti->fieldName);
-    for(unsigned i = 0; i < ti->out_extype->getNFields(); ++i) {
-        outfields.push_back(GeneralField::create(NULL, ti->outputseries, ti->out_extype->getFieldName(i)));
-    }
+    //the v1 record id is twice the v2 one (plus one for replies)
+    Int64Field v1RecordId(*sourcePipes->inputseries, ti->out_extype->getFieldName(isNetIp ? 15 : 0));
+    RecordCopier copier(ti->out_extype, *sourcePipes->inputseries, ti->outputseries);
 
     uint64_t output_row_count = 0;
 
     //Fetch the very first record from the source pipe...
     int64_t current_record_id = INVALID_REC_ID;
     if(sourcePipes->getFirstRecord()) {
-
-        GeneralValue v(sourcePipes->infields[primaryFieldNum]);
-        current_record_id = v.valInt64();
+        current_record_id = V2_REC_ID(v1RecordId.val());
     }
 
 
@@ -519,70 +617,43 @@ void * followerCommon(void *arg)
     int64_t tmp_rec_id = INT64_MIN;
     while(current_record_id != INVALID_REC_ID) {
 
-        GeneralValue v(sourcePipes->infields[primaryFieldNum]);
-
-        pthread_mutex_lock(&sharedInfo->mtx);
-
-        if(v.valInt64() < tmp_rec_id) {
-            std::cerr << "\33[0;31m" << "Extent type: " << ti->extype->getName() << " Current_rec_id = "<< v.valInt64() << " Last Record id was = "<< tmp_rec_id<< "\33[0m"<<endl;
-            assert(sharedInfo->sharedVar < tmp_rec_id);
+        if(current_record_id < tmp_rec_id) {
+            std::cerr << "\33[0;31m" << "Extent type: " << ti->extype->getName() << " Current_rec_id = "<< current_record_id << " Last Record id was = "<< tmp_rec_id<< "\33[0m"<<endl;
+            assert(sharedInfo->sharedVar.load(std::memory_order_acquire) < tmp_rec_id);
          }
-        tmp_rec_id = v.valInt64();
+        tmp_rec_id = current_record_id;
 
+        //sharedVar only moves forward, so records up to it need no lock
+        if(current_record_id > sharedInfo->sharedVar.load(std::memory_order_acquire)) {
+            pthread_mutex_lock(&sharedInfo->mtx);
 
-        if(!sharedInfo->masterExited) {
-            while(v.valInt64() > sharedInfo->sharedVar) {
-                (sharedInfo->followerDoneCnt)++;
-                if(sharedInfo->followerDoneCnt == sharedInfo->followerThreadCnt) {
+            if(!sharedInfo->masterExited) {
+                while(current_record_id > sharedInfo->sharedVar.load(std::memory_order_acquire)) {
+                    (sharedInfo->followerDoneCnt)++;
+                    if(sharedInfo->followerDoneCnt == sharedInfo->followerThreadCnt) {
 
-                    pthread_cond_signal(&sharedInfo->followerDone);
-                    sharedInfo->followerDoneCnt = 0;
+                        pthread_cond_signal(&sharedInfo->followerDone);
+                        sharedInfo->followerDoneCnt = 0;
 
-                }
+                    }
 
-				pthread_cond_wait (&sharedInfo->masterDone, &sharedInfo->mtx);
+                    pthread_cond_wait (&sharedInfo->masterDone, &sharedInfo->mtx);
+                }
             }
+            pthread_mutex_unlock(&sharedInfo->mtx);
         }
-        pthread_mutex_unlock(&sharedInfo->mtx);
 
 
-        if(v.valInt64() <= sharedInfo->sharedVar) {
+        if(current_record_id <= sharedInfo->sharedVar.load(std::memory_order_acquire)) {
             //create room for new record in the sink file
             ti->outmodule->newRecord();
             ++output_row_count;
-            if("trace::net::ip" == ti->extype->getName()) { //is extent type == trace::net::ip
-
-                if(2049 == (sourcePipes->infields[7]->val()).valInt32()) { //is request packet?
-                    GeneralValue req_recid;
-                    req_recid.setInt64(V1_REQ_REC_ID(current_record_id));
-                    outfields[15]->set(req_recid);
-                }
-                else {  //is reply packet?
-                    GeneralValue reply_recid;
-                    reply_recid.setInt64(V1_REPLY_REC_ID(current_record_id));
-                    outfields[15]->set(reply_recid);
-                }
-
-                for(unsigned i=0; i<=14 ; ++i) {
-                    outfields[i]->set(sourcePipes->infields[i]);
-                }
-            }
-            else {
-                GeneralValue req_recid, reply_recid;
-                req_recid.setInt64(V1_REQ_REC_ID(current_record_id));
-                reply_recid.setInt64(V1_REPLY_REC_ID(current_record_id));
-                outfields[0]->set(req_recid);
-                outfields[1]->set(reply_recid);
-                for(unsigned int i=1; i< (sourcePipes->infields).size(); ++i) {
-                    outfields[i + 1]->set(sourcePipes->infields[i]);
-                }
-            }
+            copier.copy();
             current_record_id = INVALID_REC_ID;
 
             //get next record from the source pipe
             if(sourcePipes->getNextRecord()) {
-                GeneralValue v(sourcePipes->infields[primaryFieldNum]);
-                current_record_id = v.valInt64();
+                current_record_id = V2_REC_ID(v1RecordId.val());
             }
         }
     }
@@ -601,8 +672,6 @@ void * followerCommon(void *arg)
     ti->outmodule->flushExtent();
     ti->outmodule->close();
 
-    GeneralField::deleteFields(outfields);
-
     cout << "Extent type: "<< ti->extype->getName()<< ", Total input rows: " << sourcePipes->input_row_count << ", Total Output rows: " << output_row_count<< "\n";
 
     return 0;
@@ -655,16 +724,16 @@ void * masterWorker(void *arg)
     while(current_record_id != INVALID_REC_ID) {
 
         GeneralValue v(sourcePipes->infields[primaryFieldNum]);
-        sharedInfo->sharedVar = v.valInt64();
+        sharedInfo->sharedVar.store(v.valInt64(), std::memory_order_release);
 		GeneralValue ts_req(sourcePipes->infields[0]); //trace::rpc request_at (nullable)
         GeneralValue ts_reply(sourcePipes->infields[1]); //trace::rpc reply_at (nullable))
-		sharedInfo->sharedTSVar = (ts_reply.valInt64() > ts_req.valInt64())? ts_reply.valInt64() : ts_req.valInt64(); //pick whichever is greater
+		sharedInfo->sharedTSVar.store((ts_reply.valInt64() > ts_req.valInt64())? ts_reply.valInt64() : ts_req.valInt64(), std::memory_order_release); //pick whichever is greater
 
-        if(sharedInfo->sharedVar < tmp_rec_id) {
-            std::cerr << "\33[0;31m" << "Extent type: " << ti->extype->getName() << " sharedVar = "<< sharedInfo->sharedVar << " Last Record id was = "<< tmp_rec_id<< "\33[0m"<<endl;
-            assert(sharedInfo->sharedVar < tmp_rec_id);
+        if(v.valInt64() < tmp_rec_id) {
+            std::cerr << "\33[0;31m" << "Extent type: " << ti->extype->getName() << " sharedVar = "<< v.valInt64() << " Last Record id was = "<< tmp_rec_id<< "\33[0m"<<endl;
+            assert(v.valInt64() < tmp_rec_id);
         }
-        tmp_rec_id = sharedInfo->sharedVar;
+        tmp_rec_id = v.valInt64();
 
         ti->outmodule->newRecord();
         ++output_row_count;
@@ -739,8 +808,8 @@ void * masterWorker(void *arg)
 
     pthread_mutex_lock(&sharedInfo->mtx);
     sharedInfo->masterExited = true;
-	sharedInfo->sharedTSVar = MAX_INT64;
-    sharedInfo->sharedVar = MAX_INT64;
+	sharedInfo->sharedTSVar.store(MAX_INT64, std::memory_order_release);
+    sharedInfo->sharedVar.store(MAX_INT64, std::memory_order_release);
     pthread_cond_broadcast(&sharedInfo->masterDone);
     pthread_mutex_unlock(&sharedInfo->mtx);
 
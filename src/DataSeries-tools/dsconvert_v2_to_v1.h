@@ -5,6 +5,7 @@
 #include "DataSeries/TypeIndexModule.hpp"
 #include "DataSeries/SequenceModule.hpp"
 #include "DataSeries/ExtentSeries.hpp"
+#include "ExtentPipeline.h"
 #include "ChronicleExtentsV1.h"
 
 using namespace std;
@@ -14,6 +15,8 @@ class SortedSourcePipe {
 
 public:
     TypeIndexModule *source;
+    ExtentPipeline *pipeline;   //converts source extents, if given a converter
+    DataSeriesModule *extents;  //where the records come from
     ExtentSeries *inputseries; //(ExtentSeries::typeLoose);
     Extent::Ptr inextent;
     uint64_t input_row_count;
@@ -22,23 +25,39 @@ public:
     vector<GeneralField *> infields;
 
     SortedSourcePipe(const ExtentType::Ptr extype) {
-        input_row_count = 0;
-        source = new TypeIndexModule(extype->getName());
-
-        inputseries = new ExtentSeries(ExtentSeries::typeLoose);
-        inputseries->setType(extype);
+        init(extype, extype);
+    }
 
-        for(unsigned i = 0; i < extype->getNFields(); ++i) {
-            infields.push_back(GeneralField::create(NULL, *inputseries, extype->getFieldName(i)));
-        }
+    /// Records are read after convert has turned each source extent into
+    /// an extent of convertedType, on threads extents at a time
+    SortedSourcePipe(const ExtentType::Ptr extype, const ExtentType::Ptr convertedType,
+            const ExtentPipeline::Converter &convert, unsigned threads) {
+        init(extype, convertedType);
+        pipeline = new ExtentPipeline(*source, convert, threads, 2 * threads);
+        extents = pipeline;
     }
 
     ~SortedSourcePipe() {
         GeneralField::deleteFields(infields);
         delete inputseries;
+        delete pipeline;
         delete source;
     }
 
+    void init(const ExtentType::Ptr extype, const ExtentType::Ptr seriesType) {
+        input_row_count = 0;
+        source = new TypeIndexModule(extype->getName());
+        pipeline = NULL;
+        extents = source;
+
+        inputseries = new ExtentSeries(ExtentSeries::typeLoose);
+        inputseries->setType(seriesType);
+
+        for(unsigned i = 0; i < seriesType->getNFields(); ++i) {
+            infields.push_back(GeneralField::create(NULL, *inputseries, seriesType->getFieldName(i)));
+        }
+    }
+
     void addSource(const std::string &filename) {
         INVARIANT(source != NULL, "source module not initialized");
         source->addSource(filename);
@@ -50,7 +69,7 @@ public:
 
     bool getFirstRecord() {
 
-        inextent = source->getSharedExtent();
+        inextent = extents->getSharedExtent();
         if (inextent == NULL)
             return false;
 
@@ -73,7 +92,7 @@ public:
                 return true;
             }
             else {
-                inextent = source->getSharedExtent();
+                inextent = extents->getSharedExtent();
                 if (inextent == NULL)
                     return false;
                 else
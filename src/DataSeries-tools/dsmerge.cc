@@ -13,7 +13,16 @@
 #include <time.h>
 #include <limits.h>
 #include "dsmerge.h"
+#include "LoserTree.h"
 #define MAX_INT64 ( (int64_t) ( ( ~ ((uint64_t) 0) ) >> 1 ) )
+#define DEFAULT_EPOCH_ROWS 8192
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
 /// Structure for extent type information
 struct extent_type_info
@@ -76,8 +85,13 @@ bool strPrefix(const string & str, string & prefix)
 void * slaveTSWorker(void *arg);
 void * slaveWorker(void *arg);
 void * masterWorker(void *arg);
+class TypeExtentMerge;
+void slaveMerge(TypeExtentMerge *ti, bool byTime);
 class DSMerge;
 
+/// Merges the per-pipeline files of one extent type. The sources are
+/// merged with a loser tree, and a source that stays ahead of all the
+/// others has its whole run copied without replaying the tree.
 class TypeExtentMerge {
 
     ExtentType::Ptr extype;	//Extent type associated with this thread
@@ -87,6 +101,12 @@ class TypeExtentMerge {
     DSMerge *dsMerge;
     pthread_t workerThread;
 
+    SortedSourcePipe **sourcePipes;
+    LoserTree *tree;
+    int64_t lastKey;
+    uint64_t output_row_count;
+    uint64_t startNs, elapsedNs;
+
     public:
 
 
@@ -96,29 +116,41 @@ class TypeExtentMerge {
     void waitToFinish(void) {
         pthread_join(workerThread, NULL);
     }
+    void openSources(void);
+    uint64_t mergeUpTo(int64_t bound, uint64_t maxRows);
+    bool finished(void) {
+        return tree->empty();
+    }
+    void printStats(void);
 
     friend class DSMerge;
 	friend void * slaveTSWorker(void *arg);
     friend void * slaveWorker(void *arg);
     friend void * masterWorker(void *arg);
+    friend void slaveMerge(TypeExtentMerge *ti, bool byTime);
 };
 
 
+/// The per-extent-type workers advance in epochs: the master worker
+/// (trace::rpc) publishes the record id and timestamp it has merged up to
+/// every epochRows records, and the slave workers merge up to those
+/// bounds without synchronizing again until the next epoch.
 class DSMerge {
 
     pthread_cond_t masterDone, slaveDone;
     pthread_mutex_t mtx;
-    int numPipelines, slaveDoneCnt, slaveThreadCnt;
+    int numPipelines, slavesCaughtUp, liveSlaves;
     vector <path> *vec;
     DataSeriesSink *output;
     //const char* extentType;
     std::string filePrefix, outDir;
-    int64_t sharedVar;
-	int64_t sharedTSVar; // shared timestamp variable, between master, slave
+    uint64_t epoch, epochRows;
+    int64_t epochRecordId;  // bounds published by the master (under mtx)
+	int64_t epochTimestamp;
+    uint64_t startNs;
 
     int extent_size, extentCount;
     TypeExtentMerge **mergeWorkers;
-    bool masterExited;
     ExtentTypeLibrary lib;
     unsigned int rotateCount;
     off64_t ROTATE_FILE_SIZE;
@@ -132,11 +164,14 @@ class DSMerge {
 	friend void * slaveTSWorker(void *arg);
     friend void * slaveWorker(void *arg);
     friend void * masterWorker(void *arg);
+    friend void slaveMerge(TypeExtentMerge *ti, bool byTime);
 
-    DSMerge(int, vector <path> *, string, string , uint64_t);
+    DSMerge(int, vector <path> *, string, string , uint64_t, uint64_t);
     ~DSMerge();
     void setupPerExtentTypeWorkers(void);
     void waitForWorkers(void);
+    void publishEpoch(int64_t recordId, int64_t timestamp);
+    void waitForSlaves(void);
     void rotateSink(void);
     std::string newFilename(void);
 
@@ -144,9 +179,36 @@ class DSMerge {
 
 void DSMerge::waitForWorkers(void)
 {
+    uint64_t total_rows = 0;
     for(unsigned int i = 0; i < EXTENTTYPE_NUM; ++i) {
         mergeWorkers[i]->waitToFinish();
+        total_rows += mergeWorkers[i]->output_row_count;
     }
+    double secs = (nowNs() - startNs) / 1e9;
+    cout << "Merged " << total_rows << " rows in " << secs << " s ("
+        << (uint64_t) (secs > 0 ? total_rows / secs : 0) << " rows/sec)\n";
+}
+
+/// Let the slaves merge up to the given record id and timestamp
+void DSMerge::publishEpoch(int64_t recordId, int64_t timestamp)
+{
+    pthread_mutex_lock(&mtx);
+    epochRecordId = recordId;
+    epochTimestamp = timestamp;
+    ++epoch;
+    slavesCaughtUp = 0;
+    pthread_cond_broadcast(&masterDone);
+    pthread_mutex_unlock(&mtx);
+}
+
+/// Wait until all the slaves have merged up to the current epoch. They
+/// then stay idle until the next one is published.
+void DSMerge::waitForSlaves(void)
+{
+    pthread_mutex_lock(&mtx);
+    while(slavesCaughtUp < liveSlaves)
+        pthread_cond_wait(&slaveDone, &mtx);
+    pthread_mutex_unlock(&mtx);
 }
 
 class DSMerge::WriteCallback {
@@ -204,18 +266,19 @@ void DSMerge::rotateSink()
 void DSMerge::setupPerExtentTypeWorkers()
 {
     extentCount = EXTENTTYPE_NUM;
+    liveSlaves = extentCount - 1;
+    slavesCaughtUp = 0;
+    startNs = nowNs();
     mergeWorkers = new TypeExtentMerge *[extentCount];
     for(int i = 0; i < extentCount; ++i) {
         mergeWorkers[i] = new TypeExtentMerge(this, extent_types[i].field_name , extent_types[i].type_name, extent_types[i].is_primary_extent);
     }
-    slaveThreadCnt = extentCount - 1;
-    slaveDoneCnt = 0;
 }
 
 
 
 
-DSMerge::DSMerge(int n_pipelines, vector <path> *v, string file_prefix, string output_dir = "", uint64_t chunk_size = 4000000000)
+DSMerge::DSMerge(int n_pipelines, vector <path> *v, string file_prefix, string output_dir = "", uint64_t chunk_size = 4000000000, uint64_t epoch_rows = DEFAULT_EPOCH_ROWS)
 {
     numPipelines = n_pipelines;
     vec = v;
@@ -256,9 +319,10 @@ DSMerge::DSMerge(int n_pipelines, vector <path> *v, string file_prefix, string o
     pthread_mutex_init(&mtx, NULL);
     pthread_cond_init (&masterDone, NULL);
     pthread_cond_init (&slaveDone, NULL);
-    sharedVar = 0;
-	sharedTSVar = 0;
-    masterExited = false;
+    epoch = 0;
+    epochRows = epoch_rows;
+    epochRecordId = INT64_MIN;
+	epochTimestamp = INT64_MIN;
 
     writeCallback = new WriteCallback(&curFileOffset);
     writeCallback->reset();
@@ -306,6 +370,13 @@ TypeExtentMerge::~TypeExtentMerge()
     if(outmodule)
         delete outmodule;
 
+    if(sourcePipes) {
+        for(int i = 0; i < dsMerge->numPipelines; ++i) {
+            delete sourcePipes[i];
+        }
+        delete [] sourcePipes;
+    }
+    delete tree;
 
 }
 
@@ -314,6 +385,11 @@ TypeExtentMerge::TypeExtentMerge(DSMerge *dsMerge, const char* fieldName, const
 
     this->dsMerge = dsMerge;
     this->fieldName = fieldName;
+    sourcePipes = NULL;
+    tree = NULL;
+    lastKey = INT64_MIN;
+    output_row_count = 0;
+    startNs = elapsedNs = 0;
     string extentTypePrefix(extentType);
 
     //Create a dummy source just to call getLibrary on it. Is there a better way?
@@ -340,7 +416,7 @@ TypeExtentMerge::TypeExtentMerge(DSMerge *dsMerge, const char* fieldName, const
 
 void display_usage()
 {
-    std::cout << "dsmerge -i <input_directory> -p <file_prefix> -n <number_of_pipelines> [-o <output_directory> -s <chunk_size_in_MB>]" << std::endl;
+    std::cout << "dsmerge -i <input_directory> -p <file_prefix> -n <number_of_pipelines> [-o <output_directory> -s <chunk_size_in_MB> -e <epoch_rows>]" << std::endl;
 }
 
     int
@@ -356,9 +432,10 @@ main(int argc, char *argv[])
 
     int c, numPipelines = 0;
 	uint64_t chunkSize = 4000000000;
+    uint64_t epochRows = DEFAULT_EPOCH_ROWS;
     opterr = 0;
 
-    while ((c = getopt (argc, argv, "i:o:p:n:s:h?")) != -1) {
+    while ((c = getopt (argc, argv, "e:i:o:p:n:s:h?")) != -1) {
         switch(c) {
             case 'i':
                 dPath = optarg;
@@ -381,6 +458,12 @@ main(int argc, char *argv[])
 				chunkSize = (1024 * 1024 * atoi(optarg));
 				break;
 
+            case 'e':
+                epochRows = strtoull(optarg, NULL, 10);
+                if(epochRows == 0)
+                    epochRows = 1;
+                break;
+
             case '?':
             case 'h':
             default:
@@ -429,270 +512,139 @@ main(int argc, char *argv[])
         cout << ex.what() << '\n';
     }
 
-    DSMerge mergeDsFiles(numPipelines, &vec, filePrefix, oDir, chunkSize);
+    DSMerge mergeDsFiles(numPipelines, &vec, filePrefix, oDir, chunkSize, epochRows);
     mergeDsFiles.setupPerExtentTypeWorkers();
     mergeDsFiles.waitForWorkers();
 
     return 0;
 }
 
-void * slaveTSWorker(void *arg)
+void TypeExtentMerge::openSources(void)
 {
-    TypeExtentMerge *ti = (TypeExtentMerge *)arg;
-    DSMerge *sharedInfo = ti->dsMerge;
-
-    SortedSourcePipe **sourcePipes = new SortedSourcePipe* [sharedInfo->numPipelines];
+    sourcePipes = new SortedSourcePipe* [dsMerge->numPipelines];
+    tree = new LoserTree(dsMerge->numPipelines);
 
-    for(int i = 0; i < sharedInfo->numPipelines; ++i) {
+    for(int i = 0; i < dsMerge->numPipelines; ++i) {
 
-        string subStr = sharedInfo->filePrefix + "_p" + boost::lexical_cast<std::string>(i) + "_";
-        //source[i] = new TypeIndexModule(ti->extype->getName());
-        sourcePipes[i] = new SortedSourcePipe(ti->extype);
-        //        pipeline[i] = new SequenceModule(source[i]);
+        string subStr = dsMerge->filePrefix + "_p" + boost::lexical_cast<std::string>(i) + "_";
+        sourcePipes[i] = new SortedSourcePipe(extype, fieldName, outputseries);
 
-        for (vector<path>::iterator it(sharedInfo->vec->begin()), it_end(sharedInfo->vec->end()); it != it_end; it++) {
+        for (vector<path>::iterator it(dsMerge->vec->begin()), it_end(dsMerge->vec->end()); it != it_end; it++) {
             if((*it).filename().generic_string().find(subStr) != string::npos)
                 sourcePipes[i]->addSource((*it).generic_string());
         }
         sourcePipes[i]->startPrefetching();
     }
 
-    vector<GeneralField *> outfields;
-
-    int primaryFieldNum = -1;
-    for(unsigned i = 0; i < ti->extype->getNFields(); ++i) {
-        outfields.push_back(GeneralField::create(NULL, ti->outputseries, ti->extype->getFieldName(i)));
-        if(ti->extype->getFieldName(i) == ti->fieldName) {
-            primaryFieldNum = i;
-            cout << "Primary Field number for extent type "<< ti->extype->getName()<< " and field name " << ti->fieldName << ": "<<primaryFieldNum << endl;
-        }
-    }
-    assert(primaryFieldNum != -1);//, boost::format("Couldn't find a field matching %s") % ti->fieldName);
-
-    uint64_t output_row_count = 0;
-
-    std::map<int64_t, int> map_;
-    for(int i = 0; i < sharedInfo->numPipelines ; ++i) {
-
-        if(sourcePipes[i]->getFirstRecord()) {
-
-            GeneralValue v(sourcePipes[i]->infields[primaryFieldNum]);
-            int64_t record_id = v.valInt64();
-            map_[record_id] = i;
-        }
+    for(int i = 0; i < dsMerge->numPipelines; ++i) {
+        if(sourcePipes[i]->getFirstRecord())
+            tree->setKey(i, sourcePipes[i]->key->val());
     }
+    tree->build();
+    startNs = nowNs();
+}
 
-
-    pthread_mutex_lock(&sharedInfo->mtx);
-    pthread_cond_wait (&sharedInfo->masterDone, &sharedInfo->mtx);
-    pthread_mutex_unlock(&sharedInfo->mtx);
-
-    for( std::map<int64_t, int>::iterator iter = map_.begin();iter != map_.end(); ) {
-
-        int index = iter->second;
-        GeneralValue v(sourcePipes[index]->infields[primaryFieldNum]);
-
-
-        pthread_mutex_lock(&sharedInfo->mtx);
-
-        if(!sharedInfo->masterExited) {
-            while(v.valInt64() > sharedInfo->sharedTSVar) {
-                (sharedInfo->slaveDoneCnt)++;
-                if(sharedInfo->slaveDoneCnt == sharedInfo->slaveThreadCnt) {
-
-                    pthread_cond_signal(&sharedInfo->slaveDone);
-                    sharedInfo->slaveDoneCnt = 0;
-                }
-
-                pthread_cond_wait (&sharedInfo->masterDone, &sharedInfo->mtx);
-            }
-        }
-/*        else {
-            cout << endl << endl << "######## Master has exited ... sharedTSVar:"<< sharedInfo->sharedTSVar << " Current-ip-TS:" <<v.valInt64() << endl;
-        }
-*/
-        pthread_mutex_unlock(&sharedInfo->mtx);
-
-
-        if(v.valInt64() <= sharedInfo->sharedTSVar) {
-            ti->outmodule->newRecord();
-            ++output_row_count;
-
-            for(unsigned int i=0; i< (sourcePipes[index]->infields).size(); ++i) {
-                outfields[i]->set(sourcePipes[index]->infields[i]);
+/// Merge the records with a key up to bound, stopping after maxRows.
+/// @returns the number of records merged
+uint64_t TypeExtentMerge::mergeUpTo(int64_t bound, uint64_t maxRows)
+{
+    uint64_t rows = 0;
+
+    while(rows < maxRows && !tree->empty()) {
+        unsigned index = tree->winner();
+        if(tree->key(index) > bound)
+            break;
+
+        // keep copying from the winner for as long as it stays ahead of
+        // the runner-up, and only replay the tree when it falls behind
+        SortedSourcePipe *pipe = sourcePipes[index];
+        unsigned runnerUp = tree->runnerUp();
+        do {
+            int64_t key = tree->key(index);
+            if(key < lastKey) {
+                std::cerr << "\33[0;31m" << "Extent type: " << extype->getName() << " Current_rec_id = "<< key << " Last Record id was = "<< lastKey << "\33[0m"<<endl;
             }
+            lastKey = key;
 
-            map_.erase(iter);
+            outmodule->newRecord();
+            pipe->copier->copy();
+            ++rows;
 
-            if(sourcePipes[index]->getNextRecord()) {
-                GeneralValue v(sourcePipes[index]->infields[primaryFieldNum]);
-                int64_t record_id = v.valInt64();
-                map_[record_id] = index;
+            if(!pipe->getNextRecord()) {
+                tree->setExhausted(index);
+                break;
             }
-        }
-
-        iter = map_.begin();
-
+            tree->setKey(index, pipe->key->val());
+        } while(rows < maxRows && tree->key(index) <= bound
+                && tree->precedes(index, runnerUp));
+        tree->replay(index);
     }
 
+    output_row_count += rows;
+    elapsedNs = nowNs() - startNs;
+    return rows;
+}
 
-    pthread_mutex_lock(&sharedInfo->mtx);
-    if(!sharedInfo->masterExited) {
-        (sharedInfo->slaveThreadCnt)--;
-        if(sharedInfo->slaveDoneCnt == sharedInfo->slaveThreadCnt) {
-            sharedInfo->slaveDoneCnt = 0;
-            pthread_cond_signal(&sharedInfo->slaveDone);
-        }
-    }
-    //cout << "extype: "<< ti->extype->getName()<< "slaveDoneCnt: "<< sharedInfo->slaveDoneCnt<< endl;
-    //cout << "extype: "<< ti->extype->getName()<< "slaveThreadCnt: "<< sharedInfo->slaveThreadCnt<< endl;
-    pthread_mutex_unlock(&sharedInfo->mtx);
-
-    ti->outmodule->flushExtent();
-    ti->outmodule->close();
-
-    GeneralField::deleteFields(outfields);
-
+void TypeExtentMerge::printStats(void)
+{
     uint64_t total_input_rows = 0;
-    for(int i = 0; i < sharedInfo->numPipelines ; ++i) {
-        //cout << "Source " << i<< ": "<< sourcePipes[i]->input_row_count << "\n";
+    for(int i = 0; i < dsMerge->numPipelines ; ++i) {
         total_input_rows += sourcePipes[i]->input_row_count;
     }
-    cout << "Extent type: "<< ti->extype->getName()<< ", Total input rows: " << total_input_rows << ", Total Output rows: " << output_row_count<< "\n";
-
-	return 0;
+    double secs = elapsedNs / 1e9;
+    cout << "Extent type: "<< extype->getName()<< ", Total input rows: " << total_input_rows << ", Total Output rows: " << output_row_count
+        << ", rows/sec: " << (uint64_t) (secs > 0 ? output_row_count / secs : 0) << "\n";
 }
 
-
-void * slaveWorker(void *arg)
+/// Merges an extent type up to the bounds the master publishes, either
+/// by record id or by time.
+void slaveMerge(TypeExtentMerge *ti, bool byTime)
 {
-    TypeExtentMerge *ti = (TypeExtentMerge *)arg;
     DSMerge *sharedInfo = ti->dsMerge;
+    uint64_t seenEpoch = 0;
 
-    SortedSourcePipe **sourcePipes = new SortedSourcePipe* [sharedInfo->numPipelines];
-
-    for(int i = 0; i < sharedInfo->numPipelines; ++i) {
-
-        string subStr = sharedInfo->filePrefix + "_p" + boost::lexical_cast<std::string>(i) + "_";
-        //source[i] = new TypeIndexModule(ti->extype->getName());
-        sourcePipes[i] = new SortedSourcePipe(ti->extype);
-        //        pipeline[i] = new SequenceModule(source[i]);
-
-        for (vector<path>::iterator it(sharedInfo->vec->begin()), it_end(sharedInfo->vec->end()); it != it_end; it++) {
-            if((*it).filename().generic_string().find(subStr) != string::npos)
-                sourcePipes[i]->addSource((*it).generic_string());
-        }
-        sourcePipes[i]->startPrefetching();
-
-    }
-
-    vector<GeneralField *> outfields;
-
-    int primaryFieldNum = -1;
-    for(unsigned i = 0; i < ti->extype->getNFields(); ++i) {
-        outfields.push_back(GeneralField::create(NULL, ti->outputseries, ti->extype->getFieldName(i)));
-        if(ti->extype->getFieldName(i) == ti->fieldName) {
-            primaryFieldNum = i;
-            cout << "Primary Field number for extent type "<< ti->extype->getName()<< " and field name " << ti->fieldName << ": "<<primaryFieldNum << endl;
-        }
-    }
-    assert(primaryFieldNum != -1);//, boost::format("Couldn't find a field matching %s") % ti->fieldName);
-
-    uint64_t output_row_count = 0;
-
-    std::map<int64_t, int> map_;
-    for(int i = 0; i < sharedInfo->numPipelines ; ++i) {
-
-        if(sourcePipes[i]->getFirstRecord()) {
-
-            GeneralValue v(sourcePipes[i]->infields[primaryFieldNum]);
-            int64_t record_id = v.valInt64();
-            map_[record_id] = i;
-        }
-    }
-
+    ti->openSources();
 
     pthread_mutex_lock(&sharedInfo->mtx);
-    pthread_cond_wait (&sharedInfo->masterDone, &sharedInfo->mtx);
-    pthread_mutex_unlock(&sharedInfo->mtx);
-    
-    int64_t tmp_rec_id = INT64_MIN;
-    for( std::map<int64_t, int>::iterator iter = map_.begin();iter != map_.end(); ) {
-
-        int index = iter->second;
-        GeneralValue v(sourcePipes[index]->infields[primaryFieldNum]);
-
-
-        pthread_mutex_lock(&sharedInfo->mtx);
-
-        if(v.valInt64() < tmp_rec_id) {
-            std::cerr << "\33[0;31m" << "Extent type: " << ti->extype->getName() << " Current_rec_id = "<< v.valInt64() << " Last Record id was = "<< tmp_rec_id<< "\33[0m"<<endl;
-            assert(sharedInfo->sharedVar < tmp_rec_id);
-         }
-        tmp_rec_id = v.valInt64();
-
-
-        if(!sharedInfo->masterExited) {
-            while(v.valInt64() > sharedInfo->sharedVar) {
-                (sharedInfo->slaveDoneCnt)++;
-                if(sharedInfo->slaveDoneCnt == sharedInfo->slaveThreadCnt) {
-
-                    pthread_cond_signal(&sharedInfo->slaveDone);
-                    sharedInfo->slaveDoneCnt = 0;
-
-                }
-
-				pthread_cond_wait (&sharedInfo->masterDone, &sharedInfo->mtx);
-            }
-        }
+    while(true) {
+        while(sharedInfo->epoch == seenEpoch)
+            pthread_cond_wait(&sharedInfo->masterDone, &sharedInfo->mtx);
+        seenEpoch = sharedInfo->epoch;
+        int64_t bound = byTime ? sharedInfo->epochTimestamp : sharedInfo->epochRecordId;
         pthread_mutex_unlock(&sharedInfo->mtx);
 
+        ti->mergeUpTo(bound, UINT64_MAX);
+        if(ti->finished())
+            break;
 
-        if(v.valInt64() <= sharedInfo->sharedVar) {
-            ti->outmodule->newRecord();
-            ++output_row_count;
-
-            for(unsigned int i=0; i< (sourcePipes[index]->infields).size(); ++i) {
-                outfields[i]->set(sourcePipes[index]->infields[i]);
-            }
-
-            map_.erase(iter);
-
-            if(sourcePipes[index]->getNextRecord()) {
-                GeneralValue v(sourcePipes[index]->infields[primaryFieldNum]);
-                int64_t record_id = v.valInt64();
-                map_[record_id] = index;
-            }
-        }
-
-        iter = map_.begin();
-
+        pthread_mutex_lock(&sharedInfo->mtx);
+        if(sharedInfo->epoch == seenEpoch
+                && ++sharedInfo->slavesCaughtUp == sharedInfo->liveSlaves)
+            pthread_cond_signal(&sharedInfo->slaveDone);
     }
 
+    // done with the output module before the master may rotate it
+    ti->outmodule->flushExtent();
+    ti->outmodule->close();
 
     pthread_mutex_lock(&sharedInfo->mtx);
-    if(!sharedInfo->masterExited) {
-        (sharedInfo->slaveThreadCnt)--;
-        if(sharedInfo->slaveDoneCnt == sharedInfo->slaveThreadCnt) {
-            sharedInfo->slaveDoneCnt = 0;
-            pthread_cond_signal(&sharedInfo->slaveDone);
-        }
-    }
-    //cout << "extype: "<< ti->extype->getName()<< "slaveDoneCnt: "<< sharedInfo->slaveDoneCnt<< endl;
-    //cout << "extype: "<< ti->extype->getName()<< "slaveThreadCnt: "<< sharedInfo->slaveThreadCnt<< endl;
+    (sharedInfo->liveSlaves)--;
+    if(sharedInfo->slavesCaughtUp >= sharedInfo->liveSlaves)
+        pthread_cond_signal(&sharedInfo->slaveDone);
     pthread_mutex_unlock(&sharedInfo->mtx);
 
-    ti->outmodule->flushExtent();
-    ti->outmodule->close();
+    ti->printStats();
+}
 
-    GeneralField::deleteFields(outfields);
+void * slaveTSWorker(void *arg)
+{
+    slaveMerge((TypeExtentMerge *)arg, true);
+    return 0;
+}
 
-    uint64_t total_input_rows = 0;
-    for(int i = 0; i < sharedInfo->numPipelines ; ++i) {
-        //cout << "Source " << i<< ": "<< sourcePipes[i]->input_row_count << "\n";
-        total_input_rows += sourcePipes[i]->input_row_count;
-    }
-    cout << "Extent type: "<< ti->extype->getName()<< ", Total input rows: " << total_input_rows << ", Total Output rows: " << output_row_count<< "\n";
+void * slaveWorker(void *arg)
+{
+    slaveMerge((TypeExtentMerge *)arg, false);
     return 0;
 }
 
@@ -703,128 +655,45 @@ void * masterWorker(void *arg)
 	uint64_t extent_num = 0;
 	bool synced_with_others = false;
 
+    ti->openSources();
 
-    SortedSourcePipe **sourcePipes = new SortedSourcePipe* [sharedInfo->numPipelines];
-
-    for(int i = 0; i < sharedInfo->numPipelines ; ++i) {
-
-        string subStr = sharedInfo->filePrefix + "_p" + boost::lexical_cast<std::string>(i) + "_";
-        //source[i] = new TypeIndexModule(ti->extype->getName());
-        sourcePipes[i] = new SortedSourcePipe(ti->extype);
-        //        pipeline[i] = new SequenceModule(source[i]);
-
-        for (vector<path>::iterator it(sharedInfo->vec->begin()), it_end(sharedInfo->vec->end()); it != it_end; it++) {
-            if((*it).filename().generic_string().find(subStr) != string::npos)
-                sourcePipes[i]->addSource((*it).generic_string());
-        }
-        sourcePipes[i]->startPrefetching();
-    }
-
-    vector<GeneralField *> outfields;
-
-    int primaryFieldNum = -1;
-    for(unsigned i = 0; i < ti->extype->getNFields(); ++i) {
-        outfields.push_back(GeneralField::create(NULL, ti->outputseries, ti->extype->getFieldName(i)));
-        if(ti->extype->getFieldName(i) == ti->fieldName) {
-            primaryFieldNum = i;
-            cout << "Primary Field number for extent type "<< ti->extype->getName()<< " and field name " << ti->fieldName << ": "<<primaryFieldNum << endl;
-        }
-    }
-    INVARIANT(primaryFieldNum != -1, boost::format("Couldn't find a field matching %s") % ti->fieldName);
-
-    uint64_t output_row_count = 0;
-
-    std::map<int64_t, int> map_;
-    for(int i = 0; i < sharedInfo->numPipelines ; ++i) {
-
-        if(sourcePipes[i]->getFirstRecord()) {
-
-            GeneralValue v(sourcePipes[i]->infields[primaryFieldNum]);
-            int64_t record_id = v.valInt64();
-            map_[record_id] = i;
-        }
-    }
-
-
-    sleep(4);
-
-    int64_t tmp_rec_id = INT64_MIN;;
-    for( std::map<int64_t, int>::iterator iter = map_.begin();iter != map_.end(); ) {
-
-        int index = iter->second;
-        GeneralValue v(sourcePipes[index]->infields[primaryFieldNum]);
-        sharedInfo->sharedVar = v.valInt64();
-		GeneralValue ts_req(sourcePipes[index]->infields[0]); //trace::rpc request_at (nullable)
-        GeneralValue ts_reply(sourcePipes[index]->infields[1]); //trace::rpc reply_at (nullable))
-		sharedInfo->sharedTSVar = (ts_reply.valInt64() > ts_req.valInt64())? ts_reply.valInt64() : ts_req.valInt64(); //pick whichever is greater
-
-        if(sharedInfo->sharedVar < tmp_rec_id) {
-            std::cerr << "\33[0;31m" << "Extent type: " << ti->extype->getName() << " sharedVar = "<< sharedInfo->sharedVar << " Last Record id was = "<< tmp_rec_id<< "\33[0m"<<endl;
-            assert(sharedInfo->sharedVar < tmp_rec_id);
-        }
-        tmp_rec_id = sharedInfo->sharedVar;
+    //trace::rpc request_at and reply_at (nullable) of the last merged record
+    const std::string reqName = ti->extype->getFieldName(0);
+    const std::string replyName = ti->extype->getFieldName(1);
+    Int64Field ts_req(ti->outputseries, reqName, ti->extype->getNullable(reqName) ? Field::flag_nullable : 0);
+    Int64Field ts_reply(ti->outputseries, replyName, ti->extype->getNullable(replyName) ? Field::flag_nullable : 0);
+    int64_t timestamp = INT64_MIN;
 
-        ti->outmodule->newRecord();
-        ++output_row_count;
-
-        for(unsigned int i=0; i< (sourcePipes[index]->infields).size(); ++i) {
-            outfields[i]->set(sourcePipes[index]->infields[i]);
-        }
-
-        map_.erase(iter);
-
-        if(sourcePipes[index]->getNextRecord()) {
-            GeneralValue v(sourcePipes[index]->infields[primaryFieldNum]);
-            int64_t record_id = v.valInt64();
-            map_[record_id] = index;
-        }
+    while(!ti->finished()) {
+        ti->mergeUpTo(MAX_INT64, sharedInfo->epochRows);
 
-        iter = map_.begin();
+        //pick whichever is greater, and never move the bound backwards
+        int64_t ts = (ts_reply.val() > ts_req.val())? ts_reply.val() : ts_req.val();
+        if(ts > timestamp)
+            timestamp = ts;
+        sharedInfo->publishEpoch(ti->lastKey, timestamp);
 
         if(sharedInfo->curFileOffset > sharedInfo->ROTATE_FILE_SIZE) {
             cout<< "\n--------------------\nRotating sinks....\n";
-            //cout << "extype: "<< ti->extype->getName()<< "slaveDoneCnt: "<< sharedInfo->slaveDoneCnt<< endl;
-            //cout << "extype: "<< ti->extype->getName()<< "slaveThreadCnt: "<< sharedInfo->slaveThreadCnt<< endl;
-			pthread_mutex_lock(&sharedInfo->mtx);
-			pthread_cond_broadcast(&sharedInfo->masterDone);
-			pthread_cond_wait(&sharedInfo->slaveDone, &sharedInfo->mtx);
-			pthread_mutex_unlock(&sharedInfo->mtx);
+            sharedInfo->waitForSlaves();
             sharedInfo->rotateSink();
         }
 
         if((ti->outmodule->curExtentSize() > (0.8 * ti->outmodule->getTargetExtentSize())) && !synced_with_others) {
             cout << boost::format("Processing extent #%d of size %d nearing the target size of %d\n") % extent_num++ % ti->outmodule->curExtentSize() % ti->outmodule->getTargetExtentSize();
-
-            pthread_mutex_lock(&sharedInfo->mtx);
-            pthread_cond_broadcast(&sharedInfo->masterDone);
-
-			pthread_cond_wait(&sharedInfo->slaveDone, &sharedInfo->mtx);
-            pthread_mutex_unlock(&sharedInfo->mtx);
+            sharedInfo->waitForSlaves();
 			synced_with_others = true;
         }
 		if(ti->outmodule->curExtentSize() < (0.8 * ti->outmodule->getTargetExtentSize()))
 			synced_with_others = false;
-
     }
 
-
-    pthread_mutex_lock(&sharedInfo->mtx);
-    sharedInfo->masterExited = true;
-	sharedInfo->sharedTSVar = MAX_INT64;
-    sharedInfo->sharedVar = MAX_INT64;
-    pthread_cond_broadcast(&sharedInfo->masterDone);
-    pthread_mutex_unlock(&sharedInfo->mtx);
+    sharedInfo->publishEpoch(MAX_INT64, MAX_INT64);
 
     ti->outmodule->flushExtent();
     ti->outmodule->close();
 
-    GeneralField::deleteFields(outfields);
-
-    uint64_t total_input_rows = 0;
-    for(int i = 0; i < sharedInfo->numPipelines ; ++i) {
-        total_input_rows += sourcePipes[i]->input_row_count;
-    }
-    cout << "Extent type: "<< ti->extype->getName()<< ", Total input rows: " << total_input_rows << ", Total Output rows: " << output_row_count<< "\n";
+    ti->printStats();
 
     return 0;
 }
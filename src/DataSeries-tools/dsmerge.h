@@ -5,6 +5,7 @@
 #include "DataSeries/TypeIndexModule.hpp"
 #include "DataSeries/SequenceModule.hpp"
 #include "DataSeries/ExtentSeries.hpp"
+#include "RecordCopier.h"
 
 using namespace std;
 using boost::format;
@@ -17,23 +18,25 @@ public:
     Extent::Ptr inextent;
     uint64_t input_row_count;
 
+    Int64Field *key;        // field the sources are sorted on
+    RecordCopier *copier;   // copies the current record to the output
 
-    vector<GeneralField *> infields;
-
-    SortedSourcePipe(const ExtentType::Ptr extype) {
+    SortedSourcePipe(const ExtentType::Ptr extype, const std::string &keyName,
+            ExtentSeries &outputseries) {
         input_row_count = 0;
         source = new TypeIndexModule(extype->getName());
 
         inputseries = new ExtentSeries(ExtentSeries::typeLoose);
         inputseries->setType(extype);
 
-        for(unsigned i = 0; i < extype->getNFields(); ++i) {
-            infields.push_back(GeneralField::create(NULL, *inputseries, extype->getFieldName(i)));
-        }
+        key = new Int64Field(*inputseries, keyName,
+                extype->getNullable(keyName) ? Field::flag_nullable : 0);
+        copier = new RecordCopier(extype, *inputseries, outputseries);
     }
 
     ~SortedSourcePipe() {
-        GeneralField::deleteFields(infields);
+        delete copier;
+        delete key;
         delete inputseries;
         delete source;
     }
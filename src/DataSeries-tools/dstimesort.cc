@@ -0,0 +1,688 @@
+/*
+ * dstimesort: orders the records of a set of DataSeries traces (e.g., the
+ * per-pipeline files of a Chronicle capture) globally by time, for replay
+ * and timeline analysis. The traces don't have to fit in memory: worker
+ * threads read the input files and spill sorted runs of records to a
+ * temporary directory, and the runs of each extent type are then merged
+ * with large sequential reads.
+ *
+ * trace::rpc records are ordered by request time (reply time for replies
+ * without a request). Per-op extent types (e.g., trace::rpc::nfs3::read)
+ * don't carry a time, so they are joined by record_id with the
+ * trace::rpc record in the same input file and take its time. The join
+ * sorts both by record_id, so it spills within the memory budget too.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+
+#include "DataSeries/DataSeriesFile.hpp"
+#include "DataSeries/DataSeriesModule.hpp"
+#include "DataSeries/TypeIndexModule.hpp"
+#include "DataSeries/ExtentSeries.hpp"
+#include "ExternalSort.h"
+#include "RowCodec.h"
+
+using namespace std;
+
+#define PRIMARY_TYPE "trace::rpc"
+#define DEFAULT_KEY_FIELDS "request_at,reply_at"
+#define JOIN_FIELD "record_id"
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/// An extent type being sorted and the runs spilled for it
+struct SortType {
+    std::string name;
+    ExtentType::Ptr extype;
+    std::vector<std::string> keyFields;     // empty if joined to PRIMARY_TYPE
+    std::vector<std::string> runs;
+    uint64_t records, unjoined;
+
+    SortType(const std::string &typeName) : name(typeName), records(0), unjoined(0) { }
+};
+
+class TimeSort {
+
+    std::vector<std::string> inputs;
+    size_t nextInput;
+    std::vector<SortType *> types;
+    pthread_mutex_t mtx;
+    unsigned runCount;
+
+    // options
+    std::string outputPrefix, tmpDir;
+    size_t memoryBudget;
+    unsigned numThreads, fanIn;
+    uint64_t chunkSize;
+    int compressionMode;
+    bool timeIndex;
+
+    static void *runWorker(void *arg);
+    static void *mergeWorker(void *arg);
+    void generateRuns(void);
+    void spill(SortType *type, SortBuffer &buffer);
+    void mergeType(SortType *type);
+    std::string nextFile(void);
+    std::string newRunPath(void);
+
+    friend class TimeSortOutput;
+    friend class RunWorker;
+    friend class RunPaths;
+
+    public:
+
+    TimeSort(const std::vector<std::string> &inputFiles,
+            const std::vector<std::string> &typeNames,
+            const std::vector<std::string> &keyFields,
+            const std::string &output, const std::string &tmp,
+            size_t memory, unsigned threads, unsigned mergeFanIn,
+            uint64_t chunk, int compression, bool index);
+    ~TimeSort();
+    void run(void);
+};
+
+/// Writes the merged records of one extent type to DataSeries files,
+/// starting a new file every chunkSize bytes, optionally with a time
+/// index of the extents in each file.
+class TimeSortOutput {
+
+    TimeSort *ts;
+    SortType *type;
+    ExtentSeries series;
+    RowCodec *codec;
+    DataSeriesSink *sink;
+    OutputModule *outmodule;
+    unsigned fileCount;
+    std::string fileName;
+
+    // the extents of the current file: key range and row count, and the
+    // offsets the sink reports (in write order) once they are written
+    struct IndexEntry {
+        int64_t first, last;
+        uint64_t rows;
+    };
+    std::vector<IndexEntry> index;
+    bool inExtent;
+    std::vector<off64_t> offsets;
+    off64_t lastOffset;
+    pthread_mutex_t offsetMtx;
+
+    class WriteCallback {
+        TimeSortOutput *output;
+        public:
+        WriteCallback(TimeSortOutput *o) : output(o) { }
+        void operator()(off64_t offset, Extent &e) {
+            if(e.getTypePtr()->getName() != output->type->name)
+                return;
+            pthread_mutex_lock(&output->offsetMtx);
+            output->offsets.push_back(offset);
+            output->lastOffset = offset;
+            pthread_mutex_unlock(&output->offsetMtx);
+        }
+    };
+
+    static const unsigned EXTENT_SIZE = 16 * 1024 * 1024;
+
+    void openFile(void) {
+        std::string typeName = type->name;
+        for(size_t pos; (pos = typeName.find("::")) != std::string::npos; )
+            typeName.replace(pos, 2, "_");
+        char num[6];
+        sprintf(num, "%05u", fileCount++);
+        fileName = ts->outputPrefix + "_" + typeName + "_" + num + ".ds";
+
+        sink = new DataSeriesSink(fileName,
+                Extent::compression_algs[ts->compressionMode].compress_flag, 9);
+        ExtentTypeLibrary lib;
+        lib.registerTypePtr(type->extype->getXmlDescriptionString());
+        sink->writeExtentLibrary(lib);
+        lastOffset = 0;
+        sink->setExtentWriteCallback(WriteCallback(this));
+        outmodule = new OutputModule(*sink, series, type->extype, EXTENT_SIZE);
+    }
+
+    void closeFile(void) {
+        endExtent();
+        delete outmodule;
+        outmodule = NULL;
+        sink->flushPending();
+        delete sink;
+        sink = NULL;
+
+        if(ts->timeIndex) {
+            std::ofstream out((fileName + ".tindex").c_str());
+            out << "# first_time last_time rows offset\n";
+            pthread_mutex_lock(&offsetMtx);
+            for(size_t i = 0; i < index.size(); ++i) {
+                out << index[i].first << " " << index[i].last << " "
+                    << index[i].rows << " "
+                    << (i < offsets.size() ? offsets[i] : -1) << "\n";
+            }
+            pthread_mutex_unlock(&offsetMtx);
+        }
+        index.clear();
+        offsets.clear();
+    }
+
+    /// Flush the current extent, so it matches its index entry
+    void endExtent(void) {
+        if(!inExtent)
+            return;
+        outmodule->flushExtent();
+        inExtent = false;
+    }
+
+    public:
+
+    TimeSortOutput(TimeSort *timeSort, SortType *sortType) :
+        ts(timeSort), type(sortType), sink(NULL), outmodule(NULL),
+        fileCount(0), inExtent(false), lastOffset(0) {
+        pthread_mutex_init(&offsetMtx, NULL);
+        series.setType(type->extype);
+        codec = new RowCodec(type->extype, series);
+        openFile();
+    }
+
+    ~TimeSortOutput() {
+        closeFile();
+        delete codec;
+        pthread_mutex_destroy(&offsetMtx);
+    }
+
+    void operator()(int64_t key, const char *payload, uint32_t size) {
+        if(outmodule->curExtentSize() >= EXTENT_SIZE) {
+            endExtent();
+            pthread_mutex_lock(&offsetMtx);
+            bool rotate = ts->chunkSize && lastOffset > (off64_t) ts->chunkSize;
+            pthread_mutex_unlock(&offsetMtx);
+            if(rotate) {
+                closeFile();
+                openFile();
+            }
+        }
+        size_t before = outmodule->curExtentSize();
+        outmodule->newRecord();
+        // the output module may have flushed the extent on its own
+        if(inExtent && outmodule->curExtentSize() < before)
+            inExtent = false;
+        if(!inExtent) {
+            IndexEntry e = { key, key, 0 };
+            index.push_back(e);
+            inExtent = true;
+        }
+        codec->decode(payload);
+        index.back().last = key;
+        ++index.back().rows;
+    }
+};
+
+TimeSort::TimeSort(const std::vector<std::string> &inputFiles,
+        const std::vector<std::string> &typeNames,
+        const std::vector<std::string> &keyFields,
+        const std::string &output, const std::string &tmp,
+        size_t memory, unsigned threads, unsigned mergeFanIn,
+        uint64_t chunk, int compression, bool index) :
+    inputs(inputFiles), nextInput(0), runCount(0), outputPrefix(output),
+    tmpDir(tmp), memoryBudget(memory), numThreads(threads),
+    fanIn(mergeFanIn < 2 ? 2 : mergeFanIn), chunkSize(chunk),
+    compressionMode(compression), timeIndex(index)
+{
+    pthread_mutex_init(&mtx, NULL);
+
+    DataSeriesSource f(inputs.front());
+    bool joined = false;
+    for(unsigned i = 0; i < typeNames.size(); ++i) {
+        SortType *type = new SortType(typeNames[i]);
+        type->extype = f.getLibrary().getTypeByNamePtr(typeNames[i], true);
+        INVARIANT(type->extype != NULL, boost::format("Couldn't find a type matching extent type %s") % typeNames[i]);
+        for(unsigned j = 0; j < keyFields.size(); ++j) {
+            if(type->extype->hasColumn(keyFields[j]))
+                type->keyFields.push_back(keyFields[j]);
+        }
+        if(type->keyFields.empty()) {
+            INVARIANT(type->extype->hasColumn(JOIN_FIELD),
+                    boost::format("Extent type %s has neither a key field nor %s") % typeNames[i] % JOIN_FIELD);
+            joined = true;
+        }
+        // the primary type goes first, so its times can be joined
+        if(typeNames[i] == PRIMARY_TYPE)
+            types.insert(types.begin(), type);
+        else
+            types.push_back(type);
+    }
+    INVARIANT(!joined || types.front()->name == PRIMARY_TYPE,
+            "per-op extent types are joined to " PRIMARY_TYPE ", which must be sorted too");
+    f.closefile();
+}
+
+TimeSort::~TimeSort()
+{
+    for(unsigned i = 0; i < types.size(); ++i) {
+        delete types[i];
+    }
+    pthread_mutex_destroy(&mtx);
+}
+
+std::string TimeSort::nextFile(void)
+{
+    std::string file;
+    pthread_mutex_lock(&mtx);
+    if(nextInput < inputs.size())
+        file = inputs[nextInput++];
+    pthread_mutex_unlock(&mtx);
+    return file;
+}
+
+std::string TimeSort::newRunPath(void)
+{
+    pthread_mutex_lock(&mtx);
+    unsigned num = runCount++;
+    pthread_mutex_unlock(&mtx);
+    return (boost::format("%s/dstimesort.%d.%u.run") % tmpDir % getpid() % num).str();
+}
+
+/// Names the runs of the multi-pass merges
+class RunPaths {
+    TimeSort *ts;
+    public:
+    RunPaths(TimeSort *timeSort) : ts(timeSort) { }
+    std::string operator()() { return ts->newRunPath(); }
+};
+
+void TimeSort::spill(SortType *type, SortBuffer &buffer)
+{
+    if(buffer.empty())
+        return;
+    RunWriter run(newRunPath(), 8 * 1024 * 1024);
+    buffer.sortAndWrite(run);
+    run.close();
+    pthread_mutex_lock(&mtx);
+    type->runs.push_back(run.getPath());
+    type->records += run.records;
+    pthread_mutex_unlock(&mtx);
+}
+
+/**
+ * Reads input files and spills sorted runs of each type. Per-op records
+ * are joined to the times of their trace::rpc records by sorting both by
+ * record id: the times of a file go into one buffer first (tagged 0,
+ * with the time), then the per-op records (tagged with the index of
+ * their type, with the encoded record). Equal keys keep the order they
+ * were added in, in memory and across runs, so each time comes right
+ * before the records that take it. The join buffer counts towards the
+ * memory budget and spills to runs like the others.
+ */
+class RunWorker {
+
+    TimeSort *ts;
+    size_t budget;
+    std::vector<SortBuffer> buffers;        // by time, per type
+    std::vector<uint64_t> unjoined;
+
+    SortBuffer joinBuffer;                  // by record id
+    std::vector<std::string> joinRuns;
+    bool joining;                           // joinBuffer is being sorted
+    uint64_t joined;                        // records handed to the join
+    // the last time the join came across, and its record id
+    int64_t joinId, joinTime;
+    bool haveTime;
+
+    static const size_t JOIN_RUN_BUFFER = 8 * 1024 * 1024;
+    static const unsigned BUDGET_CHECK_INTERVAL = 4096;
+
+    void spillJoin(void) {
+        if(joinBuffer.empty())
+            return;
+        RunWriter run(ts->newRunPath(), JOIN_RUN_BUFFER);
+        joinBuffer.sortAndWrite(run);
+        run.close();
+        joinRuns.push_back(run.getPath());
+    }
+
+    public:
+
+    RunWorker(TimeSort *timeSort) :
+        ts(timeSort), budget(ts->memoryBudget / ts->numThreads),
+        buffers(ts->types.size()), unjoined(ts->types.size(), 0),
+        joining(false), joined(0), joinId(0), joinTime(INT64_MIN),
+        haveTime(false) { }
+
+    /// Spills the largest buffer when over budget
+    void checkBudget(void) {
+        size_t total = joinBuffer.bytes(), largest = 0;
+        for(unsigned i = 0; i < buffers.size(); ++i) {
+            total += buffers[i].bytes();
+            if(buffers[i].bytes() > buffers[largest].bytes())
+                largest = i;
+        }
+        if(total <= budget)
+            return;
+        if(!joining && joinBuffer.bytes() > buffers[largest].bytes())
+            spillJoin();
+        else
+            ts->spill(ts->types[largest], buffers[largest]);
+    }
+
+    void add(unsigned type, int64_t time, const std::string &record) {
+        buffers[type].append(time, record.data(), record.size());
+    }
+
+    void addTime(int64_t recordId, int64_t time) {
+        char payload[1 + sizeof(time)] = { 0 };
+        memcpy(&payload[1], &time, sizeof(time));
+        joinBuffer.append(recordId, payload, sizeof(payload));
+    }
+
+    void addJoined(unsigned type, int64_t recordId, std::string &record) {
+        record.insert(record.begin(), (char) type);
+        joinBuffer.append(recordId, record.data(), record.size());
+    }
+
+    /// Joins the per-op records of the file read last to their times,
+    /// in memory if the join never spilled and leaves room for the
+    /// records it produces
+    void endFile(void) {
+        if(joinRuns.empty() && joinBuffer.bytes() <= budget / 2) {
+            joining = true;
+            joinBuffer.sortInto(*this);
+            joining = false;
+        } else {
+            spillJoin();
+            // the merge reads from at most fanIn runs at a time, with
+            // half of the budget, as the joined records need the rest
+            size_t bufferSize = budget / 2 / ts->fanIn;
+            if(bufferSize < 256 * 1024)
+                bufferSize = 256 * 1024;
+            if(bufferSize > JOIN_RUN_BUFFER)
+                bufferSize = JOIN_RUN_BUFFER;
+            RunPaths paths(ts);
+            mergeRunsInPasses(joinRuns, ts->fanIn, bufferSize, paths, *this);
+            joinRuns.clear();
+        }
+        joinTime = INT64_MIN;
+        haveTime = false;
+    }
+
+    /// The join sink: takes the records of the join in record id order
+    void operator()(int64_t recordId, const char *payload, uint32_t size) {
+        unsigned type = (unsigned char) payload[0];
+        if(type == 0) {
+            memcpy(&joinTime, &payload[1], sizeof(joinTime));
+            joinId = recordId;
+            haveTime = true;
+            return;
+        }
+        // the call went to another file: keep the record next to the
+        // one with the closest record id
+        if(!haveTime || joinId != recordId)
+            ++unjoined[type];
+        buffers[type].append(joinTime, payload + 1, size - 1);
+        if(++joined % BUDGET_CHECK_INTERVAL == 0)
+            checkBudget();
+    }
+
+    /// Spills what is left and adds up the counts
+    void finish(void) {
+        for(unsigned t = 0; t < buffers.size(); ++t) {
+            ts->spill(ts->types[t], buffers[t]);
+        }
+        pthread_mutex_lock(&ts->mtx);
+        for(unsigned t = 0; t < buffers.size(); ++t) {
+            ts->types[t]->unjoined += unjoined[t];
+        }
+        pthread_mutex_unlock(&ts->mtx);
+    }
+};
+
+void *TimeSort::runWorker(void *arg)
+{
+    TimeSort *ts = (TimeSort *)arg;
+    RunWorker worker(ts);
+    std::string record;
+
+    bool joins = false;
+    for(unsigned t = 0; t < ts->types.size(); ++t) {
+        joins = joins || ts->types[t]->keyFields.empty();
+    }
+
+    for(std::string file; !(file = ts->nextFile()).empty(); ) {
+        for(unsigned t = 0; t < ts->types.size(); ++t) {
+            SortType *type = ts->types[t];
+            TypeIndexModule source(type->name);
+            source.addSource(file);
+            ExtentSeries series(ExtentSeries::typeLoose);
+            series.setType(type->extype);
+            RowCodec codec(type->extype, series);
+
+            std::vector<Int64Field *> keys;
+            for(unsigned i = 0; i < type->keyFields.size(); ++i) {
+                keys.push_back(new Int64Field(series, type->keyFields[i], Field::flag_nullable));
+            }
+            bool join = keys.empty();
+            bool collect = type->name == PRIMARY_TYPE && joins;
+            Int64Field *recordId = (join || collect) ? new Int64Field(series, JOIN_FIELD) : NULL;
+            int64_t lastKey = INT64_MIN;
+
+            for(Extent::Ptr extent; (extent = source.getSharedExtent()) != NULL; ) {
+                for(series.setExtent(extent); series.morerecords(); ++series) {
+                    record.clear();
+                    codec.encode(record);
+                    if(join) {
+                        worker.addJoined(t, recordId->val(), record);
+                        continue;
+                    }
+
+                    int64_t key = lastKey;
+                    for(unsigned i = 0; i < keys.size(); ++i) {
+                        if(!keys[i]->isNull()) {
+                            key = keys[i]->val();
+                            break;
+                        }
+                    }
+                    lastKey = key;
+                    if(collect)
+                        worker.addTime(recordId->val(), key);
+                    worker.add(t, key, record);
+                }
+                worker.checkBudget();
+            }
+
+            for(unsigned i = 0; i < keys.size(); ++i) {
+                delete keys[i];
+            }
+            delete recordId;
+        }
+        worker.endFile();
+    }
+
+    worker.finish();
+    return 0;
+}
+
+void TimeSort::generateRuns(void)
+{
+    std::vector<pthread_t> threads(numThreads);
+    for(unsigned i = 0; i < numThreads; ++i) {
+        pthread_create(&threads[i], NULL, &runWorker, (void *)this);
+    }
+    for(unsigned i = 0; i < numThreads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+void TimeSort::mergeType(SortType *type)
+{
+    // each merge reads from at most fanIn runs at a time
+    size_t bufferSize = memoryBudget / types.size() / fanIn;
+    if(bufferSize < 256 * 1024)
+        bufferSize = 256 * 1024;
+    if(bufferSize > 16 * 1024 * 1024)
+        bufferSize = 16 * 1024 * 1024;
+
+    RunPaths paths(this);
+    TimeSortOutput output(this, type);
+    mergeRunsInPasses(type->runs, fanIn, bufferSize, paths, output);
+}
+
+struct MergeArg {
+    TimeSort *ts;
+    SortType *type;
+};
+
+void *TimeSort::mergeWorker(void *arg)
+{
+    MergeArg *m = (MergeArg *)arg;
+    m->ts->mergeType(m->type);
+    return 0;
+}
+
+void TimeSort::run(void)
+{
+    uint64_t start = nowNs();
+    generateRuns();
+    uint64_t runsDone = nowNs();
+
+    unsigned totalRuns = 0;
+    for(unsigned i = 0; i < types.size(); ++i) {
+        totalRuns += types[i]->runs.size();
+    }
+    cout << "Generated " << totalRuns << " sorted runs in "
+        << (runsDone - start) / 1e9 << " s\n";
+
+    // the extent types are merged in parallel
+    std::vector<pthread_t> threads(types.size());
+    std::vector<MergeArg> args(types.size());
+    for(unsigned i = 0; i < types.size(); ++i) {
+        args[i].ts = this;
+        args[i].type = types[i];
+        pthread_create(&threads[i], NULL, &mergeWorker, (void *)&args[i]);
+    }
+    for(unsigned i = 0; i < types.size(); ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    uint64_t end = nowNs();
+
+    uint64_t total = 0;
+    for(unsigned i = 0; i < types.size(); ++i) {
+        cout << "Extent type: " << types[i]->name << ", rows: " << types[i]->records;
+        if(types[i]->keyFields.empty())
+            cout << " (" << types[i]->unjoined << " without a " PRIMARY_TYPE " record in the same file)";
+        cout << "\n";
+        total += types[i]->records;
+    }
+    double secs = (end - start) / 1e9;
+    cout << "Sorted " << total << " rows in " << secs << " s (merge "
+        << (end - runsDone) / 1e9 << " s, "
+        << (uint64_t) (secs > 0 ? total / secs : 0) << " rows/sec)\n";
+}
+
+void display_usage()
+{
+    std::cout << "dstimesort -o <output_prefix> [-t <extent_type>]... [-k <key_fields>] [-m <memory_MB>] [-T <tmp_dir>] [-j <threads>] [-f <merge_fan_in>] [-s <chunk_size_in_MB>] [-z none|gz|bz2|lzf] [-x] <input.ds>..." << std::endl;
+    std::cout << "  -t  extent type to sort (default " PRIMARY_TYPE "); per-op types are joined to " PRIMARY_TYPE " by " JOIN_FIELD "\n"
+        << "  -k  comma separated time fields, the first non-null one is the key (default " DEFAULT_KEY_FIELDS ")\n"
+        << "  -x  write a time index (<output>.ds.tindex) of the extents in each output file" << std::endl;
+}
+
+    int
+main(int argc, char *argv[])
+{
+    std::vector<std::string> typeNames, keyFields;
+    std::string keys(DEFAULT_KEY_FIELDS), output, tmpDir("/tmp");
+    size_t memory = 1024 * 1024 * 1024;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned threads = cpus > 0 ? cpus : 1, fanIn = 256;
+    uint64_t chunkSize = 0;
+    int compression = Extent::compress_mode_lzf;
+    bool timeIndex = false;
+    int c;
+
+    while ((c = getopt (argc, argv, "f:j:k:m:o:s:t:T:xz:h?")) != -1) {
+        switch(c) {
+            case 'f':
+                fanIn = atoi(optarg);
+                break;
+            case 'j':
+                threads = atoi(optarg) > 0 ? atoi(optarg) : 1;
+                break;
+            case 'k':
+                keys = optarg;
+                break;
+            case 'm':
+                memory = (size_t) atoi(optarg) * 1024 * 1024;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 's':
+                chunkSize = (uint64_t) atoi(optarg) * 1024 * 1024;
+                break;
+            case 't':
+                typeNames.push_back(optarg);
+                break;
+            case 'T':
+                tmpDir = optarg;
+                break;
+            case 'x':
+                timeIndex = true;
+                break;
+            case 'z':
+                if(!strcmp(optarg, "none"))
+                    compression = Extent::compress_mode_none;
+                else if(!strcmp(optarg, "gz"))
+                    compression = Extent::compress_mode_gz;
+                else if(!strcmp(optarg, "bz2"))
+                    compression = Extent::compress_mode_bz2;
+                else if(!strcmp(optarg, "lzf"))
+                    compression = Extent::compress_mode_lzf;
+                else {
+                    display_usage();
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case '?':
+            case 'h':
+            default:
+                display_usage();
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if(output.empty() || optind >= argc) {
+        display_usage();
+        exit(EXIT_FAILURE);
+    }
+    std::vector<std::string> inputs(argv + optind, argv + argc);
+    if(typeNames.empty())
+        typeNames.push_back(PRIMARY_TYPE);
+    for(size_t start = 0, end; start <= keys.size(); start = end + 1) {
+        end = keys.find(',', start);
+        if(end == std::string::npos)
+            end = keys.size();
+        if(end > start)
+            keyFields.push_back(keys.substr(start, end - start));
+    }
+
+    TimeSort timeSort(inputs, typeNames, keyFields, output, tmpDir, memory,
+            threads, fanIn, chunkSize, compression, timeIndex);
+    timeSort.run();
+
+    return 0;
+}
@@ -5,6 +5,14 @@
  */
 
 #include "AnonHelper.h"
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <pthread.h>
+#include <unistd.h>
 
 StringList
 tokenize(const std::string &inString, char separator)
@@ -20,3 +28,73 @@ tokenize(const std::string &inString, char separator)
 
     return tokens;
 }
+
+std::string
+keyfileDigest(const std::string &keyfile)
+{
+    unsigned char md_value[EVP_MAX_MD_SIZE];
+    unsigned md_len = sizeof(md_value);
+    char buf[4096];
+
+    EVP_MD_CTX *ctx = EVP_MD_CTX_create();
+    assert(EVP_DigestInit_ex(ctx, EVP_sha1(), 0));
+
+    int fd = open(keyfile.c_str(), O_RDONLY);
+    if (0 > fd) {
+        perror(keyfile.c_str());
+        abort();
+    }
+    ssize_t bytes = -1;
+    while ((bytes = read(fd, buf, sizeof(buf))) > 0) {
+        assert(EVP_DigestUpdate(ctx, buf, bytes));
+    }
+    assert(bytes >= 0);
+    close(fd);
+
+    assert(EVP_DigestFinal_ex(ctx, md_value, &md_len));
+    EVP_MD_CTX_destroy(ctx);
+    return std::string(reinterpret_cast<const char *>(md_value), md_len);
+}
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+static pthread_mutex_t *cryptoLocks;
+
+static void
+cryptoLock(int mode, int n, const char *file, int line)
+{
+    if (mode & CRYPTO_LOCK)
+        pthread_mutex_lock(&cryptoLocks[n]);
+    else
+        pthread_mutex_unlock(&cryptoLocks[n]);
+}
+
+static unsigned long
+cryptoThreadId()
+{
+    return static_cast<unsigned long>(pthread_self());
+}
+
+static void
+setupCryptoLocks()
+{
+    cryptoLocks = new pthread_mutex_t[CRYPTO_num_locks()];
+    for (int i = 0; i < CRYPTO_num_locks(); ++i) {
+        pthread_mutex_init(&cryptoLocks[i], NULL);
+    }
+    CRYPTO_set_id_callback(cryptoThreadId);
+    CRYPTO_set_locking_callback(cryptoLock);
+}
+#else
+static void
+setupCryptoLocks()
+{
+    // OpenSSL does its own locking
+}
+#endif
+
+void
+initCryptoThreads()
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, setupCryptoLocks);
+}
@@ -15,4 +15,13 @@ typedef std::list<std::string> StringList;
 /// Tokenize a string by breaking it at the provided separators.
 StringList tokenize(const std::string &inString, char separator);
 
+/// The SHA1 digest of a key file, from which the anonymization keys
+/// are made
+std::string keyfileDigest(const std::string &keyfile);
+
+/// Make OpenSSL safe to call from several threads. OpenSSL before 1.1
+/// needs the application to provide its locks. Safe to call more than
+/// once.
+void initCryptoThreads();
+
 #endif // ANONHELPER_H
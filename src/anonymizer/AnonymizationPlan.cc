@@ -0,0 +1,223 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2015 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "AnonymizationPlan.h"
+#include "DataSeries/ByteField.hpp"
+#include "DataSeries/Int32Field.hpp"
+#include "DataSeries/Int64Field.hpp"
+#include "DataSeries/Variable32Field.hpp"
+
+void
+AnonymizationPlan::addField(const std::string &extentTypeName,
+                            const std::string &fieldName,
+                            const AnonymizerFactory &factory)
+{
+    FieldOp op;
+    op.fieldName = fieldName;
+    op.factory = factory;
+    _fieldOps[extentTypeName].push_back(op);
+}
+
+void
+AnonymizationPlan::addNull(const std::string &extentTypeName,
+                           const std::string &fieldName)
+{
+    FieldOp op;
+    op.fieldName = fieldName;
+    _fieldOps[extentTypeName].push_back(op);
+}
+
+void
+AnonymizationPlan::addStrip(const std::string &extentTypeName)
+{
+    _stripped.insert(extentTypeName);
+}
+
+std::set<std::string>
+AnonymizationPlan::extentTypeNames() const
+{
+    std::set<std::string> names(_stripped);
+    for (TypeOps::const_iterator i = _fieldOps.begin();
+         i != _fieldOps.end(); ++i) {
+        names.insert(i->first);
+    }
+    return names;
+}
+
+
+ExtentAnonymizer::TypePlan::TypePlan(const ExtentType::Ptr type,
+                                     const std::list<AnonymizationPlan::FieldOp> &ops) :
+    hasBatched(false)
+{
+    std::map<std::string, unsigned> opsPerField;
+    for (std::list<AnonymizationPlan::FieldOp>::const_iterator i = ops.begin();
+         i != ops.end(); ++i) {
+        ++opsPerField[i->fieldName];
+    }
+
+    series.setType(type);
+    for (std::list<AnonymizationPlan::FieldOp>::const_iterator i = ops.begin();
+         i != ops.end(); ++i) {
+        Column c;
+        c.type = type->getFieldType(i->fieldName);
+        c.anonymizer = i->factory ? i->factory() : 0;
+        c.batched = c.anonymizer && c.anonymizer->prefersBatch() &&
+            (c.type == ExtentType::ft_int32 ||
+             c.type == ExtentType::ft_int64) &&
+            opsPerField[i->fieldName] == 1;
+        c.next = 0;
+        hasBatched = hasBatched || c.batched;
+        int flags = type->getNullable(i->fieldName) ? Field::flag_nullable : 0;
+        switch (c.type) {
+        case ExtentType::ft_byte:
+            c.field = new ByteField(series, i->fieldName, flags);
+            break;
+        case ExtentType::ft_int32:
+            c.field = new Int32Field(series, i->fieldName, flags);
+            break;
+        case ExtentType::ft_int64:
+            c.field = new Int64Field(series, i->fieldName, flags);
+            break;
+        case ExtentType::ft_variable32:
+            c.field = new Variable32Field(series, i->fieldName, flags);
+            break;
+        case ExtentType::ft_double:
+        case ExtentType::ft_fixedwidth:
+        default:
+            assert("Don't know how to anonymize field type" && 0);
+            c.field = 0;
+        }
+        columns.push_back(c);
+    }
+}
+
+ExtentAnonymizer::TypePlan::~TypePlan()
+{
+    for (unsigned i = 0; i < columns.size(); ++i) {
+        delete columns[i].field;
+        delete columns[i].anonymizer;
+    }
+}
+
+void
+ExtentAnonymizer::TypePlan::batchColumns(Extent::Ptr extent)
+{
+    for (std::vector<Column>::iterator c = columns.begin();
+         c != columns.end(); ++c) {
+        c->batch32.clear();
+        c->batch64.clear();
+        c->next = 0;
+    }
+
+    for (series.setExtent(extent); series.morerecords(); ++series) {
+        for (std::vector<Column>::iterator c = columns.begin();
+             c != columns.end(); ++c) {
+            if (!c->batched || c->field->isNull())
+                continue;
+            if (c->type == ExtentType::ft_int32)
+                c->batch32.push_back(static_cast<Int32Field *>(c->field)->val());
+            else
+                c->batch64.push_back(static_cast<Int64Field *>(c->field)->val());
+        }
+    }
+
+    for (std::vector<Column>::iterator c = columns.begin();
+         c != columns.end(); ++c) {
+        if (!c->batched)
+            continue;
+        if (c->type == ExtentType::ft_int32)
+            c->anonymizer->anonymizeBatch(c->batch32.data(), c->batch32.size());
+        else
+            c->anonymizer->anonymizeBatch(c->batch64.data(), c->batch64.size());
+    }
+}
+
+void
+ExtentAnonymizer::TypePlan::processRow()
+{
+    for (std::vector<Column>::iterator c = columns.begin();
+         c != columns.end(); ++c) {
+        if (!c->anonymizer) {
+            c->field->setNull();
+            continue;
+        }
+        if (c->field->isNull())
+            continue;
+
+        if (c->batched) {
+            if (c->type == ExtentType::ft_int32)
+                static_cast<Int32Field *>(c->field)->set(c->batch32[c->next++]);
+            else
+                static_cast<Int64Field *>(c->field)->set(c->batch64[c->next++]);
+            continue;
+        }
+
+        switch (c->type) {
+        case ExtentType::ft_byte: {
+            ByteField *f = static_cast<ByteField *>(c->field);
+            f->set(c->anonymizer->anonymize(static_cast<uint8_t>(f->val())));
+            break;
+        }
+        case ExtentType::ft_int32: {
+            Int32Field *f = static_cast<Int32Field *>(c->field);
+            f->set(c->anonymizer->anonymize(static_cast<int32_t>(f->val())));
+            break;
+        }
+        case ExtentType::ft_int64: {
+            Int64Field *f = static_cast<Int64Field *>(c->field);
+            f->set(c->anonymizer->anonymize(static_cast<int64_t>(f->val())));
+            break;
+        }
+        case ExtentType::ft_variable32: {
+            Variable32Field *f = static_cast<Variable32Field *>(c->field);
+            f->set(c->anonymizer->anonymize(f->stringval()));
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+
+ExtentAnonymizer::ExtentAnonymizer(const AnonymizationPlan &plan) :
+    _plan(plan)
+{
+}
+
+ExtentAnonymizer::~ExtentAnonymizer()
+{
+    for (std::map<std::string, TypePlan *>::iterator i = _typePlans.begin();
+         i != _typePlans.end(); ++i) {
+        delete i->second;
+    }
+}
+
+bool
+ExtentAnonymizer::anonymize(Extent::Ptr extent)
+{
+    const std::string &typeName = extent->getTypePtr()->getName();
+    std::map<std::string, TypePlan *>::iterator i = _typePlans.find(typeName);
+    if (i == _typePlans.end()) {
+        AnonymizationPlan::TypeOps::const_iterator ops =
+            _plan._fieldOps.find(typeName);
+        if (ops == _plan._fieldOps.end())
+            return false;
+        i = _typePlans.insert(std::make_pair(typeName,
+                                             new TypePlan(extent->getTypePtr(),
+                                                          ops->second))).first;
+    }
+
+    TypePlan *typePlan = i->second;
+    if (typePlan->hasBatched)
+        typePlan->batchColumns(extent);
+    for (typePlan->series.setExtent(extent); typePlan->series.morerecords();
+         ++typePlan->series) {
+        typePlan->processRow();
+    }
+    typePlan->series.clearExtent();
+    return true;
+}
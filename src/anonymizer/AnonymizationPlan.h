@@ -0,0 +1,114 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2015 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef ANONYMIZATIONPLAN_H
+#define ANONYMIZATIONPLAN_H
+
+#include <functional>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Anonymizer.h"
+#include "DataSeries/ExtentSeries.hpp"
+
+/**
+ * The set of anonymization operations to apply to a trace, in the
+ * order they were given. Each operation rewrites one field of one
+ * extent type, either with an Anonymizer or by setting it to null, or
+ * strips a whole extent type.
+ *
+ * The plan only holds factories for the anonymizers. Each thread
+ * compiles its own copy with an ExtentAnonymizer, so anonymizers that
+ * keep state (e.g., the FPE cache) are never shared between threads.
+ */
+class AnonymizationPlan {
+public:
+    typedef std::function<Anonymizer *()> AnonymizerFactory;
+
+    /// Anonymize a field with anonymizers made by factory
+    void addField(const std::string &extentTypeName,
+                  const std::string &fieldName,
+                  const AnonymizerFactory &factory);
+    /// Anonymize a (nullable) field by setting it to null
+    void addNull(const std::string &extentTypeName,
+                 const std::string &fieldName);
+    /// Remove an extent type from the stream
+    void addStrip(const std::string &extentTypeName);
+
+    bool isStripped(const std::string &extentTypeName) const {
+        return _stripped.count(extentTypeName);
+    }
+
+    /// All the extent types named by an operation
+    std::set<std::string> extentTypeNames() const;
+
+private:
+    friend class ExtentAnonymizer;
+
+    struct FieldOp {
+        std::string fieldName;
+        /// empty for a null operation
+        AnonymizerFactory factory;
+    };
+    typedef std::map<std::string, std::list<FieldOp> > TypeOps;
+
+    TypeOps _fieldOps;
+    std::set<std::string> _stripped;
+};
+
+/**
+ * A thread's compiled copy of an AnonymizationPlan. Each extent type
+ * gets one typed field and one anonymizer per operation, and an extent
+ * is rewritten in a single pass over its rows, applying the operations
+ * of each row in plan order. Integer columns whose anonymizer prefers
+ * batches (e.g., FPE) are gathered in a first pass and anonymized a
+ * whole column at a time.
+ */
+class ExtentAnonymizer {
+public:
+    ExtentAnonymizer(const AnonymizationPlan &plan);
+    ~ExtentAnonymizer();
+
+    /// Anonymize an extent in place.
+    /// @returns false if the plan has no operations on its type
+    bool anonymize(Extent::Ptr extent);
+
+private:
+    struct Column {
+        ExtentType::fieldType type;
+        /// NULL for a null operation
+        Anonymizer *anonymizer;
+        Field *field;
+        /// anonymized a column at a time; only if this is the one
+        /// operation on the field
+        bool batched;
+        /// the column's anonymized non-null values, and the next one
+        std::vector<int32_t> batch32;
+        std::vector<int64_t> batch64;
+        size_t next;
+    };
+
+    struct TypePlan {
+        ExtentSeries series;
+        std::vector<Column> columns;
+        bool hasBatched;
+
+        TypePlan(const ExtentType::Ptr type,
+                 const std::list<AnonymizationPlan::FieldOp> &ops);
+        ~TypePlan();
+        /// Gather and anonymize the values of the batched columns
+        void batchColumns(Extent::Ptr extent);
+        void processRow();
+    };
+
+    const AnonymizationPlan &_plan;
+    std::map<std::string, TypePlan *> _typePlans;
+};
+
+#endif // ANONYMIZATIONPLAN_H
@@ -35,6 +35,19 @@ public:
         return std::string();
     }
 
+    /// Anonymize count values in place. Anonymizers that can work on
+    /// many values at once more cheaply than one at a time override
+    /// these and prefersBatch().
+    virtual void anonymizeBatch(int32_t *vals, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            vals[i] = anonymize(vals[i]);
+    }
+    virtual void anonymizeBatch(int64_t *vals, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            vals[i] = anonymize(vals[i]);
+    }
+    virtual bool prefersBatch() const { return false; }
+
 protected:
     void notSupported() {
         assert("Anonymization of this value type is not supported" && 0);
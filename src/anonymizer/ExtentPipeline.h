@@ -0,0 +1,147 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2015 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef EXTENT_PIPELINE_H
+#define EXTENT_PIPELINE_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <map>
+#include <vector>
+
+#include <boost/function.hpp>
+
+#include "DataSeries/DataSeriesModule.hpp"
+#include "DataSeries/Extent.hpp"
+
+/**
+ * A module that converts the extents of an upstream module on a pool of
+ * threads. Extents are independent of each other, so each worker takes
+ * the next extent from upstream, converts it on its own and parks the
+ * result until the consumer asks for it. Extents come out in the order
+ * upstream produced them, and at most maxInFlight extents are taken from
+ * upstream and not yet returned, which bounds the memory held. A converter
+ * that returns NULL drops the extent. Used by the dsconvert tools and by
+ * the anonymizer.
+ */
+class ExtentPipeline : public DataSeriesModule {
+
+    public:
+
+    /// Converts one extent; called concurrently from the worker threads.
+    /// Returns NULL to drop the extent.
+    typedef boost::function<Extent::Ptr (Extent::Ptr)> Converter;
+
+    ExtentPipeline(DataSeriesModule &upstreamModule, const Converter &converter,
+            unsigned numThreads, unsigned maxInFlightExtents) :
+        upstream(upstreamModule), convert(converter),
+        maxInFlight(maxInFlightExtents < numThreads ? numThreads : maxInFlightExtents),
+        nextIn(0), nextOut(0), endSeq(UINT64_MAX), stopping(false) {
+        pthread_mutex_init(&mtx, NULL);
+        pthread_cond_init(&ready, NULL);
+        pthread_cond_init(&room, NULL);
+        workers.resize(numThreads > 0 ? numThreads : 1);
+        started = false;
+    }
+
+    ~ExtentPipeline() {
+        pthread_mutex_lock(&mtx);
+        stopping = true;
+        pthread_cond_broadcast(&room);
+        pthread_mutex_unlock(&mtx);
+        for(unsigned i = 0; started && i < workers.size(); ++i) {
+            pthread_join(workers[i], NULL);
+        }
+        pthread_cond_destroy(&room);
+        pthread_cond_destroy(&ready);
+        pthread_mutex_destroy(&mtx);
+    }
+
+    /// The next converted extent in source order, NULL at the end. The
+    /// workers start reading upstream on the first call.
+    Extent::Ptr getSharedExtent() {
+        if(!started) {
+            started = true;
+            for(unsigned i = 0; i < workers.size(); ++i) {
+                pthread_create(&workers[i], NULL, &ExtentPipeline::worker, this);
+            }
+        }
+        pthread_mutex_lock(&mtx);
+        Extent::Ptr e;
+        while(nextOut != endSeq) {
+            std::map<uint64_t, Extent::Ptr>::iterator it = done.find(nextOut);
+            if(it == done.end()) {
+                pthread_cond_wait(&ready, &mtx);
+                continue;
+            }
+            e = it->second;
+            done.erase(it);
+            ++nextOut;
+            pthread_cond_broadcast(&room);
+            if(e != NULL)       // skip dropped extents
+                break;
+        }
+        pthread_mutex_unlock(&mtx);
+        return e;
+    }
+
+    private:
+
+    DataSeriesModule &upstream;
+    Converter convert;
+    const uint64_t maxInFlight;
+
+    pthread_mutex_t mtx;
+    pthread_cond_t ready;       // an extent was parked, or upstream ended
+    pthread_cond_t room;        // the consumer took an extent
+    std::vector<pthread_t> workers;
+    bool started;
+
+    std::map<uint64_t, Extent::Ptr> done;   // converted, by sequence number
+    uint64_t nextIn;            // sequence number of the next upstream extent
+    uint64_t nextOut;           // sequence number the consumer waits for
+    uint64_t endSeq;            // sequence number of the end of upstream
+    bool stopping;
+
+    static void *worker(void *arg) {
+        ExtentPipeline *p = static_cast<ExtentPipeline *>(arg);
+
+        pthread_mutex_lock(&p->mtx);
+        while(true) {
+            while(!p->stopping && p->endSeq == UINT64_MAX
+                    && p->nextIn - p->nextOut >= p->maxInFlight) {
+                pthread_cond_wait(&p->room, &p->mtx);
+            }
+            if(p->stopping || p->endSeq != UINT64_MAX)
+                break;
+
+            // Upstream is read under the lock so that sequence numbers
+            // follow its order; with prefetching this is a queue pop.
+            uint64_t seq = p->nextIn++;
+            Extent::Ptr in = p->upstream.getSharedExtent();
+            if(in == NULL) {
+                p->endSeq = seq;
+                pthread_cond_broadcast(&p->ready);
+                break;
+            }
+            pthread_mutex_unlock(&p->mtx);
+
+            Extent::Ptr out = p->convert(in);
+            in.reset();
+
+            pthread_mutex_lock(&p->mtx);
+            p->done[seq] = out;
+            if(seq == p->nextOut)
+                pthread_cond_broadcast(&p->ready);
+        }
+        pthread_cond_broadcast(&p->room);
+        pthread_mutex_unlock(&p->mtx);
+        return NULL;
+    }
+};
+
+#endif // EXTENT_PIPELINE_H
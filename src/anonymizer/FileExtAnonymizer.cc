@@ -8,9 +8,12 @@
 #include <iomanip>
 #include <sstream>
 
-FileExtAnonymizer::FileExtAnonymizer(Anonymizer *textHasher) :
-    _hasher(textHasher)
+FileExtAnonymizer::FileExtAnonymizer(Anonymizer *textHasher,
+                                     MemoCache *cache) :
+    _hasher(textHasher), _cache(cache)
 {
+    if (_cache)
+        _ns = _cache->getNamespace("fileext");
 }
 
 FileExtAnonymizer::~FileExtAnonymizer()
@@ -21,6 +24,15 @@ FileExtAnonymizer::~FileExtAnonymizer()
 
 std::string
 FileExtAnonymizer::anonymize(const std::string &inData)
+{
+    if (!_cache)
+        return anonymizeName(inData);
+    return _cache->get(_ns, inData.data(), inData.size(),
+                       [this, &inData]() { return anonymizeName(inData); });
+}
+
+std::string
+FileExtAnonymizer::anonymizeName(const std::string &inData)
 {
     std::ostringstream outName;
 
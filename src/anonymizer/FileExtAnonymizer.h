@@ -10,6 +10,7 @@
 #include "DataSeries/GeneralField.hpp"
 #include "Anonymizer.h"
 #include "HashAnonymizer.h"
+#include "MemoCache.h"
 
 /**
  * Anonymizer that changes a filename into
@@ -18,14 +19,18 @@
  * "0008|9bf908850d59279e7ff1513cee29e4d30c79a8d5|txt". The length of
  * the original name is 0x0008, the hash of "file" is 9b...d5, and the
  * extension is "txt".
+ *
+ * If given a MemoCache, whole filenames are looked up there before
+ * being anonymized.
  */
 class FileExtAnonymizer : public Anonymizer {
 public:
-    FileExtAnonymizer(Anonymizer *textHasher);
+    FileExtAnonymizer(Anonymizer *textHasher, MemoCache *cache = 0);
     ~FileExtAnonymizer();
 
     virtual std::string anonymize(const std::string &inData);
 protected:
+    std::string anonymizeName(const std::string &inData);
 
     /// Splits a filename into its basename and its extension. Either
     /// one may be empty.
@@ -33,6 +38,8 @@ protected:
     fileAndExtension(const std::string &filename);
 
     Anonymizer *_hasher;
+    MemoCache *_cache;
+    MemoCache::Namespace _ns;
 };
 
 #endif // FILEEXTANONYMIZER_H
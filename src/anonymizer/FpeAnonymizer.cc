@@ -5,6 +5,7 @@
  */
 
 #include "FpeAnonymizer.h"
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <endian.h>
@@ -18,13 +19,21 @@
 
 
 static const EVP_MD *MD_ALGORITHM = EVP_sha1();
-static const EVP_CIPHER *CIPHER = EVP_aes_128_cbc();
+// FF1's CBC-MAC is computed one block at a time, so the cipher is
+// AES itself
+static const EVP_CIPHER *CIPHER = EVP_aes_128_ecb();
 static const unsigned CIPHER_KEYLEN = 16; // AES 16-byte key (128 bits)
 
 FpeAnonymizer::FpeAnonymizer(const std::string &keyfile,
-                             const std::string &tweak):
-    _cache32(200), _cache64(200)
+                             const std::string &tweak,
+                             MemoCache *cache):
+    _cache32(200), _cache64(200), _memo(cache)
 {
+    if (_memo) {
+        _ns32 = _memo->getNamespace("fpe32:" + tweak);
+        _ns64 = _memo->getNamespace("fpe64:" + tweak);
+    }
+
     _tweaklen = tweak.size();
     _tweak = new unsigned char[_tweaklen];
     memcpy(_tweak, tweak.data(), _tweaklen);
@@ -55,17 +64,57 @@ FpeAnonymizer::FpeAnonymizer(const std::string &keyfile,
     assert(1 == rc);
 
     EVP_MD_CTX_destroy(ctx);
+
+    setupFf1();
 }
 
 FpeAnonymizer::~FpeAnonymizer()
 {
+    EVP_CIPHER_CTX_free(_ctx);
     delete _key;
     delete _tweak;
 }
 
+void
+FpeAnonymizer::anonymizeBatch(int32_t *vals, size_t count)
+{
+    uint64_t buf[BATCH_SIZE];
+    for (size_t done = 0; done < count; done += BATCH_SIZE) {
+        unsigned n = std::min<size_t>(count - done, BATCH_SIZE);
+        for (unsigned i = 0; i < n; ++i)
+            buf[i] = static_cast<uint32_t>(vals[done + i]);
+        ff1EncryptBatch(buf, n, 4);
+        for (unsigned i = 0; i < n; ++i)
+            vals[done + i] = static_cast<int32_t>(buf[i]);
+    }
+}
+
+void
+FpeAnonymizer::anonymizeBatch(int64_t *vals, size_t count)
+{
+    uint64_t buf[BATCH_SIZE];
+    for (size_t done = 0; done < count; done += BATCH_SIZE) {
+        unsigned n = std::min<size_t>(count - done, BATCH_SIZE);
+        for (unsigned i = 0; i < n; ++i)
+            buf[i] = static_cast<uint64_t>(vals[done + i]);
+        ff1EncryptBatch(buf, n, 8);
+        for (unsigned i = 0; i < n; ++i)
+            vals[done + i] = static_cast<int64_t>(buf[i]);
+    }
+}
+
 int32_t
 FpeAnonymizer::anonymize(int32_t inVal)
 {
+    if (_memo) {
+        std::string out = _memo->get(_ns32, &inVal, sizeof(inVal), [&]() {
+                return encryptToString(static_cast<uint32_t>(inVal), 4);
+            });
+        int32_t outVal;
+        memcpy(&outVal, out.data(), sizeof(outVal));
+        return outVal;
+    }
+
     int32_t *cval = _cache32.lookup(inVal);
     if (cval)
         return *cval;
@@ -83,6 +132,15 @@ FpeAnonymizer::anonymize(int32_t inVal)
 int64_t
 FpeAnonymizer::anonymize(int64_t inVal)
 {
+    if (_memo) {
+        std::string out = _memo->get(_ns64, &inVal, sizeof(inVal), [&]() {
+                return encryptToString(inVal, 8);
+            });
+        int64_t outVal;
+        memcpy(&outVal, out.data(), sizeof(outVal));
+        return outVal;
+    }
+
     int64_t *cval = _cache64.lookup(inVal);
     if (cval)
         return *cval;
@@ -96,18 +154,52 @@ FpeAnonymizer::anonymize(int64_t inVal)
     return outVal;
 }
 
+std::string
+FpeAnonymizer::encryptToString(uint64_t val, unsigned bytes)
+{
+    ff1Encrypt(&val, bytes);
+    if (4 == bytes) {
+        assert(val < 1ull<<32);
+        uint32_t u32 = val;
+        return std::string(reinterpret_cast<const char *>(&u32), 4);
+    }
+    return std::string(reinterpret_cast<const char *>(&val), 8);
+}
+
 void
-FpeAnonymizer::ff1Encrypt(uint64_t *val, unsigned bytes)
+FpeAnonymizer::setupFf1()
+{
+    _ctx = EVP_CIPHER_CTX_new();
+    assert(_ctx);
+    int rc = EVP_EncryptInit_ex(_ctx, CIPHER, 0, _key, 0);
+    assert(1 == rc);
+    // AES block size is 16 bytes
+    assert(16 == EVP_CIPHER_CTX_block_size(_ctx));
+    // only whole blocks are encrypted, so there is nothing to finalize
+    EVP_CIPHER_CTX_set_padding(_ctx, 0);
+
+    ff1Prefix(4, &_prefix32);
+    ff1Prefix(8, &_prefix64);
+}
+
+void
+FpeAnonymizer::aesBlocks(unsigned char *out, const unsigned char *in,
+                         unsigned count)
+{
+    int outlen;
+    int rc = EVP_EncryptUpdate(_ctx, out, &outlen, in, count * 16);
+    assert(1 == rc);
+    assert(static_cast<int>(count * 16) == outlen);
+}
+
+void
+FpeAnonymizer::ff1Prefix(unsigned bytes, Ff1Prefix *prefix)
 {
-    assert(bytes == 4 || bytes == 8);
     // using radix = 2, so switch to bits
     const unsigned n = bytes * 8;
     const unsigned u = n/2;
-    //const unsigned uBytes = u/8;
     const unsigned v = n - u;
     const unsigned vBytes = v/8;
-    uint64_t A = (*val >> v) & ((1llu << u) - 1);
-    uint64_t B = *val & ((1llu << v) - 1);
     const unsigned d = ceil(vBytes/4.0) * 4 + 4;
     assert(d == 8); // for 8, 32, 64-bit, it should always be 8
     unsigned char P[16];
@@ -121,51 +213,77 @@ FpeAnonymizer::ff1Encrypt(uint64_t *val, unsigned bytes)
     uint32_t be_tlen = htobe32(_tweaklen);
     memcpy(&(P[12]), &be_tlen, 4);
 
-    // prepare fixed portion of Q
+    // fixed portion of Q; the round number and B go in the last
+    // vBytes + 1 bytes of the last block
     const unsigned qlen = int((_tweaklen + vBytes + 1 + 15) / 16) * 16;
     unsigned char Q[qlen];
     memset(Q, 0, qlen);
     memcpy(Q, _tweak, _tweaklen);
-    const unsigned ipos = qlen - vBytes - 1;
-    const unsigned char IV[] = {
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-    };
 
+    // CBC-MAC with a zero IV over P and all but the last block of Q
+    unsigned char X[16];
+    aesBlocks(X, P, 1);
+    for (unsigned j = 0; j + 16 < qlen; j += 16) {
+        for (unsigned k = 0; k < 16; ++k)
+            X[k] ^= Q[j + k];
+        aesBlocks(X, X, 1);
+    }
+    for (unsigned k = 0; k < 16; ++k)
+        prefix->block[k] = X[k] ^ Q[qlen - 16 + k];
+}
+
+void
+FpeAnonymizer::ff1Encrypt(uint64_t *val, unsigned bytes)
+{
+    ff1EncryptBatch(val, 1, bytes);
+}
+
+void
+FpeAnonymizer::ff1EncryptBatch(uint64_t *vals, unsigned count,
+                               unsigned bytes)
+{
+    assert(bytes == 4 || bytes == 8);
+    assert(count <= BATCH_SIZE);
+    // using radix = 2, so switch to bits
+    const unsigned n = bytes * 8;
+    const unsigned u = n/2;
+    const unsigned v = n - u;
+    const unsigned vBytes = v/8;
+    assert(u == v);
+    const Ff1Prefix &prefix = 4 == bytes ? _prefix32 : _prefix64;
+
+    uint64_t A[BATCH_SIZE], B[BATCH_SIZE];
+    for (unsigned k = 0; k < count; ++k) {
+        A[k] = (vals[k] >> v) & ((1llu << u) - 1);
+        B[k] = vals[k] & ((1llu << v) - 1);
+    }
+
+    unsigned char X[BATCH_SIZE * 16], R[BATCH_SIZE * 16];
     for (unsigned i = 0; i < 10; ++i) {
-        // part of Q that varies by round
-        memcpy(&Q[qlen-vBytes], &B, vBytes);
-        Q[ipos] = i;
-        // R = prf(P||Q)
-        EVP_CIPHER_CTX ctx;
-        EVP_CIPHER_CTX_init(&ctx);
-        int rc = EVP_EncryptInit_ex(&ctx, CIPHER, 0, _key, IV);
-        assert(1 == rc);
-        // AES block size is 16 bytes
-        assert(16 == EVP_CIPHER_CTX_block_size(&ctx));
-        // since block size is > d, we only need 1 block
-        unsigned char R[16];
-        int rlen;
-        rc = EVP_EncryptUpdate(&ctx, R, &rlen, P, 16);
-        assert(1 == rc);
-        for (unsigned j=0; j < qlen; j += 16) {
-            rc = EVP_EncryptUpdate(&ctx, R, &rlen, &(Q[j]), 16);
-            assert(1 == rc);
+        // last block of Q for each value, chained onto the prefix
+        for (unsigned k = 0; k < count; ++k) {
+            unsigned char *x = &X[k * 16];
+            unsigned char b[8];
+            memcpy(x, prefix.block, 16);
+            x[15 - vBytes] ^= i;
+            memcpy(b, &B[k], vBytes);
+            for (unsigned j = 0; j < vBytes; ++j)
+                x[16 - vBytes + j] ^= b[j];
+        }
+        // R = prf(P||Q), for all the values at once
+        aesBlocks(R, X, count);
+
+        for (unsigned k = 0; k < count; ++k) {
+            // First d bytes (8) of R (== S) is what we care about
+            uint64_t y;
+            memcpy(&y, &R[k * 16], 8);
+            y = be64toh(y);
+            uint64_t c = (A[k] + y) % (1llu << u);
+            A[k] = B[k];
+            B[k] = c;
         }
-        assert(16 == rlen);
-        // Since we're encrypting whole blocks, we don't need to call final.
-        //rc = EVP_EncryptFinal_ex(&ctx, R, &rlen);
-        //assert(1 == rc);
-        EVP_CIPHER_CTX_cleanup(&ctx);
-
-        // First d bytes (8) of R (== S) is what we care about
-        uint64_t *yp = reinterpret_cast<uint64_t*>(R);
-        uint64_t y = be64toh(*yp);
-        assert(u == v);
-        uint64_t c = (A + y) % (1llu << u);
-        A = B;
-        B = c;
     }
 
-    *val = (A << v) | B;
+    for (unsigned k = 0; k < count; ++k)
+        vals[k] = (A[k] << v) | B[k];
 }
@@ -8,33 +8,74 @@
 #define FPEANONYMIZER_H
 
 #include "Anonymizer.h"
+#include "MemoCache.h"
 #include "RandCache.h"
 #include <string>
 
+struct evp_cipher_ctx_st;
+
 /**
  * Anonymizer that permutes the values in a field based on a key and
  * tweak. This anonymizer uses Format Preserving Encryption (FPE)
  * based on the FF1 mode from NIST 800-38G draft.
+ *
+ * Recent values are kept in a small cache, or, if given a MemoCache,
+ * all values are looked up there before being encrypted. Whole
+ * columns are best encrypted with anonymizeBatch(), which runs each
+ * Feistel round over many values with a single AES call and skips the
+ * caches.
  */
 class FpeAnonymizer : public Anonymizer {
 public:
     FpeAnonymizer(const std::string &keyfile,
-                  const std::string &tweak);
+                  const std::string &tweak,
+                  MemoCache *cache = 0);
     ~FpeAnonymizer();
 
+    virtual void anonymizeBatch(int32_t *vals, size_t count);
+    virtual void anonymizeBatch(int64_t *vals, size_t count);
+    virtual bool prefersBatch() const { return true; }
+
 protected:
     virtual int32_t anonymize(int32_t inVal);
     virtual int64_t anonymize(int64_t inVal);
 
 private:
+    /// Values encrypted per AES call in ff1EncryptBatch
+    static const unsigned BATCH_SIZE = 256;
+
+    /// The PRF of FF1 is a CBC-MAC over P||Q, where only the last
+    /// block of Q varies between rounds and values. This is the MAC
+    /// state before that block, XORed with the fixed (tweak) bytes of
+    /// the block, for 4- and 8-byte values.
+    struct Ff1Prefix {
+        unsigned char block[16];
+    };
+
+    void setupFf1();
+    void ff1Prefix(unsigned bytes, Ff1Prefix *prefix);
+    /// Encrypt one AES block per input block with the key
+    void aesBlocks(unsigned char *out, const unsigned char *in,
+                   unsigned count);
+
     // Encrypt the data in val using the FF1 mode of 800-38G.
     void ff1Encrypt(uint64_t *val, unsigned bytes);
+    /// ff1Encrypt() on count values, at most BATCH_SIZE
+    void ff1EncryptBatch(uint64_t *vals, unsigned count, unsigned bytes);
+    /// Encrypt a value with ff1Encrypt, returning it as a string of
+    /// the given size for the MemoCache
+    std::string encryptToString(uint64_t val, unsigned bytes);
 
     RandCache<int32_t, int32_t> _cache32;
     RandCache<int64_t, int64_t> _cache64;
     unsigned char *_key;
     unsigned char *_tweak;
     unsigned _tweaklen;
+    /// AES-128-ECB with _key, for the whole lifetime of the anonymizer
+    evp_cipher_ctx_st *_ctx;
+    Ff1Prefix _prefix32, _prefix64;
+    MemoCache *_memo;
+    MemoCache::Namespace _ns32, _ns64;
 };
 
 #endif // FPEANONYMIZER_H
@@ -0,0 +1,290 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2014 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "gtest/gtest.h"
+#include "FpeAnonymizer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <openssl/evp.h>
+#include <unistd.h>
+#include <vector>
+
+typedef std::vector<unsigned char> Bytes;
+typedef unsigned __int128 uint128_t;
+
+static Bytes
+fromHex(const char *hex)
+{
+    Bytes bytes;
+    for (; hex[0] && hex[1]; hex += 2) {
+        char byte[3] = { hex[0], hex[1], 0 };
+        bytes.push_back(strtoul(byte, 0, 16));
+    }
+    return bytes;
+}
+
+/// CIPH_K of SP 800-38G (one AES block)
+static void
+aesBlock(const Bytes &key, const unsigned char *in, unsigned char *out)
+{
+    const EVP_CIPHER *cipher = 16 == key.size() ? EVP_aes_128_ecb() :
+        24 == key.size() ? EVP_aes_192_ecb() : EVP_aes_256_ecb();
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    int outlen;
+    ASSERT_EQ(1, EVP_EncryptInit_ex(ctx, cipher, 0, &key[0], 0));
+    EVP_CIPHER_CTX_set_padding(ctx, 0);
+    ASSERT_EQ(1, EVP_EncryptUpdate(ctx, out, &outlen, in, 16));
+    EVP_CIPHER_CTX_free(ctx);
+}
+
+static uint128_t
+num(const std::vector<unsigned> &x, unsigned radix)
+{
+    uint128_t n = 0;
+    for (unsigned i = 0; i < x.size(); ++i)
+        n = n * radix + x[i];
+    return n;
+}
+
+/**
+ * A direct transcription of FF1.Encrypt (SP 800-38G, algorithm 7),
+ * for strings short enough that their numbers fit in 128 bits.
+ * FpeAnonymizer encodes NUM(B) in Q in host (little-endian) byte
+ * order, which leBytes reproduces; the output of the anonymizer must
+ * not change, as earlier traces were anonymized with it.
+ */
+static std::vector<unsigned>
+ff1Reference(const Bytes &key, unsigned radix, const Bytes &tweak,
+             const std::vector<unsigned> &x, bool leBytes = false)
+{
+    const unsigned n = x.size();
+    const unsigned u = n / 2;
+    const unsigned v = n - u;
+    std::vector<unsigned> A(x.begin(), x.begin() + u);
+    std::vector<unsigned> B(x.begin() + u, x.end());
+
+    // b = ceil(ceil(v * log2(radix)) / 8), d = 4 * ceil(b / 4) + 4
+    uint128_t radixV = 1;
+    for (unsigned i = 0; i < v; ++i)
+        radixV *= radix;
+    unsigned bits = 0;
+    for (uint128_t r = radixV - 1; r; r >>= 1)
+        ++bits;
+    const unsigned b = (bits + 7) / 8;
+    const unsigned d = 4 * ((b + 3) / 4) + 4;
+    EXPECT_GE(16u, d);
+
+    const unsigned t = tweak.size();
+    unsigned char P[16] = {
+        1, 2, 1,
+        (unsigned char)(radix >> 16), (unsigned char)(radix >> 8),
+        (unsigned char)radix,
+        10, (unsigned char)(u % 256),
+        (unsigned char)(n >> 24), (unsigned char)(n >> 16),
+        (unsigned char)(n >> 8), (unsigned char)n,
+        (unsigned char)(t >> 24), (unsigned char)(t >> 16),
+        (unsigned char)(t >> 8), (unsigned char)t
+    };
+
+    for (unsigned i = 0; i < 10; ++i) {
+        Bytes Q(tweak);
+        Q.resize(Q.size() + (16 - (t + b + 1) % 16) % 16, 0);
+        Q.push_back(i);
+        uint128_t numB = num(B, radix);
+        for (unsigned j = 0; j < b; ++j) {
+            unsigned shift = leBytes ? j : b - 1 - j;
+            Q.push_back(static_cast<unsigned char>(numB >> (8 * shift)));
+        }
+
+        // R = PRF(P || Q): CBC-MAC with a zero IV
+        unsigned char R[16];
+        aesBlock(key, P, R);
+        for (unsigned j = 0; j < Q.size(); j += 16) {
+            for (unsigned k = 0; k < 16; ++k)
+                R[k] ^= Q[j + k];
+            aesBlock(key, R, R);
+        }
+        // S = R, as d <= 16
+        uint128_t y = 0;
+        for (unsigned k = 0; k < d; ++k)
+            y = (y << 8) | R[k];
+
+        const unsigned m = i % 2 ? v : u;
+        uint128_t radixM = 1;
+        for (unsigned j = 0; j < m; ++j)
+            radixM *= radix;
+        uint128_t c = (num(A, radix) + y % radixM) % radixM;
+        std::vector<unsigned> C(m);
+        for (unsigned j = m; j-- > 0; c /= radix)
+            C[j] = c % radix;
+        A = B;
+        B = C;
+    }
+    A.insert(A.end(), B.begin(), B.end());
+    return A;
+}
+
+static std::vector<unsigned>
+fromNumerals(const char *s)
+{
+    std::vector<unsigned> x;
+    for (; *s; ++s)
+        x.push_back(*s <= '9' ? *s - '0' : *s - 'a' + 10);
+    return x;
+}
+
+static std::string
+toNumerals(const std::vector<unsigned> &x)
+{
+    std::string s;
+    for (unsigned i = 0; i < x.size(); ++i)
+        s += "0123456789abcdefghijklmnopqrstuvwxyz"[x[i]];
+    return s;
+}
+
+TEST(FF1, MatchesNistSamples) {
+    // the FF1 samples of SP 800-38G
+    static const struct {
+        const char *key, *tweak;
+        unsigned radix;
+        const char *pt, *ct;
+    } samples[] = {
+        { "2B7E151628AED2A6ABF7158809CF4F3C", "",
+          10, "0123456789", "2433477484" },
+        { "2B7E151628AED2A6ABF7158809CF4F3C", "39383736353433323130",
+          10, "0123456789", "6124200773" },
+        { "2B7E151628AED2A6ABF7158809CF4F3C", "3737373770717273373737",
+          36, "0123456789abcdefghi", "a9tv40mll9kdu509eum" },
+        { "2B7E151628AED2A6ABF7158809CF4F3CEF4359D8D580AA4F", "",
+          10, "0123456789", "2830668132" },
+        { "2B7E151628AED2A6ABF7158809CF4F3CEF4359D8D580AA4F",
+          "39383736353433323130",
+          10, "0123456789", "2496655549" },
+        { "2B7E151628AED2A6ABF7158809CF4F3CEF4359D8D580AA4F",
+          "3737373770717273373737",
+          36, "0123456789abcdefghi", "xbj3kv35jrawxv32ysr" },
+        { "2B7E151628AED2A6ABF7158809CF4F3CEF4359D8D580AA4F"
+          "7F036D6F04FC6A94", "",
+          10, "0123456789", "6657667009" },
+        { "2B7E151628AED2A6ABF7158809CF4F3CEF4359D8D580AA4F"
+          "7F036D6F04FC6A94", "39383736353433323130",
+          10, "0123456789", "1001623463" },
+        { "2B7E151628AED2A6ABF7158809CF4F3CEF4359D8D580AA4F"
+          "7F036D6F04FC6A94", "3737373770717273373737",
+          36, "0123456789abcdefghi", "xs8a0azh2avyalyzuwd" },
+    };
+    for (unsigned i = 0; i < sizeof(samples) / sizeof(samples[0]); ++i) {
+        std::vector<unsigned> ct =
+            ff1Reference(fromHex(samples[i].key), samples[i].radix,
+                         fromHex(samples[i].tweak),
+                         fromNumerals(samples[i].pt));
+        EXPECT_EQ(samples[i].ct, toNumerals(ct)) << "sample " << i + 1;
+    }
+}
+
+/// Writes a key file for FpeAnonymizer and keeps the AES key that it
+/// derives from it (the start of the file's SHA-1)
+class FpeAnonymizerTest : public ::testing::Test {
+protected:
+    void SetUp() {
+        char name[] = "/tmp/FpeAnonymizerTest.XXXXXX";
+        int fd = mkstemp(name);
+        ASSERT_LE(0, fd);
+        const char contents[] = "a key for the FpeAnonymizer test\n";
+        ASSERT_EQ(ssize_t(sizeof(contents)),
+                  write(fd, contents, sizeof(contents)));
+        close(fd);
+        _keyfile = name;
+
+        unsigned char md[EVP_MAX_MD_SIZE];
+        unsigned mdlen;
+        ASSERT_EQ(1, EVP_Digest(contents, sizeof(contents), md, &mdlen,
+                                EVP_sha1(), 0));
+        _key.assign(md, md + 16);
+    }
+    void TearDown() {
+        unlink(_keyfile.c_str());
+    }
+
+    /// the reference encryption of a value of the given size
+    uint64_t reference(uint64_t val, unsigned bytes,
+                       const std::string &tweak) {
+        std::vector<unsigned> bits(bytes * 8);
+        for (unsigned i = 0; i < bits.size(); ++i)
+            bits[i] = (val >> (bits.size() - 1 - i)) & 1;
+        bits = ff1Reference(_key, 2, Bytes(tweak.begin(), tweak.end()),
+                            bits, true);
+        uint64_t out = 0;
+        for (unsigned i = 0; i < bits.size(); ++i)
+            out = (out << 1) | bits[i];
+        return out;
+    }
+
+    std::string _keyfile;
+    Bytes _key;
+};
+
+static const char *tweaks[] = {
+    "", "a", "0123456789a", "0123456789ab", "0123456789abc",
+    "0123456789abcdef", "0123456789abcdef0123456789abcdef01234567"
+};
+
+TEST_F(FpeAnonymizerTest, MatchesFf1Reference) {
+    srandom(1);
+    for (unsigned t = 0; t < sizeof(tweaks) / sizeof(tweaks[0]); ++t) {
+        FpeAnonymizer fpe(_keyfile, tweaks[t]);
+        Anonymizer &anon = fpe;
+        for (unsigned i = 0; i < 50; ++i) {
+            uint32_t v32 = random() ^ (random() << 16);
+            uint64_t v64 = (uint64_t(random()) << 40) ^
+                (uint64_t(random()) << 20) ^ random();
+            EXPECT_EQ(reference(v32, 4, tweaks[t]),
+                      uint32_t(anon.anonymize(int32_t(v32))))
+                << "tweak " << tweaks[t];
+            EXPECT_EQ(reference(v64, 8, tweaks[t]),
+                      uint64_t(anon.anonymize(int64_t(v64))))
+                << "tweak " << tweaks[t];
+        }
+    }
+}
+
+TEST_F(FpeAnonymizerTest, BatchMatchesSingleValues) {
+    // across the batches of the AES calls (256 values)
+    static const size_t counts[] = { 1, 2, 255, 256, 257, 1000 };
+    srandom(2);
+    for (unsigned t = 0; t < sizeof(tweaks) / sizeof(tweaks[0]); ++t) {
+        for (unsigned c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+            std::vector<int32_t> in32(counts[c]), out32(counts[c]);
+            std::vector<int64_t> in64(counts[c]), out64(counts[c]);
+            for (size_t i = 0; i < counts[c]; ++i) {
+                in32[i] = random() ^ (random() << 16);
+                in64[i] = (int64_t(random()) << 40) ^
+                    (int64_t(random()) << 20) ^ random();
+            }
+            // a repeated value, which the single-value path caches
+            in32.back() = in32.front();
+            in64.back() = in64.front();
+
+            FpeAnonymizer single(_keyfile, tweaks[t]);
+            Anonymizer &anon = single;
+            for (size_t i = 0; i < counts[c]; ++i) {
+                out32[i] = anon.anonymize(in32[i]);
+                out64[i] = anon.anonymize(in64[i]);
+            }
+
+            FpeAnonymizer batch(_keyfile, tweaks[t]);
+            batch.anonymizeBatch(&in32[0], in32.size());
+            batch.anonymizeBatch(&in64[0], in64.size());
+            EXPECT_EQ(0, memcmp(&in32[0], &out32[0],
+                                in32.size() * sizeof(int32_t)))
+                << "tweak " << tweaks[t] << ", " << counts[c] << " values";
+            EXPECT_EQ(0, memcmp(&in64[0], &out64[0],
+                                in64.size() * sizeof(int64_t)))
+                << "tweak " << tweaks[t] << ", " << counts[c] << " values";
+        }
+    }
+}
@@ -20,8 +20,13 @@
 
 static const EVP_MD *MD_ALGORITHM = EVP_sha1();
 
-HashAnonymizer::HashAnonymizer(const std::string &keyfile)
+HashAnonymizer::HashAnonymizer(const std::string &keyfile,
+                               MemoCache *cache) :
+    _cache(cache)
 {
+    if (_cache)
+        _ns = _cache->getNamespace("hmac");
+
     unsigned char md_value[EVP_MAX_MD_SIZE];
     char buf[4096];
     _keylen = sizeof(md_value);
@@ -118,6 +123,15 @@ HashAnonymizer::anonymize(uint64_t inVal)
 
 std::string
 HashAnonymizer::anonymize(const std::string &inData)
+{
+    if (!_cache)
+        return hmac(inData);
+    return _cache->get(_ns, inData.data(), inData.size(),
+                       [this, &inData]() { return hmac(inData); });
+}
+
+std::string
+HashAnonymizer::hmac(const std::string &inData)
 {
     unsigned char md_value[EVP_MAX_MD_SIZE];
     unsigned md_len = sizeof(md_value);
@@ -8,6 +8,7 @@
 #define HASHANONYMIZER_H
 
 #include "Anonymizer.h"
+#include "MemoCache.h"
 #include <string>
 
 /**
@@ -24,10 +25,13 @@
  *
  * For the function that takes an arbitrany byte stream, it returns
  * the raw HMAC of size blockSize() in the output buffer.
+ *
+ * If given a MemoCache, HMACs are looked up there before being
+ * computed.
  */
 class HashAnonymizer : public Anonymizer {
 public:
-    HashAnonymizer(const std::string &keyfile);
+    HashAnonymizer(const std::string &keyfile, MemoCache *cache = 0);
     ~HashAnonymizer();
 
     virtual int8_t anonymize(int8_t inVal);
@@ -41,8 +45,12 @@ public:
     virtual std::string anonymize(const std::string &inData);
 
 private:
+    std::string hmac(const std::string &inData);
+
     unsigned char *_key;
     unsigned _keylen;
+    MemoCache *_cache;
+    MemoCache::Namespace _ns;
 };
 
 
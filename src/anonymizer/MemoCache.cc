@@ -0,0 +1,356 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2015 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "MemoCache.h"
+#include "AnonHelper.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <endian.h>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Size of the file header; the slots start on the next page
+static const size_t HEADER_SIZE = 4096;
+/// Smallest table we bother with
+static const uint64_t MIN_SLOTS = 1024;
+/// Label for deriving the cache key from the anonymization key
+static const char KEY_LABEL[] = "chronicle anonymization memo cache";
+/// Label for deriving the key of the values from the anonymization key
+static const char VALUE_KEY_LABEL[] = "chronicle anonymization memo values";
+/// Numbers the caches of the process
+static std::atomic<uint64_t> lastInstance(0);
+
+static inline uint64_t
+rotl(uint64_t x, int b)
+{
+    return (x << b) | (x >> (64 - b));
+}
+
+static inline void
+sipRound(uint64_t &v0, uint64_t &v1, uint64_t &v2, uint64_t &v3)
+{
+    v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+    v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+    v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+    v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+}
+
+/// SipHash-2-4 with a 128-bit output
+static void
+sipHash128(uint64_t k0, uint64_t k1, const void *data, size_t len,
+           uint64_t out[2])
+{
+    const unsigned char *in = static_cast<const unsigned char *>(data);
+    uint64_t v0 = 0x736f6d6570736575ull ^ k0;
+    uint64_t v1 = 0x646f72616e646f6dull ^ k1 ^ 0xee;
+    uint64_t v2 = 0x6c7967656e657261ull ^ k0;
+    uint64_t v3 = 0x7465646279746573ull ^ k1;
+
+    const unsigned char *end = in + (len & ~size_t(7));
+    for (; in != end; in += 8) {
+        uint64_t m;
+        memcpy(&m, in, 8);
+        m = le64toh(m);
+        v3 ^= m;
+        sipRound(v0, v1, v2, v3);
+        sipRound(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+    uint64_t b = static_cast<uint64_t>(len) << 56;
+    for (unsigned i = 0; i < (len & 7); ++i) {
+        b |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    v3 ^= b;
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xee;
+    for (unsigned i = 0; i < 4; ++i)
+        sipRound(v0, v1, v2, v3);
+    out[0] = v0 ^ v1 ^ v2 ^ v3;
+    v1 ^= 0xdd;
+    for (unsigned i = 0; i < 4; ++i)
+        sipRound(v0, v1, v2, v3);
+    out[1] = v0 ^ v1 ^ v2 ^ v3;
+}
+
+MemoCache::MemoCache(const std::string &keyfile, size_t bytes,
+                     const std::string &path) :
+    _instance(++lastInstance), _path(path), _map(MAP_FAILED), _mapSize(0),
+    _hits(0), _misses(0), _dropped(0)
+{
+    std::string digest = keyfileDigest(keyfile);
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned macLen = sizeof(mac);
+    assert(HMAC(EVP_sha1(), digest.data(), digest.size(),
+                reinterpret_cast<const unsigned char *>(KEY_LABEL),
+                sizeof(KEY_LABEL) - 1, mac, &macLen));
+    assert(macLen >= 16);
+    memcpy(&_master.k0, mac, 8);
+    memcpy(&_master.k1, mac + 8, 8);
+
+    macLen = sizeof(mac);
+    assert(HMAC(EVP_sha1(), digest.data(), digest.size(),
+                reinterpret_cast<const unsigned char *>(VALUE_KEY_LABEL),
+                sizeof(VALUE_KEY_LABEL) - 1, mac, &macLen));
+    assert(macLen >= sizeof(_valueKey));
+    memcpy(_valueKey, mac, sizeof(_valueKey));
+
+    setup(bytes);
+}
+
+MemoCache::~MemoCache()
+{
+    if (_map != MAP_FAILED)
+        munmap(_map, _mapSize);
+}
+
+void
+MemoCache::setup(size_t bytes)
+{
+    uint64_t keyCheck[2];
+    sipHash128(_master.k0, _master.k1, KEY_LABEL, sizeof(KEY_LABEL) - 1,
+               keyCheck);
+
+    int fd = -1;
+    if (!_path.empty()) {
+        fd = open(_path.c_str(), O_RDWR | O_CREAT, 0600);
+        if (0 > fd || flock(fd, LOCK_EX)) {
+            perror(_path.c_str());
+            abort();
+        }
+        struct stat st;
+        assert(0 == fstat(fd, &st));
+        if (st.st_size) {
+            // an existing file keeps its geometry
+            bytes = st.st_size;
+        } else if (ftruncate(fd, bytes)) {
+            perror(_path.c_str());
+            abort();
+        }
+    }
+    assert("Memo cache is too small" && bytes >= HEADER_SIZE +
+           MIN_SLOTS * (sizeof(Slot) + 64));
+
+    _mapSize = bytes;
+    if (fd >= 0) {
+        _map = mmap(0, _mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    } else {
+        _map = mmap(0, _mapSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    }
+    if (MAP_FAILED == _map) {
+        perror(_path.empty() ? "memo cache" : _path.c_str());
+        abort();
+    }
+
+    _header = static_cast<Header *>(_map);
+    if (_header->magic == 0) {
+        // A new table: 1/4 of the space for slots, the rest for values
+        uint64_t numSlots = MIN_SLOTS;
+        while (numSlots * 2 * sizeof(Slot) <= (bytes - HEADER_SIZE) / 4)
+            numSlots *= 2;
+        _header->version = VERSION;
+        _header->keyCheck[0] = keyCheck[0];
+        _header->keyCheck[1] = keyCheck[1];
+        _header->numSlots = numSlots;
+        _header->arenaSize = bytes - HEADER_SIZE - numSlots * sizeof(Slot);
+        _header->arenaUsed = 0;
+        _header->numEntries = 0;
+        std::atomic_thread_fence(std::memory_order_release);
+        _header->magic = MAGIC;
+    } else if (_header->magic != MAGIC || _header->version != VERSION ||
+               bytes < HEADER_SIZE + _header->numSlots * sizeof(Slot) +
+               _header->arenaSize) {
+        std::cerr << _path << ": not a memo cache file" << std::endl;
+        abort();
+    } else if (_header->keyCheck[0] != keyCheck[0] ||
+               _header->keyCheck[1] != keyCheck[1]) {
+        std::cerr << _path << ": memo cache was made with a different key"
+                  << std::endl;
+        abort();
+    }
+    _slots = reinterpret_cast<Slot *>(static_cast<char *>(_map) +
+                                      HEADER_SIZE);
+    _arena = reinterpret_cast<char *>(_slots + _header->numSlots);
+
+    if (fd >= 0) {
+        // the mapping stays valid after the file is closed
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+}
+
+MemoCache::Namespace
+MemoCache::getNamespace(const std::string &name) const
+{
+    uint64_t key[2];
+    sipHash128(_master.k0, _master.k1, name.data(), name.size(), key);
+    Namespace ns = { key[0], key[1] };
+    return ns;
+}
+
+bool
+MemoCache::takeSample()
+{
+    static thread_local unsigned calls = 0;
+    return ++calls % SAMPLE_INTERVAL == 0;
+}
+
+void
+MemoCache::fingerprint(const Namespace &ns, const void *key, size_t len,
+                       uint64_t fp[2]) const
+{
+    sipHash128(ns.k0, ns.k1, key, len, fp);
+}
+
+void
+MemoCache::crypt(const uint64_t fp[2], const char *in, char *out,
+                 size_t len) const
+{
+    // EVP contexts can't be shared between threads, so each thread
+    // keeps one, keyed for the cache it was last used with
+    struct ThreadCipher {
+        uint64_t instance;
+        EVP_CIPHER_CTX *ctx;
+        ThreadCipher() : instance(0), ctx(EVP_CIPHER_CTX_new()) {
+            assert(ctx);
+        }
+        ~ThreadCipher() { EVP_CIPHER_CTX_free(ctx); }
+    };
+    static thread_local ThreadCipher cipher;
+    int rc;
+    if (cipher.instance != _instance) {
+        rc = EVP_EncryptInit_ex(cipher.ctx, EVP_aes_128_ctr(), 0,
+                                _valueKey, 0);
+        assert(1 == rc);
+        cipher.instance = _instance;
+    }
+    // a fingerprint always has the same value, so reusing it as the
+    // counter only shows what the fingerprints show already
+    unsigned char iv[16];
+    memcpy(iv, fp, sizeof(iv));
+    rc = EVP_EncryptInit_ex(cipher.ctx, 0, 0, 0, iv);
+    assert(1 == rc);
+    int outlen;
+    rc = EVP_EncryptUpdate(cipher.ctx,
+                           reinterpret_cast<unsigned char *>(out), &outlen,
+                           reinterpret_cast<const unsigned char *>(in),
+                           len);
+    assert(1 == rc);
+    assert(static_cast<int>(len) == outlen);
+}
+
+bool
+MemoCache::find(const uint64_t fp[2], std::string *value) const
+{
+    const uint64_t mask = _header->numSlots - 1;
+    for (uint64_t i = fp[0] & mask, probes = 0; probes <= mask;
+         i = (i + 1) & mask, ++probes) {
+        Slot &slot = _slots[i];
+        uint32_t state = slot.state.load(std::memory_order_acquire);
+        if (SLOT_EMPTY == state)
+            return false;
+        // a slot being filled in is passed over; at worst the value
+        // is computed again
+        if (SLOT_READY == state && slot.fp[0] == fp[0] &&
+            slot.fp[1] == fp[1]) {
+            value->resize(slot.valueLen);
+            crypt(fp, _arena + slot.valueOffset, &(*value)[0],
+                  slot.valueLen);
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+MemoCache::insert(const uint64_t fp[2], const std::string &value)
+{
+    if (_header->numEntries.load(std::memory_order_relaxed) >=
+        _header->numSlots / 4 * 3) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Copy the value into the arena before claiming a slot, so the
+    // slot is only briefly busy
+    uint64_t offset = _header->arenaUsed.load(std::memory_order_relaxed);
+    do {
+        if (offset + value.size() > _header->arenaSize) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    } while (!_header->arenaUsed.compare_exchange_weak(offset,
+                                                       offset + value.size(),
+                                                       std::memory_order_relaxed));
+    crypt(fp, value.data(), _arena + offset, value.size());
+
+    const uint64_t mask = _header->numSlots - 1;
+    for (uint64_t i = fp[0] & mask, probes = 0; probes <= mask;
+         i = (i + 1) & mask, ++probes) {
+        Slot &slot = _slots[i];
+        uint32_t state = slot.state.load(std::memory_order_acquire);
+        if (SLOT_EMPTY == state &&
+            slot.state.compare_exchange_strong(state, SLOT_BUSY,
+                                               std::memory_order_acquire)) {
+            slot.valueLen = value.size();
+            slot.valueOffset = offset;
+            slot.fp[0] = fp[0];
+            slot.fp[1] = fp[1];
+            slot.state.store(SLOT_READY, std::memory_order_release);
+            _header->numEntries.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (SLOT_READY == state && slot.fp[0] == fp[0] &&
+            slot.fp[1] == fp[1])
+            return; // another thread got there first
+    }
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+MemoCache::printStats(std::ostream &out) const
+{
+    uint64_t hits = _hits, misses = _misses, lookups = hits + misses;
+    if (!lookups)
+        return;
+
+    // A miss costs a lookup plus the computation, so the difference
+    // between the two is what every lookup would cost without the
+    // cache
+    double hitNs = _hitTime.average(), missNs = _missTime.average();
+    double uncached = lookups * std::max(missNs - hitNs, 0.0);
+    double cached = hits * hitNs + misses * missNs;
+
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << "Memo cache: " << lookups << " lookups, "
+        << std::fixed << std::setprecision(1)
+        << 100.0 * hits / lookups << "% hits, "
+        << _header->numEntries << " entries, "
+        << _dropped << " not stored (cache full)" << std::endl
+        << "Memo cache: " << std::setprecision(0) << hitNs
+        << " ns per hit, " << missNs << " ns per miss";
+    // without timed misses there is nothing to compare against
+    if (cached > 0 && _missTime.samples)
+        out << ", estimated speedup " << std::setprecision(2)
+            << uncached / cached << "x";
+    out << std::endl;
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,156 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2015 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef MEMOCACHE_H
+#define MEMOCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <time.h>
+
+/**
+ * Memo cache of anonymized values, shared by all the anonymizers and
+ * threads of a process. Traces repeat the same file handles, names and
+ * paths millions of times, and the anonymized value of each only needs
+ * computing once.
+ *
+ * The cache is a lock-free open-addressing hash table of 128-bit
+ * fingerprints, with the values kept in an append-only arena. Entries
+ * are never removed; once the table is 3/4 full or the arena is used
+ * up, new values are simply not remembered.
+ *
+ * The table can live in a mapping file, so it carries over to later
+ * files and runs (and to concurrent processes) that use the same key.
+ * The file holds no cleartext: the fingerprints are a keyed hash
+ * (SipHash) of the input, and the values are encrypted with AES-128 in
+ * CTR mode, with their fingerprint as the initial counter block. Both
+ * keys are derived from the anonymization key, and a file made with a
+ * different key is refused.
+ */
+class MemoCache {
+public:
+    /// Keeps the mappings of different anonymizers (or settings) apart
+    struct Namespace {
+        uint64_t k0, k1;
+    };
+
+    /**
+     * @param[in] keyfile The anonymization key file
+     * @param[in] bytes The size of the cache
+     * @param[in] path A mapping file to use, or "" for a cache in
+     * memory. An existing file keeps its own size.
+     */
+    MemoCache(const std::string &keyfile, size_t bytes,
+              const std::string &path = "");
+    ~MemoCache();
+
+    Namespace getNamespace(const std::string &name) const;
+
+    /// The value of key in ns, calling compute() for it on a miss
+    template<class Compute>
+    std::string get(const Namespace &ns, const void *key, size_t keyLen,
+                    Compute compute) {
+        bool sample = takeSample();
+        uint64_t start = sample ? now() : 0;
+        uint64_t fp[2];
+        fingerprint(ns, key, keyLen, fp);
+        std::string value;
+        if (find(fp, &value)) {
+            if (sample)
+                _hitTime.add(now() - start);
+            _hits.fetch_add(1, std::memory_order_relaxed);
+            return value;
+        }
+        value = compute();
+        insert(fp, value);
+        if (sample)
+            _missTime.add(now() - start);
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return value;
+    }
+
+    /// Prints the hit rate and the estimated speedup of the cached
+    /// anonymizers
+    void printStats(std::ostream &out) const;
+
+private:
+    static const uint64_t MAGIC = 0x314f4d454d524843ull; // "CHRMEMO1"
+    static const uint32_t VERSION = 2;
+    /// Lookups and misses are timed once every SAMPLE_INTERVAL
+    static const unsigned SAMPLE_INTERVAL = 64;
+
+    struct Header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t pad;
+        /// fingerprint of a fixed string, to recognize the key
+        uint64_t keyCheck[2];
+        uint64_t numSlots;
+        uint64_t arenaSize;
+        std::atomic<uint64_t> arenaUsed;
+        std::atomic<uint64_t> numEntries;
+    };
+
+    enum { SLOT_EMPTY = 0, SLOT_BUSY, SLOT_READY };
+
+    struct Slot {
+        std::atomic<uint32_t> state;
+        uint32_t valueLen;
+        uint64_t valueOffset;
+        uint64_t fp[2];
+    };
+
+    static uint64_t now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+    static bool takeSample();
+
+    /// Total time of the sampled hits or misses
+    struct Timing {
+        std::atomic<uint64_t> ns, samples;
+        Timing() : ns(0), samples(0) { }
+        void add(uint64_t t) {
+            ns.fetch_add(t, std::memory_order_relaxed);
+            samples.fetch_add(1, std::memory_order_relaxed);
+        }
+        double average() const {
+            return samples ? double(ns) / samples : 0;
+        }
+    };
+
+    void fingerprint(const Namespace &ns, const void *key, size_t len,
+                     uint64_t fp[2]) const;
+    /// Encrypts or decrypts (the same in CTR mode) the value of fp
+    void crypt(const uint64_t fp[2], const char *in, char *out,
+               size_t len) const;
+    bool find(const uint64_t fp[2], std::string *value) const;
+    void insert(const uint64_t fp[2], const std::string &value);
+    void setup(size_t bytes);
+
+    /// the key all namespaces are derived from
+    Namespace _master;
+    /// the AES key of the values in the mapping file
+    unsigned char _valueKey[16];
+    /// tells the per-thread cipher contexts of different caches apart
+    uint64_t _instance;
+    std::string _path;
+    void *_map;
+    size_t _mapSize;
+    Header *_header;
+    Slot *_slots;
+    char *_arena;
+
+    std::atomic<uint64_t> _hits, _misses;
+    /// misses that could not be remembered because the cache was full
+    std::atomic<uint64_t> _dropped;
+    Timing _hitTime, _missTime;
+};
+
+#endif // MEMOCACHE_H
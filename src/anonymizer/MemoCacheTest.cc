@@ -0,0 +1,106 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2015 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "gtest/gtest.h"
+#include "MemoCache.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+
+class MemoCacheTest : public ::testing::Test {
+protected:
+    void SetUp() {
+        char keyfile[] = "/tmp/MemoCacheTest.key.XXXXXX";
+        int fd = mkstemp(keyfile);
+        ASSERT_LE(0, fd);
+        const char key[] = "a key for the MemoCache test\n";
+        ASSERT_EQ(ssize_t(sizeof(key)), write(fd, key, sizeof(key)));
+        close(fd);
+        _keyfile = keyfile;
+
+        char mapfile[] = "/tmp/MemoCacheTest.map.XXXXXX";
+        fd = mkstemp(mapfile);
+        ASSERT_LE(0, fd);
+        close(fd);
+        _mapfile = mapfile;
+        // MemoCache sizes a new (empty) file itself
+        ASSERT_EQ(0, truncate(_mapfile.c_str(), 0));
+    }
+    void TearDown() {
+        unlink(_keyfile.c_str());
+        unlink(_mapfile.c_str());
+    }
+
+    static std::string valueOf(unsigned i) {
+        char value[64];
+        snprintf(value, sizeof(value), "anonymized-value-%08u", i);
+        return value;
+    }
+
+    std::string _keyfile, _mapfile;
+};
+
+/// Computes the value of a key, counting the calls
+struct Compute {
+    std::string value;
+    unsigned *calls;
+    std::string operator()() const { ++*calls; return value; }
+};
+
+TEST_F(MemoCacheTest, MappingFileHoldsNoCleartext) {
+    const unsigned N = 1000;
+    unsigned calls = 0;
+    {
+        MemoCache cache(_keyfile, 4 << 20, _mapfile);
+        MemoCache::Namespace ns = cache.getNamespace("test");
+        for (unsigned i = 0; i < N; ++i) {
+            Compute compute = { valueOf(i), &calls };
+            EXPECT_EQ(valueOf(i), cache.get(ns, &i, sizeof(i), compute));
+        }
+        // hits decrypt to the values that were stored
+        for (unsigned i = 0; i < N; ++i) {
+            Compute compute = { "", &calls };
+            EXPECT_EQ(valueOf(i), cache.get(ns, &i, sizeof(i), compute));
+        }
+        EXPECT_EQ(N, calls);
+    }
+
+    std::ifstream in(_mapfile.c_str(), std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+    EXPECT_EQ(std::string::npos, contents.find("anonymized-value"));
+
+    // a later run with the same key gets the values back
+    MemoCache cache(_keyfile, 4 << 20, _mapfile);
+    MemoCache::Namespace ns = cache.getNamespace("test");
+    for (unsigned i = 0; i < N; ++i) {
+        Compute compute = { "", &calls };
+        EXPECT_EQ(valueOf(i), cache.get(ns, &i, sizeof(i), compute));
+    }
+    EXPECT_EQ(N, calls);
+}
+
+TEST_F(MemoCacheTest, CachesInMemoryShareThreadCiphers) {
+    // two caches with the same key but separate tables, used from the
+    // same thread one after the other
+    MemoCache a(_keyfile, 4 << 20), b(_keyfile, 4 << 20);
+    MemoCache::Namespace nsA = a.getNamespace("a"), nsB = b.getNamespace("b");
+    unsigned calls = 0;
+    for (unsigned i = 0; i < 100; ++i) {
+        Compute computeA = { valueOf(i), &calls };
+        Compute computeB = { valueOf(i + 1000), &calls };
+        a.get(nsA, &i, sizeof(i), computeA);
+        b.get(nsB, &i, sizeof(i), computeB);
+    }
+    for (unsigned i = 0; i < 100; ++i) {
+        Compute none = { "", &calls };
+        EXPECT_EQ(valueOf(i), a.get(nsA, &i, sizeof(i), none));
+        EXPECT_EQ(valueOf(i + 1000), b.get(nsB, &i, sizeof(i), none));
+    }
+    EXPECT_EQ(200u, calls);
+}
@@ -0,0 +1,82 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2015 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "ParallelAnonymizer.h"
+#include "AnonHelper.h"
+#include <iostream>
+
+ParallelAnonymizer::ParallelAnonymizer(DataSeriesModule *source,
+                                       const AnonymizationPlan &plan,
+                                       unsigned threads) :
+    _plan(plan), _started(false)
+{
+    pthread_mutex_init(&_lock, NULL);
+    if (threads == 0)
+        threads = 1;
+    Anonymize convert = { this };
+    _pipeline = new ExtentPipeline(*source, convert, threads, 2 * threads);
+}
+
+ParallelAnonymizer::~ParallelAnonymizer()
+{
+    // joins the workers before their anonymizers go away
+    delete _pipeline;
+    for (unsigned i = 0; i < _anonymizers.size(); ++i)
+        delete _anonymizers[i];
+    pthread_mutex_destroy(&_lock);
+
+    std::set<std::string> types = _plan.extentTypeNames();
+    for (std::set<std::string>::const_iterator i = types.begin();
+         i != types.end(); ++i) {
+        if (!_matchedTypes.count(*i))
+            std::cout << "# WARNING: No extents of type: '" << *i
+                      << "' found during anonymization!" << std::endl;
+    }
+}
+
+Extent::Ptr
+ParallelAnonymizer::getSharedExtent()
+{
+    if (!_started) {
+        _started = true;
+        initCryptoThreads();
+    }
+    return _pipeline->getSharedExtent();
+}
+
+Extent::Ptr
+ParallelAnonymizer::anonymize(Extent::Ptr extent)
+{
+    const std::string &typeName = extent->getTypePtr()->getName();
+    if (_plan.isStripped(typeName)) {
+        pthread_mutex_lock(&_lock);
+        _matchedTypes.insert(typeName);
+        pthread_mutex_unlock(&_lock);
+        return Extent::Ptr();
+    }
+
+    // a worker uses one anonymizer at a time, so there are never more
+    // than there are workers
+    ExtentAnonymizer *anonymizer;
+    pthread_mutex_lock(&_lock);
+    if (_idle.empty()) {
+        anonymizer = new ExtentAnonymizer(_plan);
+        _anonymizers.push_back(anonymizer);
+    } else {
+        anonymizer = _idle.back();
+        _idle.pop_back();
+    }
+    pthread_mutex_unlock(&_lock);
+
+    bool matched = anonymizer->anonymize(extent);
+
+    pthread_mutex_lock(&_lock);
+    _idle.push_back(anonymizer);
+    if (matched)
+        _matchedTypes.insert(typeName);
+    pthread_mutex_unlock(&_lock);
+    return extent;
+}
@@ -0,0 +1,65 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2015 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef PARALLELANONYMIZER_H
+#define PARALLELANONYMIZER_H
+
+#include <pthread.h>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "AnonymizationPlan.h"
+#include "ExtentPipeline.h"
+#include "DataSeries/DataSeriesModule.hpp"
+
+/**
+ * DataSeries module that applies an AnonymizationPlan to the extents
+ * of its source on the worker threads of an ExtentPipeline. Each
+ * worker anonymizes with an ExtentAnonymizer of its own. Extents are
+ * returned in the order the source produced them, extents of stripped
+ * types are dropped, and extents of other types are passed through.
+ */
+class ParallelAnonymizer : public DataSeriesModule {
+public:
+    /// @param[in] source The module from which this one will obtain
+    /// extents
+    /// @param[in] plan The anonymization to apply; must outlive this
+    /// module
+    /// @param[in] threads The number of worker threads
+    ParallelAnonymizer(DataSeriesModule *source,
+                       const AnonymizationPlan &plan,
+                       unsigned threads);
+    virtual ~ParallelAnonymizer();
+    virtual Extent::Ptr getSharedExtent();
+
+private:
+    /// Anonymizes or strips one extent; run by the pipeline's workers
+    Extent::Ptr anonymize(Extent::Ptr extent);
+    /// The pipeline's converter
+    struct Anonymize {
+        ParallelAnonymizer *self;
+        Extent::Ptr operator()(Extent::Ptr extent) const {
+            return self->anonymize(extent);
+        }
+    };
+
+    const AnonymizationPlan &_plan;
+    /// Runs anonymize() on the extents of the source
+    ExtentPipeline *_pipeline;
+    bool _started;
+
+    /// Protects everything below
+    pthread_mutex_t _lock;
+    /// ExtentAnonymizers not in use by a worker
+    std::vector<ExtentAnonymizer *> _idle;
+    /// All the ExtentAnonymizers created
+    std::vector<ExtentAnonymizer *> _anonymizers;
+    /// The types of the plan that showed up in the source
+    std::set<std::string> _matchedTypes;
+};
+
+#endif // PARALLELANONYMIZER_H
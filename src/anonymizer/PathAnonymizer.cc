@@ -9,9 +9,12 @@
 #include <sstream>
 
 PathAnonymizer::PathAnonymizer(Anonymizer *anonymizer,
-                               const std::string &pathSeparator) :
-    _anonymizer(anonymizer), _separator(pathSeparator)
+                               const std::string &pathSeparator,
+                               MemoCache *cache) :
+    _anonymizer(anonymizer), _separator(pathSeparator), _cache(cache)
 {
+    if (_cache)
+        _ns = _cache->getNamespace("path:" + _separator);
 }
 
 PathAnonymizer::~PathAnonymizer()
@@ -27,7 +30,15 @@ PathAnonymizer::anonymize(const std::string &inData)
     if (inData.size() == 0) {
         return inData;
     }
+    if (!_cache)
+        return anonymizePath(inData);
+    return _cache->get(_ns, inData.data(), inData.size(),
+                       [this, &inData]() { return anonymizePath(inData); });
+}
 
+std::string
+PathAnonymizer::anonymizePath(const std::string &inData)
+{
     StringList components = tokenize(inData, _separator[0]);
     std::ostringstream outPath;
     for (StringList::const_iterator i = components.begin();
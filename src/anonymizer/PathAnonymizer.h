@@ -8,22 +8,31 @@
 #define PATHANONYMIZER_H
 
 #include "Anonymizer.h"
+#include "MemoCache.h"
 
 /**
  * Anonymizer that anonymizes pathnames by splitting it into
  * components and using an Anonymizer on each component.
+ *
+ * If given a MemoCache, whole paths are looked up there before being
+ * split up.
  */
 class PathAnonymizer : public Anonymizer {
 public:
     PathAnonymizer(Anonymizer *anonymizer,
-                   const std::string &pathSeparator = "/");
+                   const std::string &pathSeparator = "/",
+                   MemoCache *cache = 0);
     ~PathAnonymizer();
 
     virtual std::string anonymize(const std::string &inData);
 
 protected:
+    std::string anonymizePath(const std::string &inData);
+
     Anonymizer *_anonymizer;
     std::string _separator;
+    MemoCache *_cache;
+    MemoCache::Namespace _ns;
 };
 
 #endif // PATHANONYMIZER_H
@@ -108,6 +108,13 @@ Masking example:
 
 Specifies the name of the DataSeries file to anonymize
 
+=item B<-j>, B<--threads=>I<Count>
+
+Number of threads anonymizing extents in parallel. All the
+anonymization operations on an extent are applied in a single pass
+over its rows, and extents are written out in their original
+order. Defaults to the number of online CPUs.
+
 =item B<-k>, B<--keyfile=>F<key_file>
 
 Specifies the name of a file from which to generate a key for use in
@@ -117,6 +124,23 @@ for all HMAC calculations. Using the same keyfile for multiple
 DataSeries files will cause the same cleartext to map to the same
 anonymized values.
 
+=item B<-M>, B<--cache_size=>I<MB>
+
+Size of the cache of anonymized values, in megabytes. Traces repeat
+the same file handles, names and paths many times, and the
+B<--filename_ext>, B<--fpe>, B<--hmac> and B<--pathname_ext>
+anonymizers look up values here before computing them. The hit rate
+and the estimated speedup are printed at the end. A size of 0
+disables the cache. Defaults to 1024.
+
+=item B<-m>, B<--cache=>F<cache_file>
+
+Keep the cache of anonymized values in a file, so it can be reused
+when anonymizing other files of the same trace set with the same
+key. The file holds no cleartext, only keyed hashes of it, and a
+file made with a different key is refused. An existing file keeps
+the size it was made with.
+
 =item B<-N>, B<--null=>I<ExtentName>,I<FieldName>
 
 For fields that are marked as "nullable," anonymize them by setting
@@ -179,17 +203,19 @@ All rights reserved.
 #include <iostream>
 #include <list>
 #include <string>
+#include <unistd.h>
 
 #include "AnonHelper.h"
+#include "AnonymizationPlan.h"
 #include "DataSeries/PrefetchBufferModule.hpp"
 #include "DataSeries/SequenceModule.hpp"
 #include "DataSeries/TypeIndexModule.hpp"
 #include "ConstAnonymizer.h"
-#include "ExtentStrip.h"
 #include "FileExtAnonymizer.h"
 #include "FpeAnonymizer.h"
 #include "IpAnonymizer.h"
-#include "NullAnonymizer.h"
+#include "MemoCache.h"
+#include "ParallelAnonymizer.h"
 #include "PathAnonymizer.h"
 
 typedef std::list<std::string> StringList;
@@ -198,11 +224,16 @@ std::string commandName;
 
 // The size of memory buffer for EACH buffer module
 static const unsigned BUFFER_SIZE = 128 * 1024 * 1024;
+// Default size of the memo cache, in MB
+static const unsigned DEFAULT_CACHE_MB = 1024;
 
 static const struct option OPTIONS[] = {
     {"help", no_argument, 0, 'h'},
     {"infile", required_argument, 0, 'i'},
+    {"threads", required_argument, 0, 'j'},
     {"keyfile", required_argument, 0, 'k'},
+    {"cache_size", required_argument, 0, 'M'},
+    {"cache", required_argument, 0, 'm'},
     {"outfile", required_argument, 0, 'o'},
     {"buffer", no_argument, 0, 'B'},
     {"constant", required_argument, 0, 'C'},
@@ -249,6 +280,12 @@ usage()
               << "anonymize a field via HMAC"
               << std::endl << "\t-I, --ipaddr=EXTENT,FIELD,BITS\t\t\t"
               << "mask off the top BITS of an IP address field"
+              << std::endl << "\t-j, --threads=COUNT\t\t\t\t"
+              << "anonymize with COUNT threads (default: # of CPUs)"
+              << std::endl << "\t-M, --cache_size=MB\t\t\t\t"
+              << "size of the cache of anonymized values (default: 1024, 0: none)"
+              << std::endl << "\t-m, --cache=FILE\t\t\t\t"
+              << "keep the cache of anonymized values in FILE for reuse"
               << std::endl << "\t-N, --null=EXTENT,FIELD\t\t\t\t"
               << "anonymize a (nullable) field by setting it to null"
               << std::endl << "\t-P, --pathname_ext=EXTENT,FIELD\t\t\t"
@@ -366,51 +403,50 @@ getCompressionMode(std::string arg)
 }
 
 static void
-addConstAnonymizer(SequenceModule *pipeline, std::string args)
+addConstAnonymizer(AnonymizationPlan *plan, std::string args)
 {
     StringList optionArgs = tokenize(args, ',');
     if (optionArgs.size() != 3)
         commandError("bad arguments for constant anonymizer");
-    std::string constant = optionArgs.back();
-    Anonymizer *anonymizer = new ConstAnonymizer(std::stoull(constant));
-    pipeline->addModule(new GenericFieldAnonymizer(&pipeline->tail(),
-                                                   gAndP(optionArgs),
-                                                   gAndP(optionArgs),
-                                                   anonymizer));
+    std::string extent = gAndP(optionArgs);
+    std::string field = gAndP(optionArgs);
+    int64_t constant = std::stoull(gAndP(optionArgs));
+    plan->addField(extent, field, [constant]() -> Anonymizer * {
+            return new ConstAnonymizer(constant);
+        });
 }
 
 static void
-addFileExtAnonymizer(SequenceModule *pipeline, std::string args,
-                     std::string keyfile)
+addFileExtAnonymizer(AnonymizationPlan *plan, std::string args,
+                     std::string keyfile, MemoCache *cache)
 {
     StringList optionArgs = tokenize(args, ',');
     if (optionArgs.size() != 2)
         commandError("bad arguments for file_ext anonymizer");
-    Anonymizer *hasher = new HashAnonymizer(keyfile);
-    Anonymizer *anonymizer = new FileExtAnonymizer(hasher);
-    pipeline->addModule(new GenericFieldAnonymizer(&pipeline->tail(),
-                                                   gAndP(optionArgs),
-                                                   gAndP(optionArgs),
-                                                   anonymizer));
+    std::string extent = gAndP(optionArgs);
+    std::string field = gAndP(optionArgs);
+    plan->addField(extent, field, [keyfile, cache]() -> Anonymizer * {
+            return new FileExtAnonymizer(new HashAnonymizer(keyfile), cache);
+        });
 }
 
 static void
-addHmacAnonymizer(SequenceModule *pipeline, std::string args,
-                  std::string keyfile)
+addHmacAnonymizer(AnonymizationPlan *plan, std::string args,
+                  std::string keyfile, MemoCache *cache)
 {
     StringList optionArgs = tokenize(args, ',');
     if (optionArgs.size() != 2)
         commandError("bad arguments for HMAC anonymizer");
-    Anonymizer *anonymizer = new HashAnonymizer(keyfile);
-    pipeline->addModule(new GenericFieldAnonymizer(&pipeline->tail(),
-                                                   gAndP(optionArgs),
-                                                   gAndP(optionArgs),
-                                                   anonymizer));
+    std::string extent = gAndP(optionArgs);
+    std::string field = gAndP(optionArgs);
+    plan->addField(extent, field, [keyfile, cache]() -> Anonymizer * {
+            return new HashAnonymizer(keyfile, cache);
+        });
 }
 
 static void
-addFpeAnonymizer(SequenceModule *pipeline, std::string args,
-                 std::string keyfile)
+addFpeAnonymizer(AnonymizationPlan *plan, std::string args,
+                 std::string keyfile, MemoCache *cache)
 {
     StringList optionArgs = tokenize(args, ',');
     if (optionArgs.size() != 3)
@@ -418,63 +454,59 @@ addFpeAnonymizer(SequenceModule *pipeline, std::string args,
     std::string extent = gAndP(optionArgs);
     std::string field = gAndP(optionArgs);
     std::string tweak = gAndP(optionArgs);
-    Anonymizer *anonymizer = new FpeAnonymizer(keyfile,
-                                               tweak);
-    pipeline->addModule(new GenericFieldAnonymizer(&pipeline->tail(),
-                                                   extent,
-                                                   field,
-                                                   anonymizer));
+    plan->addField(extent, field, [keyfile, tweak, cache]() -> Anonymizer * {
+            return new FpeAnonymizer(keyfile, tweak, cache);
+        });
 }
 
 static void
-addIpAnonymizer(SequenceModule *pipeline, std::string args)
+addIpAnonymizer(AnonymizationPlan *plan, std::string args)
 {
     StringList optionArgs = tokenize(args, ',');
     if (optionArgs.size() != 3)
         commandError("bad arguments for IP anonymizer");
-    std::string mask = optionArgs.back();
-    Anonymizer *anonymizer = new IpAnonymizer(std::stoul(mask));
-    pipeline->addModule(new GenericFieldAnonymizer(&pipeline->tail(),
-                                                   gAndP(optionArgs),
-                                                   gAndP(optionArgs),
-                                                   anonymizer));
+    std::string extent = gAndP(optionArgs);
+    std::string field = gAndP(optionArgs);
+    unsigned mask = std::stoul(gAndP(optionArgs));
+    plan->addField(extent, field, [mask]() -> Anonymizer * {
+            return new IpAnonymizer(mask);
+        });
 }
 
 static void
-addNullAnonymizer(SequenceModule *pipeline, std::string args)
+addNullAnonymizer(AnonymizationPlan *plan, std::string args)
 {
     StringList optionArgs = tokenize(args, ',');
     if (optionArgs.size() != 2)
         commandError("bad arguments for null anonymizer");
-    pipeline->addModule(new NullAnonymizer(&pipeline->tail(),
-                                           gAndP(optionArgs),
-                                           gAndP(optionArgs)));
+    std::string extent = gAndP(optionArgs);
+    std::string field = gAndP(optionArgs);
+    plan->addNull(extent, field);
 }
 
 static void
-addPathExtAnonymizer(SequenceModule *pipeline, std::string args,
-                     std::string keyfile)
+addPathExtAnonymizer(AnonymizationPlan *plan, std::string args,
+                     std::string keyfile, MemoCache *cache)
 {
     StringList optionArgs = tokenize(args, ',');
     if (optionArgs.size() != 2)
         commandError("bad arguments for file_ext anonymizer");
-    Anonymizer *hasher = new HashAnonymizer(keyfile);
-    Anonymizer *fanon = new FileExtAnonymizer(hasher);
-    Anonymizer *anonymizer = new PathAnonymizer(fanon);
-    pipeline->addModule(new GenericFieldAnonymizer(&pipeline->tail(),
-                                                   gAndP(optionArgs),
-                                                   gAndP(optionArgs),
-                                                   anonymizer));
+    std::string extent = gAndP(optionArgs);
+    std::string field = gAndP(optionArgs);
+    plan->addField(extent, field, [keyfile, cache]() -> Anonymizer * {
+            Anonymizer *fanon = new FileExtAnonymizer(new HashAnonymizer(keyfile),
+                                                      cache);
+            return new PathAnonymizer(fanon, "/", cache);
+        });
 }
 
 static void
-addStripAnonymizer(SequenceModule *pipeline, std::string args)
+addStripAnonymizer(AnonymizationPlan *plan, std::string args)
 {
     StringList optionArgs = tokenize(args, ',');
     if (optionArgs.size() != 1)
         commandError("bad arguments for strip anonymizer");
-    pipeline->addModule(new ExtentStrip(&pipeline->tail(),
-                                        gAndP(optionArgs)));
+    plan->addStrip(gAndP(optionArgs));
 }
 
 std::pair<std::string, std::string>
@@ -489,11 +521,15 @@ main(int argc, char *argv[])
     commandName = argv[0];
 
     TypeIndexModule *source = new TypeIndexModule();
-    // Sequence of anonymization modules we will be using
+    // Source, buffers, and the anonymization module at the end
     SequenceModule *pipeline = new SequenceModule(source);
+    AnonymizationPlan plan;
+    unsigned threads = sysconf(_SC_NPROCESSORS_ONLN);
     StringList infileNames;
     std::string outfileName;
     std::string keyfileName;
+    std::string cacheFileName;
+    unsigned cacheMB = DEFAULT_CACHE_MB;
     int compressionMode = Extent::compress_all;
     std::list<std::pair<std::string, std::string> > moduleList;
 
@@ -530,9 +566,18 @@ main(int argc, char *argv[])
         case 'i':
             infileNames.push_back(std::string(optarg));
             break;
+        case 'j':
+            threads = std::stoul(optarg);
+            break;
         case 'k':
             keyfileName = optarg;
             break;
+        case 'M':
+            cacheMB = std::stoul(optarg);
+            break;
+        case 'm':
+            cacheFileName = optarg;
+            break;
         case 'o':
             outfileName = optarg;
             break;
@@ -561,29 +606,39 @@ main(int argc, char *argv[])
     if (keyfileName == "") {
         commandError("Missing key file argument");
     }
+    if (threads == 0) {
+        commandError("Need at least one thread");
+    }
+
+    MemoCache *cache = 0;
+    if (cacheMB)
+        cache = new MemoCache(keyfileName, size_t(cacheMB) << 20,
+                              cacheFileName);
 
-    // add the modules to the pipeline
+    // compile the operations into a single anonymization plan
     for (std::list<std::pair<std::string, std::string> >::const_iterator i =
              moduleList.begin(); i != moduleList.end(); ++i) {
         if (i->first == "const")
-            addConstAnonymizer(pipeline, i->second);
+            addConstAnonymizer(&plan, i->second);
         else if (i->first == "null")
-            addNullAnonymizer(pipeline, i->second);
+            addNullAnonymizer(&plan, i->second);
         else if (i->first == "file_ext")
-            addFileExtAnonymizer(pipeline, i->second, keyfileName);
+            addFileExtAnonymizer(&plan, i->second, keyfileName, cache);
         else if (i->first == "fpe")
-            addFpeAnonymizer(pipeline, i->second, keyfileName);
+            addFpeAnonymizer(&plan, i->second, keyfileName, cache);
         else if (i->first == "hmac")
-            addHmacAnonymizer(pipeline, i->second, keyfileName);
+            addHmacAnonymizer(&plan, i->second, keyfileName, cache);
         else if (i->first == "ip")
-            addIpAnonymizer(pipeline, i->second);
+            addIpAnonymizer(&plan, i->second);
         else if (i->first == "path_ext")
-            addPathExtAnonymizer(pipeline, i->second, keyfileName);
+            addPathExtAnonymizer(&plan, i->second, keyfileName, cache);
         else if (i->first == "strip")
-            addStripAnonymizer(pipeline, i->second);
+            addStripAnonymizer(&plan, i->second);
         else
             assert("unknown module type" && 0);
     }
+    pipeline->addModule(new ParallelAnonymizer(&pipeline->tail(), plan,
+                                               threads));
 
     DataSeriesSink *sink = new DataSeriesSink(outfileName, compressionMode);
     sink->setMaxBytesInProgress(8 * BUFFER_SIZE);
@@ -616,6 +671,10 @@ main(int argc, char *argv[])
     delete sink;
 
     stats.printText(std::cout);
+    if (cache) {
+        cache->printStats(std::cout);
+        delete cache;
+    }
 
     return EXIT_SUCCESS;
 }
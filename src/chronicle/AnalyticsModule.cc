@@ -4,26 +4,96 @@
  * All rights reserved.
  */
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
 #include <stdexcept>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "FDWatcher.h"
 #include "Chronicle.h"
 #include "ChronicleConfig.h"
 #include "Message.h"
 #include "AnalyticsModule.h"
 #include "RpcParser.h"
 #include "StatGatherer.h"
+#include "RpcLatencyModule.h"
+#include "HeavyHittersModule.h"
+#include "CardinalityModule.h"
+#include "IoPatternModule.h"
+#include "AnalyticsModuleFactory.h"
 #include "PcapPacketBufferPool.h"
+#include "StageTracer.h"
 
 AnalyticsManager::Nfs3OperationCounts AnalyticsManager::nfs3OpCounts;
 
+/// the seconds between the manager's ticks
+static const int TICK_INTERVAL = 1;
+
+/// returns the monotonic time in seconds (for the deadlines)
+static time_t
+monotonicTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+class AnalyticsModule::MsgBase : public Message {
+	protected:
+		AnalyticsModule *_module;
+
+	public:
+		MsgBase(AnalyticsModule *module) : _module(module) { }
+		virtual ~MsgBase() { }
+};
+
+class AnalyticsModule::MsgCombine : public MsgBase {
+	private:
+		AnalyticsPartial *_partial;
+		time_t _intervalEnd;
+		uint32_t _shard;
+
+	public:
+		MsgCombine(AnalyticsModule *module, AnalyticsPartial *partial,
+			time_t intervalEnd, uint32_t shard) 
+			: MsgBase(module), _partial(partial), _intervalEnd(intervalEnd),
+			_shard(shard) { }
+		void run() { _module->doCombine(_partial, _intervalEnd, _shard); }
+};
+
+class AnalyticsModule::MsgTick : public MsgBase {
+	private:
+		time_t _now;
+
+	public:
+		MsgTick(AnalyticsModule *module, time_t now) 
+			: MsgBase(module), _now(now) { }
+		void run() { _module->doTick(_now); }
+};
+
+class AnalyticsModule::MsgShutdown : public MsgBase {
+	private:
+		ChronicleSource *_src;
+
+	public:
+		MsgShutdown(AnalyticsModule *module, ChronicleSource *src) 
+			: MsgBase(module), _src(src) { }
+		void run() { _module->doShutdown(_src); }
+};
+
 AnalyticsModule::AnalyticsModule(std::string name, AnalyticsManager *manager,
 	std::string command, int id, int interval)
-	: Process(name), _manager(manager), _command(command), _id(id), 
-	_interval(interval)
+	: Process(name), _manager(manager), _command(command), _aggregate(NULL),
+	_intervalEnd(0), _id(id), _interval(interval > 0 ? interval : 1),
+	_shardDone(manager ? manager->getNumShards() : 1, 0), _lastReported(0),
+	_latePartials(0)
 {
 	char buf[30];
 	struct tm *statTm;
 	std::ostringstream fileName;
-	_bufPool = PcapPacketBufferPool::registerBufferPool();
 	if (traceDirectory[traceDirectory.size() - 1] == '/')
 		traceDirectory.resize(traceDirectory.size() - 1);
 	fileName << traceDirectory << "/" << processName() << "-"
@@ -36,17 +106,274 @@ AnalyticsModule::AnalyticsModule(std::string name, AnalyticsManager *manager,
 	strftime(buf, sizeof(buf), "%D-%T", statTm);
 	std::string curTime(buf);
 	_output << curTime << " "<< _command << " " << std::endl;
-	_reportTime = _startTime + _interval;
 }
 
 AnalyticsModule::~AnalyticsModule()
 {
+	for (std::map<time_t, Interval>::iterator it = _intervals.begin();
+			it != _intervals.end(); it++)
+		delete it->second.aggregate;
 	_output << std::endl;
 	_output.close();
 }
 
 void
-AnalyticsModule::releasePdu(PduDescriptor *pduDesc)
+AnalyticsModule::combine(AnalyticsPartial *partial, time_t intervalEnd,
+	uint32_t shard)
+{
+	enqueueMessage(new MsgCombine(this, partial, intervalEnd, shard));
+}
+
+void
+AnalyticsModule::doCombine(AnalyticsPartial *partial, time_t intervalEnd,
+	uint32_t shard)
+{
+	time_t now = monotonicTime();
+	if (shard < _shardDone.size() && intervalEnd > _shardDone[shard])
+		_shardDone[shard] = intervalEnd;
+	if (intervalEnd <= _lastReported) {
+		// a shard that was too far behind: the interval has been reported 
+		// already, and merging into a later one would misattribute it
+		_latePartials++;
+		delete partial;
+	} else {
+		std::map<time_t, Interval>::iterator it = 
+			_intervals.find(intervalEnd);
+		if (it == _intervals.end()) {
+			// idle or lagging shards get one more interval to catch up
+			Interval &interval = _intervals[intervalEnd];
+			interval.aggregate = partial;
+			interval.deadline = now + _interval;
+		} else {
+			it->second.aggregate->merge(partial);
+			delete partial;
+		}
+	}
+	closeIntervals(now, false);
+}
+
+void
+AnalyticsModule::tick(time_t now)
+{
+	enqueueMessage(new MsgTick(this, now));
+}
+
+void
+AnalyticsModule::doTick(time_t now)
+{
+	closeIntervals(now, false);
+}
+
+void
+AnalyticsModule::closeIntervals(time_t now, bool all)
+{
+	// the shards hand over their partials in order, so once every shard 
+	// has handed over an interval, no more partials can arrive for it
+	time_t done = *std::min_element(_shardDone.begin(), _shardDone.end());
+	while (!_intervals.empty()) {
+		std::map<time_t, Interval>::iterator it = _intervals.begin();
+		if (!all && it->first > done && now < it->second.deadline)
+			break;
+		finishInterval(it->first, it->second.aggregate);
+		_intervals.erase(it);
+	}
+}
+
+void
+AnalyticsModule::finishInterval(time_t intervalEnd, 
+	AnalyticsPartial *aggregate)
+{
+	struct timeval ts;
+	_aggregate = aggregate;
+	_intervalEnd = _lastReported = intervalEnd;
+	ts.tv_sec = _intervalEnd;
+	ts.tv_usec = 0;
+	report(ts);
+	delete _aggregate;
+	_aggregate = NULL;
+}
+
+void
+AnalyticsModule::shutdown(ChronicleSource *src)
+{
+	enqueueMessage(new MsgShutdown(this, src));
+}
+
+void
+AnalyticsModule::doShutdown(ChronicleSource *src)
+{
+	// the shards have already handed over their last partials
+	closeIntervals(monotonicTime(), true);
+	_manager->shutdownDone(this);
+	exit();
+}
+
+const char *
+AnalyticsModule::getNfs3ProcName(uint32_t proc)
+{
+	static const char *names[NUM_NFS3_PROCS] = {
+		"null", "getattr", "setattr", "lookup", "access", "readlink", "read",
+		"write", "create", "mkdir", "symlink", "mknod", "remove", "rmdir",
+		"rename", "link", "readdir", "readdirplus", "fsstat", "fsinfo",
+		"pathconf", "commit"
+	};
+	return proc < NUM_NFS3_PROCS ? names[proc] : "other";
+}
+
+std::string 
+AnalyticsModule::getTime(struct timeval ts)
+{
+	char buf[30];
+	time_t statTime = ts.tv_sec;
+	struct tm *statTm = localtime(&statTime);
+	strftime(buf, sizeof(buf), "%D-%T", statTm);
+	std::string curTime(buf);
+	return curTime;
+}
+
+class AnalyticsShard::MsgBase : public Message {
+	protected:
+		AnalyticsShard *_shard;
+
+	public:
+		MsgBase(AnalyticsShard *shard) : _shard(shard) { }
+		virtual ~MsgBase() { }
+};
+
+class AnalyticsShard::MsgProcessRequest : public MsgBase {
+	private:
+		PduDescriptor *_pduDesc;
+
+	public:
+		MsgProcessRequest(AnalyticsShard *shard, PduDescriptor *pduDesc) 
+			: MsgBase(shard), _pduDesc(pduDesc) { }
+		void run() { _shard->doProcessRequest(_pduDesc); }
+};
+
+class AnalyticsShard::MsgAddModule : public MsgBase {
+	private:
+		AnalyticsModule *_module;
+
+	public:
+		MsgAddModule(AnalyticsShard *shard, AnalyticsModule *module) 
+			: MsgBase(shard), _module(module) { }
+		void run() { _shard->doAddModule(_module); }
+};
+
+class AnalyticsShard::MsgRemoveModule : public MsgBase {
+	private:
+		AnalyticsModule *_module;
+
+	public:
+		MsgRemoveModule(AnalyticsShard *shard, AnalyticsModule *module) 
+			: MsgBase(shard), _module(module) { }
+		void run() { _shard->doRemoveModule(_module); }
+};
+
+class AnalyticsShard::MsgShutdown : public MsgBase {
+	private:
+		ChronicleSource *_src;
+
+	public:
+		MsgShutdown(AnalyticsShard *shard, ChronicleSource *src) 
+			: MsgBase(shard), _src(src) { }
+		void run() { _shard->doShutdown(_src); }
+};
+
+class AnalyticsShard::MsgTick : public MsgBase {
+	private:
+		time_t _now;
+
+	public:
+		MsgTick(AnalyticsShard *shard, time_t now) 
+			: MsgBase(shard), _now(now) { }
+		void run() { _shard->doTick(_now); }
+};
+
+AnalyticsShard::AnalyticsShard(AnalyticsManager *manager, uint32_t id)
+	: Process("AnalyticsShard"), _manager(manager), _id(id)
+{
+	_bufPool = PcapPacketBufferPool::registerBufferPool();
+}
+
+AnalyticsShard::~AnalyticsShard()
+{
+	for (std::list<ModuleState>::iterator it = _modules.begin(); 
+			it != _modules.end(); it++)
+		delete it->partial;
+	if (_bufPool && _bufPool->unregisterBufferPool()) 
+		delete _bufPool;
+}
+
+void
+AnalyticsShard::processRequest(ChronicleSource *src, PduDescriptor *pduDesc)
+{
+	PacketBufferPool::handOver(pduDesc, PacketBufferPool::HOLDER_ANALYTICS);
+	enqueueMessage(new MsgProcessRequest(this, pduDesc));
+}
+
+void
+AnalyticsShard::doProcessRequest(PduDescriptor *pduDesc)
+{
+	std::list<ModuleState>::iterator it;
+	StageTracer::stamp(pduDesc, StageTracer::STAGE_ANALYTICS);
+	for (PduDescriptor *desc = pduDesc; desc != NULL; desc = desc->next) {
+		time_t sec = desc->firstPktDesc->pcapHeader.ts.tv_sec;
+		for (it = _modules.begin(); it != _modules.end(); it++) {
+			if (it->partial == NULL || sec >= it->intervalEnd) {
+				// intervals are aligned across the shards by packet time;
+				// without traffic, the partial is handed over by the 
+				// (monotonic) time the interval ends, plus a tick
+				int interval = it->module->getInterval();
+				if (it->partial)
+					handOverPartial(*it);
+				else
+					it->partial = it->module->newPartial();
+				it->intervalEnd = (sec / interval + 1) * interval;
+				it->deadline = monotonicTime() + (it->intervalEnd - sec) 
+					+ TICK_INTERVAL;
+			} else if (it->deadline == 0) {
+				// a late PDU of the interval the tick handed over
+				it->deadline = monotonicTime() + TICK_INTERVAL;
+			}
+			it->partial->update(desc);
+		}
+	}
+	releasePdu(pduDesc);
+}
+
+void
+AnalyticsShard::handOverPartial(ModuleState &state)
+{
+	AnalyticsPartial *next = state.module->newPartial();
+	state.partial->handOver(next);
+	if (state.deadline)
+		state.module->combine(state.partial, state.intervalEnd, _id);
+	else
+		delete state.partial; // nothing new since the tick handed it over
+	state.partial = next;
+	state.deadline = 0;
+}
+
+void
+AnalyticsShard::tick(time_t now)
+{
+	enqueueMessage(new MsgTick(this, now));
+}
+
+void
+AnalyticsShard::doTick(time_t now)
+{
+	std::list<ModuleState>::iterator it;
+	for (it = _modules.begin(); it != _modules.end(); it++) {
+		// the state that outlives the interval stays with the shard
+		if (it->partial && it->deadline && now >= it->deadline)
+			handOverPartial(*it);
+	}
+}
+
+void
+AnalyticsShard::releasePdu(PduDescriptor *pduDesc)
 {
 	PduDescriptor *tmpPduDesc;
 	PacketDescriptor *pktDesc, *oldPktDesc;
@@ -55,7 +382,7 @@ AnalyticsModule::releasePdu(PduDescriptor *pduDesc)
 		do {
 			oldPktDesc = pktDesc;
 			pktDesc = pktDesc->next;
-			_bufPool->releasePacketDescriptor(oldPktDesc);
+			_bufPool->releasePduPacket(pduDesc, oldPktDesc);
 		} while (oldPktDesc != pduDesc->lastPktDesc);
 		tmpPduDesc = pduDesc;
 		pduDesc = pduDesc->next;
@@ -64,25 +391,66 @@ AnalyticsModule::releasePdu(PduDescriptor *pduDesc)
 	}
 }
 
-bool
-AnalyticsModule::timeToReport(struct timeval ts)
+void
+AnalyticsShard::addModule(AnalyticsModule *module)
 {
-	if (ts.tv_sec > _reportTime) {
-		_reportTime = ts.tv_sec + _interval;
-		return true;
+	enqueueMessage(new MsgAddModule(this, module));
+}
+
+void
+AnalyticsShard::doAddModule(AnalyticsModule *module)
+{
+	_modules.push_back(ModuleState(module));
+}
+
+void
+AnalyticsShard::removeModule(AnalyticsModule *module)
+{
+	enqueueMessage(new MsgRemoveModule(this, module));
+}
+
+void
+AnalyticsShard::doRemoveModule(AnalyticsModule *module)
+{
+	std::list<ModuleState>::iterator it;
+	for (it = _modules.begin(); it != _modules.end(); it++) {
+		if (it->module != module)
+			continue;
+		if (it->partial) {
+			it->partial->handOver(NULL);
+			if (it->deadline)
+				it->module->combine(it->partial, it->intervalEnd, _id);
+			else
+				delete it->partial;
+		}
+		_modules.erase(it);
+		break;
 	}
-	return false;
+	_manager->moduleRemoved(module);
 }
 
-std::string 
-AnalyticsModule::getTime(struct timeval ts)
+void
+AnalyticsShard::shutdown(ChronicleSource *src)
 {
-	char buf[30];
-	time_t statTime = ts.tv_sec;
-	struct tm *statTm = localtime(&statTime);
-	strftime(buf, sizeof(buf), "%D-%T", statTm);
-	std::string curTime(buf);
-	return curTime;
+	enqueueMessage(new MsgShutdown(this, src));
+}
+
+void
+AnalyticsShard::doShutdown(ChronicleSource *src)
+{
+	std::list<ModuleState>::iterator it;
+	for (it = _modules.begin(); it != _modules.end(); it++) {
+		if (it->partial) {
+			it->partial->handOver(NULL);
+			if (it->deadline)
+				it->module->combine(it->partial, it->intervalEnd, _id);
+			else
+				delete it->partial;
+			it->partial = NULL;
+		}
+	}
+	_manager->shutdownDone(this);
+	exit();
 }
 
 class AnalyticsManager::MsgBase : public Message {
@@ -94,16 +462,6 @@ class AnalyticsManager::MsgBase : public Message {
 		virtual ~MsgBase() { }
 };
 
-class AnalyticsManager::MsgProcessRequest : public MsgBase {
-	private:
-		PduDescriptor *_pduDesc;
-	
-	public:
-		MsgProcessRequest(AnalyticsManager *manager, PduDescriptor *pduDesc) 
-			: MsgBase(manager), _pduDesc(pduDesc) { }
-		void run() { _manager->doProcessRequest(_pduDesc); }		
-};
-
 class AnalyticsManager::MsgProcessCommand : public MsgBase {
 	private:
 		std::list<std::string> _command;
@@ -151,47 +509,115 @@ class AnalyticsManager::MsgGetStats : public MsgBase {
 		void run() { _manager->doHandleGetStats(_sg); }
 };
 
+class AnalyticsManager::MsgModuleRemoved : public MsgBase {
+	private:
+		AnalyticsModule *_module;
+
+	public:
+		MsgModuleRemoved(AnalyticsManager *manager, AnalyticsModule *module)
+			: MsgBase(manager), _module(module) {}
+		void run() { _manager->doModuleRemoved(_module); }
+};
+
+class AnalyticsManager::MsgPublishStats : public MsgBase {
+	private:
+		std::map<std::string, int64_t> _stats;
+
+	public:
+		MsgPublishStats(AnalyticsManager *manager, 
+			const std::map<std::string, int64_t> &stats)
+			: MsgBase(manager), _stats(stats) {}
+		void run() { _manager->doPublishStats(_stats); }
+};
+
+class AnalyticsManager::MsgTick : public MsgBase {
+	public:
+		MsgTick(AnalyticsManager *manager) : MsgBase(manager) { }
+		void run() { _manager->doTick(); }
+};
+
+class AnalyticsManager::TickCb : public FDWatcher::FdCallback {
+	private:
+		AnalyticsManager *_manager;
+
+	public:
+		TickCb(AnalyticsManager *manager) : _manager(manager) { }
+		void operator() (int fd, FDWatcher::Events event) {
+			_manager->tick();
+		}
+};
+
 AnalyticsManager::AnalyticsManager(Chronicle *supervisor, bool analyticsEnabled,
-	time_t ts) 
-	: Process("AnalyticsManager"), _supervisor(supervisor), 
-	_enabled(analyticsEnabled), _shutdown(false), _timestamp(ts)
+	time_t ts, uint32_t numShards) 
+	: Process("AnalyticsManager"), _supervisor(supervisor), _killedShards(0),
+	_enabled(analyticsEnabled), _shutdown(false), _timestamp(ts), 
+	_tickCb(new TickCb(this))
 {
-	_numModules = _killedModules = _moduleId = 0;
+	_numModules = _moduleId = 0;
 	_bufPool = PcapPacketBufferPool::registerBufferPool();
 	if (_bufPool == NULL)
 		_supervisor->startShutdown();
+	if (numShards == 0)
+		numShards = 1;
+	for (uint32_t i = 0; i < numShards; i++)
+		_shards.push_back(new AnalyticsShard(this, i));
+	// the ticks report the intervals even when there is no traffic
+	struct itimerspec period;
+	period.it_interval.tv_sec = period.it_value.tv_sec = TICK_INTERVAL;
+	period.it_interval.tv_nsec = period.it_value.tv_nsec = 0;
+	_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (_timerFd < 0 || timerfd_settime(_timerFd, 0, &period, NULL) < 0) {
+		perror("AnalyticsManager: timerfd");
+		_supervisor->startShutdown();
+	} else
+		watchTimer();
+	registerModule("rpclatency", 
+		new AnalyticsModuleFactoryT<RpcLatencyModule>());
+	registerModule("heavyhitters", 
+		new AnalyticsModuleFactoryT<HeavyHittersModule>());
+	registerModule("cardinality", 
+		new AnalyticsModuleFactoryT<CardinalityModule>());
+	registerModule("iopattern", 
+		new AnalyticsModuleFactoryT<IoPatternModule>());
+	// -a starts all the modules; others can be started at runtime
+	if (_enabled) {
+		std::map<std::string, AnalyticsModuleFactory *>::iterator it;
+		for (it = _factories.begin(); it != _factories.end(); it++) {
+			std::list<std::string> args;
+			startModule(it->first, args);
+		}
+	}
 }
 
 AnalyticsManager::~AnalyticsManager()
 {
-
+	std::map<std::string, AnalyticsModuleFactory *>::iterator it;
+	for (it = _factories.begin(); it != _factories.end(); it++)
+		delete it->second;
+	if (_timerFd >= 0)
+		close(_timerFd);
+	delete _tickCb;
+	if (_bufPool && _bufPool->unregisterBufferPool()) 
+		delete _bufPool;
 }
 
-void 
-AnalyticsManager::processRequest(ChronicleSource *src, PduDescriptor *pduDesc)
+void
+AnalyticsManager::registerModule(std::string name, 
+	AnalyticsModuleFactory *factory)
 {
-	enqueueMessage(new MsgProcessRequest(this, pduDesc));
+	delete _factories[name];
+	_factories[name] = factory;
 }
 
 void
-AnalyticsManager::doProcessRequest(PduDescriptor *pduDesc)
-{	
-	PduDescriptor *tmpPduDesc;
-	PacketDescriptor *pktDesc, *oldPktDesc;
-	// analytics is not enabled as part of this release
-	// releasing packet and PDU descriptors
-	while (pduDesc) {
-		pktDesc = pduDesc->firstPktDesc;
-		do {
-			oldPktDesc = pktDesc;
-			pktDesc = pktDesc->next;
-			_bufPool->releasePacketDescriptor(oldPktDesc);
-		} while (oldPktDesc != pduDesc->lastPktDesc);	
-		tmpPduDesc = pduDesc;
-		pduDesc = pduDesc->next;
-		delete tmpPduDesc;
-	}
-	return ;
+AnalyticsManager::addModule(AnalyticsModule *module, const std::string &name)
+{
+	// the module was created with _moduleId as its id
+	_moduleNames[_moduleId] = name;
+	_modules[_moduleId++] = module;
+	_numModules++;
+	for (uint32_t i = 0; i < _shards.size(); i++)
+		_shards[i]->addModule(module);
 }
 
 void
@@ -277,10 +703,169 @@ AnalyticsManager::processCommand(std::list<std::string> command)
 	enqueueMessage(new MsgProcessCommand(this, command));
 }
 
+/**
+ * parses the id of a module in an analytics command
+ * @returns false (after printing an error) if arg isn't a valid id
+ */
+static bool
+parseModuleId(const std::string &arg, int *id)
+{
+	char *end;
+	errno = 0;
+	long value = strtol(arg.c_str(), &end, 10);
+	if (arg.empty() || *end != '\0' || errno == ERANGE || value < 0 
+			|| value > INT_MAX) {
+		fprintf(stderr, FONT_RED "AnalyticsManager: invalid module id %s\n"
+			FONT_DEFAULT, arg.c_str());
+		return false;
+	}
+	*id = value;
+	return true;
+}
+
 void
 AnalyticsManager::doProcessCommand(std::list<std::string> command)
 {
+	if (command.empty() || _shutdown) {
+		usage();
+		return ;
+	}
+	std::string op = command.front();
+	command.pop_front();
+	if (!op.compare("LIST") && command.empty()) {
+		std::map<std::string, AnalyticsModuleFactory *>::iterator f;
+		printf("analytics modules:");
+		for (f = _factories.begin(); f != _factories.end(); f++)
+			printf(" %s", f->first.c_str());
+		printf("\nrunning:\n");
+		std::map<int, AnalyticsModule *>::iterator it;
+		for (it = _modules.begin(); it != _modules.end(); it++)
+			printf("\t%d %s interval=%d \"%s\" -> %s\n", it->first, 
+				_moduleNames[it->first].c_str(), it->second->getInterval(),
+				it->second->getCommand().c_str(), 
+				it->second->getOutputFile().c_str());
+		fflush(stdout);
+	} else if (!op.compare("START") && !command.empty()) {
+		std::string name = command.front();
+		command.pop_front();
+		int id = startModule(name, command);
+		if (id >= 0)
+			printf("analytics module %s started as %d\n", name.c_str(), id);
+	} else if (!op.compare("STOP") && command.size() == 1) {
+		int id;
+		if (parseModuleId(command.front(), &id))
+			stopModule(id);
+	} else if (!op.compare("CONFIG") && !command.empty()) {
+		// a module is reconfigured by replacing it
+		int id;
+		if (!parseModuleId(command.front(), &id))
+			return ;
+		command.pop_front();
+		if (_modules.find(id) == _modules.end()) {
+			fprintf(stderr, FONT_RED "AnalyticsManager: no module %d\n" 
+				FONT_DEFAULT, id);
+			return ;
+		}
+		// the new arguments override the module's current ones
+		std::map<std::string, std::string> args;
+		std::list<std::string>::iterator arg;
+		for (arg = _moduleArgs[id].begin(); arg != _moduleArgs[id].end(); 
+				arg++)
+			args[arg->substr(0, arg->find('='))] = *arg;
+		for (arg = command.begin(); arg != command.end(); arg++)
+			args[arg->substr(0, arg->find('='))] = *arg;
+		command.clear();
+		for (std::map<std::string, std::string>::iterator it = args.begin();
+				it != args.end(); it++)
+			command.push_back(it->second);
+		std::string name = _moduleNames[id];
+		int newId = startModule(name, command);
+		if (newId < 0)
+			return ;
+		stopModule(id);
+		printf("analytics module %d (%s) replaced by %d\n", id, name.c_str(),
+			newId);
+	} else
+		usage();
+}
 
+int
+AnalyticsManager::startModule(const std::string &name, 
+	std::list<std::string> &args)
+{
+	std::map<std::string, AnalyticsModuleFactory *>::iterator factory =
+		_factories.find(name);
+	if (factory == _factories.end()) {
+		fprintf(stderr, FONT_RED "AnalyticsManager: unknown module %s\n" 
+			FONT_DEFAULT, name.c_str());
+		return -1;
+	}
+	int interval = ANALYTICS_DEFAULT_INTERVAL;
+	AnalyticsModule::Params params;
+	std::string command(name);
+	for (std::list<std::string>::iterator it = args.begin(); 
+			it != args.end(); it++) {
+		size_t eq = it->find('=');
+		if (eq == std::string::npos || eq == 0) {
+			usage();
+			return -1;
+		}
+		std::string key = it->substr(0, eq);
+		if (!key.compare("interval"))
+			interval = atoi(it->substr(eq + 1).c_str());
+		else
+			params[key] = it->substr(eq + 1);
+		command += " " + *it;
+	}
+	AnalyticsModule *module = NULL;
+	if (interval > 0)
+		module = factory->second->newModule(this, command, _moduleId, 
+			interval, params);
+	if (module == NULL) {
+		std::string usage = factory->second->getUsage();
+		fprintf(stderr, FONT_RED "AnalyticsManager: invalid parameters for "
+			"%s (interval=seconds%s%s)\n" FONT_DEFAULT, name.c_str(), 
+			usage.empty() ? "" : " ", usage.c_str());
+		return -1;
+	}
+	int id = _moduleId;
+	addModule(module, name);
+	_moduleArgs[id] = args;
+	return id;
+}
+
+void
+AnalyticsManager::stopModule(int id)
+{
+	std::map<int, AnalyticsModule *>::iterator it = _modules.find(id);
+	if (it == _modules.end()) {
+		fprintf(stderr, FONT_RED "AnalyticsManager: no module %d\n" 
+			FONT_DEFAULT, id);
+		return ;
+	}
+	// the shards hand over their last partials before the module stops
+	AnalyticsModule *module = it->second;
+	_stoppingModules[module] = _shards.size();
+	_modules.erase(it);
+	_moduleNames.erase(id);
+	_moduleArgs.erase(id);
+	for (uint32_t i = 0; i < _shards.size(); i++)
+		_shards[i]->removeModule(module);
+}
+
+void
+AnalyticsManager::moduleRemoved(AnalyticsModule *module)
+{
+	enqueueMessage(new MsgModuleRemoved(this, module));
+}
+
+void
+AnalyticsManager::doModuleRemoved(AnalyticsModule *module)
+{
+	if (--_stoppingModules[module] > 0)
+		return ;
+	_stoppingModules.erase(module);
+	module->shutdown(this);
 }
 
 void 
@@ -289,15 +874,33 @@ AnalyticsManager::shutdownDone(ChronicleSink *sink)
 	enqueueMessage(new MsgHandleModuleShutdown(this, sink));
 }
 
+bool
+AnalyticsManager::isShard(ChronicleSink *sink)
+{
+	// the sink may have exited already, so it can't be dereferenced
+	for (uint32_t i = 0; i < _shards.size(); i++)
+		if (static_cast<ChronicleSink *>(_shards[i]) == sink)
+			return true;
+	return false;
+}
+
 void
 AnalyticsManager::doHandleModuleShutdown(ChronicleSink *sink)
 {
-	if ((_enabled && ++_killedModules == _moduleId && _shutdown)
-			|| !_enabled) {
-		_supervisor->handleAnalyticsManagerShutdown();
-		exit();
+	if (isShard(sink)) {
+		if (++_killedShards < _shards.size())
+			return ;
+		// the modules now have the last partials of all the shards
+		for (std::map<int, AnalyticsModule *>::iterator it = _modules.begin();
+				it != _modules.end(); it++)
+			it->second->shutdown(this);
+		_modules.clear();
 	} else
 		_numModules--;
+	if (_shutdown && _killedShards == _shards.size() && !_numModules) {
+		_supervisor->handleAnalyticsManagerShutdown();
+		exit();
+	}
 }
 
 void 
@@ -321,15 +924,12 @@ AnalyticsManager::shutdown()
 void
 AnalyticsManager::doShutdownModules()
 {
-	std::map<int, AnalyticsModule *>::iterator it;
 	_shutdown = true;
-	if (!_enabled || !_numModules) {
-		_supervisor->handleAnalyticsManagerShutdown();
-		exit();
-		return ;
-	}
-	for (it = _modules.begin(); it != _modules.end(); it++)
-		it->second->shutdown(this);
+	if (_timerFd >= 0)
+		FDWatcher::getFDWatcher()->clearFdCallback(_timerFd);
+	// the shards flush their partials before the modules report
+	for (uint32_t i = 0; i < _shards.size(); i++)
+		_shards[i]->shutdown(this);
 }
 
 void 
@@ -345,20 +945,82 @@ AnalyticsManager::doHandleGetStats(StatGatherer *sg)
 	timespec ts;
     clock_gettime(CLOCK_REALTIME, &ts);
 	uint64_t timestamp = ts.tv_sec * 1000000000llu + ts.tv_nsec;
-	processStats.insert(std::pair<std::string, int64_t> (processName() + "."
-		+ "0.backlog",	pendingMessages()));
+	processStats.insert(std::pair<std::string, int64_t> ("process." 
+		+ processName() + "." + "0.backlog",	pendingMessages()));
+	for (uint32_t i = 0; i < _shards.size(); i++) {
+		processStats.insert(std::pair<std::string, int64_t> ("process." +
+			_shards[i]->processName() + "." + _shards[i]->getId() 
+			+ ".backlog", _shards[i]->pendingMessages()));
+	}
 	for (std::map<int, AnalyticsModule *>::iterator it = _modules.begin();
 			it != _modules.end(); it++) {
 		processStats.insert(std::pair<std::string, int64_t> (
-			"AnalyticsModule." + it->second->processName() + "." 
+			"process.AnalyticsModule." + it->second->processName() + "." 
 			+ it->second->getId() + ".backlog",
 			it->second->pendingMessages()));
+		processStats.insert(std::pair<std::string, int64_t> (
+			"process.AnalyticsModule." + it->second->processName() + "." 
+			+ it->second->getId() + ".late_partials",
+			it->second->getLatePartials()));
 	}
+	processStats.insert(_moduleStats.begin(), _moduleStats.end());
+	_moduleStats.clear();
 	sg->handleAnalyticsModulesStats(timestamp, processStats);
 }
 
+void 
+AnalyticsManager::publishStats(const std::map<std::string, int64_t> &stats)
+{
+	enqueueMessage(new MsgPublishStats(this, stats));
+}
+
 void
-AnalyticsManager::usage()
+AnalyticsManager::doPublishStats(std::map<std::string, int64_t> stats)
 {
+	for (std::map<std::string, int64_t>::iterator it = stats.begin();
+			it != stats.end(); it++)
+		_moduleStats[it->first] = it->second;
+}
 
+void
+AnalyticsManager::tick()
+{
+	enqueueMessage(new MsgTick(this));
+}
+
+void
+AnalyticsManager::watchTimer()
+{
+	FDWatcher::getFDWatcher()->registerFdCallback(_timerFd, 
+		FDWatcher::EVENT_READ, _tickCb);
+}
+
+void
+AnalyticsManager::doTick()
+{
+	uint64_t expirations;
+	if (read(_timerFd, &expirations, sizeof(expirations)) < 0 
+			&& errno != EAGAIN)
+		perror("AnalyticsManager: timerfd");
+	if (_shutdown)
+		return ;
+	watchTimer();
+	time_t now = monotonicTime();
+	for (uint32_t i = 0; i < _shards.size(); i++)
+		_shards[i]->tick(now);
+	for (std::map<int, AnalyticsModule *>::iterator it = _modules.begin();
+			it != _modules.end(); it++)
+		it->second->tick(now);
+}
+
+void
+AnalyticsManager::usage()
+{
+	fprintf(stderr, FONT_RED 
+		"Usage:\n"
+		"\tANALYTICS LIST\n"
+		"\tANALYTICS START module [interval=seconds] [key=value]...\n"
+		"\tANALYTICS STOP module_id\n"
+		"\tANALYTICS CONFIG module_id [interval=seconds] [key=value]...\n"
+		FONT_DEFAULT);
 }
@@ -7,12 +7,14 @@
 #ifndef	ANALYTICS_MODULE_H 
 #define ANALYTICS_MODULE_H
 
+#include <atomic>
 #include <ctime>
 #include <list>
 #include <map>
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <vector>
 #include "ChronicleProcess.h"
 #include "Process.h"
 #include "PcapPacketBufferPool.h"
@@ -21,27 +23,90 @@ class Chronicle;
 class StatGatherer;
 class PcapPacketBufferPool;
 class AnalyticsManager;
+class AnalyticsShard;
+class AnalyticsModuleFactory;
+
+/**
+ * The mergeable, partial state of an analytics module. Each analytics shard
+ * aggregates the PDUs it sees into its own partial, and the module combines
+ * the partials of all the shards at the end of every reporting interval.
+ */
+class AnalyticsPartial {
+	public:
+		virtual ~AnalyticsPartial() { }
+		/// accounts for a PDU (a call or a reply)
+		virtual void update(PduDescriptor *pduDesc) = 0;
+		/// folds in another partial of the same module
+		virtual void merge(const AnalyticsPartial *other) = 0;
+		/**
+		 * invoked by the shard at the end of an interval, before the 
+		 * partial is handed to the module
+		 * @param[in] next The shard's partial for the next interval, to 
+		 * move the state that outlives an interval to (NULL on shutdown)
+		 */
+		virtual void handOver(AnalyticsPartial *next) { }
+};
 
 /// A parent class for all the analytics modules
-class AnalyticsModule : public Process, public PduDescReceiver {
+class AnalyticsModule : public Process, public ChronicleSink {
 	public:
+		/// the NFSv3 procedures (NFS3PROC_NULL to NFS3PROC_COMMIT)
+		static const unsigned NUM_NFS3_PROCS = 22;
+		/// module parameters (key=value) given with ANALYTICS START
+		typedef std::map<std::string, std::string> Params;
+
 		AnalyticsModule(std::string name, AnalyticsManager *manager,
 			std::string command, int id, int interval);
 		virtual ~AnalyticsModule();
+		/// creates an empty partial (invoked by the shards)
+		virtual AnalyticsPartial *newPartial() = 0;
+		/**
+		 * reports the aggregate (_aggregate) of the interval ending at ts
+		 * A module that keeps the aggregate (e.g., for a sliding window)
+		 * sets _aggregate to NULL.
+		 */
 		virtual void report(struct timeval ts) = 0;
+		/**
+		 * invoked by a shard to hand over its partial for an interval
+		 * (each shard hands over its partials in interval order)
+		 * @param[in] partial The partial (the module takes ownership)
+		 * @param[in] intervalEnd The end of the interval (in seconds)
+		 * @param[in] shard The id of the shard
+		 */
+		void combine(AnalyticsPartial *partial, time_t intervalEnd,
+			uint32_t shard);
+		/**
+		 * invoked periodically by the manager to report the intervals 
+		 * whose grace period has passed
+		 * @param[in] now The monotonic time (in seconds)
+		 */
+		void tick(time_t now);
+		/// reports the last interval and terminates the module
+		void shutdown(ChronicleSource *src);
 		std::string getId() { return std::to_string(_id); }
 		std::string getCommand() { return _command; }
 		std::string getOutputFile() { return _outputFile; }
+		int getInterval() { return _interval; }
+		/// the number of partials dropped because they arrived after
+		/// their interval was reported
+		uint64_t getLatePartials() { return _latePartials.load(); }
+	
+		/// returns the lower-case name of an NFSv3 procedure
+		static const char *getNfs3ProcName(uint32_t proc);
+		/**
+		 * validates the parameters of a new module (modules that take 
+		 * parameters hide these two)
+		 * @returns true if the parameters are valid
+		 */
+		static bool checkParams(const Params &params) 
+			{ return params.empty(); }
+		static std::string getParamsUsage() { return ""; }
 	
 	protected:
-		void releasePdu(PduDescriptor *pduDesc);
-		bool timeToReport(struct timeval ts);
 		std::string getTime(struct timeval ts);
 
 		/// analytics manager
 		AnalyticsManager *_manager;
-		/// reference to packet buffer pool
-		PcapPacketBufferPool *_bufPool;
 		/// command for this module
 		std::string _command;
 		/// output file
@@ -50,29 +115,147 @@ class AnalyticsModule : public Process, public PduDescReceiver {
 		std::fstream _output;
 		/// the start time of the module
 		time_t _startTime;
-		/// the report time of the module
-		time_t _reportTime;
+		/// the aggregate of the interval being reported
+		AnalyticsPartial *_aggregate;
+		/// the end of the interval being reported
+		time_t _intervalEnd;
 		/// analytics module id
 		int _id;
 		/// reporting interval
 		int _interval;
+
+	private:
+		class MsgBase;
+		class MsgCombine;
+		class MsgTick;
+		class MsgShutdown;
+
+		/// the partials combined so far for an interval that is still open
+		struct Interval {
+			AnalyticsPartial *aggregate;
+			/// the monotonic time by which the interval is reported, even 
+			/// if some shards haven't handed over their partials
+			time_t deadline;
+		};
+
+		void doCombine(AnalyticsPartial *partial, time_t intervalEnd,
+			uint32_t shard);
+		void doTick(time_t now);
+		void doShutdown(ChronicleSource *src);
+		/**
+		 * reports the open intervals (oldest first) that every shard has 
+		 * handed over, or whose deadline has passed
+		 * @param[in] all Whether to report all the open intervals
+		 */
+		void closeIntervals(time_t now, bool all);
+		/// reports and drops the aggregate of an interval
+		void finishInterval(time_t intervalEnd, AnalyticsPartial *aggregate);
+
+		/// the open intervals by their end
+		std::map<time_t, Interval> _intervals;
+		/// the end of the last interval each shard has handed over
+		std::vector<time_t> _shardDone;
+		/// the end of the last interval reported
+		time_t _lastReported;
+		std::atomic<uint64_t> _latePartials;
 };
 
+/**
+ * An analytics shard runs next to a pipeline (or an output module) and
+ * keeps a partial of every analytics module, so that the PDUs of different
+ * pipelines are aggregated in parallel. It also releases the PDUs.
+ * Shards are per pipeline: the pipelines are picked by a symmetric hash of
+ * the flow, so a call and its reply always meet in the same shard.
+ */
+class AnalyticsShard : public Process, public PduDescReceiver {
+	public:
+		AnalyticsShard(AnalyticsManager *manager, uint32_t id);
+		~AnalyticsShard();
+		void processRequest(ChronicleSource *src, PduDescriptor *pduDesc);
+		/// starts keeping a partial for the module
+		void addModule(AnalyticsModule *module);
+		/// hands the module its last partial and stops aggregating for it
+		void removeModule(AnalyticsModule *module);
+		/// hands the partials to the modules and terminates the shard
+		void shutdown(ChronicleSource *src);
+		/**
+		 * invoked periodically by the manager to hand over the partials 
+		 * of the intervals that have ended, even without any traffic
+		 * @param[in] now The monotonic time (in seconds)
+		 */
+		void tick(time_t now);
+		std::string getId() { return std::to_string(_id); }
+
+	private:
+		class MsgBase;
+		class MsgProcessRequest;
+		class MsgAddModule;
+		class MsgRemoveModule;
+		class MsgShutdown;
+		class MsgTick;
 
+		/// a module and the shard's partial for the current interval
+		struct ModuleState {
+			AnalyticsModule *module;
+			AnalyticsPartial *partial;
+			time_t intervalEnd;
+			/// the monotonic time by which the partial is handed over (0 
+			/// once the tick has, until the partial is updated again)
+			time_t deadline;
+			ModuleState(AnalyticsModule *m) 
+				: module(m), partial(NULL), intervalEnd(0), deadline(0) { }
+		};
+
+		void doProcessRequest(PduDescriptor *pduDesc);
+		void doTick(time_t now);
+		/// hands the partial over to the module and starts a new one
+		void handOverPartial(ModuleState &state);
+		void doAddModule(AnalyticsModule *module);
+		void doRemoveModule(AnalyticsModule *module);
+		void doShutdown(ChronicleSource *src);
+		void releasePdu(PduDescriptor *pduDesc);
 
-class AnalyticsManager : public Process, public ChronicleSource, 
-		public PduDescReceiver {
+		/// analytics manager
+		AnalyticsManager *_manager;
+		/// reference to packet buffer pool
+		PcapPacketBufferPool *_bufPool;
+		/// the modules this shard aggregates for
+		std::list<ModuleState> _modules;
+		/// shard id
+		uint32_t _id;
+};
+
+class AnalyticsManager : public Process, public ChronicleSource {
 	public:
 		AnalyticsManager(Chronicle *supervisor, bool analyticsEnabled, 
-			time_t ts);
+			time_t ts, uint32_t numShards);
 		~AnalyticsManager();
-		void processRequest(ChronicleSource *src, PduDescriptor *pduDesc);
+		/**
+		 * makes a kind of analytics module available to ANALYTICS START
+		 * @param[in] name The name of the modules
+		 * @param[in] factory The factory (the manager takes ownership)
+		 */
+		void registerModule(std::string name, AnalyticsModuleFactory *factory);
+		/**
+		 * finds the analytics shard for a pipeline or an output module
+		 * @returns the shard
+		 */
+		AnalyticsShard *getShard(uint32_t id) 
+			{ return _shards[id % _shards.size()]; }
+		uint32_t getNumShards() { return _shards.size(); }
 		/**
 		 * invoked by the supervisor to pass the commands from CLI
-		 * @param[in] src The supervisor
+		 * (LIST, START name [interval=s] [key=value]..., STOP id, or
+		 * CONFIG id [interval=s] [key=value]...)
 		 * @param[in] command The analytics command
 		 */
 		void processCommand(std::list<std::string> command);
+		/**
+		 * invoked by a shard once it no longer aggregates for a module
+		 * that is being stopped
+		 * @param[in] module The module
+		 */
+		void moduleRemoved(AnalyticsModule *module);
 		/**
 		 * invoked when an output module has completely shut down
 		 * @param[in] sink The process that has shut down
@@ -88,11 +271,18 @@ class AnalyticsManager : public Process, public ChronicleSource,
 		 * invoked by the supervisor to shut down the output modules
 		 */
 		void shutdown();
-		void shutdown(ChronicleSource *) { }
 		/**
 		 * triggered by StatGatherer to collect analytics modules process stats
 		 */
 		void getStats(StatGatherer *sg);
+		/**
+		 * invoked by a module to pass the results of an interval on to the
+		 * StatGatherer (with its next stats collection)
+		 * @param[in] stats The results
+		 */
+		void publishStats(const std::map<std::string, int64_t> &stats);
+		/// invoked by the timer to tick the shards and the modules
+		void tick();
 
 		static struct Nfs3OperationCounts {
 			uint64_t packets;
@@ -121,32 +311,61 @@ class AnalyticsManager : public Process, public ChronicleSource,
 
 	private:
 		class MsgBase;
-		class MsgProcessRequest;
 		class MsgProcessCommand;
 		class MsgModuleDone;
 		class MsgShutdownModules;
 		class MsgHandleModuleShutdown;
 		class MsgGetStats;
+		class MsgPublishStats;
+		class MsgModuleRemoved;
+		class MsgTick;
+		class TickCb;
 		
-		void doProcessRequest(PduDescriptor *pdu);
 		void updateNfsStats(PduDescriptor *pduDesc);
 		void doProcessCommand(std::list<std::string> command);
 		void doHandleModuleDone(ChronicleSink *sink);
 		void doShutdownModules();
 		void doHandleModuleShutdown(ChronicleSink *sink);
 		void doHandleGetStats(StatGatherer *sg);
+		void doPublishStats(std::map<std::string, int64_t> stats);
+		void doModuleRemoved(AnalyticsModule *module);
+		void doTick();
+		/// arms the timer for the next tick
+		void watchTimer();
+		/// starts a module
+		/// @returns the module id or -1 if the module couldn't be started
+		int startModule(const std::string &name, 
+			std::list<std::string> &args);
+		/// makes the shards drop a module and then shuts it down
+		void stopModule(int id);
+		bool isShard(ChronicleSink *sink);
 		void usage();
+		/// adds a module (with id _moduleId) and makes all the shards 
+		/// aggregate for it
+		void addModule(AnalyticsModule *module, const std::string &name);
 
 		/// reference to the supervisor
 		Chronicle *_supervisor;
-		/// a map of all the analytics modules
+		/// a map of all the running analytics modules
 		std::map<int, AnalyticsModule *> _modules;
+		/// the names of the running analytics modules
+		std::map<int, std::string> _moduleNames;
+		/// the arguments (key=value) the running modules were started with
+		std::map<int, std::list<std::string> > _moduleArgs;
+		/// the module factories by name
+		std::map<std::string, AnalyticsModuleFactory *> _factories;
+		/// modules being stopped and the number of shards still using them
+		std::map<AnalyticsModule *, uint32_t> _stoppingModules;
+		/// module results not yet passed on to the StatGatherer
+		std::map<std::string, int64_t> _moduleStats;
+		/// the analytics shards
+		std::vector<AnalyticsShard *> _shards;
+		/// the number of shards terminated during shutdown
+		uint32_t _killedShards;
 		/// reference to the packet buffer pool
 		PcapPacketBufferPool *_bufPool;
-		/// the current number of analytics modules
+		/// the current number of analytics modules (incl. stopping ones)
 		int _numModules;
-		/// the number of analytics modules terminated during shutdown
-		int _killedModules;
 		/// a monotonically increasing id for modules
 		int _moduleId;
 		/// flag to denote analytics is enabled
@@ -155,6 +374,9 @@ class AnalyticsManager : public Process, public ChronicleSource,
 		bool _shutdown;
 		/// timestamp for this Chronicle run
 		time_t _timestamp;
+		/// the timer (timerfd) for the ticks
+		int _timerFd;
+		TickCb *_tickCb;
 };
 
 #endif //ANALYTICS_MODULE_H
@@ -0,0 +1,44 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef ANALYTICS_MODULE_FACTORY_H
+#define ANALYTICS_MODULE_FACTORY_H
+
+#include <map>
+#include <string>
+#include "AnalyticsModule.h"
+
+/// Creates the analytics modules of a kind (registered by name)
+class AnalyticsModuleFactory {
+	public:
+		virtual ~AnalyticsModuleFactory() { }
+		/**
+		 * creates a module
+		 * @param[in] params The module parameters (key=value)
+		 * @returns the module, or NULL if the parameters are invalid
+		 */
+		virtual AnalyticsModule *newModule(AnalyticsManager *manager, 
+			std::string command, int id, int interval,
+			const AnalyticsModule::Params &params) = 0;
+		/// describes the parameters the modules take
+		virtual std::string getUsage() = 0;
+};
+
+template <class Module>
+class AnalyticsModuleFactoryT : public AnalyticsModuleFactory {
+	public:
+		AnalyticsModule *newModule(AnalyticsManager *manager, 
+			std::string command, int id, int interval,
+			const AnalyticsModule::Params &params) 
+		{
+			if (!Module::checkParams(params))
+				return NULL;
+			return new Module(manager, command, id, interval, params);
+		}
+		std::string getUsage() { return Module::getParamsUsage(); }
+};
+
+#endif //ANALYTICS_MODULE_FACTORY_H
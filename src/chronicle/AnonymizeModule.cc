@@ -0,0 +1,400 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2015 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "AnonymizeModule.h"
+#include "OutputModule.h"
+#include "Message.h"
+#include "ChronicleConfig.h"
+#include "StageTracer.h"
+#include "Metrics.h"
+#include "FileExtAnonymizer.h"
+#include "FpeAnonymizer.h"
+#include "HashAnonymizer.h"
+#include "IpAnonymizer.h"
+#include "PathAnonymizer.h"
+#include "RpcParser.h"
+#include <algorithm>
+#include <cstring>
+#include <linux/nfs.h>
+#include <linux/nfs3.h>
+#include <time.h>
+
+static MetricCounter anonymizedPdus("anon.pdus");
+/// time spent anonymizing (in ns)
+static MetricCounter anonymizeNs("anon.ns");
+
+static uint64_t
+monotonicNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000llu + ts.tv_nsec;
+}
+
+class AnonymizeModule::MessageBase : public Message {
+protected:
+    AnonymizeModule *_self;
+public:
+    MessageBase(AnonymizeModule *self) : _self(self) { }
+};
+
+AnonymizeModule::AnonymizeModule(ChronicleSource *src, uint32_t id,
+                                 OutputManager *outputManager,
+                                 MemoCache *cache) :
+    Process("AnonymizeModule"), _source(src), _sink(0),
+    _outputManager(outputManager), _pipelineId(id), _fileHandles(0),
+    _uids(0), _gids(0)
+{
+    // the same anonymizers as anonymizeNfs3Trace uses
+    _addresses = new IpAnonymizer(ANON_IP_BITS);
+    _fileNames = new FileExtAnonymizer(new HashAnonymizer(anonKeyFile), cache);
+    _pathNames = new PathAnonymizer(
+        new FileExtAnonymizer(new HashAnonymizer(anonKeyFile), cache),
+        "/", cache);
+    if (anonFileHandles) {
+        _fileHandles = new HashAnonymizer(anonKeyFile, cache);
+    }
+    if (anonIds) {
+        _uids = new FpeAnonymizer(anonKeyFile, "uid", cache);
+        _gids = new FpeAnonymizer(anonKeyFile, "gid", cache);
+    }
+}
+
+AnonymizeModule::~AnonymizeModule()
+{
+    delete _addresses;
+    delete _fileNames;
+    delete _pathNames;
+    delete _fileHandles;
+    delete _uids;
+    delete _gids;
+}
+
+class AnonymizeModule::MessagePRPdu: public MessageBase {
+protected:
+    ChronicleSource *_src;
+    PduDescriptor *_pdu;
+public:
+    MessagePRPdu(AnonymizeModule *self, ChronicleSource *src,
+                 PduDescriptor *pdu) :
+        MessageBase(self), _src(src), _pdu(pdu) { }
+    void run() { _self->doProcessRequest(_src, _pdu); }
+};
+
+void
+AnonymizeModule::processRequest(ChronicleSource *src, PduDescriptor *pduDesc)
+{
+    PacketBufferPool::handOver(pduDesc, PacketBufferPool::HOLDER_ANONYMIZE);
+    enqueueMessage(new MessagePRPdu(this, src, pduDesc));
+}
+
+void
+AnonymizeModule::doProcessRequest(ChronicleSource *src,
+                                  PduDescriptor *pduDesc)
+{
+    StageTracer::stamp(pduDesc, StageTracer::STAGE_ANONYMIZE);
+    uint64_t start = monotonicNs();
+    unsigned pdus = 0;
+    for (PduDescriptor *d = pduDesc; d != 0; d = d->next, ++pdus) {
+        anonymizeAddresses(d);
+        NfsV3PduDescriptor *nfsDesc = dynamic_cast<NfsV3PduDescriptor *>(d);
+        if (nfsDesc && nfsDesc->parsable) {
+            anonymizeNfs(nfsDesc);
+        }
+    }
+    anonymizedPdus.add(pdus);
+    anonymizeNs.add(monotonicNs() - start);
+
+    if (_sink) {
+        _sink->processRequest(this, pduDesc);
+    } else {
+        _outputManager->findNextModule(_pipelineId)->processRequest(this,
+                                                                    pduDesc);
+    }
+}
+
+void
+AnonymizeModule::anonymizeAddresses(PduDescriptor *pduDesc)
+{
+    PacketDescriptor *pktDesc = pduDesc->firstPktDesc, *old;
+    do {
+        // The last packet of a PDU may also be the first one of the next
+        // PDU, which may already be in the output. The mapping maps
+        // anonymized addresses to themselves, so such a packet is never
+        // written to again.
+        uint32_t ip = _addresses->anonymize(
+            static_cast<int32_t>(pktDesc->srcIP));
+        if (ip != pktDesc->srcIP) {
+            pktDesc->srcIP = ip;
+        }
+        ip = _addresses->anonymize(static_cast<int32_t>(pktDesc->destIP));
+        if (ip != pktDesc->destIP) {
+            pktDesc->destIP = ip;
+        }
+        old = pktDesc;
+        pktDesc = pktDesc->next;
+    } while (old != pduDesc->lastPktDesc && pktDesc != 0);
+}
+
+void
+AnonymizeModule::anonymizeFileHandle(unsigned char *fileHandle,
+                                     uint32_t *fhLen)
+{
+    std::string fh(reinterpret_cast<char *>(fileHandle), *fhLen);
+    fh = _fileHandles->anonymize(fh);
+    *fhLen = std::min<size_t>(fh.size(), NFS3_FHSIZE);
+    memcpy(fileHandle, fh.data(), *fhLen);
+}
+
+void
+AnonymizeModule::anonymizeIds(uint32_t *uid, uint32_t *gid)
+{
+    // the traces hold ids as int32 fields
+    *uid = _uids->anonymize(static_cast<int32_t>(*uid));
+    *gid = _gids->anonymize(static_cast<int32_t>(*gid));
+}
+
+void
+AnonymizeModule::addFileName(NfsV3PduDescriptor *desc, uint16_t index,
+                             PacketDescriptor *pktDesc,
+                             NfsV3PduDescriptor::AnonymizedFields *fields)
+{
+    unsigned char name[NFS_MAXNAMLEN + 1];
+    // a name that can't be decoded is left out (and written as "")
+    if (desc->getFileName(name, index, pktDesc)) {
+        fields->names.push_back(NfsV3PduDescriptor::AnonymizedFields::Value(
+            index, pktDesc,
+            _fileNames->anonymize(std::string(reinterpret_cast<char *>(name)))));
+    }
+}
+
+void
+AnonymizeModule::addPathName(NfsV3PduDescriptor *desc, uint16_t index,
+                             PacketDescriptor *pktDesc,
+                             NfsV3PduDescriptor::AnonymizedFields *fields)
+{
+    unsigned char name[NFS_MAXPATHLEN + 1];
+    if (desc->getPathName(name, index, pktDesc)) {
+        fields->names.push_back(NfsV3PduDescriptor::AnonymizedFields::Value(
+            index, pktDesc,
+            _pathNames->anonymize(std::string(reinterpret_cast<char *>(name)))));
+    }
+}
+
+void
+AnonymizeModule::anonymizeNfs(NfsV3PduDescriptor *desc)
+{
+    typedef NfsV3PduDescriptor::AnonymizedFields AnonymizedFields;
+    AnonymizedFields *fields = 0;
+    unsigned proc = desc->rpcProgramProcedure;
+
+    // First the values the writers would decode from the packets, while
+    // the descriptor still holds the original handles
+    if (desc->rpcMsgType == RPC_CALL) {
+        switch (proc) {
+        case NFS3PROC_LOOKUP:
+        case NFS3PROC_CREATE:
+        case NFS3PROC_MKDIR:
+        case NFS3PROC_MKNOD:
+        case NFS3PROC_REMOVE:
+        case NFS3PROC_RMDIR:
+            fields = new AnonymizedFields();
+            addFileName(desc, desc->miscIndex0, desc->pktDesc[0], fields);
+            break;
+        case NFS3PROC_SYMLINK:
+            fields = new AnonymizedFields();
+            addFileName(desc, desc->miscIndex0, desc->pktDesc[0], fields);
+            addPathName(desc, desc->miscIndex1, desc->pktDesc[1], fields);
+            break;
+        case NFS3PROC_RENAME: {
+            fields = new AnonymizedFields();
+            addFileName(desc, desc->miscIndex0, desc->pktDesc[0], fields);
+            addFileName(desc, desc->miscIndex1, desc->pktDesc[1], fields);
+            // getFileHandle() overwrites the "from" handle
+            unsigned char fromFh[NFS3_FHSIZE];
+            uint32_t fromFhLen = desc->fhLen;
+            memcpy(fromFh, desc->fileHandle, fromFhLen);
+            if (desc->getFileHandle(desc->miscIndex2, desc->pktDesc[2])) {
+                if (_fileHandles) {
+                    anonymizeFileHandle(desc->fileHandle, &desc->fhLen);
+                }
+                fields->fileHandles.push_back(AnonymizedFields::Value(
+                    desc->miscIndex2, desc->pktDesc[2],
+                    std::string(reinterpret_cast<char *>(desc->fileHandle),
+                                desc->fhLen)));
+            }
+            desc->fhLen = fromFhLen;
+            memcpy(desc->fileHandle, fromFh, fromFhLen);
+            break;
+        }
+        case NFS3PROC_LINK: {
+            fields = new AnonymizedFields();
+            // getLink() overwrites fhLen
+            uint32_t fhLen = desc->fhLen;
+            NfsV3PduDescriptor::Link link;
+            if (desc->getLink(&link)) {
+                uint32_t dirFhLen = desc->fhLen;
+                if (_fileHandles) {
+                    anonymizeFileHandle(link.dirFileHandle, &dirFhLen);
+                }
+                fields->fileHandles.push_back(AnonymizedFields::Value(
+                    desc->miscIndex0, desc->pktDesc[0],
+                    std::string(reinterpret_cast<char *>(link.dirFileHandle),
+                                dirFhLen)));
+                fields->names.push_back(AnonymizedFields::Value(
+                    desc->miscIndex0, desc->pktDesc[0],
+                    _fileNames->anonymize(link.linkName)));
+            }
+            desc->fhLen = fhLen;
+            break;
+        }
+        }
+    } else if (desc->rpcMsgType == RPC_REPLY && desc->nfsStatus == NFS_OK) {
+        switch (proc) {
+        case NFS3PROC_READLINK:
+            fields = new AnonymizedFields();
+            addPathName(desc, desc->miscIndex0, desc->pktDesc[0], fields);
+            break;
+        case NFS3PROC_READDIR:
+        case NFS3PROC_READDIRPLUS:
+            fields = new AnonymizedFields();
+            anonymizeDirEntries(desc, fields);
+            break;
+        }
+    }
+    // from now on the getters return the anonymized values
+    desc->anonymized = fields;
+
+    // Then the fields of the descriptor itself
+    if (_fileHandles && desc->fhLen) {
+        anonymizeFileHandle(desc->fileHandle, &desc->fhLen);
+    }
+    // ids are only parsed from successful replies and some calls
+    if (_uids && ((desc->rpcMsgType == RPC_REPLY &&
+                   desc->nfsStatus == NFS_OK) ||
+                  (desc->rpcMsgType == RPC_CALL &&
+                   (proc == NFS3PROC_SETATTR || proc == NFS3PROC_MKDIR ||
+                    proc == NFS3PROC_SYMLINK || proc == NFS3PROC_MKNOD)))) {
+        anonymizeIds(&desc->fileUid, &desc->fileGid);
+    }
+}
+
+void
+AnonymizeModule::anonymizeDirEntries(NfsV3PduDescriptor *desc,
+    NfsV3PduDescriptor::AnonymizedFields *fields)
+{
+    typedef NfsV3PduDescriptor::AnonymizedFields::DirEntry DirEntry;
+    bool plus = desc->rpcProgramProcedure == NFS3PROC_READDIRPLUS;
+
+    // The getters advance miscIndex0 and pktDesc[0] and fill in the
+    // descriptor fields one entry at a time; the DsWriter will go over the
+    // anonymized copies instead, so put everything back afterwards.
+    uint16_t index = desc->miscIndex0;
+    PacketDescriptor *pktDesc = desc->pktDesc[0];
+    bool parsable = desc->parsable;
+    DirEntry saved;
+    saved.copyFrom(desc);
+
+    std::string name;
+    bool eof = false;
+    while (true) {
+        if (!(plus ? desc->getReaddirplusEntry(&name, eof) :
+              desc->getReaddirEntry(&name, eof))) {
+            fields->dirEntriesParsable = false;
+            break;
+        }
+        if (eof) {
+            break;
+        }
+        fields->dirEntries.push_back(DirEntry());
+        DirEntry &entry = fields->dirEntries.back();
+        entry.copyFrom(desc);
+        entry.fileName = _fileNames->anonymize(name);
+        // only READDIRPLUS entries carry attributes and handles
+        if (plus && _uids) {
+            anonymizeIds(&entry.fileUid, &entry.fileGid);
+        }
+        if (plus && _fileHandles && entry.fhLen) {
+            anonymizeFileHandle(entry.fileHandle, &entry.fhLen);
+        }
+    }
+
+    desc->miscIndex0 = index;
+    desc->pktDesc[0] = pktDesc;
+    desc->parsable = parsable;
+    saved.copyTo(desc);
+}
+
+class AnonymizeModule::MessageShutdown: public MessageBase {
+public:
+    MessageShutdown(AnonymizeModule *self) : MessageBase(self) { }
+    void run() { _self->doShutdown(); }
+};
+
+void
+AnonymizeModule::shutdown(ChronicleSource *src)
+{
+    if (src == _source) {
+        enqueueMessage(new MessageShutdown(this));
+    }
+}
+
+void
+AnonymizeModule::doShutdown()
+{
+    if (_sink) {
+        _sink->shutdown(this);
+    } else {
+        doShutdownDone(0);
+    }
+}
+
+class AnonymizeModule::MessageShutdownDone: public MessageBase {
+protected:
+    ChronicleSink *_sink;
+public:
+    MessageShutdownDone(AnonymizeModule *self, ChronicleSink *sink) :
+        MessageBase(self), _sink(sink) { }
+    void run() { _self->doShutdownDone(_sink); }
+};
+
+void
+AnonymizeModule::shutdownDone(ChronicleSink *sink)
+{
+    if (sink == _sink) {
+        enqueueMessage(new MessageShutdownDone(this, sink));
+    }
+}
+
+void
+AnonymizeModule::doShutdownDone(ChronicleSink *sink)
+{
+    _source->shutdownDone(this);
+    exit();
+}
+
+class AnonymizeModule::MessageProcessDone: public MessageBase {
+protected:
+    ChronicleSink *_sink;
+public:
+    MessageProcessDone(AnonymizeModule *self, ChronicleSink *sink) :
+        MessageBase(self), _sink(sink) { }
+    void run() { _self->doProcessDone(_sink); }
+};
+
+void
+AnonymizeModule::processDone(ChronicleSink *sink)
+{
+    if (sink == _sink) {
+        enqueueMessage(new MessageProcessDone(this, sink));
+    }
+}
+
+void
+AnonymizeModule::doProcessDone(ChronicleSink *sink)
+{
+    _source->processDone(this);
+}
@@ -0,0 +1,104 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2015 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef ANONYMIZEMODULE_H
+#define ANONYMIZEMODULE_H
+
+#include "Process.h"
+#include "ChronicleProcess.h"
+
+class OutputManager;
+class Anonymizer;
+class MemoCache;
+
+/**
+ * The anonymize module sits between the NfsParser and the rest of an NFS
+ * pipeline and anonymizes the PDUs before the DsWriter encodes them, with
+ * the same anonymizers (and results) as anonymizeNfs3Trace[WithUid]:
+ * - IP addresses get their ANON_IP_BITS upper bits replaced (IpAnonymizer)
+ * - file names, LINK names, and the READDIR(PLUS) entry names are replaced
+ *   by their HMAC (FileExtAnonymizer)
+ * - symlink and READLINK targets are anonymized one component at a time
+ *   (PathAnonymizer)
+ * - optionally, uids and gids are encrypted (FpeAnonymizer) and file
+ *   handles are replaced by their HMAC (HashAnonymizer)
+ *
+ * The fields of the PDU descriptors and the packet addresses are rewritten
+ * in place. The names the writers decode from the packets are decoded here
+ * instead and attached to the PDU (see NfsV3PduDescriptor::AnonymizedFields),
+ * so the cleartext never reaches the output.
+ *
+ * The pipelines share a MemoCache, so each distinct name, handle, or id is
+ * only anonymized once. The PDUs anonymized and the time spent on them are
+ * published as the anon.pdus and anon.ns metrics (i.e., the cost in
+ * PDUs/sec per pipeline is anon.pdus / anon.ns * 1e9).
+ */
+class AnonymizeModule : public Process,
+                        public PduDescReceiver,
+                        public ChronicleSource {
+public:
+    AnonymizeModule(ChronicleSource *src, uint32_t id,
+                    OutputManager *outputManager, MemoCache *cache);
+    ~AnonymizeModule();
+
+    /// Sets the module the PDUs go to (instead of the output module)
+    void setSink(PduDescReceiver *s) { _sink = s; }
+
+    // from ChronicleSink
+    virtual void shutdown(ChronicleSource *src);
+    // from PduDescReceiver
+    virtual void processRequest(ChronicleSource *src, PduDescriptor *pduDesc);
+    // from ChronicleSource
+    virtual void shutdownDone(ChronicleSink *sink);
+    virtual void processDone(ChronicleSink *sink);
+    std::string getId() { return std::to_string(_pipelineId); }
+
+private:
+    class MessageBase;
+    class MessagePRPdu;
+    class MessageShutdown;
+    class MessageShutdownDone;
+    class MessageProcessDone;
+
+    void doProcessRequest(ChronicleSource *src, PduDescriptor *pduDesc);
+    void doShutdown();
+    void doShutdownDone(ChronicleSink *sink);
+    void doProcessDone(ChronicleSink *sink);
+
+    /// Rewrites the source and destination of the PDU's packets
+    void anonymizeAddresses(PduDescriptor *pduDesc);
+    /// Anonymizes the fields of a parsed NFS PDU
+    void anonymizeNfs(NfsV3PduDescriptor *desc);
+    /// Decodes and anonymizes the entries of a READDIR(PLUS) reply
+    void anonymizeDirEntries(NfsV3PduDescriptor *desc,
+                             NfsV3PduDescriptor::AnonymizedFields *fields);
+    void anonymizeFileHandle(unsigned char *fileHandle, uint32_t *fhLen);
+    void anonymizeIds(uint32_t *uid, uint32_t *gid);
+    /// Adds the anonymized file name at index in pktDesc to fields
+    void addFileName(NfsV3PduDescriptor *desc, uint16_t index,
+                     PacketDescriptor *pktDesc,
+                     NfsV3PduDescriptor::AnonymizedFields *fields);
+    /// Adds the anonymized path name at index in pktDesc to fields
+    void addPathName(NfsV3PduDescriptor *desc, uint16_t index,
+                     PacketDescriptor *pktDesc,
+                     NfsV3PduDescriptor::AnonymizedFields *fields);
+
+    ChronicleSource *_source;
+    PduDescReceiver *_sink;
+    OutputManager *_outputManager;
+    uint32_t _pipelineId;
+
+    Anonymizer *_addresses;
+    Anonymizer *_fileNames;
+    Anonymizer *_pathNames;
+    /// NULL unless file handles are anonymized
+    Anonymizer *_fileHandles;
+    /// NULL unless ids are anonymized
+    Anonymizer *_uids;
+    Anonymizer *_gids;
+};
+
+#endif // ANONYMIZEMODULE_H
@@ -0,0 +1,116 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include <linux/nfs.h>
+#include <linux/nfs3.h>
+#include <stdint.h>
+#include <algorithm>
+#include "ChronicleConfig.h"
+#include "MurmurHash3.h"
+#include "RpcParser.h"
+#include "CardinalityModule.h"
+
+CardinalityPartial::CardinalityPartial()
+	: clients(ANALYTICS_HLL_PRECISION), files(ANALYTICS_HLL_PRECISION),
+	blocks(ANALYTICS_HLL_PRECISION), readBlocks(ANALYTICS_HLL_PRECISION),
+	writeBlocks(ANALYTICS_HLL_PRECISION)
+{
+
+}
+
+void
+CardinalityPartial::update(PduDescriptor *pduDesc)
+{
+	// the calls carry the client, the file handle, and the byte range
+	if (pduDesc->rpcPduType == PduDescriptor::PDU_BAD 
+			|| pduDesc->rpcMsgType != RPC_CALL)
+		return ;
+	clients.add(HyperLogLog::hash64(pduDesc->firstPktDesc->srcIP));
+
+	if (pduDesc->rpcProgram != NFS_PROGRAM 
+			|| pduDesc->rpcProgramVersion != NFS3_VERSION)
+		return ;
+	NfsV3PduDescriptor *nfsDesc = dynamic_cast<NfsV3PduDescriptor *>(pduDesc);
+	if (nfsDesc == NULL || !nfsDesc->parsable || nfsDesc->fhLen == 0)
+		return ;
+	uint64_t md[2];
+	MurmurHash3_x64_128(nfsDesc->fileHandle, nfsDesc->fhLen, 0, md);
+	files.add(md[0]);
+
+	uint32_t proc = nfsDesc->rpcProgramProcedure;
+	if ((proc != NFS3PROC_READ && proc != NFS3PROC_WRITE) 
+			|| nfsDesc->byteCount == 0)
+		return ;
+	HyperLogLog &rwBlocks = proc == NFS3PROC_READ ? readBlocks : writeBlocks;
+	// the count comes off the wire: bound it by the largest transfer, 
+	// and a WRITE's by the data its PDU actually carries
+	uint64_t byteCount = std::min<uint64_t>(nfsDesc->byteCount, 
+		ANALYTICS_MAX_TRANSFER_SIZE);
+	if (proc == NFS3PROC_WRITE)
+		byteCount = std::min<uint64_t>(byteCount, nfsDesc->rpcPduLen);
+	if (byteCount == 0 || nfsDesc->fileOffset > UINT64_MAX - byteCount)
+		return ;
+	uint64_t first = nfsDesc->fileOffset / ANALYTICS_WORKING_SET_BLOCK_SIZE;
+	uint64_t last = (nfsDesc->fileOffset + byteCount - 1) 
+		/ ANALYTICS_WORKING_SET_BLOCK_SIZE;
+	for (uint64_t block = first; block <= last; block++) {
+		uint64_t hash = HyperLogLog::hash64(md[1] + block);
+		blocks.add(hash);
+		rwBlocks.add(hash);
+	}
+}
+
+void
+CardinalityPartial::merge(const AnalyticsPartial *other)
+{
+	const CardinalityPartial *partial = 
+		static_cast<const CardinalityPartial *>(other);
+	clients.merge(partial->clients);
+	files.merge(partial->files);
+	blocks.merge(partial->blocks);
+	readBlocks.merge(partial->readBlocks);
+	writeBlocks.merge(partial->writeBlocks);
+}
+
+unsigned
+CardinalityPartial::getSize() const
+{
+	return clients.getSize() + files.getSize() + blocks.getSize() 
+		+ readBlocks.getSize() + writeBlocks.getSize();
+}
+
+CardinalityModule::CardinalityModule(AnalyticsManager *manager, 
+	std::string command, int id, int interval, const Params &params)
+	: AnalyticsModule("CardinalityModule", manager, command, id, interval)
+{
+
+}
+
+void
+CardinalityModule::report(struct timeval ts)
+{
+	const CardinalityPartial *sketches = 
+		static_cast<const CardinalityPartial *>(_aggregate);
+	std::map<std::string, int64_t> stats;
+	stats["analytics.cardinality.clients"] = sketches->clients.estimate();
+	stats["analytics.cardinality.files"] = sketches->files.estimate();
+	stats["analytics.cardinality.blocks"] = sketches->blocks.estimate();
+	stats["analytics.cardinality.workingset.read"] = 
+		sketches->readBlocks.estimate() * ANALYTICS_WORKING_SET_BLOCK_SIZE;
+	stats["analytics.cardinality.workingset.write"] = 
+		sketches->writeBlocks.estimate() * ANALYTICS_WORKING_SET_BLOCK_SIZE;
+	stats["analytics.cardinality.workingset.total"] = 
+		sketches->blocks.estimate() * ANALYTICS_WORKING_SET_BLOCK_SIZE;
+
+	_output << getTime(ts) << " distinct over " << _interval << "s" 
+		<< std::endl;
+	for (std::map<std::string, int64_t>::iterator it = stats.begin();
+			it != stats.end(); it++)
+		_output << it->first.substr(sizeof("analytics.cardinality.") - 1) 
+			<< " " << it->second << std::endl;
+	_output << std::endl;
+	_manager->publishStats(stats);
+}
@@ -0,0 +1,47 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef CARDINALITY_MODULE_H
+#define CARDINALITY_MODULE_H
+
+#include "AnalyticsModule.h"
+#include "HyperLogLog.h"
+
+/**
+ * Distinct clients, file handles and blocks seen during an interval.
+ * The working set of READs (WRITEs) is the number of distinct blocks
+ * they touched times the block size. Each sketch takes 
+ * 2^ANALYTICS_HLL_PRECISION bytes (see bench_cardinality for the cost).
+ */
+class CardinalityPartial : public AnalyticsPartial {
+	public:
+		CardinalityPartial();
+		void update(PduDescriptor *pduDesc);
+		void merge(const AnalyticsPartial *other);
+		/// the memory taken by the sketches
+		unsigned getSize() const;
+
+		HyperLogLog clients;
+		HyperLogLog files;
+		/// blocks touched by READs or WRITEs
+		HyperLogLog blocks;
+		HyperLogLog readBlocks;
+		HyperLogLog writeBlocks;
+};
+
+/**
+ * Reports the estimated number of distinct clients, files and blocks and
+ * the READ/WRITE working set sizes of every interval.
+ */
+class CardinalityModule : public AnalyticsModule {
+	public:
+		CardinalityModule(AnalyticsManager *manager, std::string command,
+			int id, int interval, const Params &params);
+		AnalyticsPartial *newPartial() { return new CardinalityPartial(); }
+		void report(struct timeval ts);
+};
+
+#endif //CARDINALITY_MODULE_H
@@ -5,14 +5,11 @@
  */
 
 #include "ChecksumModule.h"
+#include "ChecksumWorker.h"
 #include "OutputModule.h"
 #include "Message.h"
-#include <linux/nfs.h>
-#include <linux/nfs3.h>
-#include <iostream>
-
-static const unsigned RPC_CALL = 0;
-static const unsigned RPC_REPLY = 1;
+#include "ChronicleConfig.h"
+#include "StageTracer.h"
 
 class ChecksumModule::MessageBase : public Message {
 protected:
@@ -22,15 +19,28 @@ public:
 };
 
 ChecksumModule::ChecksumModule(ChronicleSource *src, uint32_t id,
-		OutputManager *outputManager) :
-    Process("ChecksumModule"), _source(src), _pipelineId(id)
+		OutputManager *outputManager, ChecksumWorkerPool *workers) :
+    Process("ChecksumModule"), _source(src), _workers(workers), _headSeq(0),
+    _batch(0), _outstandingBatches(0), _shuttingDown(false), _pipelineId(id)
 {
 	_outputManager = outputManager;
 }
 
 ChecksumModule::~ChecksumModule()
 {
+    delete _batch;
+}
 
+bool
+ChecksumModule::needsChecksum(PduDescriptor *pduDesc)
+{
+    for (PduDescriptor *d = pduDesc; d != 0; d = d->next) {
+        NfsV3PduDescriptor *nfsDesc = dynamic_cast<NfsV3PduDescriptor *>(d);
+        if (nfsDesc && nfsDesc->carriesData()) {
+            return true;
+        }
+    }
+    return false;
 }
 
 class ChecksumModule::MessagePRPdu: public MessageBase {
@@ -47,111 +57,88 @@ public:
 void
 ChecksumModule::processRequest(ChronicleSource *src, PduDescriptor *pduDesc)
 {
+    PacketBufferPool::handOver(pduDesc, PacketBufferPool::HOLDER_CHECKSUM);
     enqueueMessage(new MessagePRPdu(this, src, pduDesc));
 }
 
 void
 ChecksumModule::doProcessRequest(ChronicleSource *src, PduDescriptor *pduDesc)
 {
-    uint64_t fileOffset = 0;
-    for (PduDescriptor *d = pduDesc; d != 0; d = d->next) {
-        NfsV3PduDescriptor *nfsDesc = dynamic_cast<NfsV3PduDescriptor *>(d);
-        if (nfsDesc && nfsDesc->parsable) {
-            // relies on the fact that calls precede replies for the same op.
-            if (nfsDesc->rpcMsgType == RPC_CALL) {
-                fileOffset = nfsDesc->fileOffset;
-            }
-            if ((nfsDesc->rpcMsgType == RPC_CALL &&
-                 nfsDesc->rpcProgramProcedure == NFS3PROC_WRITE) ||
-                (nfsDesc->rpcMsgType == RPC_REPLY &&
-                 nfsDesc->rpcProgramProcedure == NFS3PROC_READ &&
-				 nfsDesc->nfsStatus == NFS_OK)) {
-                // There should be data to xsum
-                checksumPdu(nfsDesc, fileOffset);
-            }
-        }
+    StageTracer::stamp(pduDesc, StageTracer::STAGE_CHECKSUM);
+    bool needed = needsChecksum(pduDesc);
+    if (!needed && _pending.empty()) {
+        // nothing to wait for
+        _outputManager->findNextModule(_pipelineId)->processRequest(src,
+                                                                    pduDesc);
+        return;
     }
 
-    // pass it on
-	PduDescReceiver *next;
-	next = _outputManager->findNextModule(_pipelineId);
-	next->processRequest(src, pduDesc);
+    _pending.push_back(PendingPdu(src, pduDesc, !needed));
+    if (needed) {
+        if (!_batch) {
+            _batch = new ChecksumBatch(this);
+        }
+        _batch->pdus.push_back(pduDesc);
+        _batch->seqs.push_back(_headSeq + _pending.size() - 1);
+    }
+    // don't hold on to a partial batch if nothing else is coming right now
+    if (_batch && (_batch->pdus.size() >= DS_CHECKSUM_BATCH_SIZE ||
+                   pendingMessages() == 0)) {
+        submitBatch();
+    }
 }
 
-static void
-initDataPointers(PacketDescriptor *pkt, unsigned char **payloadStart,
-                 int *bytesLeft)
+void
+ChecksumModule::submitBatch()
 {
-    *payloadStart = &pkt->packetBuffer[pkt->payloadOffset];
-    *bytesLeft = pkt->payloadLength;
+    if (!_batch) {
+        return;
+    }
+    ++_outstandingBatches;
+    _workers->submit(_batch);
+    _batch = 0;
 }
 
-static bool
-isFullPacket(PacketDescriptor *pkt)
+class ChecksumModule::MessageChecksumDone: public MessageBase {
+protected:
+    ChecksumBatch *_batch;
+public:
+    MessageChecksumDone(ChecksumModule *self, ChecksumBatch *batch) :
+        MessageBase(self), _batch(batch) { }
+    void run() { _self->doChecksumDone(_batch); }
+};
+
+void
+ChecksumModule::checksumDone(ChecksumBatch *batch)
 {
-    return pkt->pcapHeader.caplen == pkt->pcapHeader.len;
+    enqueueMessage(new MessageChecksumDone(this, batch));
 }
 
 void
-ChecksumModule::checksumPdu(NfsV3PduDescriptor *desc, uint64_t fileOffset)
+ChecksumModule::doChecksumDone(ChecksumBatch *batch)
 {
-    uint64_t md_value[2];
-
-    int opBytesRemaining = desc->byteCount;
-    PacketDescriptor *currentPacket = desc->pktDesc[0];
-    if (!isFullPacket(currentPacket))
-        return;
-    unsigned char *currentData;
-    int pktBytesRemaining;
-    initDataPointers(currentPacket, &currentData, &pktBytesRemaining);
-    // advance to start of xfer data
-    int delta = desc->miscIndex1 - currentPacket->payloadOffset;
-    currentData += delta;
-    pktBytesRemaining -= delta;
-    //std::cerr << "op @ " << fileOffset << std::endl;
-    // advance to 512B offset
-    if (fileOffset & 512llu) {
-        delta = (fileOffset & ~512llu) + 512 - fileOffset;
-        currentData += delta;
-        pktBytesRemaining -= delta;
-        opBytesRemaining -= delta;
-        fileOffset += delta;
+    for (unsigned i = 0; i < batch->seqs.size(); ++i) {
+        _pending[batch->seqs[i] - _headSeq].done = true;
     }
-    //std::cerr << "advanced to " << fileOffset << std::endl;
-    while (opBytesRemaining >= 512) { // while more to checksum
-        int xsumBytesRemaining = 512;
-        MurmurHash3_x64_128_init(0, &_mhstate);
-        while (xsumBytesRemaining) {
-            int bytesThisCall = std::min(pktBytesRemaining, opBytesRemaining);
-            bytesThisCall = std::min(bytesThisCall, xsumBytesRemaining);
-            if (bytesThisCall <= 0) { // need a new packet
-                // XXX advance to next packet
-                currentPacket = currentPacket->next;
-                if (!currentPacket || !isFullPacket(currentPacket)) {
-                    return;
-                }
-                initDataPointers(currentPacket, &currentData,
-                                 &pktBytesRemaining);
-                if (bytesThisCall < 0) {
-                    bytesThisCall = -bytesThisCall;
-                    currentData += bytesThisCall;
-                    fileOffset += bytesThisCall;
-                }
-                continue;
-            }
-            //std::cerr << "digesting bytes: " << bytesThisCall << std::endl;
-            MurmurHash3_x64_128_update(currentData, bytesThisCall, &_mhstate);
-            currentData += bytesThisCall;
-            fileOffset += bytesThisCall;
-            pktBytesRemaining -= bytesThisCall;
-            opBytesRemaining -= bytesThisCall;
-            xsumBytesRemaining -= bytesThisCall;
-        }
-        MurmurHash3_x64_128_finalize(&_mhstate, md_value);
-        uint64_t hashvalue = md_value[0] ^ md_value[1];
-        NfsV3PduDescriptor::ChecksumRecord rec(hashvalue, fileOffset - 512);
-        //std::cerr << "checksum done: " << rec.offset << std::endl;
-        desc->dataChecksums.push_back(rec);
+    delete batch;
+    --_outstandingBatches;
+    passOnCompleted();
+    if (_shuttingDown && !_outstandingBatches) {
+        finishShutdown();
+    }
+}
+
+void
+ChecksumModule::passOnCompleted()
+{
+    while (!_pending.empty() && _pending.front().done) {
+        PendingPdu &p = _pending.front();
+        // pass it on
+        PduDescReceiver *next;
+        next = _outputManager->findNextModule(_pipelineId);
+        next->processRequest(p.src, p.pduDesc);
+        _pending.pop_front();
+        ++_headSeq;
     }
 }
 
@@ -172,8 +159,18 @@ ChecksumModule::shutdown(ChronicleSource *src)
 
 void
 ChecksumModule::doShutdown(ChronicleSource *src)
+{
+    // wait for the PDUs still being hashed so that none are lost
+    submitBatch();
+    _shuttingDown = true;
+    if (!_outstandingBatches) {
+        finishShutdown();
+    }
+}
+
+void
+ChecksumModule::finishShutdown()
 {
 	_source->shutdownDone(this);
     exit();
 }
-
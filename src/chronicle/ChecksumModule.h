@@ -9,20 +9,24 @@
 
 #include "Process.h"
 #include "ChronicleProcess.h"
-//#include <openssl/evp.h>
-#include "MurmurHash3.h"
+#include <deque>
 
 class OutputManager;
+class ChecksumWorkerPool;
+struct ChecksumBatch;
 
 /**
- * The checksum module checksums NFS read/write data so that the data
- * hashes can be written out by the DsWriter.
+ * The checksum module hands the NFS read/write PDUs of a pipeline to the
+ * shared checksum workers in batches, so that the data hashes can be
+ * written out by the DsWriter. The workers may finish batches out of
+ * order; the module restores the pipeline's order before passing the PDUs
+ * on to the output module.
  */
 class ChecksumModule : public Process,
                        public PduDescReceiver {
 public:
     ChecksumModule(ChronicleSource *src, uint32_t id, 
-		OutputManager *outputManager);
+		OutputManager *outputManager, ChecksumWorkerPool *workers);
     ~ChecksumModule();
 
     // from ChronicleSink
@@ -31,20 +35,50 @@ public:
     virtual void processRequest(ChronicleSource *src, PduDescriptor *pduDesc);
 	std::string getId() { return std::to_string(_pipelineId); }
 
+    /// Invoked by a ChecksumWorker once it is done with a batch
+    void checksumDone(ChecksumBatch *batch);
+
 private:
     class MessageBase;
     class MessagePRPdu;
+    class MessageChecksumDone;
     class MessageShutdown;
 
+    /// A PDU chain waiting for its turn to be passed on
+    struct PendingPdu {
+        ChronicleSource *src;
+        PduDescriptor *pduDesc;
+        bool done;
+        PendingPdu(ChronicleSource *s, PduDescriptor *p, bool d) :
+            src(s), pduDesc(p), done(d) { }
+    };
+
     void doShutdown(ChronicleSource *src);
     void doProcessRequest(ChronicleSource *src, PduDescriptor *pduDesc);
+    void doChecksumDone(ChecksumBatch *batch);
 
-    /// Checksum a single PDU descriptor
-    void checksumPdu(NfsV3PduDescriptor *desc, uint64_t fileOffset);
+    /// Whether any PDU in the chain has data to checksum
+    static bool needsChecksum(PduDescriptor *pduDesc);
+    /// Send the current batch to the workers
+    void submitBatch();
+    /// Pass on the completed PDUs at the head of _pending
+    void passOnCompleted();
+    /// Report the shutdown once all the batches have come back
+    void finishShutdown();
 
     ChronicleSource *_source;
 	OutputManager *_outputManager;
-    MurmurHash3_x64_128_State _mhstate;
+    ChecksumWorkerPool *_workers;
+    /// PDU chains in arrival order
+    std::deque<PendingPdu> _pending;
+    /// sequence number of _pending.front()
+    uint64_t _headSeq;
+    /// the batch being filled
+    ChecksumBatch *_batch;
+    /// batches handed to the workers that haven't come back
+    unsigned _outstandingBatches;
+    /// set once a shutdown is waiting for outstanding batches
+    bool _shuttingDown;
 	uint32_t _pipelineId;
 };
 
@@ -0,0 +1,293 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "ChecksumWorker.h"
+#include "ChecksumModule.h"
+#include "ChronicleConfig.h"
+#include "Message.h"
+#include "PcapPacketBufferPool.h"
+#include "RpcParser.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+/// The configured checksum algorithm (the apps validate dsChecksumAlgorithm)
+static MultiBlockHasher::Algorithm
+configuredAlgorithm()
+{
+    MultiBlockHasher::Algorithm alg;
+    if (!MultiBlockHasher::algorithmFromName(dsChecksumAlgorithm, &alg) ||
+        !MultiBlockHasher::isAvailable(alg)) {
+        alg = MultiBlockHasher::ALG_MURMUR3;
+    }
+    return alg;
+}
+
+static uint64_t
+nsNow()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000llu + ts.tv_nsec;
+}
+
+class ChecksumWorker::MessageBase : public Message {
+protected:
+    ChecksumWorker *_self;
+public:
+    MessageBase(ChecksumWorker *self) : _self(self) { }
+};
+
+ChecksumWorker::ChecksumWorker(uint32_t id) :
+    Process("ChecksumWorker"), _id(id),
+    _hasher(dsChecksumBlockSize, MultiBlockHasher::IMPL_BEST,
+            configuredAlgorithm()),
+    _numBlocks(0), _outstanding(0), _busyNs(0), _pdus(0), _bytes(0)
+{
+    _bufPool = PcapPacketBufferPool::registerBufferPool();
+    _staging = new unsigned char[MultiBlockHasher::MAX_LANES *
+                                 _hasher.getBlockSize()];
+}
+
+ChecksumWorker::~ChecksumWorker()
+{
+    delete [] _staging;
+    if (_bufPool && _bufPool->unregisterBufferPool())
+        delete _bufPool;
+}
+
+class ChecksumWorker::MessageChecksum: public MessageBase {
+protected:
+    ChecksumBatch *_batch;
+public:
+    MessageChecksum(ChecksumWorker *self, ChecksumBatch *batch) :
+        MessageBase(self), _batch(batch) { }
+    void run() { _self->doChecksum(_batch); }
+};
+
+void
+ChecksumWorker::checksum(ChecksumBatch *batch)
+{
+    ++_outstanding;
+    enqueueMessage(new MessageChecksum(this, batch));
+}
+
+void
+ChecksumWorker::doChecksum(ChecksumBatch *batch)
+{
+    uint64_t start = nsNow();
+    for (unsigned i = 0; i < batch->pdus.size(); ++i) {
+        checksumChain(batch->pdus[i]);
+    }
+    _busyNs += nsNow() - start;
+    _pdus += batch->pdus.size();
+    --_outstanding;
+    batch->owner->checksumDone(batch);
+}
+
+void
+ChecksumWorker::getStats(uint64_t &busyNs, uint64_t &pdus, uint64_t &bytes)
+{
+    busyNs = _busyNs.load();
+    pdus = _pdus.load();
+    bytes = _bytes.load();
+}
+
+void
+ChecksumWorker::checksumChain(PduDescriptor *pduDesc)
+{
+    uint64_t fileOffset = 0;
+    for (PduDescriptor *d = pduDesc; d != 0; d = d->next) {
+        NfsV3PduDescriptor *nfsDesc = dynamic_cast<NfsV3PduDescriptor *>(d);
+        if (nfsDesc && nfsDesc->parsable) {
+            // relies on the fact that calls precede replies for the same op.
+            if (nfsDesc->rpcMsgType == RPC_CALL) {
+                fileOffset = nfsDesc->fileOffset;
+            }
+            if (nfsDesc->carriesData()) {
+                checksumPdu(nfsDesc, fileOffset);
+                // only the headers & checksums get written out from here on
+                if (pduEarlyRelease) {
+                    nfsDesc->releasePayloadPackets(_bufPool,
+                                                   dsEnableIpChecksum);
+                }
+            }
+        }
+    }
+}
+
+static void
+initDataPointers(PacketDescriptor *pkt, unsigned char **payloadStart,
+                 int *bytesLeft)
+{
+    *payloadStart = &pkt->packetBuffer[pkt->payloadOffset];
+    *bytesLeft = pkt->payloadLength;
+}
+
+static bool
+isFullPacket(PacketDescriptor *pkt)
+{
+    return pkt->pcapHeader.caplen == pkt->pcapHeader.len;
+}
+
+/// Moves to the next full packet with data in the PDU
+static bool
+nextDataPacket(NfsV3PduDescriptor *desc, PacketDescriptor **pkt,
+               unsigned char **data, int *bytesLeft)
+{
+    do {
+        if (*pkt == desc->lastPktDesc) {
+            return false;
+        }
+        *pkt = (*pkt)->next;
+        if (!*pkt || !isFullPacket(*pkt)) {
+            return false;
+        }
+        initDataPointers(*pkt, data, bytesLeft);
+    } while (*bytesLeft <= 0);
+    return true;
+}
+
+void
+ChecksumWorker::checksumPdu(NfsV3PduDescriptor *desc, uint64_t fileOffset)
+{
+    PacketDescriptor *currentPacket = desc->pktDesc[0];
+    if (!currentPacket || !isFullPacket(currentPacket))
+        return;
+    unsigned char *currentData;
+    int pktBytesRemaining;
+    initDataPointers(currentPacket, &currentData, &pktBytesRemaining);
+    // advance to start of xfer data
+    int delta = desc->miscIndex0 - currentPacket->payloadOffset;
+    if (delta < 0 || delta > pktBytesRemaining)
+        return;
+    currentData += delta;
+    pktBytesRemaining -= delta;
+    int opBytesRemaining = desc->byteCount;
+    const int blockSize = _hasher.getBlockSize();
+
+    // advance to the next block boundary
+    int skip = (blockSize - (fileOffset % blockSize)) % blockSize;
+    opBytesRemaining -= skip;
+    fileOffset += skip;
+    while (skip) {
+        if (pktBytesRemaining == 0 &&
+            !nextDataPacket(desc, &currentPacket, &currentData,
+                            &pktBytesRemaining)) {
+            return;
+        }
+        int bytes = std::min(skip, pktBytesRemaining);
+        currentData += bytes;
+        pktBytesRemaining -= bytes;
+        skip -= bytes;
+    }
+
+    _numBlocks = 0;
+    while (opBytesRemaining >= blockSize) {
+        if (pktBytesRemaining == 0 &&
+            !nextDataPacket(desc, &currentPacket, &currentData,
+                            &pktBytesRemaining)) {
+            break;
+        }
+        if (pktBytesRemaining >= blockSize) {
+            // the whole block is in this packet: hash it in place
+            _blocks[_numBlocks] = currentData;
+            currentData += blockSize;
+            pktBytesRemaining -= blockSize;
+        } else {
+            // the block spans packets: gather it into the staging area
+            unsigned char *stage = &_staging[_numBlocks * blockSize];
+            int copied = 0;
+            while (copied < blockSize) {
+                if (pktBytesRemaining == 0 &&
+                    !nextDataPacket(desc, &currentPacket, &currentData,
+                                    &pktBytesRemaining)) {
+                    break;
+                }
+                int bytes = std::min(blockSize - copied,
+                                     pktBytesRemaining);
+                memcpy(stage + copied, currentData, bytes);
+                copied += bytes;
+                currentData += bytes;
+                pktBytesRemaining -= bytes;
+            }
+            if (copied < blockSize) {
+                break; // truncated or missing packet
+            }
+            _blocks[_numBlocks] = stage;
+        }
+        _blockOffsets[_numBlocks] = fileOffset;
+        fileOffset += blockSize;
+        opBytesRemaining -= blockSize;
+        if (++_numBlocks == MultiBlockHasher::MAX_LANES) {
+            flushBlocks(desc);
+        }
+    }
+    flushBlocks(desc);
+}
+
+void
+ChecksumWorker::flushBlocks(NfsV3PduDescriptor *desc)
+{
+    uint64_t hashvalues[MultiBlockHasher::MAX_LANES];
+    _hasher.hash(_blocks, _numBlocks, hashvalues);
+    for (unsigned i = 0; i < _numBlocks; ++i) {
+        NfsV3PduDescriptor::ChecksumRecord rec(hashvalues[i],
+                                               _blockOffsets[i]);
+        desc->dataChecksums.push_back(rec);
+    }
+    _bytes += _numBlocks * _hasher.getBlockSize();
+    _numBlocks = 0;
+}
+
+class ChecksumWorker::MessageShutdown: public MessageBase {
+public:
+    MessageShutdown(ChecksumWorker *self) : MessageBase(self) { }
+    void run() { _self->doShutdown(); }
+};
+
+void
+ChecksumWorker::shutdown()
+{
+    enqueueMessage(new MessageShutdown(this));
+}
+
+void
+ChecksumWorker::doShutdown()
+{
+    exit();
+}
+
+ChecksumWorkerPool::ChecksumWorkerPool(unsigned numWorkers)
+{
+    for (unsigned i = 0; i < numWorkers; ++i) {
+        _workers.push_back(new ChecksumWorker(i));
+    }
+}
+
+void
+ChecksumWorkerPool::submit(ChecksumBatch *batch)
+{
+    std::list<ChecksumWorker *>::const_iterator it = _workers.begin();
+    ChecksumWorker *worker = *it;
+    unsigned load = worker->getOutstanding();
+    for (++it; it != _workers.end() && load; ++it) {
+        if ((*it)->getOutstanding() < load) {
+            worker = *it;
+            load = worker->getOutstanding();
+        }
+    }
+    worker->checksum(batch);
+}
+
+void
+ChecksumWorkerPool::shutdown()
+{
+    for (std::list<ChecksumWorker *>::const_iterator it = _workers.begin();
+         it != _workers.end(); ++it) {
+        (*it)->shutdown();
+    }
+}
@@ -0,0 +1,106 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef CHECKSUM_WORKER_H
+#define CHECKSUM_WORKER_H
+
+#include <atomic>
+#include <list>
+#include <vector>
+#include "Process.h"
+#include "ChronicleProcess.h"
+#include "MultiBlockHasher.h"
+
+class ChecksumModule;
+class PacketBufferPool;
+
+/**
+ * A batch of PDU chains sent by a ChecksumModule to a ChecksumWorker.
+ * The worker hashes the chains in place and hands the same batch back.
+ */
+struct ChecksumBatch {
+    /// the module to return the batch to
+    ChecksumModule *owner;
+    /// the PDU chains to checksum
+    std::vector<PduDescriptor *> pdus;
+    /// the owner's sequence numbers of the chains in pdus
+    std::vector<uint64_t> seqs;
+
+    ChecksumBatch(ChecksumModule *o) : owner(o) { }
+};
+
+/**
+ * A checksum worker hashes the NFS read/write data of the batches it is
+ * given. Workers are shared by all the pipelines, so the hashing capacity
+ * doesn't depend on the number of pipelines.
+ */
+class ChecksumWorker : public Process {
+public:
+    ChecksumWorker(uint32_t id);
+    ~ChecksumWorker();
+
+    /// Checksum a batch and return it to batch->owner
+    void checksum(ChecksumBatch *batch);
+    /// Terminate the worker
+    void shutdown();
+    std::string getId() { return std::to_string(_id); }
+
+    /// The number of batches queued on this worker
+    unsigned getOutstanding() { return _outstanding.load(); }
+    /// Cumulative counters for the StatGatherer
+    void getStats(uint64_t &busyNs, uint64_t &pdus, uint64_t &bytes);
+
+private:
+    class MessageBase;
+    class MessageChecksum;
+    class MessageShutdown;
+
+    void doChecksum(ChecksumBatch *batch);
+    void doShutdown();
+
+    /// Checksum the READ/WRITE PDUs of a call/reply chain
+    void checksumChain(PduDescriptor *pduDesc);
+    /// Checksum a single PDU descriptor
+    void checksumPdu(NfsV3PduDescriptor *desc, uint64_t fileOffset);
+    /// Hash the gathered blocks and append their checksum records
+    void flushBlocks(NfsV3PduDescriptor *desc);
+
+    uint32_t _id;
+    PacketBufferPool *_bufPool;
+    MultiBlockHasher _hasher;
+    /// blocks waiting to be hashed, either in place or in _staging
+    const unsigned char *_blocks[MultiBlockHasher::MAX_LANES];
+    /// file offsets of the blocks in _blocks
+    uint64_t _blockOffsets[MultiBlockHasher::MAX_LANES];
+    unsigned _numBlocks;
+    /// copies of the blocks that span packets
+    unsigned char *_staging;
+
+    std::atomic<unsigned> _outstanding;
+    std::atomic<uint64_t> _busyNs;
+    std::atomic<uint64_t> _pdus;
+    std::atomic<uint64_t> _bytes;
+};
+
+/**
+ * The set of checksum workers shared by the NFS pipelines
+ */
+class ChecksumWorkerPool {
+public:
+    ChecksumWorkerPool(unsigned numWorkers);
+    ~ChecksumWorkerPool() { }
+
+    /// Queue a batch on the least loaded worker
+    void submit(ChecksumBatch *batch);
+    /// Terminate all the workers
+    void shutdown();
+    const std::list<ChecksumWorker *> &getWorkers() { return _workers; }
+
+private:
+    std::list<ChecksumWorker *> _workers;
+};
+
+#endif // CHECKSUM_WORKER_H
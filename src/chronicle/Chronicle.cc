@@ -24,6 +24,9 @@
 #include "CommandChannel.h"
 #include "ChroniclePipeline.h"
 #include "StatGatherer.h"
+#include "StatsSegment.h"
+#include "StageTracer.h"
+#include "Metrics.h"
 
 void _exit(int status)
 {
@@ -183,12 +186,17 @@ Chronicle::Chronicle(uint32_t numInterfaces, int channelFd,
 		_exit(EXIT_FAILURE);
 	_channel = new CommandChannel(this, channelFd, FDWatcher::EVENT_READ);
 	time_t timestamp = time(0);
-	_analyticsManager = new AnalyticsManager(this, analyticsEnabled, timestamp);
+	_analyticsManager = new AnalyticsManager(this, analyticsEnabled, timestamp,
+		numPipelines);
 	_outputManager = new OutputManager(this, outputFormat, numOutputManagers,
 		snapLength, _analyticsManager, timestamp);
 	_pipelineManager = new PipelineManager(this, _pipelineType, numPipelines,
 		_outputManager, snapLength);
     StatListener *listener = _outputManager->getStatListener(); 
+	_statsSegment = NULL;
+	if (statsSegmentEnabled)
+		listener = _statsSegment = new StatsSegment(STATS_SEGMENT_NAME,
+			listener);
 	_carbon = new CarbonSocket(listener);
     _statModule = new StatGatherer(_carbon, _analyticsManager);
     _statModule->setChronicle(this);
@@ -208,8 +216,10 @@ Chronicle::~Chronicle()
 	for (it = doneInterfaceStats.begin(); it != doneInterfaceStats.end(); it++) {
 		delete *it;
 	}
-    if (_carbon)
-        delete _carbon;
+	if (_carbon)
+		delete _carbon;
+	if (_statsSegment)
+		delete _statsSegment;
 	delete _queueCb;	
 	delete _selfFdQueue;
 	delete _fdWatcherCb;
@@ -521,6 +531,9 @@ Chronicle::doHandleCommandChannel(int command, std::list<std::string> args)
 		case CommandChannel::OP_ANALYTICS:
 			_analyticsManager->processCommand(args);	
 			break;
+		case CommandChannel::OP_METRICS:
+			Metrics::processCommand(args);
+			break;
 		case CommandChannel::OP_BAD_CHANNEL:
 		case CommandChannel::OP_CLOSED_CHANNEL:
 			std::cerr << FONT_RED << "Chronicle::doHandleCommandChannel: "
@@ -555,6 +568,15 @@ Chronicle::doHandleDeadChannel()
 	}
 	std::cout << "Chronicle quiting and printing stats!\n";
 	(*_compCb) (this, _statCb);
+	Metrics::print(std::cout);
+	if (StageTracer::isEnabled()) {
+		std::string traceFile = traceDirectory + "/" + TRACE_DUMP_FILE;
+		if (StageTracer::dumpChromeTrace(traceFile))
+			std::cout << "Stage trace written to " << traceFile << std::endl;
+		else
+			std::cerr << FONT_RED << "Chronicle::doHandleDeadChannel: "
+				<< "cannot write " << traceFile << "!\n" << FONT_DEFAULT;
+	}
 	exit();
 }
 
@@ -198,6 +198,8 @@ class Chronicle : public Process {
 		StatGatherer *_statModule;
 		/// Graphite handle
 		StatListener *_carbon;
+		/// shared memory stats handle (NULL if disabled)
+		StatListener *_statsSegment;
 		/// flag set when shutdown is in progress
 		bool _shutdownStarted;
 };
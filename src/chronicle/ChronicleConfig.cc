@@ -10,4 +10,13 @@ std::string traceDirectory(TRACE_DIRECTORY);
 off64_t dsFileSize = DS_DEFAULT_FILE_SIZE;
 unsigned dsExtentSize = DS_DEFAULT_EXTENT_SIZE;
 bool dsEnableIpChecksum = DS_DEFAULT_ENABLE_IP_CHECKSUM;
-
+std::string dsChecksumAlgorithm(DS_DEFAULT_CHECKSUM_ALGORITHM);
+unsigned dsChecksumBlockSize = DS_DEFAULT_CHECKSUM_BLOCK_SIZE;
+unsigned dsChecksumWorkerNum = DS_DEFAULT_CHECKSUM_WORKER_NUM;
+std::string anonKeyFile(ANON_DEFAULT_KEY_FILE);
+bool anonIds = ANON_DEFAULT_IDS;
+bool anonFileHandles = ANON_DEFAULT_FILE_HANDLES;
+unsigned anonCacheMB = ANON_DEFAULT_CACHE_MB;
+bool pduEarlyRelease = PDU_DEFAULT_EARLY_RELEASE;
+unsigned traceSampleRate = TRACE_DEFAULT_SAMPLE_RATE;
+bool statsSegmentEnabled = STATS_SEGMENT_DEFAULT_ENABLED;
@@ -20,23 +20,19 @@
 #define CHRONICLE_DEBUG_VALGRIND				(1 << 4)
 #define CHRONICLE_DEBUG_BUFPOOL					(1 << 5)
 #define CHRONICLE_DEBUG_FLOWTABLE				(1 << 6)
-#define CHRONICLE_DEBUG_STAT					(1 << 7)
+// (1 << 7) and (1 << 10) used to be the STAT and NETWORK_STAT builds; those
+// counters are now always on (see Metrics.h) and their verbose parts are
+// switched at runtime with the METRICS command
 #define CHRONICLE_DEBUG_CACHE					(1 << 8)
 #define CHRONICLE_DEBUG_PKTLOSS					(1 << 9)
-#define CHRONICLE_DEBUG_NETWORK_STAT			(1 << 10)
 #define CHRONICLE_DEBUG_LEAK					(CHRONICLE_DEBUG_FLOWTABLE | \
 												 CHRONICLE_DEBUG_BUFPOOL | \
-												 CHRONICLE_DEBUG_STAT | \
 												 CHRONICLE_DEBUG_RPC | \
 												 CHRONICLE_DEBUG_GC)
 #define CHRONICLE_DEBUG_PROFILE					(CHRONICLE_DEBUG_FLOWTABLE | \
-												 CHRONICLE_DEBUG_BUFPOOL | \
-												 CHRONICLE_DEBUG_STAT)
-#define CHRONICLE_DEBUG_STAT_ALL				(CHRONICLE_DEBUG_STAT | \
-												 CHRONICLE_DEBUG_NETWORK_STAT)
+												 CHRONICLE_DEBUG_BUFPOOL)
 
-//#define CHRONICLE_DEBUG							0
-#define CHRONICLE_DEBUG							CHRONICLE_DEBUG_STAT
+#define CHRONICLE_DEBUG							0
 #define CHRON_DEBUG(mode)						(CHRONICLE_DEBUG & (mode))
 
 /* ======================== *
@@ -71,6 +67,9 @@ extern std::string traceDirectory;
 // Ethernet frame size
 #define MAX_ETH_FRAME_SIZE_STAND				1536
 #define MAX_ETH_FRAME_SIZE_JUMBO				9216
+// Are READ/WRITE payload packets released right after checksumming?
+#define PDU_DEFAULT_EARLY_RELEASE				true
+extern bool pduEarlyRelease;
 
 //CHRONICLE01 (2x10Gb NIC)
 // number of standard sized packets in the buffer pool 
@@ -132,6 +131,97 @@ extern unsigned dsExtentSize;
 // Are IP and Checksum extents enabled?
 #define DS_DEFAULT_ENABLE_IP_CHECKSUM           true
 extern bool dsEnableIpChecksum;
+// READ/WRITE block checksum algorithm ("murmur3", "crc32c", or "xxh3")
+#define DS_DEFAULT_CHECKSUM_ALGORITHM           "murmur3"
+extern std::string dsChecksumAlgorithm;
+// READ/WRITE checksum block size (a power of 2)
+#define DS_DEFAULT_CHECKSUM_BLOCK_SIZE          512
+#define DS_MIN_CHECKSUM_BLOCK_SIZE              512
+#define DS_MAX_CHECKSUM_BLOCK_SIZE              (64 * 1024)
+extern unsigned dsChecksumBlockSize;
+// Number of checksum workers shared by the NFS pipelines
+// (0: one per libtask thread)
+#define DS_DEFAULT_CHECKSUM_WORKER_NUM          0
+extern unsigned dsChecksumWorkerNum;
+// Max number of READ/WRITE PDUs a pipeline sends to a worker at a time
+#define DS_CHECKSUM_BATCH_SIZE                  32
+
+/* ====================== *
+ * Inline anonymization   *
+ * ====================== */
+// Key file for anonymizing the NFS pipelines' output ("": no anonymization)
+#define ANON_DEFAULT_KEY_FILE					""
+extern std::string anonKeyFile;
+// Encrypt uids and gids (FPE) too
+#define ANON_DEFAULT_IDS						false
+extern bool anonIds;
+// Replace file handles with their HMAC too
+#define ANON_DEFAULT_FILE_HANDLES				false
+extern bool anonFileHandles;
+// Number of upper bits replaced in IP addresses (as in anonymizeNfs3Trace)
+#define ANON_IP_BITS							8
+// Size (in MB) of the memo cache of anonymized values shared by the pipelines
+#define ANON_DEFAULT_CACHE_MB					256
+extern unsigned anonCacheMB;
+
+/* ================== *
+ * Analytics defaults *
+ * ================== */
+// Reporting interval (in seconds) of the built-in analytics modules
+#define ANALYTICS_DEFAULT_INTERVAL				10
+// Max number of clients (and servers) with their own latency histograms
+// (has to be power of 2)
+#define ANALYTICS_LATENCY_MAX_HOSTS				256
+// Number of keys monitored by each heavy hitters summary
+#define ANALYTICS_HEAVY_HITTERS_CAPACITY		512
+// Number of heavy hitters reported per summary
+#define ANALYTICS_HEAVY_HITTERS_TOPK			10
+// Number of intervals in the heavy hitters sliding window
+#define ANALYTICS_HEAVY_HITTERS_WINDOW			6
+#define ANALYTICS_HEAVY_HITTERS_MAX_WINDOW		360
+// HyperLogLog precision (each sketch takes 2^precision bytes)
+#define ANALYTICS_HLL_PRECISION					14
+// Block size for counting distinct blocks and working sets
+#define ANALYTICS_WORKING_SET_BLOCK_SIZE		4096
+// Max READ/WRITE transfer size counted (byte counts come off the wire)
+#define ANALYTICS_MAX_TRANSFER_SIZE				(1024 * 1024)
+// Max number of READ/WRITE streams (client, file) tracked per shard
+#define ANALYTICS_IO_PATTERN_MAX_STREAMS		65536
+
+/* ============================ *
+ * Per-stage latency tracing    *
+ * ============================ */
+// Trace 1 in this many packets through the pipeline stages (0: disabled)
+#define TRACE_DEFAULT_SAMPLE_RATE				0
+extern unsigned traceSampleRate;
+// Max number of traced packets in flight (has to fit in 16 bits)
+#define TRACE_MAX_SAMPLES						4096
+// Number of completed samples kept for the Chrome trace dump
+#define TRACE_DUMP_SAMPLES						4096
+// Chrome trace file written under traceDirectory on exit
+#define TRACE_DUMP_FILE							"chronicle_stages.json"
+
+/* ============================ *
+ * Metrics                      *
+ * ============================ */
+// Max number of threads with their own slot in every metric (the rest share
+// one)
+#define METRICS_MAX_THREADS						64
+// Verbose metrics categories on at startup (Metrics::Category bits)
+#define METRICS_DEFAULT_VERBOSE					0
+
+/* ============================ *
+ * Stats export                 *
+ * ============================ */
+// Publish the stats in a shared memory segment (in addition to Carbon)
+#define STATS_SEGMENT_DEFAULT_ENABLED			false
+extern bool statsSegmentEnabled;
+// Name of the shared memory segment (as in shm_open)
+#define STATS_SEGMENT_NAME						"/chronicle_stats"
+// Max number of distinct stats in the segment
+#define STATS_SEGMENT_MAX_ENTRIES				8192
+// Max stat name length (incl. the terminating null; 128-byte entries)
+#define STATS_SEGMENT_NAME_LEN					120
 
 /* ============ *
  * Misc. macros *
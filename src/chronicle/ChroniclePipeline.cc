@@ -18,6 +18,10 @@
 #include "PcapWriterFactory.h"
 #include "NfsParser.h"
 #include "ChecksumModule.h"
+#include "ChecksumWorker.h"
+#include "AnonymizeModule.h"
+#include "AnonHelper.h"
+#include "MemoCache.h"
 #include "StatGatherer.h"
 
 ChroniclePipeline *PipelineManager::_pipelines[MAX_PIPELINE_NUM];
@@ -62,11 +66,22 @@ PipelineManager::PipelineManager(Chronicle *supervisor, uint8_t pipelineType,
 	: Process("PipelineManager"), _supervisor(supervisor), _numPipelines(num)
 {
 	_killedPipelines = 0;
+	_checksumWorkers = NULL;
+	_anonCache = NULL;
 	switch(pipelineType) {
 		case NFS_PIPELINE:
+			if (dsEnableIpChecksum)
+				_checksumWorkers = new ChecksumWorkerPool(dsChecksumWorkerNum);
+			if (!anonKeyFile.empty()) {
+				initCryptoThreads();
+				if (anonCacheMB)
+					_anonCache = new MemoCache(anonKeyFile,
+						static_cast<size_t>(anonCacheMB) << 20);
+			}
 			for (uint32_t i = 0; i < MAX_PIPELINE_NUM; i++) {
 				if (i < _numPipelines)
-					_pipelines[i] = new NfsPipeline(this, i, outputModule);
+					_pipelines[i] = new NfsPipeline(this, i, outputModule,
+						_checksumWorkers, _anonCache);
 				else
 					_pipelines[i] = _pipelines[i % _numPipelines];
 			}
@@ -82,6 +97,12 @@ PipelineManager::PipelineManager(Chronicle *supervisor, uint8_t pipelineType,
 	}
 }
 
+PipelineManager::~PipelineManager()
+{
+	delete _checksumWorkers;
+	delete _anonCache;
+}
+
 void
 PipelineManager::processDone(ChronicleSink *sink)
 {
@@ -139,6 +160,11 @@ PipelineManager::doHandlePipelineShutdown(ChronicleSink *sink)
 		return ;
 	}
 	if (++_killedPipelines == _numPipelines) {
+		// every pipeline has drained its outstanding checksum batches
+		if (_checksumWorkers)
+			_checksumWorkers->shutdown();
+		if (_anonCache)
+			_anonCache->printStats(std::cout);
 		_supervisor->handlePipelineManagerShutdown();
 		exit();
 	}
@@ -149,6 +175,8 @@ PipelineManager::addPipelineMembers(StatGatherer *statGatherer)
 {
 	for (uint32_t i = 0; i < _numPipelines; i++)
 		statGatherer->addPipeline(_pipelines[i]->getPipelineMembers());
+	if (_checksumWorkers)
+		statGatherer->addChecksumWorkers(_checksumWorkers->getWorkers());
 }
 
 ChroniclePipeline *
@@ -173,7 +201,8 @@ ChroniclePipeline::~ChroniclePipeline()
 }
 
 NfsPipeline::NfsPipeline(PipelineManager *manager, uint32_t id, 
-		OutputManager *outputModule)
+		OutputManager *outputModule, ChecksumWorkerPool *checksumWorkers,
+		MemoCache *anonCache)
 	: ChroniclePipeline(manager, id)
 {
 	RpcParserFactory f;
@@ -185,11 +214,27 @@ NfsPipeline::NfsPipeline(PipelineManager *manager, uint32_t id,
 	rpcParser->setSink(nfsParser);
     _pipelineMembers.nfsParser = nfsParser;
 
+    // anonymize before the checksum module releases the payload packets
+    // (and copies their addresses)
+    AnonymizeModule *anon = 0;
+    if (!anonKeyFile.empty()) {
+        anon = new AnonymizeModule(nfsParser, id, outputModule, anonCache);
+        _pipelineMembers.anonymizeModule = anon;
+        nfsParser->setSink(anon);
+    }
+
     ChecksumModule *xsum = 0;
-    if (dsEnableIpChecksum) {
-        xsum = new ChecksumModule(nfsParser, id, outputModule);
+    if (checksumWorkers) {
+        if (anon) {
+            xsum = new ChecksumModule(anon, id, outputModule,
+                                      checksumWorkers);
+            anon->setSink(xsum);
+        } else {
+            xsum = new ChecksumModule(nfsParser, id, outputModule,
+                                      checksumWorkers);
+            nfsParser->setSink(xsum);
+        }
         _pipelineMembers.checksumModule = xsum;
-        nfsParser->setSink(xsum);
     }
 }
 
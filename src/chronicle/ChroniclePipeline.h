@@ -17,12 +17,17 @@ class StatGatherer;
 class RpcParser;
 class NfsParser;
 class ChecksumModule;
+class ChecksumWorkerPool;
+class AnonymizeModule;
+class MemoCache;
 
 struct PipelineMembers {
     RpcParser *rpcParser;
     NfsParser *nfsParser;
+    AnonymizeModule *anonymizeModule;
     ChecksumModule *checksumModule;
-    PipelineMembers() : rpcParser(0), nfsParser(0), checksumModule(0) { }
+    PipelineMembers() : rpcParser(0), nfsParser(0), anonymizeModule(0),
+        checksumModule(0) { }
 };
 
 /**
@@ -32,7 +37,7 @@ class PipelineManager : public Process, public ChronicleSource {
 	public:
 		PipelineManager(Chronicle *supervisor, uint8_t pipelineType,
 			uint32_t num, OutputManager *outputModule, int snapLength);
-		~PipelineManager() { } 
+		~PipelineManager(); 
 		/**
 		 * invoked when the pipeline has completely shut down
 		 * @param[in] sink The process that has shut down
@@ -82,6 +87,10 @@ class PipelineManager : public Process, public ChronicleSource {
 		uint32_t _numPipelines;
 		// number of killed pipelines
 		uint32_t _killedPipelines;
+		// checksum workers shared by the NFS pipelines
+		ChecksumWorkerPool *_checksumWorkers;
+		// memo cache of anonymized values shared by the NFS pipelines
+		MemoCache *_anonCache;
 };
 
 /**
@@ -116,7 +125,8 @@ class ChroniclePipeline {
 class NfsPipeline : public ChroniclePipeline {
 	public:
 		NfsPipeline(PipelineManager *manager, uint32_t id, 
-			OutputManager *outputModule);
+			OutputManager *outputModule, ChecksumWorkerPool *checksumWorkers,
+			MemoCache *anonCache);
 		~NfsPipeline() { }
 };
 
@@ -10,6 +10,7 @@
 #include <time.h>
 #include <sstream>
 #include "ChronicleProcessRequest.h"
+#include "PacketBufferPool.h"
 #include "RpcParser.h"
 #include "TcpStreamNavigator.h"
 
@@ -49,6 +50,19 @@ PacketDescriptor::print()
 	#endif
 }
 
+PacketSummary::PacketSummary(PacketDescriptor *pktDesc)
+	: interface(pktDesc->interface), ts(pktDesc->pcapHeader.ts), 
+	  wireLength(pktDesc->pcapHeader.len), srcIP(pktDesc->srcIP), 
+	  destIP(pktDesc->destIP), tcpSeqNum(pktDesc->tcpSeqNum), 
+	  srcPort(pktDesc->srcPort), destPort(pktDesc->destPort), 
+	  payloadLength(pktDesc->payloadLength), ringId(pktDesc->ringId),
+	  protocol(pktDesc->protocol)
+{
+	unsigned char *ethFrame = pktDesc->getEthFrameAddress();
+	memcpy(destMac, ethFrame, sizeof(destMac));
+	memcpy(srcMac, &ethFrame[6], sizeof(srcMac));
+}
+
 int
 PduDescriptor::getNumPackets()
 {
@@ -77,6 +91,42 @@ PduDescriptor::tagPduPkts(uint8_t processId)
 
 NfsV3PduDescriptor::~NfsV3PduDescriptor()
 {
+	delete anonymized;
+}
+
+bool
+NfsV3PduDescriptor::carriesData()
+{
+	if (!parsable || pktDesc[0] == NULL)
+		return false;
+	return (rpcMsgType == RPC_CALL && rpcProgramProcedure == NFS3PROC_WRITE) 
+		|| (rpcMsgType == RPC_REPLY && rpcProgramProcedure == NFS3PROC_READ 
+			&& nfsStatus == NFS_OK);
+}
+
+unsigned
+NfsV3PduDescriptor::releasePayloadPackets(PacketBufferPool *bufPool,
+	bool keepSummaries)
+{
+	// Only complete PDUs are guaranteed to exclusively own the packets 
+	// between their first and last packet. The last packet may also hold 
+	// the start of the next PDU and is always kept.
+	if (rpcPduType != PDU_COMPLETE || !carriesData() || 
+			pktDesc[0] == lastPktDesc)
+		return 0;
+	unsigned released = 0;
+	PacketDescriptor *tmpPktDesc = pktDesc[0]->next, *oldPktDesc;
+	while (tmpPktDesc != lastPktDesc) {
+		if (keepSummaries)
+			releasedPktSummaries.push_back(PacketSummary(tmpPktDesc));
+		oldPktDesc = tmpPktDesc;
+		tmpPktDesc = tmpPktDesc->next;
+		bufPool->releasePduPacket(this, oldPktDesc);
+		released++;
+	}
+	pktDesc[0]->next = lastPktDesc;
+	lastPktDesc->prev = pktDesc[0];
+	return released;
 }
 
 bool
@@ -111,9 +161,51 @@ err:
 	return false;
 }
 
+std::string
+NfsV3PduDescriptor::getFileNameStr(uint16_t index, PacketDescriptor *pktDesc)
+{
+	if (anonymized) {
+		const std::string *name =
+			AnonymizedFields::find(anonymized->names, index, pktDesc);
+		return name ? *name : std::string();
+	}
+	unsigned char name[NFS_MAXNAMLEN + 1];
+	if (!getFileName(name, index, pktDesc))
+		return std::string();
+	return std::string(reinterpret_cast<char *>(name));
+}
+
+std::string
+NfsV3PduDescriptor::getPathNameStr(uint16_t index, PacketDescriptor *pktDesc)
+{
+	if (anonymized) {
+		const std::string *name =
+			AnonymizedFields::find(anonymized->names, index, pktDesc);
+		return name ? *name : std::string();
+	}
+	unsigned char name[NFS_MAXPATHLEN + 1];
+	if (!getPathName(name, index, pktDesc))
+		return std::string();
+	return std::string(reinterpret_cast<char *>(name));
+}
+
 bool 
 NfsV3PduDescriptor::getLink(Link *link)
 {
+	unsigned char linkName[NFS_MAXNAMLEN + 1];
+	if (anonymized) {
+		// the handle and the name are both found at miscIndex0
+		const std::string *fh = AnonymizedFields::find(
+			anonymized->fileHandles, miscIndex0, pktDesc[0]);
+		const std::string *name = AnonymizedFields::find(
+			anonymized->names, miscIndex0, pktDesc[0]);
+		if (!fh || !name)
+			return false;
+		fhLen = fh->size();
+		memcpy(link->dirFileHandle, fh->data(), fhLen);
+		link->linkName = *name;
+		return true;
+	}
 	TcpStreamNavigator *streamNavigator = new TcpStreamNavigator();
 	if (!streamNavigator->init(this, miscIndex0, pktDesc[0])) 
 		goto err;
@@ -123,8 +215,9 @@ NfsV3PduDescriptor::getLink(Link *link)
 		goto err;
 	if (!streamNavigator->getBytesPdu(&link->dirFileHandle[0], fhLen))
 		goto err;
-	if (!streamNavigator->getStringPdu(&link->linkName[0], NFS_MAXPATHLEN))
+	if (!streamNavigator->getStringPdu(linkName, NFS_MAXNAMLEN))
 		goto err;	
+	link->linkName = reinterpret_cast<char *>(linkName);
 	delete streamNavigator;
 	return true;
 err:
@@ -210,10 +303,13 @@ err:
 }
 
 bool
-NfsV3PduDescriptor::getReaddirEntry(unsigned char *fileName, bool &eof)
+NfsV3PduDescriptor::getReaddirEntry(std::string *fileName, bool &eof)
 {
 	uint32_t follows;	
+	unsigned char name[NFS_MAXNAMLEN + 1];
 	
+	if (anonymized)
+		return getAnonymizedDirEntry(fileName, eof);
 	TcpStreamNavigator *streamNavigator = new TcpStreamNavigator();
 	if (!streamNavigator->init(this, miscIndex0, pktDesc[0])) 
 		goto err;	
@@ -222,8 +318,9 @@ NfsV3PduDescriptor::getReaddirEntry(unsigned char *fileName, bool &eof)
 	if (follows == 1) {
 		if (!streamNavigator->getUint64Pdu(&fileId)) 
 			goto err;
-		if (!streamNavigator->getStringPdu(fileName, NFS_MAXNAMLEN)) 
+		if (!streamNavigator->getStringPdu(name, NFS_MAXNAMLEN)) 
 			goto err;
+		*fileName = reinterpret_cast<char *>(name);
 		if (!streamNavigator->skipBytesPdu(8)) // skipping cookie
 			goto err;
 		miscIndex0 = streamNavigator->getIndex();		
@@ -239,10 +336,13 @@ err:
 }
 
 bool
-NfsV3PduDescriptor::getReaddirplusEntry(unsigned char *fileName, bool &eof)
+NfsV3PduDescriptor::getReaddirplusEntry(std::string *fileName, bool &eof)
 {
 	uint32_t follows;	
+	unsigned char name[NFS_MAXNAMLEN + 1];
 	
+	if (anonymized)
+		return getAnonymizedDirEntry(fileName, eof);
 	TcpStreamNavigator *streamNavigator = new TcpStreamNavigator();
 	if (!streamNavigator->init(this, miscIndex0, pktDesc[0])) 
 		goto err;	
@@ -252,8 +352,9 @@ NfsV3PduDescriptor::getReaddirplusEntry(unsigned char *fileName, bool &eof)
 	if (follows == 1) {
 		if (!streamNavigator->getUint64Pdu(&fileId)) 
 			goto err;
-		if (!streamNavigator->getStringPdu(fileName, NFS_MAXNAMLEN)) 
+		if (!streamNavigator->getStringPdu(name, NFS_MAXNAMLEN)) 
 			goto err;
+		*fileName = reinterpret_cast<char *>(name);
 		if (!streamNavigator->skipBytesPdu(8)) // skipping cookie
 			goto err;
 		
@@ -340,9 +441,37 @@ err:
 	return false;
 }
 
+bool
+NfsV3PduDescriptor::getAnonymizedDirEntry(std::string *fileName, bool &eof)
+{
+	if (anonymized->nextDirEntry == anonymized->dirEntries.size()) {
+		// same outcome as decoding the rest of the packets
+		if (!anonymized->dirEntriesParsable) {
+			parsable = false;
+			return false;
+		}
+		eof = true;
+		return true;
+	}
+	const AnonymizedFields::DirEntry &entry =
+		anonymized->dirEntries[anonymized->nextDirEntry++];
+	*fileName = entry.fileName;
+	entry.copyTo(this);
+	return true;
+}
+
 bool
 NfsV3PduDescriptor::getFileHandle(uint16_t index, PacketDescriptor *pktDesc)
 {
+	if (anonymized) {
+		const std::string *fh =
+			AnonymizedFields::find(anonymized->fileHandles, index, pktDesc);
+		if (!fh)
+			return false;
+		fhLen = fh->size();
+		memcpy(fileHandle, fh->data(), fhLen);
+		return true;
+	}
 	TcpStreamNavigator *streamNavigator = new TcpStreamNavigator();
 	if (!streamNavigator->init(this, index, pktDesc))
 		goto err;
@@ -893,7 +1022,7 @@ NfsV3PduDescriptor::printLINK()
 				// Ok for debug!
 				memcpy(fileHandle, link.dirFileHandle, sizeof(fileHandle));
 				printFileHandle();
-				printf("link:%s\n", link.linkName);
+				printf("link:%s\n", link.linkName.c_str());
 			}
 			break;
 		case RPC_REPLY:
@@ -922,10 +1051,11 @@ NfsV3PduDescriptor::printREADDIR()
 			if (parsable) {
 				printf("status:%u\n", nfsStatus);
 				if (nfsStatus == NFS_OK) {
-					unsigned char fileName[NFS_MAXNAMLEN + 1];
+					std::string fileName;
 					bool eof = false;
-					while (getReaddirEntry(fileName, eof) && !eof) {
-						printf("file:%s fileid:%lu\n", fileName, fileId);
+					while (getReaddirEntry(&fileName, eof) && !eof) {
+						printf("file:%s fileid:%lu\n", fileName.c_str(),
+							fileId);
 						printf("$$$$$$$$$$$$$$$$$$$$$$$$$$\n");
 					}
 				}
@@ -950,10 +1080,10 @@ NfsV3PduDescriptor::printREADDIRPLUS()
 			if (parsable) {
 				printf("status:%u\n", nfsStatus);
 				if (nfsStatus == NFS_OK) {
-					unsigned char fileName[NFS_MAXNAMLEN + 1];
+					std::string fileName;
 					bool eof = false;
-					while (getReaddirplusEntry(fileName, eof) && !eof) {
-						printf("file:%s\n", fileName);
+					while (getReaddirplusEntry(&fileName, eof) && !eof) {
+						printf("file:%s\n", fileName.c_str());
 						printFileAttr();
 						printFileHandle();
 						printf("$$$$$$$$$$$$$$$$$$$$$$$$$$\n");
@@ -1147,3 +1277,49 @@ BadPduDescriptor::print()
 	pktDesc->print();
 	printf(">>>>>>>>>>>>>>>>>>>>>>>>>>\n");
 }
+
+const std::string *
+NfsV3PduDescriptor::AnonymizedFields::find(const std::vector<Value> &values,
+	uint16_t index, PacketDescriptor *pktDesc)
+{
+	for (std::vector<Value>::const_iterator it = values.begin();
+			it != values.end(); it++) {
+		if (it->index == index && it->pktDesc == pktDesc)
+			return &it->value;
+	}
+	return NULL;
+}
+
+void
+NfsV3PduDescriptor::AnonymizedFields::DirEntry::copyFrom(
+	const NfsV3PduDescriptor *desc)
+{
+	fileId = desc->fileId;
+	fileSizeBytes = desc->fileSizeBytes;
+	fileUsedBytes = desc->fileUsedBytes;
+	fileSystemId = desc->fileSystemId;
+	fileModTime = desc->fileModTime;
+	type = desc->type;
+	fileMode = desc->fileMode;
+	fileUid = desc->fileUid;
+	fileGid = desc->fileGid;
+	fhLen = desc->fhLen;
+	memcpy(fileHandle, desc->fileHandle, fhLen);
+}
+
+void
+NfsV3PduDescriptor::AnonymizedFields::DirEntry::copyTo(
+	NfsV3PduDescriptor *desc) const
+{
+	desc->fileId = fileId;
+	desc->fileSizeBytes = fileSizeBytes;
+	desc->fileUsedBytes = fileUsedBytes;
+	desc->fileSystemId = fileSystemId;
+	desc->fileModTime = fileModTime;
+	desc->type = type;
+	desc->fileMode = fileMode;
+	desc->fileUid = fileUid;
+	desc->fileGid = fileGid;
+	desc->fhLen = fhLen;
+	memcpy(desc->fileHandle, fileHandle, fhLen);
+}
@@ -16,9 +16,11 @@
 #include <linux/nfs3.h>
 #include "FifoList.h"	
 #include "PacketBuffer.h"
+#include "PacketBufferPool.h"
 #include "ChronicleConfig.h"
 #include <cstring>
 #include <list>
+#include <vector>
 
 class Interface;
 class PduDescriptor;
@@ -33,7 +35,8 @@ class PacketDescriptor : public FifoNode<PacketDescriptor> {
 		PacketDescriptor() 
 		{
 			refCount = 0; 
-			#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL | CHRONICLE_DEBUG_STAT)
+			traceId = 0;
+			#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL)
 			allocated = false;
 			#endif
 			#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL)
@@ -88,7 +91,9 @@ class PacketDescriptor : public FifoNode<PacketDescriptor> {
 		uint8_t protocol;
 		/// flag (in order, truncated, etc.)
 		uint8_t flag;
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL | CHRONICLE_DEBUG_STAT)
+		/// StageTracer sample id (0 if the packet isn't traced)
+		uint16_t traceId;
+		#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL)
 		/// whether packet is allocated
 		std::atomic<bool> allocated;
 		#endif
@@ -100,6 +105,43 @@ class PacketDescriptor : public FifoNode<PacketDescriptor> {
 		#endif
 };
 
+/**
+ * A compact copy of the header fields of a packet that is released back to
+ * the buffer pool before the PDU is written out (i.e., the fields needed for
+ * the IP extent).
+ */
+class PacketSummary {
+	public:
+		PacketSummary(PacketDescriptor *pktDesc);
+
+		/// pointer to the packet interface
+		Interface *interface;
+		/// capture timestamp
+		struct timeval ts;
+		/// packet length on the wire
+		uint32_t wireLength;
+		/// source IP address
+		uint32_t srcIP;
+		/// destination IP address
+		uint32_t destIP;
+		/// TCP sequence number (if applicable)
+		uint32_t tcpSeqNum;
+		/// source port
+		uint16_t srcPort;
+		/// destination port
+		uint16_t destPort;
+		/// payload length
+		uint16_t payloadLength;
+		/// NIC ring id
+		uint16_t ringId;
+		/// source MAC address
+		unsigned char srcMac[6];
+		/// destination MAC address
+		unsigned char destMac[6];
+		/// transport protocol (e.g., UDP, TCP, etc.)
+		uint8_t protocol;
+};
+
 class PduDescriptor {
 	public:
 		/// PDU types
@@ -124,14 +166,14 @@ class PduDescriptor {
 			  rpcHeaderOffset(rpcHeaderOffset),
 			  rpcProgramStartOffset(rpcProgOffset), 
 			  rpcAcceptState(acceptState), rpcMsgType(msgType) 
-			  { next = NULL; refCount = 1; }
+			  { next = NULL; refCount = 1; initHeldBufs(); }
 		/// constructors for "bad" PDUs
 		PduDescriptor(PacketDescriptor *firstDesc, 
 			PacketDescriptor *lastDesc) 
 			: firstPktDesc(firstDesc), lastPktDesc(lastDesc)
-			  { rpcPduType = PDU_BAD; }
+			  { rpcPduType = PDU_BAD; initHeldBufs(); }
 		PduDescriptor(PacketDescriptor *firstDesc) 
-			: firstPktDesc(firstDesc) { rpcPduType = PDU_BAD; }
+			: firstPktDesc(firstDesc) { rpcPduType = PDU_BAD; initHeldBufs(); }
 		#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL)
 		/// tags packets with the last process
 		void tagPduPkts(uint8_t processId);
@@ -177,9 +219,23 @@ class PduDescriptor {
 		uint8_t rpcMsgType;
 		/// Record id assigned by DsWriter
 		uint64_t dsRecordId;
+		/// Buffers (standard and jumbo) this PDU holds references to
+		uint32_t heldBufs[2];
+		/// Whether heldBufs has been counted (on the first hand-over)
+		bool heldBufsCounted;
+		/// The stage holding this PDU
+		PacketBufferPool::Holder bufHolder;
 		#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL)
 		uint8_t lastTouchingProcess;
 		#endif
+
+	private:
+		/// PDUs are born in RpcParser out of reassembled packets
+		void initHeldBufs() {
+			heldBufs[0] = heldBufs[1] = 0;
+			heldBufsCounted = false;
+			bufHolder = PacketBufferPool::HOLDER_REASSEMBLY;
+		}
 };
 
 class NfsV3PduDescriptor : public PduDescriptor {
@@ -190,6 +246,7 @@ class NfsV3PduDescriptor : public PduDescriptor {
 		class Fsinfo;
 		class Pathconf;
 		class ChecksumRecord;
+		class AnonymizedFields;
 
 		/// Constructor for an NFS PDU
 		NfsV3PduDescriptor(PacketDescriptor *firstPktDesc,
@@ -200,18 +257,39 @@ class NfsV3PduDescriptor : public PduDescriptor {
 			: PduDescriptor(firstPktDesc, firstProgPktDesc, pduLen, xid, 
 			  NFS_PROGRAM, progVersion, progProc, rpcHeaderOffset,
 			  rpcProgOffset, acceptState, msgType)
-			  { parsable = false; fhLen = 0; pktDesc[0] = NULL; }
+			  { parsable = false; fhLen = 0; pktDesc[0] = NULL;
+			    anonymized = NULL; }
 		~NfsV3PduDescriptor();
+		/// returns true for parsed WRITE calls and successful READ replies
+		bool carriesData();
+		/**
+		 * releases the packets that carry nothing but READ/WRITE data (i.e.,
+		 * the packets strictly between pktDesc[0] and lastPktDesc) back to
+		 * the buffer pool. The data has to be checksummed before this call.
+		 * @param[in] bufPool The buffer pool the packets are returned to
+		 * @param[in] keepSummaries Whether to keep the IP extent fields of
+		 * the released packets in releasedPktSummaries
+		 * @returns the number of released packets
+		 */
+		unsigned releasePayloadPackets(PacketBufferPool *bufPool,
+			bool keepSummaries);
 		bool getFileName(unsigned char *name, uint16_t index, 
 			PacketDescriptor *pktDesc);
 		bool getPathName(unsigned char *name, uint16_t index,
 			PacketDescriptor *pktDesc);
+		/**
+		 * like getFileName() and getPathName(), but return the name in
+		 * full (an anonymized name may not fit the NFS limits)
+		 * @returns the name, or "" if it can't be decoded
+		 */
+		std::string getFileNameStr(uint16_t index, PacketDescriptor *pktDesc);
+		std::string getPathNameStr(uint16_t index, PacketDescriptor *pktDesc);
 		bool getLink(Link *link);
 		bool getDeviceSpec(DeviceSpec *spec);
 		bool getFsstat(Fsstat *fsstat);
 		bool getFsinfo(Fsinfo *fsinfo);
-		bool getReaddirEntry(unsigned char *fileName, bool &eof);
-		bool getReaddirplusEntry(unsigned char *fileName, bool &eof);
+		bool getReaddirEntry(std::string *fileName, bool &eof);
+		bool getReaddirplusEntry(std::string *fileName, bool &eof);
 		bool getPathconf(Pathconf *pathconf);
 		bool getFileHandle(uint16_t index, PacketDescriptor *pktDesc);
 		std::string getFileHandleStr();
@@ -303,6 +381,13 @@ class NfsV3PduDescriptor : public PduDescriptor {
 		PacketDescriptor *pktDesc[3];
 		/// List of the data hashes for read/write replies/calls
 		std::list<ChecksumRecord> dataChecksums;
+		/// summaries of the packets released after pktDesc[0]
+		std::vector<PacketSummary> releasedPktSummaries;
+		/// the names and handles rewritten by the AnonymizeModule (if any)
+		AnonymizedFields *anonymized;
+
+	private:
+		bool getAnonymizedDirEntry(std::string *fileName, bool &eof);
 };
 
 /**
@@ -325,7 +410,7 @@ public:
 class NfsV3PduDescriptor::Link {
 	public:
 		unsigned char dirFileHandle[NFS3_FHSIZE];
-		unsigned char linkName[NFS_MAXNAMLEN + 1];
+		std::string linkName;
 };
 
 class NfsV3PduDescriptor::Fsstat {
@@ -396,5 +481,59 @@ public:
     uint64_t checksum;
 };
 
+/**
+ * The fields of an NFS PDU that the getters decode from its packets on
+ * demand, as rewritten by the AnonymizeModule. The packets keep the
+ * original values; once a PDU carries these, its getters return them
+ * instead.
+ */
+class NfsV3PduDescriptor::AnonymizedFields {
+	public:
+		/// a name or file handle found at an index in a packet
+		struct Value {
+			Value(uint16_t i, PacketDescriptor *p, const std::string &v)
+				: index(i), pktDesc(p), value(v) { }
+			uint16_t index;
+			PacketDescriptor *pktDesc;
+			std::string value;
+		};
+
+		/// a READDIR or READDIRPLUS entry
+		struct DirEntry {
+			/// copies the entry fields the getters set from/to a PDU
+			void copyFrom(const NfsV3PduDescriptor *desc);
+			void copyTo(NfsV3PduDescriptor *desc) const;
+
+			std::string fileName;
+			uint64_t fileId;
+			uint64_t fileSizeBytes;
+			uint64_t fileUsedBytes;
+			uint64_t fileSystemId;
+			uint64_t fileModTime;
+			uint32_t type;
+			uint32_t fileMode;
+			uint32_t fileUid;
+			uint32_t fileGid;
+			uint32_t fhLen;
+			unsigned char fileHandle[NFS3_FHSIZE];
+		};
+
+		AnonymizedFields() : dirEntriesParsable(true), nextDirEntry(0) { }
+		/// @returns the value at index in pktDesc (NULL if there is none)
+		static const std::string *find(const std::vector<Value> &values,
+			uint16_t index, PacketDescriptor *pktDesc);
+
+		/// file names, symlink and READLINK targets, and LINK names
+		std::vector<Value> names;
+		/// the RENAME "to" and LINK directory handles
+		std::vector<Value> fileHandles;
+		/// READDIR(PLUS) entries in order
+		std::vector<DirEntry> dirEntries;
+		/// whether the entries after the last one could be decoded
+		bool dirEntriesParsable;
+		/// the next entry returned by getReaddir(plus)Entry()
+		size_t nextDirEntry;
+};
+
 #endif // CHRONICLE_PROCESS_REQUEST_H
 
@@ -186,6 +186,9 @@ CommandChannel::issueCommand()
 	} else if (!tmp.compare("ANALYTICS")) {
 		_tokens.pop_front();
 		command = OP_ANALYTICS;
+	} else if (!tmp.compare("METRICS")) {
+		_tokens.pop_front();
+		command = OP_METRICS;
 	} else {
 		usage();
 		return ;
@@ -203,6 +206,8 @@ CommandChannel::usage()
 		<< "\tGETSTAT\n"
 		<< "\tCLOSE interface_name|ALL\n"
 		<< "\tQUIT\n"
+		<< "\tANALYTICS LIST|START|STOP|CONFIG ...\n"
+		<< "\tMETRICS LIST|VERBOSE category ON|OFF\n"
 		<< FONT_DEFAULT;
 }
 
@@ -25,7 +25,8 @@ class CommandChannel : public Process {
 			OP_QUIT,
 			OP_CLOSED_CHANNEL,
 			OP_BAD_CHANNEL,
-			OP_ANALYTICS
+			OP_ANALYTICS,
+			OP_METRICS
 		} Command;
 		CommandChannel(Chronicle *supervisor, int fd, FDWatcher::Events events);
 		~CommandChannel();
@@ -76,14 +76,11 @@ DsExtentCreate::write(NfsV3PduDescriptor *call, NfsV3PduDescriptor *reply)
     _om->newRecord();
     _n3crRecordId.set(call->dsRecordId);
     _n3crDirfh.set(call->fileHandle, call->fhLen);
-    char filename[NFS_MAXNAMLEN+1];
-    call->getFileName(reinterpret_cast<unsigned char*>(filename),
-                      call->miscIndex0, call->pktDesc[0]);
-    _n3crFilename.set(filename, strnlen(filename, NFS_MAXNAMLEN+1));
+    _n3crFilename.set(call->getFileNameStr(call->miscIndex0,
+                                           call->pktDesc[0]));
 
     // procedure-specific stuff
     char filetype = 0;
-    char target[NFS_MAXNAMLEN+1];
     NfsV3PduDescriptor::DeviceSpec spec;
     switch (call->rpcProgramProcedure) {
     case NFS3PROC_CREATE:
@@ -122,9 +119,8 @@ DsExtentCreate::write(NfsV3PduDescriptor *call, NfsV3PduDescriptor *reply)
         _n3crMtime.set(call->fileModTime);
         _n3crAtime.setNull(); // not parsed
         _n3crExclCreateverf.setNull(); // not used
-        call->getFileName(reinterpret_cast<unsigned char*>(target),
-                          call->miscIndex1, call->pktDesc[1]);
-        _n3crTarget.set(filename, strnlen(filename, NFS_MAXNAMLEN+1));
+        _n3crTarget.set(call->getPathNameStr(call->miscIndex1,
+                                             call->pktDesc[1]));
         _n3crSpecdata.setNull(); // not used
         break;
     case NFS3PROC_MKNOD:
@@ -41,25 +41,30 @@ DsExtentIp::attach(DataSeriesSink *outfile,
 
 void
 DsExtentIp::write(PacketDescriptor *p, uint64_t recordId, bool isGoodPdu)
+{
+    write(PacketSummary(p), recordId, isGoodPdu);
+}
+
+void
+DsExtentIp::write(const PacketSummary &p, uint64_t recordId, bool isGoodPdu)
 {
     _om->newRecord();
 
-    const pcap_pkthdr *hdr = &p->pcapHeader;
-    _ipInterface.set(p->interface->getName());
-    _ipRingNum.set(p->ringId);
-    _ipPacketAt.set(DsWriter::tvToNs(hdr->ts));
-    _ipSource.set(p->srcIP);
-    _ipSourcePort.set(p->srcPort);
-    _ipSourceMac.set(&((p->getEthFrameAddress())[6]), 6);
-    _ipDest.set(p->destIP);
-    _ipDestPort.set(p->destPort);
-    _ipDestMac.set(p->getEthFrameAddress(), 6);
-    _ipWireLength.set(hdr->len);
-    _ipProtocol.set(p->protocol);
-    switch (p->protocol) {
+    _ipInterface.set(p.interface->getName());
+    _ipRingNum.set(p.ringId);
+    _ipPacketAt.set(DsWriter::tvToNs(p.ts));
+    _ipSource.set(p.srcIP);
+    _ipSourcePort.set(p.srcPort);
+    _ipSourceMac.set(p.srcMac, sizeof(p.srcMac));
+    _ipDest.set(p.destIP);
+    _ipDestPort.set(p.destPort);
+    _ipDestMac.set(p.destMac, sizeof(p.destMac));
+    _ipWireLength.set(p.wireLength);
+    _ipProtocol.set(p.protocol);
+    switch (p.protocol) {
     case IPPROTO_TCP:
-        _ipTcpSeqnum.set(p->tcpSeqNum);
-        _ipTcpPayloadLength.set(p->payloadLength);
+        _ipTcpSeqnum.set(p.tcpSeqNum);
+        _ipTcpPayloadLength.set(p.payloadLength);
         break;
     case IPPROTO_UDP:
     default:
@@ -17,6 +17,7 @@ public:
                         ExtentTypeLibrary *lib,
                         unsigned extentSize);
     void write(PacketDescriptor *p, uint64_t recordId, bool isGoodPdu);
+    void write(const PacketSummary &p, uint64_t recordId, bool isGoodPdu);
     
 private:
     ExtentSeries _esIP;
@@ -67,8 +67,7 @@ DsExtentLink::write(NfsV3PduDescriptor *call, NfsV3PduDescriptor *reply)
     NfsV3PduDescriptor::Link link;
     call->getLink(&link);
     _n3lnDirfh.set(link.dirFileHandle, call->fhLen);
-    const char *lname = reinterpret_cast<const char *>(link.linkName);
-    _n3lnFilename.set(lname, strnlen(lname, NFS_MAXNAMLEN+1));
+    _n3lnFilename.set(link.linkName);
     _n3lnStatus.set(reply->nfsStatus);
     if (NFS_OK == reply->nfsStatus) {
         _n3lnObjTypeId.set(reply->type);
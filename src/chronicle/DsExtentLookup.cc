@@ -61,10 +61,8 @@ DsExtentLookup::write(NfsV3PduDescriptor *call, NfsV3PduDescriptor *reply)
     _om->newRecord();
     _n3luRecordId.set(call->dsRecordId);
     _n3luDirfh.set(call->fileHandle, call->fhLen);
-    char filename[NFS_MAXNAMLEN+1];
-    call->getFileName(reinterpret_cast<unsigned char*>(filename),
-                      call->miscIndex0, call->pktDesc[0]);
-    _n3luFilename.set(filename, strnlen(filename, NFS_MAXNAMLEN+1));
+    _n3luFilename.set(call->getFileNameStr(call->miscIndex0,
+                                           call->pktDesc[0]));
     _n3luStatus.set(reply->nfsStatus);
     if (NFS_OK == reply->nfsStatus) {
         _n3luFilehandle.set(reply->fileHandle, reply->fhLen);
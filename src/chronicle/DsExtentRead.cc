@@ -137,7 +137,9 @@ DsExtentRead::write(NfsV3PduDescriptor *call, NfsV3PduDescriptor *reply)
 DsExtentRead::DsExtentChecksum::DsExtentChecksum() :
     _n3xsRecordId(_esN3xs, "record_id"),
     _n3xsOffset(_esN3xs, "offset"),
-    _n3xsChecksum(_esN3xs, "checksum")
+    _n3xsChecksum(_esN3xs, "checksum"),
+    _n3xsAlgorithm(_esN3xs, "algorithm", Field::flag_nullable),
+    _n3xsBlockSize(_esN3xs, "block_size", Field::flag_nullable)
 {
 }
 
@@ -165,6 +167,8 @@ DsExtentRead::DsExtentChecksum::write(NfsV3PduDescriptor *call,
         _n3xsRecordId.set(call->dsRecordId);
         _n3xsOffset.set(r->offset);
         _n3xsChecksum.set(r->checksum);
+        _n3xsAlgorithm.set(dsChecksumAlgorithm);
+        _n3xsBlockSize.set(dsChecksumBlockSize);
         xsumDesc->dataChecksums.pop_front();
     }
 }
@@ -32,6 +32,8 @@ private:
         Int64Field _n3xsRecordId;
         Int64Field _n3xsOffset;
         Int64Field  _n3xsChecksum;
+        Variable32Field _n3xsAlgorithm;
+        Int32Field _n3xsBlockSize;
     };
     
     ExtentSeries _esN3rw;
@@ -126,11 +126,9 @@ DsExtentReaddir::DsExtentRDEntries::write(NfsV3PduDescriptor *call,
 {
     bool end = false;
     while (true) {
-        char filename[NFS_MAXNAMLEN+1];
+        std::string filename;
         if (call->rpcProgramProcedure == NFS3PROC_READDIRPLUS) {
-            if (reply->getReaddirplusEntry(
-                    reinterpret_cast<unsigned char *>(filename), end) 
-                && !end) {
+            if (reply->getReaddirplusEntry(&filename, end) && !end) {
                 _om->newRecord();
                 _n3deTypeId.set(reply->type);
                 _n3deType.set(DsWriter::typeIdToName(reply->type));
@@ -152,9 +150,7 @@ DsExtentReaddir::DsExtentRDEntries::write(NfsV3PduDescriptor *call,
                 break;
             }
         } else {
-            if (reply->getReaddirEntry(
-                    reinterpret_cast<unsigned char *>(filename), end) &&
-                !end) {
+            if (reply->getReaddirEntry(&filename, end) && !end) {
                 _om->newRecord();
                 _n3deTypeId.setNull();
                 _n3deType.setNull();
@@ -177,6 +173,6 @@ DsExtentReaddir::DsExtentRDEntries::write(NfsV3PduDescriptor *call,
             }
         }
         _n3deRecordId.set(call->dsRecordId);
-        _n3deFilename.set(filename, strnlen(filename, NFS_MAXNAMLEN+1));
+        _n3deFilename.set(filename);
     }
 }
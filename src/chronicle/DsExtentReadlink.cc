@@ -62,10 +62,8 @@ DsExtentReadlink::write(NfsV3PduDescriptor *call, NfsV3PduDescriptor *reply)
         _n3rlPostopCtime.setNull(); // not parsed
         _n3rlPostopMtime.set(DsWriter::nfstimeToNs(reply->fileModTime));
         _n3rlPostopAtime.setNull(); // not parsed
-        char target[NFS_MAXPATHLEN+1];
-        reply->getFileName(reinterpret_cast<unsigned char*>(target),
-                           reply->miscIndex0, reply->pktDesc[0]);
-        _n3rlTarget.set(target, strnlen(target, NFS_MAXPATHLEN+1));
+        _n3rlTarget.set(reply->getPathNameStr(reply->miscIndex0,
+                                              reply->pktDesc[0]));
     } else {
         _n3rlPostopTypeId.setNull();
         _n3rlPostopType.setNull();
@@ -49,10 +49,8 @@ DsExtentRemove::write(NfsV3PduDescriptor *call, NfsV3PduDescriptor *reply)
     _om->newRecord();
     _n3rmRecordId.set(call->dsRecordId);
     _n3rmDirfh.set(call->fileHandle, call->fhLen);
-    char filename[NFS_MAXNAMLEN+1];
-    call->getFileName(reinterpret_cast<unsigned char*>(filename),
-                      call->miscIndex0, call->pktDesc[0]);
-    _n3rmFilename.set(filename, strnlen(filename, NFS_MAXNAMLEN+1));
+    _n3rmFilename.set(call->getFileNameStr(call->miscIndex0,
+                                           call->pktDesc[0]));
     _n3rmStatus.set(reply->nfsStatus);
     if (NFS_OK == reply->nfsStatus) {
         _n3rmParentPreopSize.setNull(); // not parsed
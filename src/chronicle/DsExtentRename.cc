@@ -68,16 +68,13 @@ DsExtentRename::write(NfsV3PduDescriptor *call, NfsV3PduDescriptor *reply)
     _om->newRecord();
     _n3mvRecordId.set(call->dsRecordId);
     _n3mvFromDirfh.set(call->fileHandle, call->fhLen);
-    char filename[NFS_MAXNAMLEN+1];
-    call->getFileName(reinterpret_cast<unsigned char*>(filename),
-                      call->miscIndex0, call->pktDesc[0]);
-    _n3mvFromFilename.set(filename, strnlen(filename, NFS_MAXNAMLEN+1));
-    
+    _n3mvFromFilename.set(call->getFileNameStr(call->miscIndex0,
+                                               call->pktDesc[0]));
+
     call->getFileHandle(call->miscIndex2, call->pktDesc[2]);
     _n3mvToDirfh.set(call->fileHandle, call->fhLen);
-    call->getFileName(reinterpret_cast<unsigned char*>(filename),
-                      call->miscIndex1, call->pktDesc[1]);
-    _n3mvToFilename.set(filename, strnlen(filename, NFS_MAXNAMLEN+1));
+    _n3mvToFilename.set(call->getFileNameStr(call->miscIndex1,
+                                             call->pktDesc[1]));
     _n3mvStatus.set(reply->nfsStatus);
     // None of the attrs are currently parsed
     _n3mvFromdirPreopSize.setNull();
@@ -8,6 +8,7 @@
 #include "Message.h"
 #include "AnalyticsModule.h"
 #include "ChronicleExtents.h"
+#include "StageTracer.h"
 #include <linux/nfs.h>
 #include <linux/nfs3.h>
 #include <arpa/inet.h>
@@ -231,6 +232,7 @@ public:
 void
 DsWriter::processRequest(ChronicleSource *src, PduDescriptor *pduDesc)
 {
+    PacketBufferPool::handOver(pduDesc, PacketBufferPool::HOLDER_OUTPUT);
     enqueueMessage(new MessagePRPdu(this, src, pduDesc));
 }
 
@@ -248,6 +250,7 @@ DsWriter::doProcessRequest(ChronicleSource *src, PduDescriptor *pduDesc)
 
 	// A reference to the first PDU descriptor
 	PduDescriptor *firstPduDesc = pduDesc;
+	StageTracer::stamp(pduDesc, StageTracer::STAGE_OUTPUT);
 
     #if DSWRITER_DEBUG_STATS
     PduDescriptor *rpcReply = 0;
@@ -464,12 +467,13 @@ DsWriter::doProcessRequest(ChronicleSource *src, PduDescriptor *pduDesc)
         openNextFile();
     }
 
-	_analyticsManager->processRequest(NULL, firstPduDesc);
+	_analyticsManager->getShard(_id)->processRequest(NULL, firstPduDesc);
 }
 
 void
 DsWriter::doProcessRequest(ChronicleSource *src, PacketDescriptor *pktDesc)
 {
+    StageTracer::stampList(pktDesc, StageTracer::STAGE_OUTPUT);
     doProcessPacketList(pktDesc, NULL, static_cast<uint64_t>(-1), false);
 }
 
@@ -519,6 +523,20 @@ DsWriter::processPduDesc(PduDescriptor *pduDesc)
 {
     PacketDescriptor *pktDesc = pduDesc->firstPktDesc;
     bool isGoodPdu = (PduDescriptor::PDU_COMPLETE == pduDesc->rpcPduType);
+    NfsV3PduDescriptor *nfsPduDesc =
+        dynamic_cast<NfsV3PduDescriptor *>(pduDesc);
+    if (nfsPduDesc && !nfsPduDesc->releasedPktSummaries.empty()) {
+        // the payload packets after pktDesc[0] were released early, so
+        // their IP records come from the summaries to keep them in order
+        doProcessPacketList(pktDesc, nfsPduDesc->pktDesc[0],
+                            pduDesc->dsRecordId, isGoodPdu);
+        if (dsEnableIpChecksum) {
+            for (const PacketSummary &s : nfsPduDesc->releasedPktSummaries) {
+                _writerIP.write(s, pduDesc->dsRecordId, isGoodPdu);
+            }
+        }
+        pktDesc = pduDesc->lastPktDesc;
+    }
 	doProcessPacketList(pktDesc, pduDesc->lastPktDesc, pduDesc->dsRecordId,
                         isGoodPdu); 
 }
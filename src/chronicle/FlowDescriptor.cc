@@ -9,6 +9,34 @@
 
 extern void printIpAddress(uint32_t addr);
 
+MetricCounter FlowDescriptorTcp::_metrics[FlowDescriptorTcp::NUM_COUNTERS] = {
+	{ "flow.tcp.seen" },
+	{ "flow.tcp.outoforder" },
+	{ "flow.tcp.emptyack" },
+	{ "flow.tcp.retrans.good" },
+	{ "flow.tcp.retrans.bad" },
+	{ "flow.tcp.retrans.wrapgood" },
+	{ "flow.tcp.retrans.wrapbad" },
+	{ "flow.tcp.retrans.stale" },
+	{ "flow.tcp.recoveredoutoforder" },
+	{ "flow.tcp.discard.tail" },
+	{ "flow.tcp.discard.wrap" },
+	{ "flow.tcp.discard.misc" },
+	{ "flow.tcp.truncated" },
+	{ "flow.tcp.dropped" },
+	{ "flow.tcp.retrans.bad.duplicate" },
+	{ "flow.tcp.retrans.bad.nonduplicate" }
+};
+
+static const char *counterNames[FlowDescriptorTcp::NUM_COUNTERS] = {
+	"seenPacketCount", "outOfOrderCount", "emptyAckCount",
+	"goodRetransCount", "badRetransCount", "wrapGoodRetransCount",
+	"wrapBadRetransCount", "staleRetransCount", "recoveredOutOfOrderCount",
+	"tailDiscardCount", "wrapDiscardCount", "miscDiscardCount",
+	"truncatedPktCount", "droppedPktCount", "badRetransDuplicateCount",
+	"badRetransNonDuplicateCount"
+};
+
 FlowDescriptorIPv4::FlowDescriptorIPv4(uint32_t sourceIP, uint32_t destIP, 
 	uint16_t sourcePort, uint16_t destPort, uint8_t protocol) 
 	: sourceIP(sourceIP), destIP(destIP), sourcePort(sourcePort), 
@@ -285,16 +313,8 @@ FlowDescriptorTcp::FlowDescriptorTcp(uint32_t sourceIP, uint32_t destIP,
 	: FlowDescriptorIPv4(sourceIP, destIP, sourcePort, destPort, protocol)
 {
 	maxSeqNumSeen = maxAckNumSeen = 0;
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-	seenPacketCount = outOfOrderCount = emptyAckCount = goodRetransCount = 
-		badRetransCount = wrapGoodRetransCount = wrapBadRetransCount =
-		staleRetransCount = recoveredOutOfOrderCount = 
-		tailDiscardCount = wrapDiscardCount = miscDiscardCount = 
-		truncatedPktCount = droppedPktCount = 0;
-	#endif
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK_STAT)
-	badRetransDuplicateCount = badRetransNonDuplicateCount = 0;
-	#endif
+	for (unsigned i = 0; i < NUM_COUNTERS; i++)
+		counts[i] = 0;
 }
 
 FlowDescriptorTcp::~FlowDescriptorTcp()
@@ -314,16 +334,12 @@ FlowDescriptorTcp::insertPacketDescriptor(PacketDescriptor *pktDesc,
 	#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK)
 	pktDesc->print();
 	#endif
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-	seenPacketCount++;
-	#endif
+	count(SEEN_PKT);
 	if (pktDesc->payloadLength == 0) {
 		#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK)
 		printf("[empty ack]\n");
 		#endif
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-		emptyAckCount++;
-		#endif
+		count(EMPTY_ACK);
 		return false;
 	}
 	uint32_t maxSeqNumInPacket = pktDesc->tcpSeqNum + pktDesc->payloadLength;
@@ -342,9 +358,7 @@ FlowDescriptorTcp::insertPacketDescriptor(PacketDescriptor *pktDesc,
 					#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK)
 					printf("[out of order]\n");
 					#endif
-					#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-					outOfOrderCount++;
-					#endif
+					count(OUT_OF_ORDER);
 					if (firstOutOfOrderPkt == NULL)
 						firstOutOfOrderPkt = pktDesc;
 				}
@@ -375,30 +389,18 @@ FlowDescriptorTcp::insertPacketDescriptor(PacketDescriptor *pktDesc,
 		#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK)
 		printf("[retrans]\n");
 		#endif
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-		badRetransCount++;
-		#endif
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK_STAT)
-		if (findDuplicate(pktDesc))
-			badRetransDuplicateCount++;
-		else
-			badRetransNonDuplicateCount++;
-		#endif
+		countBadRetransmission(pktDesc);
 		return false;
 	} else { // maxSeqNumInPacket > maxSeqNumSeen
 		if (head && maxSeqNumInPacket - maxSeqNumSeen > MAX_TCP_RECV_WINDOW) {
 			if (head->tcpSeqNum < pktDesc->tcpSeqNum && 
 					handleRetransmission(pktDesc, maxSeqNumInPacket)) {
-				#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-				wrapGoodRetransCount++;
-				#endif
+				count(WRAP_GOOD_RETRANS);
 				return true;
 			}
 			// ignore retransmissions during seq wrap
-			#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-			wrapBadRetransCount++;
-			badRetransCount++;
-			#endif
+			count(WRAP_BAD_RETRANS);
+			count(BAD_RETRANS);
 			return false;
 		}
 		// packet is advancing the TCP congestion window
@@ -414,9 +416,7 @@ FlowDescriptorTcp::insertPacketDescriptor(PacketDescriptor *pktDesc,
 			#endif
 			if (pktDesc->tcpSeqNum == tail->tcpSeqNum) {
 				// should discard the tail but for now ignore the new packet
-				#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-				tailDiscardCount++;
-				#endif
+				count(TAIL_DISCARD);
 				return false;				
 			} else if (pktDesc->tcpSeqNum > tail->tcpSeqNum &&
 					tail->toParseOffset < (tail->pcapHeader.caplen - 
@@ -435,14 +435,10 @@ FlowDescriptorTcp::insertPacketDescriptor(PacketDescriptor *pktDesc,
 					pktDesc->tcpSeqNum, pktDesc->payloadLength, 
 					tail->tcpSeqNum, tail->payloadLength);
 				#endif
-				#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-				truncatedPktCount++;
-				#endif
+				count(TRUNCATED_PKT);
 			} else {
 				// should discard the tail but for now ignore the new packet
-				#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-				tailDiscardCount++;
-				#endif
+				count(TAIL_DISCARD);
 				return false;	
 			}
 		} else if (tail && 
@@ -452,9 +448,7 @@ FlowDescriptorTcp::insertPacketDescriptor(PacketDescriptor *pktDesc,
 			#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK)
 			printf("[retrans wrap] ignored\n");
 			#endif
-			#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-			wrapDiscardCount++;
-			#endif
+			count(WRAP_DISCARD);
 			return false;
 		}
 		if (maxSeqNumSeen != pktDesc->tcpSeqNum) {
@@ -462,9 +456,7 @@ FlowDescriptorTcp::insertPacketDescriptor(PacketDescriptor *pktDesc,
 			#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK)
 			printf("[out of order]\n");
 			#endif
-			#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-			outOfOrderCount++;
-			#endif
+			count(OUT_OF_ORDER);
 			if ((firstOutOfOrderPkt != NULL &&
 					pktDesc->tcpSeqNum < firstOutOfOrderPkt->tcpSeqNum) ||
 					firstOutOfOrderPkt == NULL)
@@ -481,10 +473,8 @@ FlowDescriptorTcp::insertPacketDescriptor(PacketDescriptor *pktDesc,
 			if (!(pktDesc->flag & PACKET_OUT_OF_ORDER))
 				printf("[correction -> first pkt in order]\n");
 			#endif
-			#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
 			if (!maxSeqNumSeen)
-				outOfOrderCount--;
-			#endif
+				count(OUT_OF_ORDER, -1);
 			pktDesc->prev = pktDesc->next = NULL;
 			head = tail = pktDesc;
 			firstOutOfOrderPkt = NULL;
@@ -530,10 +520,8 @@ FlowDescriptorTcp::handleRetransmission(PacketDescriptor *pktDesc,
 			head->flag |= PACKET_OUT_OF_ORDER;
 			firstOutOfOrderPkt = head;
 		} else {
-			#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)		
-			badRetransCount++;
-			miscDiscardCount++;
-			#endif
+			count(BAD_RETRANS);
+			count(MISC_DISCARD);
 			return false;
 		}
 		pktDesc->next = head;
@@ -542,54 +530,40 @@ FlowDescriptorTcp::handleRetransmission(PacketDescriptor *pktDesc,
 		head->prev = pktDesc;
 		head = pktDesc;
 		queueLen++;
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-		goodRetransCount++;
+		count(GOOD_RETRANS);
 		if (head && pktDesc->pcapHeader.ts.tv_sec == 
 				pktDesc->next->pcapHeader.ts.tv_sec &&
 				pktDesc->pcapHeader.ts.tv_usec == 
 				pktDesc->next->pcapHeader.ts.tv_usec) {
-			recoveredOutOfOrderCount++;
+			count(RECOVERED_OUT_OF_ORDER);
 		}
-		#endif
 		firstUnscannedPkt = head;
 		return true;
 	} else if (head != NULL && 
 			head->tcpSeqNum - maxSeqNumInPacket < MAX_TCP_RECV_WINDOW &&
 			maxSeqNumInPacket <= head->tcpSeqNum) {
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-		badRetransCount++;
-		staleRetransCount++;
-		#endif
+		count(BAD_RETRANS);
+		count(STALE_RETRANS);
 		return false;
 	}
 	if (firstOutOfOrderPkt == NULL) {
 		#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK)
 		printf("[retrans]\n");
 		#endif
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-		badRetransCount++;
-		#endif
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK_STAT)
-		if (findDuplicate(pktDesc))
-			badRetransDuplicateCount++;
-		else
-			badRetransNonDuplicateCount++;
-		#endif
+		countBadRetransmission(pktDesc);
 		return false;
 	}
 	if (insertPktInHole(pktDesc, firstOutOfOrderPkt)) {
 		#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK)
 		printf("[out of order/fills hole]\n");
 		#endif
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-		goodRetransCount++;
+		count(GOOD_RETRANS);
 		if (pktDesc->pcapHeader.ts.tv_sec == 
 				pktDesc->next->pcapHeader.ts.tv_sec &&
 				pktDesc->pcapHeader.ts.tv_usec == 
 				pktDesc->next->pcapHeader.ts.tv_usec) {
-			recoveredOutOfOrderCount++;
+			count(RECOVERED_OUT_OF_ORDER);
 		}
-		#endif
 		queueLen++;
 		if (firstUnscannedPkt == NULL ||
 				firstUnscannedPkt->tcpSeqNum - pktDesc->tcpSeqNum < 
@@ -605,30 +579,20 @@ FlowDescriptorTcp::handleRetransmission(PacketDescriptor *pktDesc,
 			#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK)
 			printf("[retrans]\n");
 			#endif
-			#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-			badRetransCount++;
-			#endif
-			#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK_STAT)
-			if (findDuplicate(pktDesc))
-				badRetransDuplicateCount++;
-			else
-				badRetransNonDuplicateCount++;
-			#endif
+			countBadRetransmission(pktDesc);
 			return false;
 		}
 		if (insertPktInHole(pktDesc, nextHolePktDesc)) {
 			#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK)
 			printf("[out of order/fills hole]\n");
 			#endif
-			#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-			goodRetransCount++;
+			count(GOOD_RETRANS);
 			if (pktDesc->pcapHeader.ts.tv_sec == 
 					pktDesc->next->pcapHeader.ts.tv_sec &&
 					pktDesc->pcapHeader.ts.tv_usec == 
 					pktDesc->next->pcapHeader.ts.tv_usec) {
-				recoveredOutOfOrderCount++;
+				count(RECOVERED_OUT_OF_ORDER);
 			}
-			#endif
 			queueLen++;
 			if (firstUnscannedPkt == NULL ||
 					firstUnscannedPkt->tcpSeqNum - pktDesc->tcpSeqNum 
@@ -643,15 +607,7 @@ FlowDescriptorTcp::handleRetransmission(PacketDescriptor *pktDesc,
 	#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK)
 	printf("[retrans]\n");
 	#endif
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-	badRetransCount++;	
-	#endif
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK_STAT)
-	if (findDuplicate(pktDesc))
-		badRetransDuplicateCount++;
-	else
-		badRetransNonDuplicateCount++;
-	#endif
+	countBadRetransmission(pktDesc);
 	return false;
 }
 
@@ -683,9 +639,7 @@ FlowDescriptorTcp::insertPktInHole(PacketDescriptor *pktDesc,
 				"outOfOrderPktDesc->tcpSeqNum:%u\n", pktDesc->tcpSeqNum, 
 				pktDesc->payloadLength, outOfOrderPktDesc->tcpSeqNum);
 			#endif
-			#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-			truncatedPktCount++;
-			#endif
+			count(TRUNCATED_PKT);
 		}
 		if (pktDesc->tcpSeqNum < prevPktDesc->tcpSeqNum + 
 				prevPktDesc->payloadLength &&
@@ -704,17 +658,13 @@ FlowDescriptorTcp::insertPktInHole(PacketDescriptor *pktDesc,
 				"pktDesc->tcpSeqNum:%u\n", prevPktDesc->tcpSeqNum, 
 				prevPktDesc->payloadLength, pktDesc->tcpSeqNum);
 			#endif
-			#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-			truncatedPktCount++;
-			#endif
+			count(TRUNCATED_PKT);
 		} else if (pktDesc->tcpSeqNum < prevPktDesc->tcpSeqNum + 
 				prevPktDesc->payloadLength &&
 				prevPktDesc->toParseOffset >= (prevPktDesc->pcapHeader.caplen
 				- (prevPktDesc->tcpSeqNum + prevPktDesc->payloadLength - 
 				pktDesc->tcpSeqNum))) {
-			#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-			miscDiscardCount++;
-			#endif
+			count(MISC_DISCARD);
 			return false;
 		}
 	}
@@ -737,9 +687,7 @@ FlowDescriptorTcp::insertPktInHole(PacketDescriptor *pktDesc,
 				return false;
 		else 
 		*/
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-		wrapDiscardCount++;
-		#endif
+		count(WRAP_DISCARD);
 		return false;
 	} else
 		return false;
@@ -774,26 +722,23 @@ void FlowDescriptorTcp::printStats()
 	printf(":%u -> ", sourcePort);
 	printIpAddress(destIP);
 	printf(":%u] ", destPort);
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-	printf("seenPacketCount:%lu outOfOrderCount:%lu emptyAckCount:%lu "
-		"goodRetransCount:%lu badRetransCount:%lu wrapGoodRetransCount:%lu "
-		"wrapBadRetransCount:%lu staleRetransCount:%lu "
-		"recoveredOutOfOrderCount:%lu "
-		"tailDiscardCount:%lu wrapDiscardCount:%lu miscDiscardCount:%lu "
-		"truncatedPktCount:%lu droppedPktCount:%lu ", 
-		seenPacketCount, outOfOrderCount, emptyAckCount, goodRetransCount, 
-		badRetransCount, wrapGoodRetransCount, wrapBadRetransCount, 
-		staleRetransCount, recoveredOutOfOrderCount,
-		tailDiscardCount, wrapDiscardCount, miscDiscardCount,
-		truncatedPktCount, droppedPktCount);
-	#endif
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK_STAT)
-	printf("badRetransDuplicateCount:%lu badRetransNonDuplicateCount:%lu ",
-		badRetransDuplicateCount, badRetransNonDuplicateCount);
-	#endif
+	for (unsigned i = 0; i < NUM_COUNTERS; i++)
+		printf("%s:%lu ", counterNames[i], counts[i]);
 	//printf("\n");
 }
 
+void FlowDescriptorTcp::countBadRetransmission(PacketDescriptor *pktDesc)
+{
+	count(BAD_RETRANS);
+	// walking the flow is too costly unless asked for
+	if (Metrics::isVerbose(Metrics::VERBOSE_NETWORK)) {
+		if (findDuplicate(pktDesc))
+			count(BAD_RETRANS_DUPLICATE);
+		else
+			count(BAD_RETRANS_NON_DUPLICATE);
+	}
+}
+
 bool FlowDescriptorTcp::findDuplicate(PacketDescriptor *pktDesc)
 {
 	PacketDescriptor *tmpPktDesc = head;
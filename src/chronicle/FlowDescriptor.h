@@ -9,6 +9,7 @@
 
 #include <inttypes.h>
 #include "ChronicleProcessRequest.h"
+#include "Metrics.h"
 
 /* maximum TCP receive window size (assuming a max window scale option of 14)
    http://www.ietf.org/rfc/rfc1323.txt										*/
@@ -163,26 +164,41 @@ class FlowDescriptorTcp : public FlowDescriptorIPv4 {
 		uint32_t maxSeqNumSeen;
 		/// max ACK number seen for this flow
 		uint32_t maxAckNumSeen;
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-		uint64_t seenPacketCount;
-		uint64_t outOfOrderCount;
-		uint64_t emptyAckCount;
-		uint64_t goodRetransCount;
-		uint64_t badRetransCount;
-		uint64_t wrapGoodRetransCount;
-		uint64_t wrapBadRetransCount;
-		uint64_t staleRetransCount;
-		uint64_t recoveredOutOfOrderCount;
-		uint64_t tailDiscardCount;
-		uint64_t wrapDiscardCount;
-		uint64_t miscDiscardCount;
-		uint64_t truncatedPktCount;
-		uint64_t droppedPktCount;
-		#endif
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_NETWORK_STAT)
-		uint64_t badRetransDuplicateCount;
-		uint64_t badRetransNonDuplicateCount;
-		#endif
+
+		/// the events counted per flow (and summed over all the flows)
+		typedef enum {
+			SEEN_PKT = 0,
+			OUT_OF_ORDER,
+			EMPTY_ACK,
+			GOOD_RETRANS,
+			BAD_RETRANS,
+			WRAP_GOOD_RETRANS,
+			WRAP_BAD_RETRANS,
+			STALE_RETRANS,
+			RECOVERED_OUT_OF_ORDER,
+			TAIL_DISCARD,
+			WRAP_DISCARD,
+			MISC_DISCARD,
+			TRUNCATED_PKT,
+			DROPPED_PKT,
+			BAD_RETRANS_DUPLICATE,		// only counted if network is verbose
+			BAD_RETRANS_NON_DUPLICATE,	// only counted if network is verbose
+			NUM_COUNTERS
+		} Counter;
+
+		/// counts an event for this flow and in the global metrics
+		inline void count(Counter counter, int64_t n = 1) {
+			counts[counter] += n;
+			_metrics[counter].add(n);
+		}
+
+		uint64_t counts[NUM_COUNTERS];
+
+	private:
+		/// tells duplicate from non-duplicate bad retransmissions (if verbose)
+		void countBadRetransmission(PacketDescriptor *pktDesc);
+
+		static MetricCounter _metrics[NUM_COUNTERS];
 };
 
 #endif // FLOW_DESCRIPTOR_H
@@ -0,0 +1,212 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include <linux/nfs.h>
+#include <linux/nfs3.h>
+#include <cstdlib>
+#include <iomanip>
+#include "ChronicleConfig.h"
+#include "RpcParser.h"
+#include "HeavyHittersModule.h"
+
+HeavyHittersPartial::HeavyHittersPartial()
+	: clientOps(ANALYTICS_HEAVY_HITTERS_CAPACITY),
+	clientBytes(ANALYTICS_HEAVY_HITTERS_CAPACITY),
+	fileOps(ANALYTICS_HEAVY_HITTERS_CAPACITY),
+	fileBytes(ANALYTICS_HEAVY_HITTERS_CAPACITY),
+	dirOps(ANALYTICS_HEAVY_HITTERS_CAPACITY),
+	dirBytes(ANALYTICS_HEAVY_HITTERS_CAPACITY)
+{
+	memset(procOps, 0, sizeof(procOps));
+	memset(procBytes, 0, sizeof(procBytes));
+}
+
+static bool
+isDirectoryProc(uint32_t proc)
+{
+	switch (proc) {
+		case NFS3PROC_LOOKUP:
+		case NFS3PROC_CREATE:
+		case NFS3PROC_MKDIR:
+		case NFS3PROC_SYMLINK:
+		case NFS3PROC_MKNOD:
+		case NFS3PROC_REMOVE:
+		case NFS3PROC_RMDIR:
+		case NFS3PROC_RENAME:
+		case NFS3PROC_READDIR:
+		case NFS3PROC_READDIRPLUS:
+			return true;
+	}
+	return false;
+}
+
+void
+HeavyHittersPartial::update(PduDescriptor *pduDesc)
+{
+	// account for the call and its reply (if any) together
+	if (pduDesc->rpcPduType == PduDescriptor::PDU_BAD 
+			|| pduDesc->rpcMsgType != RPC_CALL)
+		return ;
+	uint64_t bytes = pduDesc->rpcPduLen;
+	PduDescriptor *reply = pduDesc->next;
+	if (reply && reply->rpcPduType != PduDescriptor::PDU_BAD 
+			&& reply->rpcMsgType == RPC_REPLY 
+			&& reply->rpcXid == pduDesc->rpcXid)
+		bytes += reply->rpcPduLen;
+
+	uint32_t client = pduDesc->firstPktDesc->srcIP;
+	clientOps.add(&client, sizeof(client), 1);
+	clientBytes.add(&client, sizeof(client), bytes);
+
+	if (pduDesc->rpcProgram != NFS_PROGRAM 
+			|| pduDesc->rpcProgramVersion != NFS3_VERSION
+			|| pduDesc->rpcProgramProcedure >= AnalyticsModule::NUM_NFS3_PROCS)
+		return ;
+	uint32_t proc = pduDesc->rpcProgramProcedure;
+	procOps[proc]++;
+	procBytes[proc] += bytes;
+	NfsV3PduDescriptor *nfsDesc = dynamic_cast<NfsV3PduDescriptor *>(pduDesc);
+	if (nfsDesc == NULL || !nfsDesc->parsable || nfsDesc->fhLen == 0)
+		return ;
+	if (isDirectoryProc(proc)) {
+		dirOps.add(nfsDesc->fileHandle, nfsDesc->fhLen, 1);
+		dirBytes.add(nfsDesc->fileHandle, nfsDesc->fhLen, bytes);
+	} else {
+		fileOps.add(nfsDesc->fileHandle, nfsDesc->fhLen, 1);
+		fileBytes.add(nfsDesc->fileHandle, nfsDesc->fhLen, bytes);
+	}
+}
+
+void
+HeavyHittersPartial::merge(const AnalyticsPartial *other)
+{
+	const HeavyHittersPartial *partial = 
+		static_cast<const HeavyHittersPartial *>(other);
+	clientOps.merge(partial->clientOps);
+	clientBytes.merge(partial->clientBytes);
+	fileOps.merge(partial->fileOps);
+	fileBytes.merge(partial->fileBytes);
+	dirOps.merge(partial->dirOps);
+	dirBytes.merge(partial->dirBytes);
+	for (unsigned i = 0; i < AnalyticsModule::NUM_NFS3_PROCS; i++) {
+		procOps[i] += partial->procOps[i];
+		procBytes[i] += partial->procBytes[i];
+	}
+}
+
+HeavyHittersModule::HeavyHittersModule(AnalyticsManager *manager, 
+	std::string command, int id, int interval, const Params &params)
+	: AnalyticsModule("HeavyHittersModule", manager, command, id, interval),
+	_topK(ANALYTICS_HEAVY_HITTERS_TOPK), 
+	_windowLength(ANALYTICS_HEAVY_HITTERS_WINDOW)
+{
+	Params::const_iterator it;
+	if ((it = params.find("topk")) != params.end())
+		_topK = atoi(it->second.c_str());
+	if ((it = params.find("window")) != params.end())
+		_windowLength = atoi(it->second.c_str());
+}
+
+bool
+HeavyHittersModule::checkParams(const Params &params)
+{
+	for (Params::const_iterator it = params.begin(); it != params.end();
+			it++) {
+		int value = atoi(it->second.c_str());
+		if (!it->first.compare("topk")) {
+			if (value <= 0 || value > ANALYTICS_HEAVY_HITTERS_CAPACITY)
+				return false;
+		} else if (!it->first.compare("window")) {
+			if (value <= 0 || value > ANALYTICS_HEAVY_HITTERS_MAX_WINDOW)
+				return false;
+		} else
+			return false;
+	}
+	return true;
+}
+
+HeavyHittersModule::~HeavyHittersModule()
+{
+	for (std::map<time_t, HeavyHittersPartial *>::iterator it = 
+			_window.begin(); it != _window.end(); it++)
+		delete it->second;
+}
+
+static std::string
+keyToString(const SpaceSaving::Entry *e, bool ipKey)
+{
+	std::ostringstream s;
+	if (ipKey) {
+		uint32_t ip;
+		memcpy(&ip, e->key, sizeof(ip));
+		s << (ip >> 24) << "_" << ((ip >> 16) & 0xff) << "_"
+			<< ((ip >> 8) & 0xff) << "_" << (ip & 0xff);
+	} else {
+		s << std::hex << std::setfill('0');
+		for (unsigned i = 0; i < e->keyLen; i++)
+			s << std::setw(2) << (unsigned)e->key[i];
+	}
+	return s.str();
+}
+
+void
+HeavyHittersModule::reportTop(const std::string &name, 
+	const SpaceSaving &summary, bool ipKeys, 
+	std::map<std::string, int64_t> &stats)
+{
+	std::vector<const SpaceSaving::Entry *> top;
+	summary.getTop(_topK, top);
+	_output << name << " (total " << summary.getTotal() << ")" << std::endl;
+	for (unsigned i = 0; i < top.size(); i++) {
+		std::string key = keyToString(top[i], ipKeys);
+		_output << "  " << key << " " << top[i]->weight << " (+/-" 
+			<< top[i]->error << ")" << std::endl;
+		stats["analytics.heavyhitters." + name + ".rank." 
+			+ std::to_string(i + 1)] = top[i]->weight;
+	}
+}
+
+void
+HeavyHittersModule::report(struct timeval ts)
+{
+	// keep this interval's aggregate for the window, and drop the
+	// intervals that ended before the window started
+	_window[_intervalEnd] = static_cast<HeavyHittersPartial *>(_aggregate);
+	_aggregate = NULL;
+	time_t windowStart = _intervalEnd - (time_t)_windowLength * _interval;
+	while (_window.begin()->first <= windowStart) {
+		delete _window.begin()->second;
+		_window.erase(_window.begin());
+	}
+	HeavyHittersPartial window;
+	for (std::map<time_t, HeavyHittersPartial *>::iterator it = 
+			_window.begin(); it != _window.end(); it++)
+		window.merge(it->second);
+
+	std::map<std::string, int64_t> stats;
+	_output << getTime(ts) << " top " << _topK 
+		<< " over the last " << _windowLength * _interval << "s" 
+		<< std::endl;
+	reportTop("clients.ops", window.clientOps, true, stats);
+	reportTop("clients.bytes", window.clientBytes, true, stats);
+	reportTop("files.ops", window.fileOps, false, stats);
+	reportTop("files.bytes", window.fileBytes, false, stats);
+	reportTop("dirs.ops", window.dirOps, false, stats);
+	reportTop("dirs.bytes", window.dirBytes, false, stats);
+	for (unsigned i = 0; i < NUM_NFS3_PROCS; i++) {
+		if (window.procOps[i] == 0)
+			continue;
+		_output << "proc " << getNfs3ProcName(i) << " ops " 
+			<< window.procOps[i] << " bytes " << window.procBytes[i] 
+			<< std::endl;
+		stats[std::string("analytics.heavyhitters.procs.") 
+			+ getNfs3ProcName(i) + ".ops"] = window.procOps[i];
+		stats[std::string("analytics.heavyhitters.procs.") 
+			+ getNfs3ProcName(i) + ".bytes"] = window.procBytes[i];
+	}
+	_output << std::endl;
+	_manager->publishStats(stats);
+}
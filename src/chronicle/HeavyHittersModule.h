@@ -0,0 +1,64 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef HEAVY_HITTERS_MODULE_H
+#define HEAVY_HITTERS_MODULE_H
+
+#include <map>
+#include "AnalyticsModule.h"
+#include "SpaceSaving.h"
+
+/// The heaviest clients, files and directories seen during an interval
+class HeavyHittersPartial : public AnalyticsPartial {
+	public:
+		HeavyHittersPartial();
+		void update(PduDescriptor *pduDesc);
+		void merge(const AnalyticsPartial *other);
+
+		/// clients by calls and by RPC bytes (calls and replies)
+		SpaceSaving clientOps, clientBytes;
+		/// file handles of the non-directory NFSv3 calls
+		SpaceSaving fileOps, fileBytes;
+		/// directory handles of the directory NFSv3 calls (LOOKUP, etc.)
+		SpaceSaving dirOps, dirBytes;
+		/// exact counts per NFSv3 procedure
+		uint64_t procOps[AnalyticsModule::NUM_NFS3_PROCS];
+		uint64_t procBytes[AnalyticsModule::NUM_NFS3_PROCS];
+};
+
+/**
+ * Reports the top clients, files and directories by calls and by bytes
+ * over a sliding window of the last few intervals, in a fixed amount of
+ * memory regardless of how many clients and files there are. Only the
+ * weights are published, by rank (e.g., 
+ * analytics.heavyhitters.files.ops.rank.1), so the number of metrics stays
+ * fixed; the keys themselves go to the module's output file.
+ */
+class HeavyHittersModule : public AnalyticsModule {
+	public:
+		HeavyHittersModule(AnalyticsManager *manager, std::string command,
+			int id, int interval, const Params &params);
+		~HeavyHittersModule();
+		/// topk=n (keys reported) and window=n (intervals in the window)
+		static bool checkParams(const Params &params);
+		static std::string getParamsUsage() { return "topk=n window=n"; }
+		AnalyticsPartial *newPartial() { return new HeavyHittersPartial(); }
+		void report(struct timeval ts);
+
+	private:
+		void reportTop(const std::string &name, const SpaceSaving &summary,
+			bool ipKeys, std::map<std::string, int64_t> &stats);
+
+		/// the aggregates of the intervals in the window, by interval end
+		/// (intervals without any calls have none)
+		std::map<time_t, HeavyHittersPartial *> _window;
+		/// the number of keys reported per summary
+		unsigned _topK;
+		/// the length of the window in intervals
+		unsigned _windowLength;
+};
+
+#endif //HEAVY_HITTERS_MODULE_H
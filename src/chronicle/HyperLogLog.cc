@@ -0,0 +1,41 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include <cmath>
+#include "HyperLogLog.h"
+
+HyperLogLog::HyperLogLog(unsigned precision)
+	: _registers(1u << precision, 0), _precision(precision)
+{
+
+}
+
+void
+HyperLogLog::merge(const HyperLogLog &other)
+{
+	for (unsigned i = 0; i < _registers.size(); i++)
+		if (other._registers[i] > _registers[i])
+			_registers[i] = other._registers[i];
+}
+
+uint64_t
+HyperLogLog::estimate() const
+{
+	double m = _registers.size();
+	double sum = 0;
+	unsigned zeros = 0;
+	for (unsigned i = 0; i < _registers.size(); i++) {
+		sum += ldexp(1.0, -_registers[i]);
+		if (_registers[i] == 0)
+			zeros++;
+	}
+	double alpha = 0.7213 / (1 + 1.079 / m);
+	double estimate = alpha * m * m / sum;
+	// linear counting is more accurate for small cardinalities
+	if (estimate <= 2.5 * m && zeros)
+		estimate = m * log(m / zeros);
+	return (uint64_t)(estimate + 0.5);
+}
@@ -0,0 +1,52 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef HYPER_LOG_LOG_H
+#define HYPER_LOG_LOG_H
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * A HyperLogLog sketch estimating the number of distinct 64-bit hashes
+ * added to it. It takes 2^precision bytes and its standard error is
+ * 1.04/sqrt(2^precision) (0.8% for precision 14). Sketches of the same
+ * precision merge without any loss.
+ */
+class HyperLogLog {
+	public:
+		HyperLogLog(unsigned precision);
+		/// adds a (well mixed) 64-bit hash
+		void add(uint64_t hash) {
+			uint32_t index = hash >> (64 - _precision);
+			// a sentinel bit bounds the rank to 64 - precision + 1
+			uint64_t rest = (hash << _precision) | (1ull << (_precision - 1));
+			uint8_t rank = __builtin_clzll(rest) + 1;
+			if (rank > _registers[index])
+				_registers[index] = rank;
+		}
+		void merge(const HyperLogLog &other);
+		/// the estimated number of distinct hashes
+		uint64_t estimate() const;
+		/// the size of the sketch in bytes
+		unsigned getSize() const { return _registers.size(); }
+
+		/// a hash for integer keys (the MurmurHash3 finalizer)
+		static uint64_t hash64(uint64_t key) {
+			key ^= key >> 33;
+			key *= 0xff51afd7ed558ccdull;
+			key ^= key >> 33;
+			key *= 0xc4ceb9fe1a85ec53ull;
+			key ^= key >> 33;
+			return key;
+		}
+
+	private:
+		std::vector<uint8_t> _registers;
+		unsigned _precision;
+};
+
+#endif //HYPER_LOG_LOG_H
@@ -0,0 +1,44 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "gtest/gtest.h"
+#include "HyperLogLog.h"
+
+static const unsigned PRECISION = 14;
+
+TEST(HyperLogLog, Empty) {
+	HyperLogLog hll(PRECISION);
+	EXPECT_EQ(0u, hll.estimate());
+	EXPECT_EQ(16384u, hll.getSize());
+}
+
+TEST(HyperLogLog, Accuracy) {
+	const uint64_t sizes[] = { 10, 1000, 50000, 1000000 };
+	for (unsigned s = 0; s < 4; s++) {
+		HyperLogLog hll(PRECISION);
+		for (uint64_t i = 0; i < sizes[s]; i++) {
+			// duplicates must not count
+			hll.add(HyperLogLog::hash64(i));
+			hll.add(HyperLogLog::hash64(i));
+		}
+		// within 4 standard errors
+		EXPECT_NEAR((double)sizes[s], (double)hll.estimate(), 
+			sizes[s] * 4 * 0.0082 + 1) << sizes[s];
+	}
+}
+
+TEST(HyperLogLog, MergeIsUnion) {
+	HyperLogLog a(PRECISION), b(PRECISION), all(PRECISION);
+	for (uint64_t i = 0; i < 200000; i++) {
+		uint64_t hash = HyperLogLog::hash64(i);
+		(i < 150000 ? a : b).add(hash);
+		if (i >= 50000)
+			b.add(hash);
+		all.add(hash);
+	}
+	a.merge(b);
+	EXPECT_EQ(all.estimate(), a.estimate());
+}
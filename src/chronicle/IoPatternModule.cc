@@ -0,0 +1,250 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include <linux/nfs.h>
+#include <linux/nfs3.h>
+#include "ChronicleConfig.h"
+#include "MurmurHash3.h"
+#include "RpcParser.h"
+#include "IoPatternModule.h"
+
+IoStreamTable::IoStreamTable(unsigned capacity)
+	: _streams(capacity), _lruHead(-1), _lruTail(-1), _size(0), 
+	_evictions(0)
+{
+	unsigned buckets = 1;
+	while (buckets < capacity)
+		buckets <<= 1;
+	_buckets.assign(buckets, -1);
+}
+
+void
+IoStreamTable::unlinkLru(int32_t index)
+{
+	IoStream &s = _streams[index];
+	if (s.lruPrev >= 0)
+		_streams[s.lruPrev].lruNext = s.lruNext;
+	else
+		_lruHead = s.lruNext;
+	if (s.lruNext >= 0)
+		_streams[s.lruNext].lruPrev = s.lruPrev;
+	else
+		_lruTail = s.lruPrev;
+}
+
+void
+IoStreamTable::pushLru(int32_t index)
+{
+	IoStream &s = _streams[index];
+	s.lruPrev = -1;
+	s.lruNext = _lruHead;
+	if (_lruHead >= 0)
+		_streams[_lruHead].lruPrev = index;
+	_lruHead = index;
+	if (_lruTail < 0)
+		_lruTail = index;
+}
+
+void
+IoStreamTable::unlinkHash(int32_t index)
+{
+	int32_t *link = &_buckets[_streams[index].key & (_buckets.size() - 1)];
+	while (*link != index)
+		link = &_streams[*link].hashNext;
+	*link = _streams[index].hashNext;
+}
+
+IoStream *
+IoStreamTable::find(uint64_t key, bool &added)
+{
+	int32_t *bucket = &_buckets[key & (_buckets.size() - 1)];
+	for (int32_t i = *bucket; i >= 0; i = _streams[i].hashNext) {
+		if (_streams[i].key == key) {
+			if (i != _lruHead) {
+				unlinkLru(i);
+				pushLru(i);
+			}
+			added = false;
+			return &_streams[i];
+		}
+	}
+
+	int32_t index;
+	if (_size < _streams.size())
+		index = _size++;
+	else {
+		// reuse the least recently used stream
+		index = _lruTail;
+		unlinkLru(index);
+		unlinkHash(index);
+		_evictions++;
+	}
+	IoStream &s = _streams[index];
+	memset(&s, 0, sizeof(s));
+	s.key = key;
+	s.hashNext = *bucket;
+	*bucket = index;
+	pushLru(index);
+	added = true;
+	return &s;
+}
+
+IoPatternPartial::IoPatternPartial()
+	: seqStreams(0), randomStreams(0), mixedStreams(0), evictions(0),
+	_streams(NULL), _lastEvictions(0)
+{
+	memset(ops, 0, sizeof(ops));
+	memset(bytes, 0, sizeof(bytes));
+	memset(seqBytes, 0, sizeof(seqBytes));
+	memset(sizes, 0, sizeof(sizes));
+}
+
+IoPatternPartial::~IoPatternPartial()
+{
+	delete _streams;
+}
+
+unsigned
+IoPatternPartial::sizeBucket(uint32_t size)
+{
+	if (size <= 4096)
+		return 0;
+	unsigned bucket = 64 - __builtin_clzll((uint64_t)size - 1) - 12;
+	return bucket < NUM_SIZE_BUCKETS ? bucket : NUM_SIZE_BUCKETS - 1;
+}
+
+void
+IoPatternPartial::update(PduDescriptor *pduDesc)
+{
+	// the calls carry the file handle and the byte range
+	if (pduDesc->rpcPduType == PduDescriptor::PDU_BAD 
+			|| pduDesc->rpcMsgType != RPC_CALL
+			|| pduDesc->rpcProgram != NFS_PROGRAM 
+			|| pduDesc->rpcProgramVersion != NFS3_VERSION
+			|| (pduDesc->rpcProgramProcedure != NFS3PROC_READ 
+				&& pduDesc->rpcProgramProcedure != NFS3PROC_WRITE))
+		return ;
+	NfsV3PduDescriptor *nfsDesc = dynamic_cast<NfsV3PduDescriptor *>(pduDesc);
+	if (nfsDesc == NULL || !nfsDesc->parsable || nfsDesc->fhLen == 0)
+		return ;
+	if (_streams == NULL)
+		_streams = new IoStreamTable(ANALYTICS_IO_PATTERN_MAX_STREAMS);
+
+	// a client reading a file while another writes it are two streams
+	uint64_t md[2];
+	MurmurHash3_x64_128(nfsDesc->fileHandle, nfsDesc->fhLen, 
+		nfsDesc->firstPktDesc->srcIP, md);
+	bool added;
+	IoStream *stream = _streams->find(md[0], added);
+	unsigned rw = nfsDesc->rpcProgramProcedure == NFS3PROC_READ ? READ : WRITE;
+	bool sequential = !added && nfsDesc->fileOffset == stream->nextOffset;
+	stream->runLength = sequential ? stream->runLength + 1 : 0;
+	stream->nextOffset = nfsDesc->fileOffset + nfsDesc->byteCount;
+	stream->ops++;
+	ops[rw]++;
+	bytes[rw] += nfsDesc->byteCount;
+	sizes[rw][sizeBucket(nfsDesc->byteCount)]++;
+	if (sequential) {
+		stream->seqOps++;
+		seqBytes[rw] += nfsDesc->byteCount;
+	}
+}
+
+void
+IoPatternPartial::handOver(AnalyticsPartial *next)
+{
+	if (_streams == NULL)
+		return ;
+	for (unsigned i = 0; i < _streams->size(); i++) {
+		IoStream &s = _streams->get(i);
+		if (s.ops == 0)
+			continue;
+		// at least 3/4 sequential accesses make a sequential stream
+		if (s.seqOps * 4 >= s.ops * 3)
+			seqStreams++;
+		else if (s.seqOps * 4 <= s.ops)
+			randomStreams++;
+		else
+			mixedStreams++;
+		s.ops = s.seqOps = 0;
+	}
+	evictions = _streams->getEvictions() - _lastEvictions;
+	if (next) {
+		IoPatternPartial *partial = static_cast<IoPatternPartial *>(next);
+		partial->_streams = _streams;
+		partial->_lastEvictions = _streams->getEvictions();
+	} else
+		delete _streams;
+	_streams = NULL;
+}
+
+void
+IoPatternPartial::merge(const AnalyticsPartial *other)
+{
+	const IoPatternPartial *partial = 
+		static_cast<const IoPatternPartial *>(other);
+	for (unsigned rw = READ; rw <= WRITE; rw++) {
+		ops[rw] += partial->ops[rw];
+		bytes[rw] += partial->bytes[rw];
+		seqBytes[rw] += partial->seqBytes[rw];
+		for (unsigned i = 0; i < NUM_SIZE_BUCKETS; i++)
+			sizes[rw][i] += partial->sizes[rw][i];
+	}
+	seqStreams += partial->seqStreams;
+	randomStreams += partial->randomStreams;
+	mixedStreams += partial->mixedStreams;
+	evictions += partial->evictions;
+}
+
+IoPatternModule::IoPatternModule(AnalyticsManager *manager, 
+	std::string command, int id, int interval, const Params &params)
+	: AnalyticsModule("IoPatternModule", manager, command, id, interval)
+{
+
+}
+
+void
+IoPatternModule::report(struct timeval ts)
+{
+	static const char *rwNames[] = { "read", "write" };
+	static const char *sizeNames[IoPatternPartial::NUM_SIZE_BUCKETS] = {
+		"4k", "8k", "16k", "32k", "64k", "128k", "256k", "512k", "large"
+	};
+	const IoPatternPartial *pattern = 
+		static_cast<const IoPatternPartial *>(_aggregate);
+	std::map<std::string, int64_t> stats;
+	std::string base("analytics.iopattern.");
+
+	_output << getTime(ts) << " I/O patterns over " << _interval << "s" 
+		<< std::endl;
+	for (unsigned rw = IoPatternPartial::READ; 
+			rw <= IoPatternPartial::WRITE; rw++) {
+		std::string name = base + rwNames[rw];
+		// fractions are reported in percent
+		int64_t seqPercent = pattern->bytes[rw] ? 
+			pattern->seqBytes[rw] * 100 / pattern->bytes[rw] : 0;
+		_output << rwNames[rw] << " ops " << pattern->ops[rw] 
+			<< " bytes " << pattern->bytes[rw] << " sequential " 
+			<< seqPercent << "% random " 
+			<< (pattern->bytes[rw] ? 100 - seqPercent : 0) << "% sizes";
+		stats[name + ".ops"] = pattern->ops[rw];
+		stats[name + ".bytes"] = pattern->bytes[rw];
+		stats[name + ".sequential_pct"] = seqPercent;
+		for (unsigned i = 0; i < IoPatternPartial::NUM_SIZE_BUCKETS; i++) {
+			_output << " " << sizeNames[i] << ":" << pattern->sizes[rw][i];
+			stats[name + ".size." + sizeNames[i]] = pattern->sizes[rw][i];
+		}
+		_output << std::endl;
+	}
+	_output << "streams sequential " << pattern->seqStreams << " random " 
+		<< pattern->randomStreams << " mixed " << pattern->mixedStreams 
+		<< " evicted " << pattern->evictions << std::endl << std::endl;
+	stats[base + "streams.sequential"] = pattern->seqStreams;
+	stats[base + "streams.random"] = pattern->randomStreams;
+	stats[base + "streams.mixed"] = pattern->mixedStreams;
+	stats[base + "streams.evicted"] = pattern->evictions;
+	_manager->publishStats(stats);
+}
@@ -0,0 +1,107 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef IO_PATTERN_MODULE_H
+#define IO_PATTERN_MODULE_H
+
+#include <vector>
+#include "AnalyticsModule.h"
+
+/// The READ/WRITE access stream of a client to a file
+struct IoStream {
+	/// hash of the file handle and the client
+	uint64_t key;
+	/// the offset a sequential access would start at
+	uint64_t nextOffset;
+	/// the number of sequential accesses in a row
+	uint32_t runLength;
+	/// READs/WRITEs in the current interval
+	uint32_t ops;
+	/// sequential READs/WRITEs in the current interval
+	uint32_t seqOps;
+	/// hash chain and LRU list links (indexes, -1 for none)
+	int32_t hashNext;
+	int32_t lruPrev;
+	int32_t lruNext;
+};
+
+/**
+ * A fixed-size hash table of I/O streams that evicts the least recently 
+ * used stream when it is full. All the memory is allocated up front.
+ */
+class IoStreamTable {
+	public:
+		IoStreamTable(unsigned capacity);
+		/**
+		 * finds a stream, adding it if needed (and making it the most
+		 * recently used one)
+		 * @param[in] key The stream key
+		 * @param[out] added Whether the stream is new
+		 */
+		IoStream *find(uint64_t key, bool &added);
+		unsigned size() const { return _size; }
+		IoStream &get(unsigned i) { return _streams[i]; }
+		/// the number of streams evicted so far
+		uint64_t getEvictions() const { return _evictions; }
+
+	private:
+		void unlinkLru(int32_t index);
+		void pushLru(int32_t index);
+		void unlinkHash(int32_t index);
+
+		std::vector<IoStream> _streams;
+		/// hash chain heads (indexes into _streams)
+		std::vector<int32_t> _buckets;
+		/// most and least recently used streams
+		int32_t _lruHead, _lruTail;
+		unsigned _size;
+		uint64_t _evictions;
+};
+
+/// READ/WRITE pattern counters of an interval
+class IoPatternPartial : public AnalyticsPartial {
+	public:
+		/// I/O size buckets: <=4K, 8K, ..., 512K, >512K
+		static const unsigned NUM_SIZE_BUCKETS = 9;
+		enum { READ = 0, WRITE = 1 };
+
+		IoPatternPartial();
+		~IoPatternPartial();
+		void update(PduDescriptor *pduDesc);
+		void merge(const AnalyticsPartial *other);
+		/// classifies the streams of the interval and moves them on
+		void handOver(AnalyticsPartial *next);
+
+		static unsigned sizeBucket(uint32_t size);
+
+		uint64_t ops[2];
+		uint64_t bytes[2];
+		uint64_t seqBytes[2];
+		uint64_t sizes[2][NUM_SIZE_BUCKETS];
+		/// streams with mostly sequential, mostly random, or mixed access
+		uint64_t seqStreams, randomStreams, mixedStreams;
+		uint64_t evictions;
+
+	private:
+		/// the shard's streams (only in the shard's current partial)
+		IoStreamTable *_streams;
+		/// evictions as of the start of the interval
+		uint64_t _lastEvictions;
+};
+
+/**
+ * Reports the sequential and random READ/WRITE byte fractions, the I/O
+ * sizes, and the number of sequential/random streams of every interval.
+ */
+class IoPatternModule : public AnalyticsModule {
+	public:
+		IoPatternModule(AnalyticsManager *manager, std::string command,
+			int id, int interval, const Params &params);
+		AnalyticsPartial *newPartial() { return new IoPatternPartial(); }
+		void report(struct timeval ts);
+};
+
+#endif //IO_PATTERN_MODULE_H
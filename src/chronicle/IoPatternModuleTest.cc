@@ -0,0 +1,93 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include <cstring>
+#include <linux/nfs3.h>
+#include "gtest/gtest.h"
+#include "RpcParser.h"
+#include "IoPatternModule.h"
+
+TEST(IoStreamTable, EvictsLeastRecentlyUsed) {
+	IoStreamTable table(4);
+	bool added;
+	for (uint64_t key = 0; key < 4; key++) {
+		table.find(key, added)->nextOffset = key;
+		EXPECT_TRUE(added);
+	}
+	// touch 0 so that 1 is the least recently used stream
+	EXPECT_EQ(0u, table.find(0, added)->nextOffset);
+	EXPECT_FALSE(added);
+	table.find(100, added);
+	EXPECT_TRUE(added);
+	EXPECT_EQ(1u, table.getEvictions());
+	EXPECT_EQ(4u, table.size());
+	table.find(0, added);
+	EXPECT_FALSE(added);
+	table.find(2, added);
+	EXPECT_FALSE(added);
+	table.find(1, added);
+	EXPECT_TRUE(added);
+	EXPECT_EQ(2u, table.getEvictions());
+}
+
+TEST(IoPatternPartial, SizeBuckets) {
+	EXPECT_EQ(0u, IoPatternPartial::sizeBucket(512));
+	EXPECT_EQ(0u, IoPatternPartial::sizeBucket(4096));
+	EXPECT_EQ(1u, IoPatternPartial::sizeBucket(4097));
+	EXPECT_EQ(3u, IoPatternPartial::sizeBucket(32768));
+	EXPECT_EQ(7u, IoPatternPartial::sizeBucket(512 * 1024));
+	EXPECT_EQ(8u, IoPatternPartial::sizeBucket(1024 * 1024));
+}
+
+class IoPatternPartialTest : public ::testing::Test {
+	protected:
+		void access(IoPatternPartial &partial, uint32_t proc, uint32_t file,
+			uint64_t offset, uint32_t count) {
+			PacketDescriptor pkt;
+			pkt.srcIP = 0x0a000001;
+			NfsV3PduDescriptor call(&pkt, &pkt, 0, 1, NFS3_VERSION, proc, 
+				0, 0, 0, RPC_CALL);
+			call.rpcPduType = PduDescriptor::PDU_COMPLETE;
+			call.parsable = true;
+			call.fhLen = 32;
+			memset(call.fileHandle, 0, sizeof(call.fileHandle));
+			memcpy(call.fileHandle, &file, sizeof(file));
+			call.fileOffset = offset;
+			call.byteCount = count;
+			partial.update(&call);
+		}
+};
+
+TEST_F(IoPatternPartialTest, ClassifiesStreams) {
+	IoPatternPartial partial;
+	for (unsigned i = 0; i < 16; i++) {
+		access(partial, NFS3PROC_READ, 1, i * 32768, 32768);
+		access(partial, NFS3PROC_WRITE, 2, ((i * 7919) % 16) * 4096, 4096);
+	}
+	EXPECT_EQ(16u, partial.ops[IoPatternPartial::READ]);
+	EXPECT_EQ(15u * 32768, partial.seqBytes[IoPatternPartial::READ]);
+	EXPECT_EQ(0u, partial.seqBytes[IoPatternPartial::WRITE]);
+	EXPECT_EQ(16u, partial.sizes[IoPatternPartial::WRITE][0]);
+
+	IoPatternPartial next;
+	partial.handOver(&next);
+	EXPECT_EQ(1u, partial.seqStreams);
+	EXPECT_EQ(1u, partial.randomStreams);
+	EXPECT_EQ(0u, partial.mixedStreams);
+
+	// the streams carry over to the next interval
+	access(next, NFS3PROC_READ, 1, 16 * 32768, 32768);
+	EXPECT_EQ(32768u, next.seqBytes[IoPatternPartial::READ]);
+	next.handOver(NULL);
+	EXPECT_EQ(1u, next.seqStreams);
+	EXPECT_EQ(0u, next.randomStreams);
+	EXPECT_EQ(0u, next.mixedStreams);
+
+	partial.merge(&next);
+	EXPECT_EQ(17u, partial.ops[IoPatternPartial::READ]);
+	EXPECT_EQ(16u * 32768, partial.seqBytes[IoPatternPartial::READ]);
+	EXPECT_EQ(2u, partial.seqStreams);
+}
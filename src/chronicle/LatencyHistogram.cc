@@ -0,0 +1,48 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "LatencyHistogram.h"
+
+void
+LatencyHistogram::merge(const LatencyHistogram &other)
+{
+	for (unsigned i = 0; i < NUM_BUCKETS; i++)
+		_counts[i] += other._counts[i];
+	_count += other._count;
+	_sum += other._sum;
+	if (other._max > _max)
+		_max = other._max;
+}
+
+uint64_t
+LatencyHistogram::bucketUpperBound(unsigned index)
+{
+	if (index < SUB_BUCKETS)
+		return index;
+	unsigned shift = (index >> SUB_BUCKET_BITS) - 1;
+	uint64_t base = (uint64_t)(index & (SUB_BUCKETS - 1)) + SUB_BUCKETS;
+	return ((base + 1) << shift) - 1;
+}
+
+uint64_t
+LatencyHistogram::getQuantile(double quantile) const
+{
+	if (_count == 0)
+		return 0;
+	uint64_t rank = (uint64_t)(quantile * _count + 0.5);
+	if (rank == 0)
+		rank = 1;
+	uint64_t seen = 0;
+	for (unsigned i = 0; i < NUM_BUCKETS; i++) {
+		seen += _counts[i];
+		if (seen >= rank) {
+			// never report more than what was actually recorded
+			uint64_t bound = bucketUpperBound(i);
+			return bound < _max ? bound : _max;
+		}
+	}
+	return _max;
+}
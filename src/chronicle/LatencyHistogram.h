@@ -0,0 +1,71 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <cstring>
+
+/**
+ * A fixed-size, log-linear (HDR-style) histogram of latencies in 
+ * microseconds. Every power of 2 is split into SUB_BUCKETS linear buckets,
+ * so a recorded value is off by less than 1/SUB_BUCKETS (~3%). Recording
+ * never allocates, and two histograms merge by adding their buckets.
+ */
+class LatencyHistogram {
+	public:
+		/// log2 of the number of linear buckets per power of 2
+		static const unsigned SUB_BUCKET_BITS = 5;
+		static const unsigned SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+		/// values at or above 2^MAX_VALUE_BITS us (~19 hours) are clamped
+		static const unsigned MAX_VALUE_BITS = 36;
+		static const unsigned NUM_BUCKETS = 
+			(MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+		LatencyHistogram() { reset(); }
+		void reset()
+			{ memset(this, 0, sizeof(*this)); }
+		/// records a latency (in microseconds)
+		void record(uint64_t value) {
+			_counts[bucketIndex(value)]++;
+			_count++;
+			_sum += value;
+			if (value > _max)
+				_max = value;
+		}
+		/// adds the values recorded by another histogram
+		void merge(const LatencyHistogram &other);
+		/**
+		 * finds the value below which a fraction of the values fall
+		 * @param[in] quantile The fraction (e.g., 0.99)
+		 * @returns the upper bound of the bucket holding the quantile
+		 */
+		uint64_t getQuantile(double quantile) const;
+		uint64_t getCount() const { return _count; }
+		uint64_t getMax() const { return _max; }
+		uint64_t getMean() const { return _count ? _sum / _count : 0; }
+
+		static unsigned bucketIndex(uint64_t value) {
+			if (value < SUB_BUCKETS)
+				return value;
+			if (value >> MAX_VALUE_BITS)
+				return NUM_BUCKETS - 1;
+			unsigned shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS;
+			return ((shift + 1) << SUB_BUCKET_BITS) 
+				+ (value >> shift) - SUB_BUCKETS;
+		}
+		/// the largest value that falls in a bucket
+		static uint64_t bucketUpperBound(unsigned index);
+
+	private:
+		uint32_t _counts[NUM_BUCKETS];
+		uint64_t _count;
+		uint64_t _sum;
+		uint64_t _max;
+};
+
+#endif //LATENCY_HISTOGRAM_H
@@ -0,0 +1,55 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "gtest/gtest.h"
+#include "LatencyHistogram.h"
+
+TEST(LatencyHistogram, BucketsAreContiguous) {
+	unsigned last = 0;
+	for (uint64_t v = 1; v < (1ull << 20); v++) {
+		unsigned index = LatencyHistogram::bucketIndex(v);
+		ASSERT_TRUE(index == last || index == last + 1) << v;
+		ASSERT_LE(v, LatencyHistogram::bucketUpperBound(index));
+		last = index;
+	}
+	EXPECT_EQ(LatencyHistogram::NUM_BUCKETS - 1,
+		LatencyHistogram::bucketIndex(~0ull));
+}
+
+TEST(LatencyHistogram, RelativeError) {
+	for (uint64_t v = 1; v < (1ull << 35); v = v * 3 + 1) {
+		uint64_t bound = LatencyHistogram::bucketUpperBound(
+			LatencyHistogram::bucketIndex(v));
+		EXPECT_LE(bound - v, v / LatencyHistogram::SUB_BUCKETS) << v;
+	}
+}
+
+TEST(LatencyHistogram, Quantiles) {
+	LatencyHistogram h;
+	EXPECT_EQ(0u, h.getQuantile(0.5));
+	for (uint64_t v = 1; v <= 1000; v++)
+		h.record(v);
+	EXPECT_EQ(1000u, h.getCount());
+	EXPECT_EQ(1000u, h.getMax());
+	EXPECT_EQ(500u, h.getMean());
+	EXPECT_NEAR(500.0, h.getQuantile(0.5), 500.0 / 32);
+	EXPECT_NEAR(990.0, h.getQuantile(0.99), 990.0 / 32);
+	EXPECT_EQ(1000u, h.getQuantile(1.0));
+}
+
+TEST(LatencyHistogram, MergeMatchesSingleHistogram) {
+	LatencyHistogram all, a, b;
+	for (uint64_t v = 1; v < 100000; v += 7) {
+		all.record(v);
+		(v & 1 ? a : b).record(v);
+	}
+	a.merge(b);
+	EXPECT_EQ(all.getCount(), a.getCount());
+	EXPECT_EQ(all.getMax(), a.getMax());
+	EXPECT_EQ(all.getMean(), a.getMean());
+	EXPECT_EQ(all.getQuantile(0.5), a.getQuantile(0.5));
+	EXPECT_EQ(all.getQuantile(0.999), a.getQuantile(0.999));
+}
@@ -0,0 +1,208 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include <iostream>
+#include "Metrics.h"
+
+std::atomic<unsigned> Metrics::_verbose(METRICS_DEFAULT_VERBOSE);
+std::atomic<unsigned> Metrics::_nextThreadSlot(0);
+__thread unsigned Metrics::_threadSlot = 0;
+
+static const struct {
+	const char *name;
+	Metrics::Category category;
+} categoryNames[] = {
+	{ "rpc", Metrics::VERBOSE_RPC },
+	{ "network", Metrics::VERBOSE_NETWORK },
+	{ "bufpool", Metrics::VERBOSE_BUFPOOL }
+};
+static const unsigned NUM_CATEGORIES =
+	sizeof(categoryNames) / sizeof(categoryNames[0]);
+
+void
+Metrics::setVerbose(Category category, bool on)
+{
+	if (on)
+		_verbose.fetch_or(category);
+	else
+		_verbose.fetch_and(~category);
+}
+
+bool
+Metrics::categoryFromName(const std::string &name, Category *category)
+{
+	for (unsigned i = 0; i < NUM_CATEGORIES; i++) {
+		if (name == categoryNames[i].name) {
+			*category = categoryNames[i].category;
+			return true;
+		}
+	}
+	return false;
+}
+
+void
+Metrics::assignThreadSlot()
+{
+	// threads beyond METRICS_MAX_THREADS share the last slot
+	unsigned slot = _nextThreadSlot.fetch_add(1);
+	_threadSlot = (slot < METRICS_MAX_THREADS ? slot : METRICS_MAX_THREADS)
+		+ 1;
+}
+
+std::list<MetricCounter *> &
+Metrics::counters()
+{
+	static std::list<MetricCounter *> counters;
+	return counters;
+}
+
+std::list<MetricHistogram *> &
+Metrics::histograms()
+{
+	static std::list<MetricHistogram *> histograms;
+	return histograms;
+}
+
+void
+Metrics::getStats(std::map<std::string, int64_t> &stats)
+{
+	for (std::list<MetricCounter *>::const_iterator it = counters().begin();
+			it != counters().end(); it++)
+		stats[(*it)->getName()] = (*it)->get();
+	for (std::list<MetricHistogram *>::const_iterator it =
+			histograms().begin(); it != histograms().end(); it++) {
+		LatencyHistogram *h = new LatencyHistogram;
+		(*it)->get(*h);
+		const std::string &name = (*it)->getName();
+		stats[name + ".count"] = h->getCount();
+		if (h->getCount()) {
+			stats[name + ".mean"] = h->getMean();
+			stats[name + ".p50"] = h->getQuantile(0.5);
+			stats[name + ".p99"] = h->getQuantile(0.99);
+			stats[name + ".max"] = h->getMax();
+		}
+		delete h;
+	}
+}
+
+void
+Metrics::print(std::ostream &out)
+{
+	std::map<std::string, int64_t> stats;
+	getStats(stats);
+	for (std::map<std::string, int64_t>::const_iterator it = stats.begin();
+			it != stats.end(); it++)
+		out << it->first << ": " << it->second << std::endl;
+}
+
+bool
+Metrics::processCommand(const std::list<std::string> &args)
+{
+	std::list<std::string>::const_iterator it = args.begin();
+	if (it == args.end()) {
+		usage();
+		return false;
+	}
+	if (*it == "LIST" && args.size() == 1) {
+		print(std::cout);
+		std::cout << "verbose:";
+		for (unsigned i = 0; i < NUM_CATEGORIES; i++)
+			std::cout << " " << categoryNames[i].name << "="
+				<< (isVerbose(categoryNames[i].category) ? "ON" : "OFF");
+		std::cout << std::endl;
+		return true;
+	}
+	if (*it == "VERBOSE" && args.size() == 3) {
+		Category category;
+		if (!categoryFromName(*++it, &category)) {
+			std::cerr << FONT_RED << "Metrics::processCommand: "
+				<< "Invalid category " << *it << "!\n" << FONT_DEFAULT;
+			usage();
+			return false;
+		}
+		if (*++it == "ON" || *it == "OFF") {
+			setVerbose(category, *it == "ON");
+			return true;
+		}
+	}
+	usage();
+	return false;
+}
+
+void
+Metrics::usage()
+{
+	std::cerr << FONT_RED << "Usage:\n"
+		<< "\tMETRICS LIST\n"
+		<< "\tMETRICS VERBOSE";
+	for (unsigned i = 0; i < NUM_CATEGORIES; i++)
+		std::cerr << (i ? "|" : " ") << categoryNames[i].name;
+	std::cerr << " ON|OFF\n" << FONT_DEFAULT;
+}
+
+MetricCounter::MetricCounter(const char *name) : _name(name)
+{
+	for (unsigned i = 0; i <= METRICS_MAX_THREADS; i++)
+		_slots[i].value = 0;
+	Metrics::counters().push_back(this);
+}
+
+MetricCounter::~MetricCounter()
+{
+	Metrics::counters().remove(this);
+}
+
+int64_t
+MetricCounter::get() const
+{
+	int64_t sum = 0;
+	for (unsigned i = 0; i <= METRICS_MAX_THREADS; i++)
+		sum += _slots[i].value.load(std::memory_order_relaxed);
+	return sum;
+}
+
+MetricHistogram::MetricHistogram(const char *name) : _name(name)
+{
+	for (unsigned i = 0; i < METRICS_MAX_THREADS; i++)
+		_slots[i] = NULL;
+	Metrics::histograms().push_back(this);
+}
+
+MetricHistogram::~MetricHistogram()
+{
+	Metrics::histograms().remove(this);
+	for (unsigned i = 0; i < METRICS_MAX_THREADS; i++)
+		delete _slots[i].load();
+}
+
+LatencyHistogram *
+MetricHistogram::newSlot(unsigned slot)
+{
+	LatencyHistogram *h = new LatencyHistogram;
+	_slots[slot].store(h, std::memory_order_release);
+	return h;
+}
+
+void
+MetricHistogram::recordShared(uint64_t value)
+{
+	_sharedLock.lock();
+	_shared.record(value);
+	_sharedLock.unlock();
+}
+
+void
+MetricHistogram::get(LatencyHistogram &out) const
+{
+	for (unsigned i = 0; i < METRICS_MAX_THREADS; i++) {
+		LatencyHistogram *h = _slots[i].load(std::memory_order_acquire);
+		if (h)
+			out.merge(*h);
+	}
+	_sharedLock.lock();
+	out.merge(_shared);
+	_sharedLock.unlock();
+}
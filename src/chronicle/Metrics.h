@@ -0,0 +1,162 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <ostream>
+#include <string>
+#include "ChronicleConfig.h"
+#include "LatencyHistogram.h"
+#include "Lock.h"
+
+class MetricCounter;
+class MetricHistogram;
+
+/**
+ * The registry of the always-on Chronicle metrics and the switches for the
+ * verbose (i.e., diagnostic) instrumentation. Metrics are updated in
+ * per-thread slots, so updating one is a plain store to a cache line no
+ * other thread writes; the slots are only summed when the metric is read.
+ * Verbose categories can be turned on and off at runtime (e.g., from the
+ * command channel) instead of requiring a CHRON_DEBUG build.
+ */
+class Metrics {
+	public:
+		/// verbose instrumentation categories
+		typedef enum {
+			VERBOSE_RPC = 1,		// RPC parser progress and per-flow stats
+			VERBOSE_NETWORK = 1 << 1,	// duplicate vs. lost retransmissions
+			VERBOSE_BUFPOOL = 1 << 2	// exact buffer pool high-water marks
+		} Category;
+
+		static inline bool isVerbose(Category category) {
+			return __builtin_expect(
+				_verbose.load(std::memory_order_relaxed) & category, 0);
+		}
+		static void setVerbose(Category category, bool on);
+		static bool categoryFromName(const std::string &name,
+			Category *category);
+
+		/// the calling thread's slot in the metrics
+		static inline unsigned getThreadSlot() {
+			if (__builtin_expect(_threadSlot == 0, 0))
+				assignThreadSlot();
+			return _threadSlot - 1;
+		}
+
+		/**
+		 * adds the current values of all the metrics (counters by name and
+		 * histograms as name.count/mean/p50/p99/max)
+		 */
+		static void getStats(std::map<std::string, int64_t> &stats);
+		/// prints all the metrics
+		static void print(std::ostream &out);
+		/**
+		 * handles a METRICS command from the command channel:
+		 * LIST | VERBOSE category ON|OFF
+		 * @returns false if the command is malformed
+		 */
+		static bool processCommand(const std::list<std::string> &args);
+		static void usage();
+
+	private:
+		friend class MetricCounter;
+		friend class MetricHistogram;
+
+		static void assignThreadSlot();
+		static std::list<MetricCounter *> &counters();
+		static std::list<MetricHistogram *> &histograms();
+
+		static std::atomic<unsigned> _verbose;
+		static std::atomic<unsigned> _nextThreadSlot;
+		/// 1 + the slot of this thread (0 if not assigned yet)
+		static __thread unsigned _threadSlot;
+};
+
+/**
+ * A counter that any thread can update without contention. Counters have to
+ * be defined with static storage duration (their slots are cache-line
+ * aligned).
+ */
+class MetricCounter {
+	public:
+		MetricCounter(const char *name);
+		~MetricCounter();
+
+		inline void add(int64_t n = 1) {
+			unsigned slot = Metrics::getThreadSlot();
+			if (__builtin_expect(slot < METRICS_MAX_THREADS, 1)) {
+				// only this thread writes to its slot
+				std::atomic<int64_t> &v = _slots[slot].value;
+				v.store(v.load(std::memory_order_relaxed) + n,
+					std::memory_order_relaxed);
+			} else
+				_slots[METRICS_MAX_THREADS].value.fetch_add(n);
+		}
+		inline void operator++(int) { add(1); }
+		inline void operator--(int) { add(-1); }
+		/// the sum of the slots
+		int64_t get() const;
+		const std::string &getName() const { return _name; }
+
+	private:
+		MetricCounter(const MetricCounter &);
+		MetricCounter &operator=(const MetricCounter &);
+
+		struct Slot {
+			std::atomic<int64_t> value;
+		} __attribute__ ((aligned (64)));
+
+		/// one slot per thread plus one shared by the threads beyond
+		/// METRICS_MAX_THREADS
+		Slot _slots[METRICS_MAX_THREADS + 1];
+		std::string _name;
+};
+
+/**
+ * A histogram that any thread can record to without contention. Each thread
+ * gets its own LatencyHistogram the first time it records a value. The
+ * values are cumulative since the start.
+ */
+class MetricHistogram {
+	public:
+		MetricHistogram(const char *name);
+		~MetricHistogram();
+
+		inline void record(uint64_t value) {
+			unsigned slot = Metrics::getThreadSlot();
+			if (__builtin_expect(slot < METRICS_MAX_THREADS, 1)) {
+				LatencyHistogram *h =
+					_slots[slot].load(std::memory_order_relaxed);
+				if (__builtin_expect(h == NULL, 0))
+					h = newSlot(slot);
+				h->record(value);
+			} else
+				recordShared(value);
+		}
+		/// merges the slots into a histogram
+		void get(LatencyHistogram &out) const;
+		const std::string &getName() const { return _name; }
+
+	private:
+		MetricHistogram(const MetricHistogram &);
+		MetricHistogram &operator=(const MetricHistogram &);
+
+		LatencyHistogram *newSlot(unsigned slot);
+		void recordShared(uint64_t value);
+
+		std::atomic<LatencyHistogram *> _slots[METRICS_MAX_THREADS];
+		/// the histogram shared by the threads beyond METRICS_MAX_THREADS
+		LatencyHistogram _shared;
+		mutable TtasLock _sharedLock;
+		std::string _name;
+};
+
+#endif //METRICS_H
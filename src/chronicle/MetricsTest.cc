@@ -0,0 +1,72 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "Metrics.h"
+
+static MetricCounter testCounter("test.counter");
+static MetricHistogram testHistogram("test.histogram");
+
+TEST(Metrics, CounterSumsThreads) {
+	int64_t start = testCounter.get();
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < 4; i++)
+		threads.push_back(std::thread([] {
+			for (unsigned j = 0; j < 100000; j++)
+				testCounter++;
+			testCounter--;
+		}));
+	for (unsigned i = 0; i < threads.size(); i++)
+		threads[i].join();
+	EXPECT_EQ(start + 4 * 99999, testCounter.get());
+}
+
+TEST(Metrics, HistogramMergesThreads) {
+	std::vector<std::thread> threads;
+	for (unsigned i = 1; i <= 4; i++)
+		threads.push_back(std::thread([i] {
+			for (unsigned j = 0; j < 1000; j++)
+				testHistogram.record(i * 1000);
+		}));
+	for (unsigned i = 0; i < threads.size(); i++)
+		threads[i].join();
+	LatencyHistogram h;
+	testHistogram.get(h);
+	EXPECT_EQ(4000u, h.getCount());
+	EXPECT_GE(h.getMax(), 4000u);
+	EXPECT_LE(h.getQuantile(0.5), 2100u);
+}
+
+TEST(Metrics, GetStatsByName) {
+	testCounter.add(5);
+	std::map<std::string, int64_t> stats;
+	Metrics::getStats(stats);
+	EXPECT_EQ(testCounter.get(), stats["test.counter"]);
+	EXPECT_TRUE(stats.count("test.histogram.count"));
+}
+
+TEST(Metrics, VerboseCommand) {
+	Metrics::Category category;
+	ASSERT_TRUE(Metrics::categoryFromName("network", &category));
+	EXPECT_EQ(Metrics::VERBOSE_NETWORK, category);
+	EXPECT_FALSE(Metrics::categoryFromName("bogus", &category));
+
+	EXPECT_FALSE(Metrics::isVerbose(Metrics::VERBOSE_RPC));
+	std::list<std::string> args = { "VERBOSE", "rpc", "ON" };
+	EXPECT_TRUE(Metrics::processCommand(args));
+	EXPECT_TRUE(Metrics::isVerbose(Metrics::VERBOSE_RPC));
+	EXPECT_FALSE(Metrics::isVerbose(Metrics::VERBOSE_BUFPOOL));
+	args = { "VERBOSE", "rpc", "OFF" };
+	EXPECT_TRUE(Metrics::processCommand(args));
+	EXPECT_FALSE(Metrics::isVerbose(Metrics::VERBOSE_RPC));
+
+	args = { "VERBOSE", "rpc" };
+	EXPECT_FALSE(Metrics::processCommand(args));
+	args = { "VERBOSE", "bogus", "ON" };
+	EXPECT_FALSE(Metrics::processCommand(args));
+}
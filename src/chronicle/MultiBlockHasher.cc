@@ -0,0 +1,468 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "MultiBlockHasher.h"
+#include "MurmurHash3.h"
+#include <cassert>
+#include <cstring>
+#ifdef USE_XXHASH
+#include <xxhash.h>
+#endif
+
+#if defined(__x86_64__)
+// the AVX-512 intrinsics start from _mm512_undefined_*() values, which some
+// GCC versions flag once inlined
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#define MBH_X86_SIMD 1
+#else
+#define MBH_X86_SIMD 0
+#endif
+
+static const uint64_t C1 = 0x87c37b91114253d5llu;
+static const uint64_t C2 = 0x4cf5ad432745937fllu;
+static const uint64_t FMIX_C1 = 0xff51afd7ed558ccdllu;
+static const uint64_t FMIX_C2 = 0xc4ceb9fe1a85ec53llu;
+
+static bool
+implementsAlgorithm(MultiBlockHasher::Impl impl,
+                    MultiBlockHasher::Algorithm alg)
+{
+    switch (impl) {
+    case MultiBlockHasher::IMPL_SCALAR:
+        return true;
+    case MultiBlockHasher::IMPL_AVX2:
+    case MultiBlockHasher::IMPL_AVX512:
+        return alg == MultiBlockHasher::ALG_MURMUR3;
+    case MultiBlockHasher::IMPL_SSE42:
+        return alg == MultiBlockHasher::ALG_CRC32C;
+    default:
+        return false;
+    }
+}
+
+MultiBlockHasher::MultiBlockHasher(unsigned blockSize, Impl impl,
+                                   Algorithm alg) :
+    _blockSize(blockSize), _alg(alg)
+{
+    assert(blockSize && blockSize % 16 == 0);
+    assert(isAvailable(alg));
+    if (impl == IMPL_BEST || !isSupported(impl) ||
+        !implementsAlgorithm(impl, alg)) {
+        impl = bestImpl(alg);
+    }
+    // the MurmurHash3 SIMD loops consume 64B of every block per iteration
+    if (alg == ALG_MURMUR3 && blockSize % 64) {
+        impl = IMPL_SCALAR;
+    }
+    _impl = impl;
+}
+
+unsigned
+MultiBlockHasher::getLanes()
+{
+    switch (_impl) {
+    case IMPL_AVX2: return 4;
+    case IMPL_AVX512: return 8;
+    case IMPL_SSE42: return 4;
+    default: return 1;
+    }
+}
+
+bool
+MultiBlockHasher::isSupported(Impl impl)
+{
+    switch (impl) {
+    case IMPL_SCALAR:
+    case IMPL_BEST:
+        return true;
+#if MBH_X86_SIMD
+    case IMPL_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case IMPL_AVX512:
+        return __builtin_cpu_supports("avx512f") &&
+            __builtin_cpu_supports("avx512dq");
+    case IMPL_SSE42:
+        return __builtin_cpu_supports("sse4.2");
+#endif
+    default:
+        return false;
+    }
+}
+
+MultiBlockHasher::Impl
+MultiBlockHasher::bestImpl(Algorithm alg)
+{
+    switch (alg) {
+    case ALG_MURMUR3:
+        if (isSupported(IMPL_AVX512)) {
+            return IMPL_AVX512;
+        }
+        if (isSupported(IMPL_AVX2)) {
+            return IMPL_AVX2;
+        }
+        break;
+    case ALG_CRC32C:
+        if (isSupported(IMPL_SSE42)) {
+            return IMPL_SSE42;
+        }
+        break;
+    default:
+        // libxxhash does its own dispatching
+        break;
+    }
+    return IMPL_SCALAR;
+}
+
+const char *
+MultiBlockHasher::implName(Impl impl)
+{
+    switch (impl) {
+    case IMPL_SCALAR: return "scalar";
+    case IMPL_AVX2: return "avx2";
+    case IMPL_AVX512: return "avx512";
+    case IMPL_SSE42: return "sse4.2";
+    default: return "best";
+    }
+}
+
+bool
+MultiBlockHasher::isAvailable(Algorithm alg)
+{
+    switch (alg) {
+    case ALG_MURMUR3:
+    case ALG_CRC32C:
+        return true;
+    case ALG_XXH3:
+#ifdef USE_XXHASH
+        return true;
+#else
+        return false;
+#endif
+    default:
+        return false;
+    }
+}
+
+const char *
+MultiBlockHasher::algorithmName(Algorithm alg)
+{
+    switch (alg) {
+    case ALG_MURMUR3: return "murmur3";
+    case ALG_CRC32C: return "crc32c";
+    case ALG_XXH3: return "xxh3";
+    default: return "unknown";
+    }
+}
+
+bool
+MultiBlockHasher::algorithmFromName(const std::string &name, Algorithm *alg)
+{
+    static const Algorithm algs[] = { ALG_MURMUR3, ALG_CRC32C, ALG_XXH3 };
+    for (unsigned i = 0; i < sizeof(algs) / sizeof(algs[0]); ++i) {
+        if (name == algorithmName(algs[i])) {
+            *alg = algs[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * CRC-32C (reflected polynomial 0x82F63B78), table driven
+ */
+
+struct Crc32cTable {
+    uint32_t t[256];
+    Crc32cTable() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int j = 0; j < 8; ++j) {
+                crc = (crc >> 1) ^ (crc & 1 ? 0x82F63B78 : 0);
+            }
+            t[i] = crc;
+        }
+    }
+};
+
+static uint32_t
+crc32cScalar(const unsigned char *data, unsigned len)
+{
+    static const Crc32cTable table;
+    uint32_t crc = 0xFFFFFFFF;
+    for (unsigned i = 0; i < len; ++i) {
+        crc = table.t[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void
+hashScalar(MultiBlockHasher::Algorithm alg, const unsigned char *const *blocks,
+           unsigned n, unsigned blockSize, uint64_t *out)
+{
+    uint64_t md[2];
+    for (unsigned i = 0; i < n; ++i) {
+        switch (alg) {
+        case MultiBlockHasher::ALG_CRC32C:
+            out[i] = crc32cScalar(blocks[i], blockSize);
+            break;
+#ifdef USE_XXHASH
+        case MultiBlockHasher::ALG_XXH3:
+            out[i] = XXH3_64bits(blocks[i], blockSize);
+            break;
+#endif
+        default:
+            MurmurHash3_x64_128(blocks[i], blockSize, 0, md);
+            out[i] = md[0] ^ md[1];
+            break;
+        }
+    }
+}
+
+#if MBH_X86_SIMD
+
+/*
+ * AVX2: 4 blocks per pass. AVX2 has no 64-bit multiply, so it's built out
+ * of 32-bit multiplies.
+ */
+
+__attribute__((target("avx2"))) static inline __m256i
+mul64Avx2(__m256i a, __m256i b)
+{
+    __m256i bSwapped = _mm256_shuffle_epi32(b, 0xB1);
+    __m256i cross = _mm256_mullo_epi32(a, bSwapped);
+    cross = _mm256_add_epi32(cross, _mm256_srli_epi64(cross, 32));
+    cross = _mm256_slli_epi64(cross, 32);
+    return _mm256_add_epi64(_mm256_mul_epu32(a, b), cross);
+}
+
+#define ROTL64_AVX2(x, r) \
+    _mm256_or_si256(_mm256_slli_epi64((x), (r)), \
+                    _mm256_srli_epi64((x), 64 - (r)))
+
+__attribute__((target("avx2"))) static inline __m256i
+fmixAvx2(__m256i k, __m256i fc1, __m256i fc2)
+{
+    k = _mm256_xor_si256(k, _mm256_srli_epi64(k, 33));
+    k = mul64Avx2(k, fc1);
+    k = _mm256_xor_si256(k, _mm256_srli_epi64(k, 33));
+    k = mul64Avx2(k, fc2);
+    return _mm256_xor_si256(k, _mm256_srli_epi64(k, 33));
+}
+
+__attribute__((target("avx2"))) static inline void
+roundAvx2(__m256i &h1, __m256i &h2, __m256i k1, __m256i k2, __m256i c1,
+          __m256i c2, __m256i n1, __m256i n2)
+{
+    k1 = mul64Avx2(k1, c1);
+    k1 = ROTL64_AVX2(k1, 31);
+    k1 = mul64Avx2(k1, c2);
+    h1 = _mm256_xor_si256(h1, k1);
+    h1 = ROTL64_AVX2(h1, 27);
+    h1 = _mm256_add_epi64(h1, h2);
+    h1 = _mm256_add_epi64(_mm256_add_epi64(_mm256_slli_epi64(h1, 2), h1), n1);
+
+    k2 = mul64Avx2(k2, c2);
+    k2 = ROTL64_AVX2(k2, 33);
+    k2 = mul64Avx2(k2, c1);
+    h2 = _mm256_xor_si256(h2, k2);
+    h2 = ROTL64_AVX2(h2, 31);
+    h2 = _mm256_add_epi64(h2, h1);
+    h2 = _mm256_add_epi64(_mm256_add_epi64(_mm256_slli_epi64(h2, 2), h2), n2);
+}
+
+__attribute__((target("avx2"))) static void
+hash4Avx2(const unsigned char *const *b, unsigned blockSize, uint64_t *out)
+{
+    const __m256i c1 = _mm256_set1_epi64x(C1);
+    const __m256i c2 = _mm256_set1_epi64x(C2);
+    const __m256i n1 = _mm256_set1_epi64x(0x52dce729);
+    const __m256i n2 = _mm256_set1_epi64x(0x38495ab5);
+    __m256i h1 = _mm256_setzero_si256();
+    __m256i h2 = _mm256_setzero_si256();
+
+    for (unsigned off = 0; off < blockSize; off += 32) {
+        // each load holds k1/k2 of two consecutive 16B MurmurHash blocks;
+        // transpose them so that every lane belongs to one data block
+        __m256i r0 = _mm256_loadu_si256((const __m256i *)(b[0] + off));
+        __m256i r1 = _mm256_loadu_si256((const __m256i *)(b[1] + off));
+        __m256i r2 = _mm256_loadu_si256((const __m256i *)(b[2] + off));
+        __m256i r3 = _mm256_loadu_si256((const __m256i *)(b[3] + off));
+        __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+        __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+        __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+        __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+        roundAvx2(h1, h2, _mm256_permute2x128_si256(t0, t2, 0x20),
+                  _mm256_permute2x128_si256(t1, t3, 0x20), c1, c2, n1, n2);
+        roundAvx2(h1, h2, _mm256_permute2x128_si256(t0, t2, 0x31),
+                  _mm256_permute2x128_si256(t1, t3, 0x31), c1, c2, n1, n2);
+    }
+
+    // no tail since blockSize is a multiple of 16
+    const __m256i len = _mm256_set1_epi64x(blockSize);
+    h1 = _mm256_xor_si256(h1, len);
+    h2 = _mm256_xor_si256(h2, len);
+    h1 = _mm256_add_epi64(h1, h2);
+    h2 = _mm256_add_epi64(h2, h1);
+    const __m256i fc1 = _mm256_set1_epi64x(FMIX_C1);
+    const __m256i fc2 = _mm256_set1_epi64x(FMIX_C2);
+    h1 = fmixAvx2(h1, fc1, fc2);
+    h2 = fmixAvx2(h2, fc1, fc2);
+    h1 = _mm256_add_epi64(h1, h2);
+    h2 = _mm256_add_epi64(h2, h1);
+    _mm256_storeu_si256((__m256i *)out, _mm256_xor_si256(h1, h2));
+}
+
+/*
+ * AVX-512: 8 blocks per pass.
+ */
+
+__attribute__((target("avx512f,avx512dq"))) static inline __m512i
+fmixAvx512(__m512i k, __m512i fc1, __m512i fc2)
+{
+    k = _mm512_xor_si512(k, _mm512_srli_epi64(k, 33));
+    k = _mm512_mullo_epi64(k, fc1);
+    k = _mm512_xor_si512(k, _mm512_srli_epi64(k, 33));
+    k = _mm512_mullo_epi64(k, fc2);
+    return _mm512_xor_si512(k, _mm512_srli_epi64(k, 33));
+}
+
+__attribute__((target("avx512f,avx512dq"))) static inline void
+roundAvx512(__m512i &h1, __m512i &h2, __m512i k1, __m512i k2, __m512i c1,
+            __m512i c2, __m512i n1, __m512i n2)
+{
+    k1 = _mm512_mullo_epi64(k1, c1);
+    k1 = _mm512_rol_epi64(k1, 31);
+    k1 = _mm512_mullo_epi64(k1, c2);
+    h1 = _mm512_xor_si512(h1, k1);
+    h1 = _mm512_rol_epi64(h1, 27);
+    h1 = _mm512_add_epi64(h1, h2);
+    h1 = _mm512_add_epi64(_mm512_add_epi64(_mm512_slli_epi64(h1, 2), h1), n1);
+
+    k2 = _mm512_mullo_epi64(k2, c2);
+    k2 = _mm512_rol_epi64(k2, 33);
+    k2 = _mm512_mullo_epi64(k2, c1);
+    h2 = _mm512_xor_si512(h2, k2);
+    h2 = _mm512_rol_epi64(h2, 31);
+    h2 = _mm512_add_epi64(h2, h1);
+    h2 = _mm512_add_epi64(_mm512_add_epi64(_mm512_slli_epi64(h2, 2), h2), n2);
+}
+
+__attribute__((target("avx512f,avx512dq"))) static void
+hash8Avx512(const unsigned char *const *b, unsigned blockSize, uint64_t *out)
+{
+    const __m512i c1 = _mm512_set1_epi64(C1);
+    const __m512i c2 = _mm512_set1_epi64(C2);
+    const __m512i n1 = _mm512_set1_epi64(0x52dce729);
+    const __m512i n2 = _mm512_set1_epi64(0x38495ab5);
+    __m512i h1 = _mm512_setzero_si512();
+    __m512i h2 = _mm512_setzero_si512();
+
+    for (unsigned off = 0; off < blockSize; off += 64) {
+        // 8x8 transpose of 64-bit words: afterwards col[2i] holds k1 and
+        // col[2i+1] holds k2 of the i-th 16B MurmurHash block of each lane
+        __m512i r[8], t[8], u[8], col[8];
+        for (int i = 0; i < 8; ++i) {
+            r[i] = _mm512_loadu_si512((const void *)(b[i] + off));
+        }
+        for (int i = 0; i < 8; i += 2) {
+            t[i] = _mm512_unpacklo_epi64(r[i], r[i + 1]);
+            t[i + 1] = _mm512_unpackhi_epi64(r[i], r[i + 1]);
+        }
+        for (int i = 0; i < 8; i += 4) {
+            u[i] = _mm512_shuffle_i64x2(t[i], t[i + 2], 0x88);
+            u[i + 1] = _mm512_shuffle_i64x2(t[i], t[i + 2], 0xDD);
+            u[i + 2] = _mm512_shuffle_i64x2(t[i + 1], t[i + 3], 0x88);
+            u[i + 3] = _mm512_shuffle_i64x2(t[i + 1], t[i + 3], 0xDD);
+        }
+        col[0] = _mm512_shuffle_i64x2(u[0], u[4], 0x88);
+        col[4] = _mm512_shuffle_i64x2(u[0], u[4], 0xDD);
+        col[2] = _mm512_shuffle_i64x2(u[1], u[5], 0x88);
+        col[6] = _mm512_shuffle_i64x2(u[1], u[5], 0xDD);
+        col[1] = _mm512_shuffle_i64x2(u[2], u[6], 0x88);
+        col[5] = _mm512_shuffle_i64x2(u[2], u[6], 0xDD);
+        col[3] = _mm512_shuffle_i64x2(u[3], u[7], 0x88);
+        col[7] = _mm512_shuffle_i64x2(u[3], u[7], 0xDD);
+        for (int i = 0; i < 8; i += 2) {
+            roundAvx512(h1, h2, col[i], col[i + 1], c1, c2, n1, n2);
+        }
+    }
+
+    const __m512i len = _mm512_set1_epi64(blockSize);
+    h1 = _mm512_xor_si512(h1, len);
+    h2 = _mm512_xor_si512(h2, len);
+    h1 = _mm512_add_epi64(h1, h2);
+    h2 = _mm512_add_epi64(h2, h1);
+    const __m512i fc1 = _mm512_set1_epi64(FMIX_C1);
+    const __m512i fc2 = _mm512_set1_epi64(FMIX_C2);
+    h1 = fmixAvx512(h1, fc1, fc2);
+    h2 = fmixAvx512(h2, fc1, fc2);
+    h1 = _mm512_add_epi64(h1, h2);
+    h2 = _mm512_add_epi64(h2, h1);
+    _mm512_storeu_si512((void *)out, _mm512_xor_si512(h1, h2));
+}
+
+/*
+ * SSE4.2 CRC-32C: crc32 has a 3 cycle latency but a throughput of one per
+ * cycle, so 4 blocks are run through independent dependency chains.
+ */
+
+__attribute__((target("sse4.2"))) static void
+crc4Sse42(const unsigned char *const *b, unsigned blockSize, uint64_t *out)
+{
+    uint64_t c0 = 0xFFFFFFFF, c1 = 0xFFFFFFFF;
+    uint64_t c2 = 0xFFFFFFFF, c3 = 0xFFFFFFFF;
+    for (unsigned off = 0; off < blockSize; off += 8) {
+        uint64_t w0, w1, w2, w3;
+        memcpy(&w0, b[0] + off, 8);
+        memcpy(&w1, b[1] + off, 8);
+        memcpy(&w2, b[2] + off, 8);
+        memcpy(&w3, b[3] + off, 8);
+        c0 = _mm_crc32_u64(c0, w0);
+        c1 = _mm_crc32_u64(c1, w1);
+        c2 = _mm_crc32_u64(c2, w2);
+        c3 = _mm_crc32_u64(c3, w3);
+    }
+    out[0] = static_cast<uint32_t>(~c0);
+    out[1] = static_cast<uint32_t>(~c1);
+    out[2] = static_cast<uint32_t>(~c2);
+    out[3] = static_cast<uint32_t>(~c3);
+}
+
+#endif // MBH_X86_SIMD
+
+void
+MultiBlockHasher::hash(const unsigned char *const *blocks, unsigned n,
+                       uint64_t *out)
+{
+#if MBH_X86_SIMD
+    if (_impl != IMPL_SCALAR) {
+        const unsigned lanes = getLanes();
+        const unsigned char *batch[MAX_LANES];
+        uint64_t result[MAX_LANES];
+        for (unsigned i = 0; i < n; i += lanes) {
+            unsigned count = n - i < lanes ? n - i : lanes;
+            // pad a partial batch by repeating its first block
+            for (unsigned j = 0; j < lanes; ++j) {
+                batch[j] = blocks[i + (j < count ? j : 0)];
+            }
+            if (_impl == IMPL_AVX512) {
+                hash8Avx512(batch, _blockSize, result);
+            } else if (_impl == IMPL_SSE42) {
+                crc4Sse42(batch, _blockSize, result);
+            } else {
+                hash4Avx2(batch, _blockSize, result);
+            }
+            for (unsigned j = 0; j < count; ++j) {
+                out[i + j] = result[j];
+            }
+        }
+        return;
+    }
+#endif
+    hashScalar(_alg, blocks, n, _blockSize, out);
+}
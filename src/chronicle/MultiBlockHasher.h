@@ -0,0 +1,77 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef MULTI_BLOCK_HASHER_H
+#define MULTI_BLOCK_HASHER_H
+
+#include <inttypes.h>
+#include <string>
+
+/**
+ * Hashes several independent, equally sized data blocks at a time with
+ * one of the block checksum algorithms:
+ * - murmur3: MurmurHash3_x64_128 (seed 0) folded into 64 bits (h1 ^ h2).
+ *   The AVX2 (4 lanes) and AVX-512 (8 lanes) implementations produce the
+ *   same values as the scalar MurmurHash3 code.
+ * - crc32c: CRC-32C (Castagnoli) as used by iSCSI. The SSE4.2
+ *   implementation interleaves 4 blocks to hide the crc32 latency.
+ * - xxh3: XXH3_64bits (seed 0), only if built with libxxhash (USE_XXHASH).
+ * The implementation is picked at runtime.
+ */
+class MultiBlockHasher {
+public:
+    typedef enum algorithm {
+        ALG_MURMUR3 = 0,
+        ALG_CRC32C = 1,
+        ALG_XXH3 = 2
+    } Algorithm;
+
+    typedef enum impl {
+        IMPL_SCALAR = 0,
+        IMPL_AVX2 = 1,
+        IMPL_AVX512 = 2,
+        IMPL_SSE42 = 3,
+        IMPL_BEST = 4   // the fastest one supported by the CPU
+    } Impl;
+
+    /// The max number of blocks hashed in parallel by any implementation
+    static const unsigned MAX_LANES = 8;
+
+    /// @param[in] blockSize The block size in bytes (a multiple of 16)
+    /// @param[in] impl The implementation to use (falls back to the best
+    /// supported one if the CPU can't run it or it doesn't implement alg)
+    /// @param[in] alg The checksum algorithm (must be available)
+    MultiBlockHasher(unsigned blockSize = 512, Impl impl = IMPL_BEST,
+                     Algorithm alg = ALG_MURMUR3);
+
+    /// Hashes blocks[0..n-1] into out[0..n-1]
+    void hash(const unsigned char *const *blocks, unsigned n, uint64_t *out);
+
+    /// The implementation in use
+    Impl getImpl() { return _impl; }
+    Algorithm getAlgorithm() { return _alg; }
+    /// The number of blocks hashed in parallel
+    unsigned getLanes();
+    unsigned getBlockSize() { return _blockSize; }
+
+    /// The fastest implementation of alg supported by this CPU
+    static Impl bestImpl(Algorithm alg = ALG_MURMUR3);
+    static bool isSupported(Impl impl);
+    static const char *implName(Impl impl);
+    /// Whether alg was compiled in
+    static bool isAvailable(Algorithm alg);
+    /// The name recorded in the trace (e.g., "crc32c")
+    static const char *algorithmName(Algorithm alg);
+    /// @return false if name isn't a known algorithm
+    static bool algorithmFromName(const std::string &name, Algorithm *alg);
+
+private:
+    unsigned _blockSize;
+    Impl _impl;
+    Algorithm _alg;
+};
+
+#endif // MULTI_BLOCK_HASHER_H
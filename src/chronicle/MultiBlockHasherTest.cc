@@ -0,0 +1,183 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "gtest/gtest.h"
+#include "MurmurHash3.h"
+#include "MultiBlockHasher.h"
+#ifdef USE_XXHASH
+#include <xxhash.h>
+#endif
+
+static const unsigned NUM_BLOCKS = 29; // not a multiple of any lane count
+
+static void
+initBlocks(std::vector<unsigned char> &buf, unsigned blockSize,
+           std::vector<const unsigned char *> &blocks)
+{
+    buf.resize(NUM_BLOCKS * blockSize + 1);
+    srand(blockSize);
+    for (unsigned i = 0; i < buf.size(); ++i) {
+        buf[i] = rand();
+    }
+    blocks.clear();
+    // unaligned block addresses as found in packet buffers
+    for (unsigned i = 0; i < NUM_BLOCKS; ++i) {
+        blocks.push_back(&buf[1 + i * blockSize]);
+    }
+}
+
+static void
+checkImpl(MultiBlockHasher::Impl impl, unsigned blockSize)
+{
+    if (!MultiBlockHasher::isSupported(impl)) {
+        return;
+    }
+    std::vector<unsigned char> buf;
+    std::vector<const unsigned char *> blocks;
+    initBlocks(buf, blockSize, blocks);
+
+    MultiBlockHasher hasher(blockSize, impl);
+    ASSERT_EQ(impl, hasher.getImpl());
+    uint64_t out[NUM_BLOCKS];
+    hasher.hash(&blocks[0], NUM_BLOCKS, out);
+    for (unsigned i = 0; i < NUM_BLOCKS; ++i) {
+        // the values ChecksumModule used to compute one block at a time
+        uint64_t md[2];
+        MurmurHash3_x64_128_State state;
+        MurmurHash3_x64_128_init(0, &state);
+        MurmurHash3_x64_128_update(blocks[i], blockSize, &state);
+        MurmurHash3_x64_128_finalize(&state, md);
+        EXPECT_EQ(md[0] ^ md[1], out[i]) << MultiBlockHasher::implName(impl)
+                                         << " block " << i;
+    }
+}
+
+TEST(MultiBlockHasher, ScalarMatchesMurmurHash3) {
+    checkImpl(MultiBlockHasher::IMPL_SCALAR, 512);
+    checkImpl(MultiBlockHasher::IMPL_SCALAR, 4096);
+}
+
+TEST(MultiBlockHasher, Avx2MatchesMurmurHash3) {
+    checkImpl(MultiBlockHasher::IMPL_AVX2, 512);
+    checkImpl(MultiBlockHasher::IMPL_AVX2, 4096);
+}
+
+TEST(MultiBlockHasher, Avx512MatchesMurmurHash3) {
+    checkImpl(MultiBlockHasher::IMPL_AVX512, 512);
+    checkImpl(MultiBlockHasher::IMPL_AVX512, 4096);
+}
+
+TEST(MultiBlockHasher, PartialBatches) {
+    std::vector<unsigned char> buf;
+    std::vector<const unsigned char *> blocks;
+    initBlocks(buf, 512, blocks);
+    MultiBlockHasher scalar(512, MultiBlockHasher::IMPL_SCALAR);
+    MultiBlockHasher best(512);
+    uint64_t expected[NUM_BLOCKS], out[NUM_BLOCKS];
+    scalar.hash(&blocks[0], NUM_BLOCKS, expected);
+    for (unsigned n = 1; n <= MultiBlockHasher::MAX_LANES + 1; ++n) {
+        best.hash(&blocks[0], n, out);
+        for (unsigned i = 0; i < n; ++i) {
+            EXPECT_EQ(expected[i], out[i]);
+        }
+    }
+}
+
+TEST(MultiBlockHasher, UnsupportedBlockSizeFallsBackToScalar) {
+    MultiBlockHasher hasher(48);
+    EXPECT_EQ(MultiBlockHasher::IMPL_SCALAR, hasher.getImpl());
+    EXPECT_EQ(1u, hasher.getLanes());
+}
+
+static void
+checkCrc32c(MultiBlockHasher::Impl impl)
+{
+    if (!MultiBlockHasher::isSupported(impl)) {
+        return;
+    }
+    // iSCSI (RFC 3720) test vectors
+    unsigned char zeros[32], ones[32], incr[32];
+    memset(zeros, 0, sizeof(zeros));
+    memset(ones, 0xff, sizeof(ones));
+    for (unsigned i = 0; i < sizeof(incr); ++i) {
+        incr[i] = i;
+    }
+    const unsigned char *blocks[] = { zeros, ones, incr };
+    uint64_t out[3];
+    MultiBlockHasher hasher(32, impl, MultiBlockHasher::ALG_CRC32C);
+    ASSERT_EQ(impl, hasher.getImpl());
+    hasher.hash(blocks, 3, out);
+    EXPECT_EQ(0x8a9136aau, out[0]) << MultiBlockHasher::implName(impl);
+    EXPECT_EQ(0x62a8ab43u, out[1]) << MultiBlockHasher::implName(impl);
+    EXPECT_EQ(0x46dd794eu, out[2]) << MultiBlockHasher::implName(impl);
+}
+
+TEST(MultiBlockHasher, Crc32cKnownValues) {
+    checkCrc32c(MultiBlockHasher::IMPL_SCALAR);
+    checkCrc32c(MultiBlockHasher::IMPL_SSE42);
+}
+
+TEST(MultiBlockHasher, Crc32cSse42MatchesScalar) {
+    if (!MultiBlockHasher::isSupported(MultiBlockHasher::IMPL_SSE42)) {
+        return;
+    }
+    const unsigned sizes[] = { 512, 4096, 8192 };
+    for (unsigned s = 0; s < 3; ++s) {
+        std::vector<unsigned char> buf;
+        std::vector<const unsigned char *> blocks;
+        initBlocks(buf, sizes[s], blocks);
+        MultiBlockHasher scalar(sizes[s], MultiBlockHasher::IMPL_SCALAR,
+                                MultiBlockHasher::ALG_CRC32C);
+        MultiBlockHasher sse42(sizes[s], MultiBlockHasher::IMPL_SSE42,
+                               MultiBlockHasher::ALG_CRC32C);
+        uint64_t expected[NUM_BLOCKS], out[NUM_BLOCKS];
+        scalar.hash(&blocks[0], NUM_BLOCKS, expected);
+        sse42.hash(&blocks[0], NUM_BLOCKS, out);
+        for (unsigned i = 0; i < NUM_BLOCKS; ++i) {
+            EXPECT_EQ(expected[i], out[i]) << sizes[s] << "B block " << i;
+        }
+    }
+}
+
+TEST(MultiBlockHasher, ImplMustImplementAlgorithm) {
+    // the AVX paths only do MurmurHash3
+    MultiBlockHasher hasher(512, MultiBlockHasher::IMPL_AVX512,
+                            MultiBlockHasher::ALG_CRC32C);
+    EXPECT_EQ(MultiBlockHasher::bestImpl(MultiBlockHasher::ALG_CRC32C),
+              hasher.getImpl());
+    EXPECT_EQ(MultiBlockHasher::ALG_CRC32C, hasher.getAlgorithm());
+}
+
+TEST(MultiBlockHasher, AlgorithmNames) {
+    MultiBlockHasher::Algorithm alg;
+    EXPECT_TRUE(MultiBlockHasher::algorithmFromName("murmur3", &alg));
+    EXPECT_EQ(MultiBlockHasher::ALG_MURMUR3, alg);
+    EXPECT_TRUE(MultiBlockHasher::algorithmFromName("crc32c", &alg));
+    EXPECT_EQ(MultiBlockHasher::ALG_CRC32C, alg);
+    EXPECT_TRUE(MultiBlockHasher::algorithmFromName("xxh3", &alg));
+    EXPECT_EQ(MultiBlockHasher::ALG_XXH3, alg);
+    EXPECT_FALSE(MultiBlockHasher::algorithmFromName("md5", &alg));
+    EXPECT_STREQ("crc32c",
+                 MultiBlockHasher::algorithmName(MultiBlockHasher::ALG_CRC32C));
+}
+
+#ifdef USE_XXHASH
+TEST(MultiBlockHasher, Xxh3MatchesLibrary) {
+    std::vector<unsigned char> buf;
+    std::vector<const unsigned char *> blocks;
+    initBlocks(buf, 4096, blocks);
+    MultiBlockHasher hasher(4096, MultiBlockHasher::IMPL_BEST,
+                            MultiBlockHasher::ALG_XXH3);
+    uint64_t out[NUM_BLOCKS];
+    hasher.hash(&blocks[0], NUM_BLOCKS, out);
+    for (unsigned i = 0; i < NUM_BLOCKS; ++i) {
+        EXPECT_EQ(XXH3_64bits(blocks[i], 4096), out[i]);
+    }
+}
+#endif
@@ -18,6 +18,7 @@
 #include "PacketReader.h"
 #include "FDWatcher.h"
 #include "Interface.h"
+#include "StageTracer.h"
 
 void printIpAddress(uint32_t addr);
 uint32_t bitRange(uint32_t num, uint8_t start, uint8_t end);
@@ -141,6 +142,7 @@ NetworkHeaderParser::doProcessRequest(PacketDescriptor *pktDesc)
     }
 
 	while (pktDesc != NULL) {
+		StageTracer::stamp(pktDesc, StageTracer::STAGE_NET_PARSER);
 		if (parseNetworkHeader(pktDesc) || _pcapPipeline) {
 			// send all parsable packets to the appropriate pipeline
 			ChroniclePipeline *pipeline = 
@@ -11,10 +11,18 @@
 #include "RpcParser.h"
 #include "TcpStreamNavigator.h"
 #include "OutputModule.h"
+#include "PcapPacketBufferPool.h"
+#include "StageTracer.h"
+#include "Metrics.h"
 #include <limits.h>
 
 NfsParser::Nfs3OperationCounts NfsParser::nfs3OpCounts;
 
+static MetricCounter parsablePdus("nfs.pdu.parsable");
+static MetricCounter unparsablePdus("nfs.pdu.unparsable");
+/// PDUs of unsuccessful RPC operations
+static MetricCounter failedPdus("nfs.pdu.failed");
+
 class NfsParser::MsgBase : public Message {
 	protected:
 		NfsParser *_parser;
@@ -61,25 +69,21 @@ NfsParser::NfsParser(ChronicleSource *src, uint32_t pipelineId,
 {
 	_outputManager = outputManager;
 	_streamNavigator = new TcpStreamNavigator();
+	_bufPool = PcapPacketBufferPool::registerBufferPool();
 	_sink = NULL;
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-	_parsablePdus = _unparsablePdus = _failedPdus = 0;
-	#endif
 }
 
 NfsParser::~NfsParser()
 {
 	delete _streamNavigator;
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-	printf("NfsParser::~NfsParser[%u]: parsablePdus:%lu unparsablePdus:%lu "
-		"failedPdus:%lu\n", _pipelineId, _parsablePdus, _unparsablePdus, 
-		_failedPdus);
-	#endif
+	if (_bufPool && _bufPool->unregisterBufferPool()) 
+		delete _bufPool;
 }
 
 void
 NfsParser::processRequest(ChronicleSource *src, PduDescriptor *pduDesc)
 {
+	PacketBufferPool::handOver(pduDesc, PacketBufferPool::HOLDER_NFS_PARSER);
 	enqueueMessage(new MsgProcessRequest(this, pduDesc));
 }
 
@@ -87,6 +91,7 @@ void
 NfsParser::doProcessRequest(PduDescriptor *pduDesc)
 {
 	PduDescriptor *tmpPduDesc = pduDesc;
+	StageTracer::stamp(pduDesc, StageTracer::STAGE_NFS_PARSER);
 	while (tmpPduDesc) {
 		switch(tmpPduDesc->rpcProgram) {
 			case NFS_PROGRAM:
@@ -98,6 +103,10 @@ NfsParser::doProcessRequest(PduDescriptor *pduDesc)
 						#if CHRON_DEBUG(CHRONICLE_DEBUG_NFS)
 						nfsPduDesc->print();
 						#endif
+						// without checksums, READ/WRITE data is never looked
+						// at again
+						if (pduEarlyRelease && !dsEnableIpChecksum)
+							nfsPduDesc->releasePayloadPackets(_bufPool, false);
 						break;
 				}
 				break;
@@ -171,9 +180,7 @@ NfsParser::parseNfsV3Pdu(NfsV3PduDescriptor *nfsPduDesc)
 	// Parsing successful RPC operations only
 	if (nfsPduDesc->rpcAcceptState) {
 		nfsPduDesc->parsable = false;
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-		_failedPdus++;
-		#endif
+		failedPdus++;
 		return ;
 	}
 	// Parsing complete PDUs only
@@ -464,12 +471,10 @@ NfsParser::parseNfsV3Pdu(NfsV3PduDescriptor *nfsPduDesc)
 			}		
 			break;
 	}
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
 	if (nfsPduDesc->parsable)
-		_parsablePdus++;
+		parsablePdus++;
 	else
-		_unparsablePdus++;
-	#endif
+		unparsablePdus++;
 }
 
 bool
@@ -18,6 +18,7 @@
 class PduDescriptor;
 class TcpStreamNavigator;
 class OutputManager;
+class PacketBufferPool;
 
 class NfsParser : public Process, public PduDescReceiver, 
 		public ChronicleSource {
@@ -127,11 +128,8 @@ class NfsParser : public Process, public PduDescReceiver,
 		TcpStreamNavigator *_streamNavigator;
 		/// The output module
 		OutputManager *_outputManager;
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-		uint64_t _parsablePdus;
-		uint64_t _unparsablePdus;
-		uint64_t _failedPdus;
-		#endif
+		/// The buffer pool for releasing READ/WRITE payload packets
+		PacketBufferPool *_bufPool;
 };
 
 #endif // NFS_PARSER_H
@@ -139,7 +139,7 @@ OutputManager::findNextModule(uint32_t pipelineId)
 {
 	if (_outputFormat != NO_OUTPUT && !_disableCapture)
 		return _modules[pipelineId & (_numModules - 1)];
-	return _analyticsManager;
+	return _analyticsManager->getShard(pipelineId);
 }
 
 StatListener *
@@ -7,6 +7,43 @@
 #include <iostream>
 #include "PacketBufferPool.h"
 #include "ChronicleProcessRequest.h"
+#include "StageTracer.h"
+#include "Metrics.h"
+
+// the allocated counts are summed over the threads getting and releasing
+// buffers, so they are only meaningful for all the threads together
+static MetricCounter allocatedBufsStandard("bufpool.standard.allocated");
+static MetricCounter timesNoFreeBufsStandard("bufpool.standard.nobuf");
+static MetricCounter allocatedBufsJumbo("bufpool.jumbo.allocated");
+static MetricCounter timesNoFreeBufsJumbo("bufpool.jumbo.nobuf");
+// buffer references held by each stage, moved along on every hand-over
+// (summed over the threads, like the allocated counts)
+static MetricCounter heldBufsStandard[PacketBufferPool::NUM_HOLDERS] = {
+	{ "bufpool.standard.held.input" },
+	{ "bufpool.standard.held.reassembly" },
+	{ "bufpool.standard.held.calltable" },
+	{ "bufpool.standard.held.nfsparser" },
+	{ "bufpool.standard.held.anonymize" },
+	{ "bufpool.standard.held.checksum" },
+	{ "bufpool.standard.held.output" },
+	{ "bufpool.standard.held.analytics" }
+};
+static MetricCounter heldBufsJumbo[PacketBufferPool::NUM_HOLDERS] = {
+	{ "bufpool.jumbo.held.input" },
+	{ "bufpool.jumbo.held.reassembly" },
+	{ "bufpool.jumbo.held.calltable" },
+	{ "bufpool.jumbo.held.nfsparser" },
+	{ "bufpool.jumbo.held.anonymize" },
+	{ "bufpool.jumbo.held.checksum" },
+	{ "bufpool.jumbo.held.output" },
+	{ "bufpool.jumbo.held.analytics" }
+};
+static const char *holderNames[PacketBufferPool::NUM_HOLDERS] = {
+	"input", "reassembly", "calltable", "nfsparser", "anonymize", "checksum",
+	"output", "analytics"
+};
+
+unsigned PacketBufferPool::_firstJumboIndex = 0;
 
 PacketBufferPool::PacketBufferPool(unsigned standardPktPoolSize, 
 			unsigned jumboPktPoolSize) 
@@ -23,25 +60,24 @@ PacketBufferPool::PacketBufferPool(unsigned standardPktPoolSize,
 		_pktDescFreeListJumbo = 
 			new (std::nothrow) TSQueue<PacketDescriptor>;
 	}
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL | CHRONICLE_DEBUG_STAT)
-	_allocatedBufsStandard = _maxAllocatedBufsStandard = 
-		_timesNoFreeBufsStandard = 0;
-	_allocatedBufsJumbo = _maxAllocatedBufsJumbo = _timesNoFreeBufsJumbo = 0;
-	#endif
+	_maxAllocatedBufsStandard = _maxAllocatedBufsJumbo = 0;
+	_firstJumboIndex = _standardPktPoolSize;
 }
 
 PacketBufferPool::~PacketBufferPool()
 {
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL | CHRONICLE_DEBUG_STAT)
-	printf("PacketBufferPool::~PacketBufferPool: "
-		"allocdBufsStand:%lu maxAllocdBufsStand:%lu noFreeBufsStand:%lu "
-		"allocdBufsJumbo:%lu maxAllocdBufsJumbo:%lu noFreeBufsJumbo:%lu\n", 
-		_allocatedBufsStandard.load(std::memory_order_acquire),
-		_maxAllocatedBufsStandard.load(std::memory_order_acquire),
-		_timesNoFreeBufsStandard.load(std::memory_order_acquire),
-		_allocatedBufsJumbo.load(std::memory_order_acquire),
-		_maxAllocatedBufsJumbo.load(std::memory_order_acquire),
-		_timesNoFreeBufsJumbo.load(std::memory_order_acquire));
+	if (Metrics::isVerbose(Metrics::VERBOSE_BUFPOOL)) {
+		uint64_t allocdStand, maxAllocdStand, noFreeStand,
+			allocdJumbo, maxAllocdJumbo, noFreeJumbo;
+		getBufPoolStats(allocdStand, maxAllocdStand, noFreeStand,
+			allocdJumbo, maxAllocdJumbo, noFreeJumbo);
+		printf("PacketBufferPool::~PacketBufferPool: "
+			"allocdBufsStand:%lu maxAllocdBufsStand:%lu noFreeBufsStand:%lu "
+			"allocdBufsJumbo:%lu maxAllocdBufsJumbo:%lu noFreeBufsJumbo:%lu\n",
+			allocdStand, maxAllocdStand, noFreeStand,
+			allocdJumbo, maxAllocdJumbo, noFreeJumbo);
+	}
+	#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL)
 	unsigned j = 0, k = 0;
 	for(unsigned i = 0; 
 			_pktDescriptors && i < _standardPktPoolSize + _jumboPktPoolSize;
@@ -67,81 +103,152 @@ PacketBufferPool::~PacketBufferPool()
 PacketDescriptor *
 PacketBufferPool::getPacketDescriptor(unsigned ethFrameSize)
 {
+	PacketDescriptor *pktDesc;
 	if (ethFrameSize <= MAX_ETH_FRAME_SIZE_STAND) {
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL | CHRONICLE_DEBUG_STAT)
-		PacketDescriptor *pktDesc = _pktDescFreeListStandard->dequeue();
-		if (pktDesc == NULL)
-			_timesNoFreeBufsStandard++;
-		else {
-			_allocatedBufsStandard++;
-			if (_allocatedBufsStandard > _maxAllocatedBufsStandard)
-				_maxAllocatedBufsStandard = _allocatedBufsStandard.load();
-			assert(pktDesc->allocated == false && 
-				pktDesc->refCount.load() == 0);
-			pktDesc->allocated = true;
-			pktDesc->refCount = 1;
+		pktDesc = _pktDescFreeListStandard->dequeue();
+		if (pktDesc == NULL) {
+			timesNoFreeBufsStandard++;
+			return NULL;
 		}
-		return pktDesc;	
-		#else
-		PacketDescriptor *pktDesc = _pktDescFreeListStandard->dequeue();
-		if (pktDesc != NULL)
-			pktDesc->refCount = 1;
-		return pktDesc;
-		#endif
+		allocatedBufsStandard++;
+		heldBufsStandard[HOLDER_INPUT]++;
+		if (Metrics::isVerbose(Metrics::VERBOSE_BUFPOOL))
+			updateMax(_maxAllocatedBufsStandard, allocatedBufsStandard.get());
 	} else {
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL | CHRONICLE_DEBUG_STAT)
-		PacketDescriptor *pktDesc = _pktDescFreeListJumbo->dequeue();
-		if (pktDesc == NULL)
-			_timesNoFreeBufsJumbo++;
-		else {
-			_allocatedBufsJumbo++;
-			if (_allocatedBufsJumbo > _maxAllocatedBufsJumbo)
-				_maxAllocatedBufsJumbo = _allocatedBufsJumbo.load();
-			assert(pktDesc->allocated == false);
-			pktDesc->allocated = true;
-			pktDesc->refCount = 1;
+		pktDesc = _pktDescFreeListJumbo->dequeue();
+		if (pktDesc == NULL) {
+			timesNoFreeBufsJumbo++;
+			return NULL;
 		}
-		return pktDesc;	
-		#else
-		PacketDescriptor *pktDesc = _pktDescFreeListJumbo->dequeue();
-		if (pktDesc != NULL)
-			pktDesc->refCount = 1;
-		return pktDesc;
-		#endif
+		allocatedBufsJumbo++;
+		heldBufsJumbo[HOLDER_INPUT]++;
+		if (Metrics::isVerbose(Metrics::VERBOSE_BUFPOOL))
+			updateMax(_maxAllocatedBufsJumbo, allocatedBufsJumbo.get());
 	}
+	#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL)
+	assert(pktDesc->allocated == false && pktDesc->refCount.load() == 0);
+	pktDesc->allocated = true;
+	#endif
+	pktDesc->refCount = 1;
+	pktDesc->traceId = StageTracer::sample();
+	return pktDesc;
 }
 
 bool 
-PacketBufferPool::releasePacketDescriptor(PacketDescriptor *pktDesc)
+PacketBufferPool::releasePacketDescriptor(PacketDescriptor *pktDesc,
+	Holder holder)
 {
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL | CHRONICLE_DEBUG_STAT)
+	#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL)
 	if (!pktDesc->allocated) { 
 		pktDesc->print();
 		fflush(stdout);
 	}
 	assert(pktDesc->allocated == true);
 	#endif
+	if (isJumbo(pktDesc))
+		heldBufsJumbo[holder]--;
+	else
+		heldBufsStandard[holder]--;
 	if (pktDesc->refCount.fetch_sub(1) != 1)
 		return false;
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL | CHRONICLE_DEBUG_STAT)
-	if (pktDesc->packetBufferIndex < _standardPktPoolSize)
-		_allocatedBufsStandard--;
-	else
-		_allocatedBufsJumbo--;
+	StageTracer::complete(pktDesc);
+	#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL)
 	assert(pktDesc->refCount == 0);
 	pktDesc->allocated = false;
-	#endif
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL)
 	pktDesc->lastTouchingProcess = 0;
 	pktDesc->pduDesc = NULL;
 	#endif
-	if (pktDesc->packetBufferIndex < _standardPktPoolSize)
+	if (pktDesc->packetBufferIndex < _standardPktPoolSize) {
+		allocatedBufsStandard--;
 		_pktDescFreeListStandard->enqueue(pktDesc);
-	else
+	} else {
+		allocatedBufsJumbo--;
 		_pktDescFreeListJumbo->enqueue(pktDesc);
+	}
 	return true;
 }
 
+bool
+PacketBufferPool::releasePduPacket(PduDescriptor *pduDesc,
+	PacketDescriptor *pktDesc)
+{
+	countPduBufs(pduDesc);
+	pduDesc->heldBufs[isJumbo(pktDesc)]--;
+	return releasePacketDescriptor(pktDesc, pduDesc->bufHolder);
+}
+
+bool
+PacketBufferPool::isJumbo(PacketDescriptor *pktDesc)
+{
+	return pktDesc->packetBufferIndex >= _firstJumboIndex;
+}
+
+void
+PacketBufferPool::handOver(PacketDescriptor *pktDesc, Holder from, Holder to)
+{
+	MetricCounter *held = isJumbo(pktDesc) ? heldBufsJumbo : heldBufsStandard;
+	held[from]--;
+	held[to]++;
+}
+
+void
+PacketBufferPool::addReference(PacketDescriptor *pktDesc, Holder holder)
+{
+	if (isJumbo(pktDesc))
+		heldBufsJumbo[holder]++;
+	else
+		heldBufsStandard[holder]++;
+}
+
+void
+PacketBufferPool::countPduBufs(PduDescriptor *pduDesc)
+{
+	if (pduDesc->heldBufsCounted)
+		return ;
+	// a PDU holds a reference to each of its packets
+	PacketDescriptor *pktDesc = pduDesc->firstPktDesc, *oldPktDesc;
+	do {
+		oldPktDesc = pktDesc;
+		pktDesc = pktDesc->next;
+		pduDesc->heldBufs[isJumbo(oldPktDesc)]++;
+	} while (oldPktDesc != pduDesc->lastPktDesc);
+	pduDesc->heldBufsCounted = true;
+}
+
+void
+PacketBufferPool::handOverPdu(PduDescriptor *pduDesc, Holder to)
+{
+	if (pduDesc->bufHolder == to)
+		return ;
+	countPduBufs(pduDesc);
+	heldBufsStandard[pduDesc->bufHolder].add(-int64_t(pduDesc->heldBufs[0]));
+	heldBufsJumbo[pduDesc->bufHolder].add(-int64_t(pduDesc->heldBufs[1]));
+	heldBufsStandard[to].add(pduDesc->heldBufs[0]);
+	heldBufsJumbo[to].add(pduDesc->heldBufs[1]);
+	pduDesc->bufHolder = to;
+}
+
+void
+PacketBufferPool::handOver(PduDescriptor *pduDesc, Holder to)
+{
+	for (; pduDesc != NULL; pduDesc = pduDesc->next)
+		handOverPdu(pduDesc, to);
+}
+
+void
+PacketBufferPool::getHeldBufs(Holder holder, int64_t &standard,
+	int64_t &jumbo)
+{
+	standard = heldBufsStandard[holder].get();
+	jumbo = heldBufsJumbo[holder].get();
+}
+
+const char *
+PacketBufferPool::getHolderName(Holder holder)
+{
+	return holderNames[holder];
+}
+
 void 
 PacketBufferPool::print(unsigned index)
 {
@@ -152,18 +259,26 @@ PacketBufferPool::print(unsigned index)
 	_pktDescriptors[index].print();
 }
 
-#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL | CHRONICLE_DEBUG_STAT)
 void
-PacketBufferPool::getBufPoolStats(uint64_t &allocatedBufsStandard, 
-	uint64_t &maxAllocdBufsStandard, uint64_t &timesNoFreeBufsStandard,
-	uint64_t &allocatedBufsJumbo, uint64_t &maxAllocatedBufsJumbo,
-	uint64_t &timesNoFreeBufsJumbo)
+PacketBufferPool::updateMax(std::atomic<int64_t> &max, int64_t value)
+{
+	int64_t oldMax = max.load(std::memory_order_relaxed);
+	while (value > oldMax && !max.compare_exchange_weak(oldMax, value))
+		;
+}
+
+void
+PacketBufferPool::getBufPoolStats(uint64_t &allocatedBufsStandardCnt,
+	uint64_t &maxAllocdBufsStandard, uint64_t &timesNoFreeBufsStandardCnt,
+	uint64_t &allocatedBufsJumboCnt, uint64_t &maxAllocatedBufsJumbo,
+	uint64_t &timesNoFreeBufsJumboCnt)
 {
-	allocatedBufsStandard = _allocatedBufsStandard.load();
+	allocatedBufsStandardCnt = allocatedBufsStandard.get();
+	updateMax(_maxAllocatedBufsStandard, allocatedBufsStandardCnt);
 	maxAllocdBufsStandard = _maxAllocatedBufsStandard.load();
-	timesNoFreeBufsStandard = _timesNoFreeBufsStandard.load();
-	allocatedBufsJumbo = _allocatedBufsJumbo.load();
+	timesNoFreeBufsStandardCnt = timesNoFreeBufsStandard.get();
+	allocatedBufsJumboCnt = allocatedBufsJumbo.get();
+	updateMax(_maxAllocatedBufsJumbo, allocatedBufsJumboCnt);
 	maxAllocatedBufsJumbo = _maxAllocatedBufsJumbo.load();
-	timesNoFreeBufsJumbo = _timesNoFreeBufsJumbo.load();
+	timesNoFreeBufsJumboCnt = timesNoFreeBufsJumbo.get();
 }
-#endif
@@ -11,12 +11,10 @@
 #include "TSQueue.h"
 #include "PacketBuffer.h"
 #include "Lock.h"
-
-#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL | CHRONICLE_DEBUG_STAT)
 #include <atomic>
-#endif
 
 class PacketDescriptor;
+class PduDescriptor;
 
 /**
  * Used when a packet buffer pool cannot be allocated properly
@@ -38,21 +36,72 @@ class PacketBufPoolException
  */
 class PacketBufferPool {
 	public:
+		/**
+		 * The pipeline stages buffers are attributed to. A stage holds the
+		 * buffers handed to it (including the ones still queued for it) until
+		 * it hands them over to the next stage or releases them. Each
+		 * reference to a buffer (see PacketDescriptor::refCount) is held by
+		 * exactly one stage.
+		 */
+		typedef enum {
+			HOLDER_INPUT = 0,		// readers and NetworkHeaderParser
+			HOLDER_REASSEMBLY,		// RpcParser flows and PDUs being formed
+			HOLDER_CALL_TABLE,		// call PDUs waiting for their replies
+			HOLDER_NFS_PARSER,		// NfsParser
+			HOLDER_ANONYMIZE,		// AnonymizeModule
+			HOLDER_CHECKSUM,		// ChecksumModule and its workers
+			HOLDER_OUTPUT,			// DsWriter, PcapWriter, PcapPduWriter
+			HOLDER_ANALYTICS,		// AnalyticsShard
+			NUM_HOLDERS
+		} Holder;
+
 		virtual ~PacketBufferPool();
 		/// returns a packet buffer descriptor from the free list
 		PacketDescriptor *getPacketDescriptor(unsigned ethFrameSize);
-		/// releases a packet buffer descriptor back to the free list
-		bool releasePacketDescriptor(PacketDescriptor *pktDesc);
+		/**
+		 * releases a reference to a packet buffer descriptor (and the
+		 * descriptor back to the free list if it was the last one)
+		 * @param[in] holder The stage that held the reference
+		 */
+		bool releasePacketDescriptor(PacketDescriptor *pktDesc,
+			Holder holder = HOLDER_INPUT);
+		/**
+		 * releases a PDU's reference to one of its packets (at the stage
+		 * holding the PDU)
+		 */
+		bool releasePduPacket(PduDescriptor *pduDesc,
+			PacketDescriptor *pktDesc);
+		/// moves a packet from one stage to another
+		static void handOver(PacketDescriptor *pktDesc, Holder from, Holder to);
+		/// moves a chain of PDUs (and their packets) to another stage
+		static void handOver(PduDescriptor *pduDesc, Holder to);
+		/// moves a single PDU (but not the ones chained to it)
+		static void handOverPdu(PduDescriptor *pduDesc, Holder to);
+		/// accounts for a new reference to a packet (e.g., a shared packet)
+		static void addReference(PacketDescriptor *pktDesc, Holder holder);
+		/**
+		 * returns the number of buffer references a stage holds
+		 * @param[in] holder The stage
+		 * @param[out] standard References to standard buffers
+		 * @param[out] jumbo References to jumbo buffers
+		 */
+		static void getHeldBufs(Holder holder, int64_t &standard,
+			int64_t &jumbo);
+		/// returns the name of a stage (as in the stats)
+		static const char *getHolderName(Holder holder);
 		/// prints a packet buffer descriptor given the index in the buf pool
 		void print(unsigned index);
 		/// unregisters a buffer pool user
 		virtual bool unregisterBufferPool() = 0;
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL | CHRONICLE_DEBUG_STAT)	
+		/**
+		 * returns the buffer pool stats (the high-water marks are only exact
+		 * while bufpool metrics are verbose; otherwise they are sampled at
+		 * every call)
+		 */
 		void getBufPoolStats(uint64_t &allocatedBufsStandard, 
 			uint64_t &maxAllocdBufsStandard, uint64_t &timesNoFreeBufsStandard,
 			uint64_t &allocatedBufsJumbo, uint64_t &maxAllocatedBufsJumbo,
 			uint64_t &timesNoFreeBufsJumbo);
-		#endif
 
 	protected:
 		PacketBufferPool(unsigned standardPktPoolSize, 
@@ -67,14 +116,20 @@ class PacketBufferPool {
 		unsigned _standardPktPoolSize;
 		/// buffer pool size for jumbo packets
 		unsigned _jumboPktPoolSize;
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL | CHRONICLE_DEBUG_STAT)
-		std::atomic<uint64_t> _allocatedBufsStandard;
-		std::atomic<uint64_t> _maxAllocatedBufsStandard;
-		std::atomic<uint64_t> _timesNoFreeBufsStandard;		
-		std::atomic<uint64_t> _allocatedBufsJumbo;
-		std::atomic<uint64_t> _maxAllocatedBufsJumbo;
-		std::atomic<uint64_t> _timesNoFreeBufsJumbo;	
-		#endif
+		/// high-water mark for allocated standard buffers
+		std::atomic<int64_t> _maxAllocatedBufsStandard;
+		/// high-water mark for allocated jumbo buffers
+		std::atomic<int64_t> _maxAllocatedBufsJumbo;
+
+	private:
+		static void updateMax(std::atomic<int64_t> &max, int64_t value);
+		/// returns true if the packet's buffer comes from the jumbo pool
+		static inline bool isJumbo(PacketDescriptor *pktDesc);
+		/// counts the buffers of a PDU the first time it is handed over
+		static void countPduBufs(PduDescriptor *pduDesc);
+
+		/// index of the first jumbo buffer (the pool is a singleton)
+		static unsigned _firstJumboIndex;
 };
 
 #endif //PACKET_BUFFER_POOL_H
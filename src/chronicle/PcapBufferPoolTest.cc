@@ -9,6 +9,7 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <errno.h>
+#include <netinet/in.h>
 #include "gtest/gtest.h"
 #include "ChronicleProcessRequest.h"
 #include "PcapPacketBufferPool.h"
@@ -121,6 +122,122 @@ TEST(PcapPacketBufferPool, pktDataCheck) {
 	delete poolUser;	
 }
 
+TEST(PcapPacketBufferPool, earlyPayloadRelease) {
+	// buf pool setup
+	PcapPacketBufferPool *poolUser;
+	poolUser = PcapPacketBufferPool::registerBufferPool(4, 0);
+	ASSERT_TRUE(poolUser != NULL);
+
+	// a WRITE call whose data starts in the first of 4 packets
+	PacketDescriptor *descriptors[4];
+	for (int i = 0; i < 4; i++) {
+		descriptors[i] = poolUser->getPacketDescriptor(MAX_ETH_FRAME_SIZE_STAND);
+		descriptors[i]->interface = NULL;
+		descriptors[i]->tcpSeqNum = i;
+		descriptors[i]->protocol = IPPROTO_TCP;
+		descriptors[i]->prev = (i > 0) ? descriptors[i - 1] : NULL;
+		if (i > 0)
+			descriptors[i - 1]->next = descriptors[i];
+	}
+	descriptors[3]->next = NULL;
+	ASSERT_TRUE(poolUser->getPacketDescriptor(MAX_ETH_FRAME_SIZE_STAND) == NULL);
+	NfsV3PduDescriptor *pduDesc = new NfsV3PduDescriptor(descriptors[0], 
+		descriptors[0], 4096, 1, NFS3_VERSION, NFS3PROC_WRITE, 0, 0, 0, 
+		0 /* call */);
+	pduDesc->rpcPduType = PduDescriptor::PDU_COMPLETE;
+	pduDesc->lastPktDesc = descriptors[3];
+	pduDesc->pktDesc[0] = descriptors[0];
+	pduDesc->parsable = true;
+
+	// the two packets in the middle only carry data
+	EXPECT_EQ(2u, pduDesc->releasePayloadPackets(poolUser, true));
+	EXPECT_TRUE(descriptors[0]->next == descriptors[3]);
+	EXPECT_TRUE(descriptors[3]->prev == descriptors[0]);
+	EXPECT_EQ(2, pduDesc->getNumPackets());
+	ASSERT_EQ(2u, pduDesc->releasedPktSummaries.size());
+	EXPECT_EQ(1u, pduDesc->releasedPktSummaries[0].tcpSeqNum);
+	EXPECT_EQ(2u, pduDesc->releasedPktSummaries[1].tcpSeqNum);
+	EXPECT_EQ(0u, pduDesc->releasePayloadPackets(poolUser, true));
+
+	// the released buffers are available again
+	PacketDescriptor *reused[2];
+	reused[0] = poolUser->getPacketDescriptor(MAX_ETH_FRAME_SIZE_STAND);
+	reused[1] = poolUser->getPacketDescriptor(MAX_ETH_FRAME_SIZE_STAND);
+	EXPECT_TRUE(reused[0] != NULL && reused[1] != NULL);
+	ASSERT_TRUE(poolUser->getPacketDescriptor(MAX_ETH_FRAME_SIZE_STAND) == NULL);
+
+	// releasing all the descriptors
+	poolUser->releasePacketDescriptor(reused[0]);
+	poolUser->releasePacketDescriptor(reused[1]);
+	poolUser->releasePacketDescriptor(descriptors[0]);
+	poolUser->releasePacketDescriptor(descriptors[3]);
+	delete pduDesc;
+
+	ASSERT_TRUE(poolUser->unregisterBufferPool());
+	delete poolUser;	
+}
+
+static int64_t
+heldBufs(PacketBufferPool::Holder holder, bool jumbo)
+{
+	int64_t standard, jumboBufs;
+	PacketBufferPool::getHeldBufs(holder, standard, jumboBufs);
+	return jumbo ? jumboBufs : standard;
+}
+
+TEST(PcapPacketBufferPool, heldBufsFollowHandOvers) {
+	PcapPacketBufferPool *poolUser;
+	poolUser = PcapPacketBufferPool::registerBufferPool(2, 1);
+	ASSERT_TRUE(poolUser != NULL);
+	// the counters are global, so only their changes are checked
+	int64_t input = heldBufs(PacketBufferPool::HOLDER_INPUT, false);
+	int64_t inputJumbo = heldBufs(PacketBufferPool::HOLDER_INPUT, true);
+	int64_t reassembly = heldBufs(PacketBufferPool::HOLDER_REASSEMBLY, false);
+	int64_t nfs = heldBufs(PacketBufferPool::HOLDER_NFS_PARSER, false);
+	int64_t nfsJumbo = heldBufs(PacketBufferPool::HOLDER_NFS_PARSER, true);
+	int64_t analytics = heldBufs(PacketBufferPool::HOLDER_ANALYTICS, false);
+
+	// a PDU over two standard packets and a jumbo one
+	PacketDescriptor *descriptors[3];
+	descriptors[0] = poolUser->getPacketDescriptor(MAX_ETH_FRAME_SIZE_STAND);
+	descriptors[1] = poolUser->getPacketDescriptor(MAX_ETH_FRAME_SIZE_JUMBO);
+	descriptors[2] = poolUser->getPacketDescriptor(MAX_ETH_FRAME_SIZE_STAND);
+	for (int i = 0; i < 3; i++) {
+		ASSERT_TRUE(descriptors[i] != NULL);
+		descriptors[i]->next = (i < 2) ? descriptors[i + 1] : NULL;
+	}
+	EXPECT_EQ(input + 2, heldBufs(PacketBufferPool::HOLDER_INPUT, false));
+	EXPECT_EQ(inputJumbo + 1, heldBufs(PacketBufferPool::HOLDER_INPUT, true));
+	for (int i = 0; i < 3; i++)
+		PacketBufferPool::handOver(descriptors[i],
+			PacketBufferPool::HOLDER_INPUT, PacketBufferPool::HOLDER_REASSEMBLY);
+	EXPECT_EQ(input, heldBufs(PacketBufferPool::HOLDER_INPUT, false));
+	EXPECT_EQ(reassembly + 2,
+		heldBufs(PacketBufferPool::HOLDER_REASSEMBLY, false));
+
+	BadPduDescriptor *pduDesc = new BadPduDescriptor(descriptors[0],
+		descriptors[2]);
+	EXPECT_EQ(PacketBufferPool::HOLDER_REASSEMBLY, pduDesc->bufHolder);
+	PacketBufferPool::handOver(pduDesc, PacketBufferPool::HOLDER_NFS_PARSER);
+	EXPECT_EQ(reassembly, heldBufs(PacketBufferPool::HOLDER_REASSEMBLY, false));
+	EXPECT_EQ(nfs + 2, heldBufs(PacketBufferPool::HOLDER_NFS_PARSER, false));
+	EXPECT_EQ(nfsJumbo + 1, heldBufs(PacketBufferPool::HOLDER_NFS_PARSER, true));
+	PacketBufferPool::handOver(pduDesc, PacketBufferPool::HOLDER_ANALYTICS);
+	EXPECT_EQ(nfs, heldBufs(PacketBufferPool::HOLDER_NFS_PARSER, false));
+	EXPECT_EQ(analytics + 2,
+		heldBufs(PacketBufferPool::HOLDER_ANALYTICS, false));
+
+	// releasing the PDU's packets gives the stage's references back
+	for (int i = 0; i < 3; i++)
+		EXPECT_TRUE(poolUser->releasePduPacket(pduDesc, descriptors[i]));
+	EXPECT_EQ(analytics, heldBufs(PacketBufferPool::HOLDER_ANALYTICS, false));
+	EXPECT_EQ(nfsJumbo, heldBufs(PacketBufferPool::HOLDER_NFS_PARSER, true));
+	delete pduDesc;
+
+	ASSERT_TRUE(poolUser->unregisterBufferPool());
+	delete poolUser;
+}
+
 /* 
  * commented out as root privilege is required for restoring original rlimits
  * so that the tests can be run in any random order.
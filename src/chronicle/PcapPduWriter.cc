@@ -17,6 +17,7 @@
 #include "ChronicleProcessRequest.h"
 #include "PcapPacketBufferPool.h"
 #include "PcapInterface.h"
+#include "StageTracer.h"
 
 class PcapPduWriter::MsgBase : public Message {
 	protected:
@@ -69,6 +70,7 @@ PcapPduWriter::~PcapPduWriter()
 void
 PcapPduWriter::processRequest(ChronicleSource *src, PduDescriptor *pduDesc)
 {
+	PacketBufferPool::handOver(pduDesc, PacketBufferPool::HOLDER_OUTPUT);
 	enqueueMessage(new MsgProcessRequest(this, pduDesc));
 }
 
@@ -77,6 +79,7 @@ PcapPduWriter::doProcessRequest(PduDescriptor *pduDesc)
 {
 	PduDescriptor *tmpPduDesc;
 	PacketDescriptor *oldPktDesc;
+	StageTracer::stamp(pduDesc, StageTracer::STAGE_OUTPUT);
 	while (pduDesc) {
 		PacketDescriptor *pktDesc = pduDesc->firstPktDesc;
 		do {
@@ -100,7 +103,7 @@ PcapPduWriter::doProcessRequest(PduDescriptor *pduDesc)
 					std::cout << "PcapPduWriter::doProcessRequest: pcap_dump_open: "
 						<< pcap_geterr(_pcapHandle) << std::endl;
 					_processState = ChronicleSink::CHRONICLE_ERR;
-					_bufPool->releasePacketDescriptor(pktDesc);
+					_bufPool->releasePduPacket(pduDesc, pktDesc);
 					_source->processDone(this);
 					return ;
 				}
@@ -115,7 +118,7 @@ PcapPduWriter::doProcessRequest(PduDescriptor *pduDesc)
 			}
 			oldPktDesc = pktDesc;
 			pktDesc = pktDesc->next;
-			_bufPool->releasePacketDescriptor(oldPktDesc);
+			_bufPool->releasePduPacket(pduDesc, oldPktDesc);
 		} while (oldPktDesc != pduDesc->lastPktDesc);
 		tmpPduDesc = pduDesc;
 		pduDesc = pduDesc->next;
@@ -17,6 +17,7 @@
 #include "ChronicleProcessRequest.h"
 #include "PcapPacketBufferPool.h"
 #include "PcapInterface.h"
+#include "StageTracer.h"
 
 class PcapWriter::MsgBase : public Message {
 	protected:
@@ -67,6 +68,9 @@ PcapWriter::~PcapWriter()
 void
 PcapWriter::processRequest(ChronicleSource *src, PacketDescriptor *pktDesc)
 {
+	for (PacketDescriptor *p = pktDesc; p != NULL; p = p->next)
+		PacketBufferPool::handOver(p, PacketBufferPool::HOLDER_INPUT,
+			PacketBufferPool::HOLDER_OUTPUT);
 	enqueueMessage(new MsgProcessRequest(this, pktDesc));
 }
 
@@ -75,6 +79,7 @@ PcapWriter::doProcessRequest(PacketDescriptor *pktDesc)
 {
 	while (pktDesc != NULL) {
 		++numPktsReceived;
+		StageTracer::stamp(pktDesc, StageTracer::STAGE_OUTPUT);
 		if(pcapFileHeaderWritten && 
 				numBytesWritten + pktDesc->pcapHeader.caplen 
 				> PCAP_MAX_TRACE_SIZE) { // pcap file has got too big
@@ -93,7 +98,8 @@ PcapWriter::doProcessRequest(PacketDescriptor *pktDesc)
 				std::cout << "PcapWriter::doProcessRequest: pcap_dump_open: "
 					<< pcap_geterr(pcapHandle) << std::endl;
 				_processState = ChronicleSink::CHRONICLE_ERR;
-				bufPool->releasePacketDescriptor(pktDesc);
+				bufPool->releasePacketDescriptor(pktDesc,
+					PacketBufferPool::HOLDER_OUTPUT);
 				source->processDone(this);
 				return ;
 			}
@@ -108,7 +114,8 @@ PcapWriter::doProcessRequest(PacketDescriptor *pktDesc)
 			numBytesWritten += pktDesc->pcapHeader.caplen;
 		}
 		PacketDescriptor *nextPktDesc = pktDesc->next;
-		if (bufPool->releasePacketDescriptor(pktDesc))
+		if (bufPool->releasePacketDescriptor(pktDesc,
+				PacketBufferPool::HOLDER_OUTPUT))
 			++numPktsReleased;
 		pktDesc = nextPktDesc;
 	}
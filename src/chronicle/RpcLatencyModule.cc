@@ -0,0 +1,164 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include <linux/nfs.h>
+#include <linux/nfs3.h>
+#include "ChronicleConfig.h"
+#include "RpcParser.h"
+#include "RpcLatencyModule.h"
+
+LatencyHostTable::LatencyHostTable(unsigned maxHosts)
+	: _slots(maxHosts * 2, -1), _maxHosts(maxHosts)
+{
+	_ips.reserve(maxHosts);
+	_histograms.reserve(maxHosts);
+}
+
+LatencyHistogram *
+LatencyHostTable::find(uint32_t ip)
+{
+	uint32_t mask = _slots.size() - 1;
+	uint32_t slot = (ip * 2654435761u) & mask;
+	while (_slots[slot] >= 0) {
+		if (_ips[_slots[slot]] == ip)
+			return &_histograms[_slots[slot]];
+		slot = (slot + 1) & mask;
+	}
+	if (_ips.size() == _maxHosts)
+		return &_overflow;
+	// the vectors were reserved, so adding a host doesn't allocate
+	_slots[slot] = _ips.size();
+	_ips.push_back(ip);
+	_histograms.push_back(LatencyHistogram());
+	return &_histograms.back();
+}
+
+void
+LatencyHostTable::merge(const LatencyHostTable &other)
+{
+	for (unsigned i = 0; i < other._ips.size(); i++)
+		find(other._ips[i])->merge(other._histograms[i]);
+	_overflow.merge(other._overflow);
+}
+
+RpcLatencyPartial::RpcLatencyPartial()
+	: clients(ANALYTICS_LATENCY_MAX_HOSTS), 
+	servers(ANALYTICS_LATENCY_MAX_HOSTS)
+{
+
+}
+
+void
+RpcLatencyPartial::update(PduDescriptor *pduDesc)
+{
+	// RpcParser passes a matched call and reply together (call first)
+	PduDescriptor *reply = pduDesc->next;
+	if (pduDesc->rpcPduType == PduDescriptor::PDU_BAD 
+			|| pduDesc->rpcMsgType != RPC_CALL || reply == NULL
+			|| reply->rpcPduType == PduDescriptor::PDU_BAD 
+			|| reply->rpcMsgType != RPC_REPLY 
+			|| reply->rpcXid != pduDesc->rpcXid)
+		return ;
+	PacketDescriptor *callPkt = pduDesc->firstPktDesc;
+	const struct timeval &callTs = callPkt->pcapHeader.ts;
+	const struct timeval &replyTs = reply->firstPktDesc->pcapHeader.ts;
+	int64_t latency = (int64_t)(replyTs.tv_sec - callTs.tv_sec) * 1000000 
+		+ (replyTs.tv_usec - callTs.tv_usec);
+	// calls and replies captured on different interfaces may be skewed
+	if (latency < 0)
+		latency = 0;
+	if (pduDesc->rpcProgram == NFS_PROGRAM 
+			&& pduDesc->rpcProgramVersion == NFS3_VERSION
+			&& pduDesc->rpcProgramProcedure < AnalyticsModule::NUM_NFS3_PROCS)
+		procs[pduDesc->rpcProgramProcedure].record(latency);
+	else
+		otherProcs.record(latency);
+	clients.find(callPkt->srcIP)->record(latency);
+	servers.find(callPkt->destIP)->record(latency);
+}
+
+void
+RpcLatencyPartial::merge(const AnalyticsPartial *other)
+{
+	const RpcLatencyPartial *partial = 
+		static_cast<const RpcLatencyPartial *>(other);
+	for (unsigned i = 0; i < AnalyticsModule::NUM_NFS3_PROCS; i++)
+		procs[i].merge(partial->procs[i]);
+	otherProcs.merge(partial->otherProcs);
+	clients.merge(partial->clients);
+	servers.merge(partial->servers);
+}
+
+RpcLatencyModule::RpcLatencyModule(AnalyticsManager *manager, 
+	std::string command, int id, int interval, const Params &params)
+	: AnalyticsModule("RpcLatencyModule", manager, command, id, interval)
+{
+
+}
+
+static std::string
+ipToString(uint32_t ip)
+{
+	// '_' rather than '.' so that the address is a single Carbon path node
+	std::ostringstream s;
+	s << (ip >> 24) << "_" << ((ip >> 16) & 0xff) << "_"
+		<< ((ip >> 8) & 0xff) << "_" << (ip & 0xff);
+	return s.str();
+}
+
+void
+RpcLatencyModule::reportHistogram(const std::string &name, 
+	const LatencyHistogram &histogram, std::map<std::string, int64_t> &stats)
+{
+	if (histogram.getCount() == 0)
+		return ;
+	uint64_t p50 = histogram.getQuantile(0.5);
+	uint64_t p90 = histogram.getQuantile(0.9);
+	uint64_t p99 = histogram.getQuantile(0.99);
+	uint64_t p999 = histogram.getQuantile(0.999);
+	_output << name << " count " << histogram.getCount() 
+		<< " mean " << histogram.getMean() << " p50 " << p50 
+		<< " p90 " << p90 << " p99 " << p99 << " p99.9 " << p999
+		<< " max " << histogram.getMax() << std::endl;
+	std::string statName = "analytics.rpclatency." + name;
+	for (unsigned i = 0; i < statName.size(); i++)
+		if (statName[i] == ' ')
+			statName[i] = '.';
+	stats[statName + ".count"] = histogram.getCount();
+	stats[statName + ".mean"] = histogram.getMean();
+	stats[statName + ".p50"] = p50;
+	stats[statName + ".p90"] = p90;
+	stats[statName + ".p99"] = p99;
+	stats[statName + ".p999"] = p999;
+	stats[statName + ".max"] = histogram.getMax();
+}
+
+void
+RpcLatencyModule::report(struct timeval ts)
+{
+	const RpcLatencyPartial *latencies = 
+		static_cast<const RpcLatencyPartial *>(_aggregate);
+	std::map<std::string, int64_t> stats;
+
+	_output << getTime(ts) << " latency (us) over " << _interval << "s" 
+		<< std::endl;
+	for (unsigned i = 0; i < NUM_NFS3_PROCS; i++)
+		reportHistogram(std::string("proc ") + getNfs3ProcName(i), 
+			latencies->procs[i], stats);
+	reportHistogram("proc other", latencies->otherProcs, stats);
+	for (unsigned i = 0; i < latencies->clients.size(); i++)
+		reportHistogram("client " + 
+			ipToString(latencies->clients.getIp(i)),
+			latencies->clients.getHistogram(i), stats);
+	reportHistogram("client other", latencies->clients.getOverflow(), stats);
+	for (unsigned i = 0; i < latencies->servers.size(); i++)
+		reportHistogram("server " + 
+			ipToString(latencies->servers.getIp(i)),
+			latencies->servers.getHistogram(i), stats);
+	reportHistogram("server other", latencies->servers.getOverflow(), stats);
+	_output << std::endl;
+	_manager->publishStats(stats);
+}
@@ -0,0 +1,78 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef RPC_LATENCY_MODULE_H
+#define RPC_LATENCY_MODULE_H
+
+#include <map>
+#include <vector>
+#include "AnalyticsModule.h"
+#include "LatencyHistogram.h"
+
+/**
+ * A bounded table of latency histograms keyed by IP address. All the memory
+ * is reserved up front; once the table is full, the hosts that don't have
+ * a histogram yet share the overflow histogram.
+ */
+class LatencyHostTable {
+	public:
+		LatencyHostTable(unsigned maxHosts);
+		/// finds (or adds) the histogram of a host
+		LatencyHistogram *find(uint32_t ip);
+		void merge(const LatencyHostTable &other);
+		unsigned size() const { return _ips.size(); }
+		uint32_t getIp(unsigned i) const { return _ips[i]; }
+		const LatencyHistogram &getHistogram(unsigned i) const 
+			{ return _histograms[i]; }
+		const LatencyHistogram &getOverflow() const { return _overflow; }
+
+	private:
+		/// open-addressed slots holding indexes into _ips (-1 if empty)
+		std::vector<int32_t> _slots;
+		/// hosts in the order they were added
+		std::vector<uint32_t> _ips;
+		/// the histograms of the hosts in _ips
+		std::vector<LatencyHistogram> _histograms;
+		LatencyHistogram _overflow;
+		unsigned _maxHosts;
+};
+
+/// Call to reply latencies seen by a shard during an interval
+class RpcLatencyPartial : public AnalyticsPartial {
+	public:
+		RpcLatencyPartial();
+		void update(PduDescriptor *pduDesc);
+		void merge(const AnalyticsPartial *other);
+
+		/// per NFSv3 procedure
+		LatencyHistogram procs[AnalyticsModule::NUM_NFS3_PROCS];
+		/// other RPC programs and versions
+		LatencyHistogram otherProcs;
+		/// per client
+		LatencyHostTable clients;
+		/// per server
+		LatencyHostTable servers;
+};
+
+/**
+ * Reports the percentiles of the RPC call to reply latency per NFSv3
+ * procedure, client and server, both to its output file and to the
+ * StatGatherer (under "analytics.rpclatency").
+ */
+class RpcLatencyModule : public AnalyticsModule {
+	public:
+		RpcLatencyModule(AnalyticsManager *manager, std::string command,
+			int id, int interval, const Params &params);
+		AnalyticsPartial *newPartial() { return new RpcLatencyPartial(); }
+		void report(struct timeval ts);
+
+	private:
+		void reportHistogram(const std::string &name, 
+			const LatencyHistogram &histogram,
+			std::map<std::string, int64_t> &stats);
+};
+
+#endif //RPC_LATENCY_MODULE_H
@@ -18,6 +18,26 @@
 #include "FlowTable.h"
 #include "NfsParser.h"
 #include "TcpStreamNavigator.h"
+#include "StageTracer.h"
+#include "Metrics.h"
+
+static MetricCounter goodPdus("pdu.good");
+static MetricCounter badPdus("pdu.bad");
+static MetricCounter completePduCalls("pdu.complete.call");
+static MetricCounter completePduReplies("pdu.complete.reply");
+static MetricCounter completeHdrPduCalls("pdu.completehdr.call");
+static MetricCounter completeHdrPduReplies("pdu.completehdr.reply");
+static MetricCounter unmatchedCalls("pdu.unmatchedcall");
+// not quite accurate due to possible recounting
+static MetricCounter unmatchedReplies("pdu.unmatchedreply");
+static MetricCounter scannedRpcCallHdrs("rpc.scanned.call");
+static MetricCounter scannedRpcReplyHdrs("rpc.scanned.reply");
+// forced reply parsing (when queueLen > RPC_PARSER_REPLY_PARSE_THRESH)
+static MetricCounter forcedRpcReplyScans("rpc.forcedreplyscan");
+// forced garbage collection (when queueLen > RPC_PARSER_REPLY_PARSE_THRESH*2)
+static MetricCounter forcedGcs("rpc.forcedgc");
+/// the number of call/reply PDUs passed on at a time
+static MetricHistogram readyPduBatches("rpc.readypdus");
 
 #define MATCH_SIGN0_CALL(num)												\
 	(num == 0x0 || num == 0x00000002 || num == 0x00000200 					\
@@ -49,7 +69,9 @@ FlowDescriptorTcpRpc::~FlowDescriptorTcpRpc()
 void
 FlowDescriptorTcpRpc::insertCallPdu(PduDescriptor *pduDesc, bool shutdown) 
 {
-	_callPduList.push_back(pduDesc);
+	if (_callPduList.push_back(pduDesc).second)
+		PacketBufferPool::handOverPdu(pduDesc,
+			PacketBufferPool::HOLDER_CALL_TABLE);
 	#if CHRON_DEBUG(CHRONICLE_DEBUG_RPC)
 	std::cout << "insertCallPdu: _callPduList.size(): " << _callPduList.size()
 		<< std::endl;
@@ -70,9 +92,9 @@ FlowDescriptorTcpRpc::insertCallPdu(PduDescriptor *pduDesc, bool shutdown)
 				(*it)->rpcXid, size);
 			(*it)->print();
 			#endif
-			#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-			_rpcParser->incrementUnmatchedCalls(1);
-			#endif
+			unmatchedCalls++;
+			PacketBufferPool::handOverPdu(*it,
+				PacketBufferPool::HOLDER_REASSEMBLY);
 			insertReadyPdus(*it, 1);
 			_callPduListByInsert->pop_front();
 		}
@@ -92,6 +114,8 @@ FlowDescriptorTcpRpc::getCallPdu(uint32_t xid)
 	else {
 		PduDescriptor *pduDesc = *it;
 		_callPduListByXid->erase(it);
+		PacketBufferPool::handOverPdu(pduDesc,
+			PacketBufferPool::HOLDER_REASSEMBLY);
 		return pduDesc;
 	}
 }
@@ -130,6 +154,8 @@ FlowDescriptorTcpRpc::passReadyPdus(PduDescReceiver *sink, RpcParser *src)
 			tmpPduDesc = tmpPduDesc->next;
 		}
 		#endif
+		goodPdus.add(_readyPdusListSize);
+		readyPduBatches.record(_readyPdusListSize);
 		sink->processRequest(src, _readyPdusListHead);
 		_readyPdusListHead = _readyPdusListTail = NULL;
 		_readyPdusListSize = 0;
@@ -149,9 +175,9 @@ FlowDescriptorTcpRpc::passCallPdus()
 			(*it)->rpcXid, _callPduListByInsert->size());
 		(*it)->print();
 		#endif
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-		_rpcParser->incrementUnmatchedCalls(1);
-		#endif
+		unmatchedCalls++;
+		PacketBufferPool::handOverPdu(*it,
+			PacketBufferPool::HOLDER_REASSEMBLY);
 		insertReadyPdus(*it, 1);
 		it = _callPduListByInsert->erase(it);
 	}	
@@ -174,9 +200,9 @@ FlowDescriptorTcpRpc::gcCallPdus(PacketDescriptor *pktDesc)
 			(*it)->rpcXid, _callPduListByInsert->size());
 		(*it)->print();
 		#endif
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-		_rpcParser->incrementUnmatchedCalls(1);
-		#endif
+		unmatchedCalls++;
+		PacketBufferPool::handOverPdu(*it,
+			PacketBufferPool::HOLDER_REASSEMBLY);
 		insertReadyPdus(*it, 1);
 		it = _callPduListByInsert->erase(it);
 	}	
@@ -280,36 +306,11 @@ RpcParser::RpcParser(ChronicleSource *src, unsigned pipelineId)
 		_processState = ChronicleSink::CHRONICLE_ERR;
 		_source->processDone(this);
 	}
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-	_goodPduCount = _badPduCount = _completePduCallCount = _completePduReplyCount
-		= _completeHdrPduCallCount = _completeHdrPduReplyCount = 0;
-	_unmatchedCallCount = _unmatchedReplyCount = 0;
 	_goodPduPrintLimit = _badPduPrintLimit = 100000;
-	_scannedRpcCallHdrs = _scannedRpcReplyHdrs = 0;
-	_forcedRpcReplyScanCount = _forcedGcCount = 0;
-	#endif
 }
 
 RpcParser::~RpcParser()
 {
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-	printf("RpcParser::~RpcParser[%u]: goodPduCount:%lu badPduCount:%lu "
-		"completePduCallCount:%lu completePduReplyCount:%lu "
-		"completeHdrPduCallCount:%lu completeHdrPduReplyCount:%lu "
-		"unmatchedCallCount:%lu unmatchedReplyCount:%lu "
-		"scannedRpcCallHdrs:%lu scannedRpcReplyHdrs:%lu "
-		"forcedRpcReplyScanCount:%lu forcedGarbageCollectCount:%lu\n",
-		_pipelineId, _goodPduCount, _badPduCount, 
-		_completePduCallCount, _completePduReplyCount,
-		_completeHdrPduCallCount, _completeHdrPduReplyCount,
-		_unmatchedCallCount, _unmatchedReplyCount,
-		_scannedRpcCallHdrs, _scannedRpcReplyHdrs, _forcedRpcReplyScanCount,
-		_forcedGcCount);
-	if(_goodPduCount != _completePduCallCount + _completePduReplyCount +
-			_completeHdrPduCallCount + _completeHdrPduReplyCount)
-		printf("RpcParser::~RpcParser[%u]: [WARNING] stats do not add up!\n",
-			_pipelineId);
-	#endif
 	delete _flowTable;
 	delete _streamNavigator;
 	if (_bufPool && _bufPool->unregisterBufferPool()) 
@@ -320,6 +321,8 @@ void
 RpcParser::processRequest(ChronicleSource *src, 
 	PacketDescriptor *pktDesc)
 {
+	PacketBufferPool::handOver(pktDesc, PacketBufferPool::HOLDER_INPUT,
+		PacketBufferPool::HOLDER_REASSEMBLY);
 	enqueueMessage(new MsgProcessRequest(this, pktDesc));
 }
 
@@ -331,9 +334,11 @@ RpcParser::doProcessRequest(PacketDescriptor *pktDesc)
 	bool forceFlush = false;
 	FlowDescriptorTcpRpc *rpcFlowDesc = NULL, *rpcReverseFlowDesc = NULL;
 
+	StageTracer::stamp(pktDesc, StageTracer::STAGE_RPC_PARSER);
 	if (_processState == ChronicleSink::CHRONICLE_ERR 
 			|| !isRpcConnection(pktDesc)) { // discarding non-RPC packets
-		assert(_bufPool->releasePacketDescriptor(pktDesc));
+		assert(_bufPool->releasePacketDescriptor(pktDesc,
+			PacketBufferPool::HOLDER_REASSEMBLY));
 		return ;
 	}
 	flowDesc = _flowTable->lookupFlow(pktDesc->srcIP, pktDesc->destIP, 
@@ -396,16 +401,17 @@ RpcParser::doProcessRequest(PacketDescriptor *pktDesc)
 			// time-based garbage collection of the flow table buckets
 			gcFlowTable(pktDesc);
 		} else {
-			#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-			rpcFlowDesc->droppedPktCount++;
-			#endif
-			assert(_bufPool->releasePacketDescriptor(pktDesc));
+			rpcFlowDesc->count(FlowDescriptorTcp::DROPPED_PKT);
+			assert(_bufPool->releasePacketDescriptor(pktDesc,
+				PacketBufferPool::HOLDER_REASSEMBLY));
 		}
 	} else if (pktDesc->protocol == IPPROTO_UDP) { // UDP packet
 		// TODO: handling UDP packets	
-		assert(_bufPool->releasePacketDescriptor(pktDesc));
+		assert(_bufPool->releasePacketDescriptor(pktDesc,
+			PacketBufferPool::HOLDER_REASSEMBLY));
 	} else // releasing pktDesc
-		assert(_bufPool->releasePacketDescriptor(pktDesc));
+		assert(_bufPool->releasePacketDescriptor(pktDesc,
+			PacketBufferPool::HOLDER_REASSEMBLY));
 }
 
 void
@@ -544,10 +550,8 @@ RpcParser::doShutdownProcess()
 		FlowDescriptorTcpRpc *rpcFlowDesc = 
 			static_cast<FlowDescriptorTcpRpc *>(flowDesc);
 		rpcFlowDesc->passCallPdus();
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-		_goodPduCount += rpcFlowDesc->_readyPdusListSize;
-		rpcFlowDesc->printStats();
-		#endif
+		if (Metrics::isVerbose(Metrics::VERBOSE_RPC))
+			rpcFlowDesc->printStats();
 		rpcFlowDesc->passReadyPdus(_sink, this);
 		flowDesc = flowDesc->next;
 		delete rpcFlowDesc;
@@ -602,26 +606,25 @@ RpcParser::parseRpcPackets(FlowDescriptorTcpRpc *rpcFlowDesc,
 			rpcReverseFlowDesc->insertReadyPdus(pduDesc, 2);
 			if (rpcReverseFlowDesc->_readyPdusListSize >= 
 					RPC_PARSER_PDUS_BATCH_SIZE) {
-				#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-				_goodPduCount += rpcReverseFlowDesc->_readyPdusListSize;
-				if (_goodPduCount >= _goodPduPrintLimit) {
+				if (Metrics::isVerbose(Metrics::VERBOSE_RPC)
+						&& goodPdus.get() + rpcReverseFlowDesc->_readyPdusListSize
+						>= _goodPduPrintLimit) {
 					printf("RpcParser::doProcessRequest[%u]: "
-						"goodPduCount:%lu badPduCount:%lu "
-						"CC:%lu CR:%lu CHC:%lu CHR:%lu "
-						"unmatchedCallCount:%lu unmatchedReplyCount:%lu "
-						"scannedRpcCallHdrs:%lu scannedRpcReplyHdrs:%lu "
-						"forcedRpcReplyScanCount:%lu forcedGcCount:%lu "
+						"goodPduCount:%ld badPduCount:%ld "
+						"CC:%ld CR:%ld CHC:%ld CHR:%ld "
+						"unmatchedCallCount:%ld unmatchedReplyCount:%ld "
+						"scannedRpcCallHdrs:%ld scannedRpcReplyHdrs:%ld "
+						"forcedRpcReplyScanCount:%ld forcedGcCount:%ld "
 						"queueLenCall:%u queueLenReply:%u\n", _pipelineId,
-						_goodPduCount, _badPduCount, 
-						_completePduCallCount, _completePduReplyCount, 
-						_completeHdrPduCallCount, _completeHdrPduReplyCount,
-						_unmatchedCallCount, _unmatchedReplyCount, 
-						_scannedRpcCallHdrs, _scannedRpcReplyHdrs, 
-						_forcedRpcReplyScanCount, _forcedGcCount,
+						goodPdus.get(), badPdus.get(),
+						completePduCalls.get(), completePduReplies.get(),
+						completeHdrPduCalls.get(), completeHdrPduReplies.get(),
+						unmatchedCalls.get(), unmatchedReplies.get(),
+						scannedRpcCallHdrs.get(), scannedRpcReplyHdrs.get(),
+						forcedRpcReplyScans.get(), forcedGcs.get(),
 						rpcReverseFlowDesc->queueLen, rpcFlowDesc->queueLen);
-					_goodPduPrintLimit += 100000;
+					_goodPduPrintLimit = goodPdus.get() + 100000;
 				}
-				#endif
 				rpcReverseFlowDesc->passReadyPdus(_sink, this);
 			}
 			if (startPktDesc == NULL) // examined all the packets
@@ -757,14 +760,12 @@ RpcParser::findPdu(FlowDescriptorTcpRpc *flowDesc,
 							// ignoring duplicate xids due to retransmission
 							if (flowDesc->hasSeenCallPdu(pduDesc->rpcXid)) {
 								PacketDescriptor *tmpPktDesc;
-								#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
 								if (pduDesc->rpcPduType ==
 										PduDescriptor::PDU_COMPLETE)
-									_completePduCallCount--;
+									completePduCalls--;
 								else if (pduDesc->rpcPduType ==
 										PduDescriptor::PDU_COMPLETE_HEADER)
-									_completeHdrPduCallCount--;
-								#endif
+									completeHdrPduCalls--;
 								pduDesc->rpcPduType = PduDescriptor::PDU_BAD;
 								pduDesc->rpcProgram = 
 									pduDesc->rpcProgramVersion = 
@@ -819,9 +820,7 @@ RpcParser::findPdu(FlowDescriptorTcpRpc *flowDesc,
 							//pduDesc = constructBadPdu(pktDesc,
 								flowDesc->tail);
 							if (pduDesc != NULL) {
-								#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-								_forcedGcCount++;
-								#endif
+								forcedGcs++;
 								flowDesc->releasePktDescriptors(
 								pduDesc->lastPktDesc, true);
 								passBadPdu(pduDesc);
@@ -839,9 +838,7 @@ RpcParser::findPdu(FlowDescriptorTcpRpc *flowDesc,
 							#endif
 							return NULL;
 						} else {
-							#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-							_forcedRpcReplyScanCount++;
-							#endif
+							forcedRpcReplyScans++;
 							if (flowDesc->head->visitCount 
 								< RPC_PARSER_COMPLETE_HDR_THRESH)
 							flowDesc->increaseVisitCount(
@@ -879,18 +876,14 @@ RpcParser::findPdu(FlowDescriptorTcpRpc *flowDesc,
 								pduDesc = constructBadPdu(flowDesc->head, 
 									flowDesc->tail);
 								if (pduDesc != NULL) {
-									#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-									_forcedGcCount++;
-									#endif
+									forcedGcs++;
 									flowDesc->releasePktDescriptors(
 									pduDesc->lastPktDesc, true);
 									passBadPdu(pduDesc);
 									return NULL;
 								}
 							}
-							#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-							_forcedRpcReplyScanCount++;
-							#endif
+							forcedRpcReplyScans++;
 							// making sure we are not stuck because call
 							// packets have n't reached the parsing 
 							// threshold.
@@ -918,9 +911,7 @@ RpcParser::findPdu(FlowDescriptorTcpRpc *flowDesc,
 						// capping the reply packets by garbage collecting them all
 						pduDesc = constructBadPdu(flowDesc->head, flowDesc->tail);
 						if (pduDesc != NULL) {
-							#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-							_forcedGcCount++;
-							#endif
+							forcedGcs++;
 							flowDesc->releasePktDescriptors(
 								pduDesc->lastPktDesc, true);
 							passBadPdu(pduDesc);
@@ -972,10 +963,7 @@ RpcParser::findPdu(FlowDescriptorTcpRpc *flowDesc,
 					#if CHRON_DEBUG(CHRONICLE_DEBUG_RPC | CHRONICLE_DEBUG_GC)  				
 					printf("GC: unmatched reply for xid:%#010x\n", xid);
 					#endif
-					#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-					// not quite accurate due to possible recounting
-					_unmatchedReplyCount++; 
-					#endif
+					unmatchedReplies++;
 					gcPktsUpto(flowDesc, tmpPktDesc);
 					pktDesc = flowDesc->head;
 					if (pktDesc == NULL)
@@ -1095,6 +1083,8 @@ RpcParser::constructAndDetachPdu(FlowDescriptorTcpRpc *flowDesc,
 			flowDesc->releasePktDescriptors(pduDesc->firstPktDesc, 
 				pduDesc->lastPktDesc, false);
 			pduDesc->lastPktDesc->refCount++;
+			PacketBufferPool::addReference(pduDesc->lastPktDesc,
+				PacketBufferPool::HOLDER_REASSEMBLY);
 		} else
 			flowDesc->releasePktDescriptors(pduDesc->firstPktDesc,
 				pduDesc->lastPktDesc, true);		
@@ -1133,12 +1123,10 @@ RpcParser::constructPdu(FlowDescriptorTcpRpc *flowDesc, PduDescriptor *pduDesc)
 		if (pduDesc->firstPktDesc->visitCount >= 
 				RPC_PARSER_COMPLETE_HDR_THRESH) {
 			pduDesc->rpcPduType = PduDescriptor::PDU_COMPLETE_HEADER;
-			#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
 			if (flowDesc->sourcePort == NFS_PORT)
-				_completeHdrPduReplyCount++;
+				completeHdrPduReplies++;
 			else
-				_completeHdrPduCallCount++;
-			#endif	
+				completeHdrPduCalls++;
 			pktDesc = _streamNavigator->getPacketDesc();
 			if (pktDesc == NULL)
 				pduDesc->lastPktDesc = flowDesc->tail;
@@ -1158,12 +1146,10 @@ RpcParser::constructPdu(FlowDescriptorTcpRpc *flowDesc, PduDescriptor *pduDesc)
 		return false;
 	}
 	pduDesc->rpcPduType = PduDescriptor::PDU_COMPLETE;
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
 	if (flowDesc->sourcePort == NFS_PORT)
-		_completePduReplyCount++;
+		completePduReplies++;
 	else
-		_completePduCallCount++;
-	#endif	
+		completePduCalls++;
 	pduDesc->lastPktDesc = _streamNavigator->getPacketDesc();
 	assert(pduDesc->lastPktDesc != NULL);
 	pduDesc->lastPktDesc->toParseOffset = _streamNavigator->getIndex();
@@ -1251,14 +1237,13 @@ RpcParser::passBadPdu(PduDescriptor *pduDesc)
 	#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL)
 	pduDesc->tagPduPkts(PROCESS_RPC_PARSER);
 	#endif
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-	_badPduCount++;
-	if (_badPduCount >= _badPduPrintLimit) {
-		printf("RpcParser::passBadPdu: goodPduCount:%lu badPduCount:%lu\n",
-			_goodPduCount, _badPduCount);
-		_badPduPrintLimit += 100000;
+	badPdus++;
+	if (Metrics::isVerbose(Metrics::VERBOSE_RPC)
+			&& badPdus.get() >= _badPduPrintLimit) {
+		printf("RpcParser::passBadPdu: goodPduCount:%ld badPduCount:%ld\n",
+			goodPdus.get(), badPdus.get());
+		_badPduPrintLimit = badPdus.get() + 100000;
 	}
-	#endif
 	_sink->processRequest(this, pduDesc);
 }
 
@@ -1599,12 +1584,10 @@ RpcParser::scanForRpcHeader(FlowDescriptorTcpRpc *flowDesc,
 				(*rpcHeadPktDesc)->toParseOffset = _streamNavigator->getIndex();
 
 				if (*rpcHeadPktDesc != flowDesc->head) {
-					#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
 					if (call)
-						_scannedRpcCallHdrs++;
+						scannedRpcCallHdrs++;
 					else
-						_scannedRpcReplyHdrs++;
-					#endif
+						scannedRpcReplyHdrs++;
 					// only when retransmissions are unlikely
 					// (i.e., forced reply parsing scenario)
 					/* // commented out as it significantly reduces the number
@@ -1799,12 +1782,10 @@ RpcParser::gcFlowTable(PacketDescriptor *pktDesc)
 							rpcReverseFlowDesc->sourcePort,
 							rpcReverseFlowDesc->destPort,
 							rpcReverseFlowDesc->protocol, bucketNum);
-						#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-						_goodPduCount += 
-							rpcReverseFlowDesc->_readyPdusListSize;
-						rpcReverseFlowDesc->printStats();
-						rpcFlowDesc->printStats();
-						#endif
+						if (Metrics::isVerbose(Metrics::VERBOSE_RPC)) {
+							rpcReverseFlowDesc->printStats();
+							rpcFlowDesc->printStats();
+						}
 						rpcReverseFlowDesc->passReadyPdus(_sink, this);
 						_flowTable->removeFlowDesc(_gcBucket, rpcFlowDesc);
 						_flowTable->removeFlowDesc(bucketNum, rpcReverseFlowDesc);
@@ -1833,21 +1814,3 @@ RpcParser::getNumFlowTableBucketsToGC(PacketDescriptor *pktDesc)
 	return std::min<unsigned>(interval/1000000, 50/*FLOW_TABLE_DEFAULT_SIZE/200*/); 
 }
 
-#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-void 
-RpcParser::getStats(uint64_t &goodPduCnt, uint64_t &badPduCnt,
-		uint64_t &completePduCallCnt, uint64_t &completePduReplyCnt,
-		uint64_t &completeHdrPduCallCnt, 
-		uint64_t &completeHdrPduReplyCnt,
-		uint64_t &unmatchedCallCnt, uint64_t &unmatchedReplyCnt) {
-	goodPduCnt = _goodPduCount;
-	badPduCnt = _badPduCount;
-	completePduCallCnt = _completePduCallCount;
-	completePduReplyCnt = _completePduReplyCount;
-	completeHdrPduCallCnt = _completeHdrPduCallCount;
-	completeHdrPduReplyCnt = _completeHdrPduReplyCount;
-	unmatchedCallCnt = _unmatchedCallCount;
-	unmatchedReplyCnt = _unmatchedReplyCount;
-}
-#endif
-
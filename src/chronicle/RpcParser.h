@@ -303,17 +303,6 @@ class RpcParser : public Process, public PacketDescReceiver,
 		 * returns the unique Process ID
 		 */
 		std::string getId() { return std::to_string(_pipelineId); }
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-		void getStats(uint64_t &goodPduCount, uint64_t &badPduCount,
-			uint64_t &completePduCallCount, 
-			uint64_t &comletePduReplyCount,
-			uint64_t &completeHdrPduCallCount,
-			uint64_t &completeHdrPduReplyCount,
-			uint64_t &unmatchedCallCount, 
-			uint64_t &unmatchedReplyCount);
-		void incrementUnmatchedCalls(uint64_t count) 
-			{ _unmatchedCallCount += count; }
-		#endif
 
 	private:
 		class MsgBase;
@@ -343,38 +332,10 @@ class RpcParser : public Process, public PacketDescReceiver,
 		uint64_t _gcTick;
 		/// flow table bucket to garbage collect
 		uint32_t _gcBucket;
-		#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-		/// The count of good PDUs
-		uint64_t _goodPduCount;
-		/// The count of bad PDUs
-		uint64_t _badPduCount;
-		/// The print count limit for good PDUs
-		uint64_t _goodPduPrintLimit;
-		/// The print count limit for bad PDUs
-		uint64_t _badPduPrintLimit;
-		/// The count of PDU_COMPLETE call PDUs
-		uint64_t _completePduCallCount;
-		/// The count of PDU_COMPLETE reply PDUs
-		uint64_t _completePduReplyCount;
-		/// The count of PDU_COMPLETE_HEADER call PDUs
-		uint64_t _completeHdrPduCallCount;
-		/// The count of PDU_COMPLETE_HEADER reply PDUs
-		uint64_t _completeHdrPduReplyCount;
-		/// The number of unmatched calls for this parser
-		uint64_t _unmatchedCallCount;
-		/// The minimum number of unmatched replies for this parser
-		uint64_t _unmatchedReplyCount;
-		/// The number of scanned RPC call headers
-		uint64_t _scannedRpcCallHdrs;
-		/// The number of scanned RPC reply headers
-		uint64_t _scannedRpcReplyHdrs;
-		/// The number of forced RPC reply scans 
-		// (when queueLen > RPC_PARSER_REPLY_PARSE_THRESH)
-		uint64_t _forcedRpcReplyScanCount;
-		/// The number of forced RPC reply scans 
-		// (when queueLen > RPC_PARSER_REPLY_PARSE_THRESH * 2)
-		uint64_t _forcedGcCount;
-		#endif
+		/// The next goodPduCount to print progress at (if verbose)
+		int64_t _goodPduPrintLimit;
+		/// The next badPduCount to print progress at (if verbose)
+		int64_t _badPduPrintLimit;
 };
 
 #endif //RPC_PARSER_H
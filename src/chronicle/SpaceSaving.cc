@@ -0,0 +1,223 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "MurmurHash3.h"
+#include "SpaceSaving.h"
+
+SpaceSaving::SpaceSaving(unsigned capacity)
+	: _total(0), _capacity(capacity)
+{
+	unsigned slots = 1;
+	// keep the load factor at or below 1/2
+	while (slots < capacity * 2)
+		slots <<= 1;
+	_slots.assign(slots, -1);
+	_entries.reserve(capacity);
+	_heap.reserve(capacity);
+	_heapPos.reserve(capacity);
+}
+
+static uint64_t
+hashKey(const void *key, unsigned keyLen)
+{
+	uint64_t md[2];
+	MurmurHash3_x64_128(key, keyLen, 0, md);
+	return md[0];
+}
+
+int32_t
+SpaceSaving::findSlot(const unsigned char *key, unsigned keyLen, 
+	uint64_t hash) const
+{
+	uint32_t mask = _slots.size() - 1;
+	uint32_t slot = hash & mask;
+	while (_slots[slot] >= 0) {
+		const Entry &e = _entries[_slots[slot]];
+		if (e.hash == hash && e.keyLen == keyLen 
+				&& memcmp(e.key, key, keyLen) == 0)
+			return slot;
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+void
+SpaceSaving::eraseSlot(uint32_t slot)
+{
+	// backward shift deletion keeps the probe sequences intact
+	uint32_t mask = _slots.size() - 1;
+	uint32_t next = slot;
+	while (true) {
+		next = (next + 1) & mask;
+		if (_slots[next] < 0)
+			break;
+		uint32_t home = _entries[_slots[next]].hash & mask;
+		bool inRange = slot <= next ? (slot < home && home <= next)
+			: (slot < home || home <= next);
+		if (inRange)
+			continue;
+		_slots[slot] = _slots[next];
+		slot = next;
+	}
+	_slots[slot] = -1;
+}
+
+void
+SpaceSaving::swapHeap(uint32_t a, uint32_t b)
+{
+	std::swap(_heap[a], _heap[b]);
+	_heapPos[_heap[a]] = a;
+	_heapPos[_heap[b]] = b;
+}
+
+void
+SpaceSaving::siftDown(uint32_t pos)
+{
+	uint32_t n = _heap.size();
+	while (true) {
+		uint32_t smallest = pos, l = 2 * pos + 1, r = l + 1;
+		if (l < n && _entries[_heap[l]].weight 
+				< _entries[_heap[smallest]].weight)
+			smallest = l;
+		if (r < n && _entries[_heap[r]].weight 
+				< _entries[_heap[smallest]].weight)
+			smallest = r;
+		if (smallest == pos)
+			return ;
+		swapHeap(pos, smallest);
+		pos = smallest;
+	}
+}
+
+void
+SpaceSaving::siftUp(uint32_t pos)
+{
+	while (pos > 0) {
+		uint32_t parent = (pos - 1) / 2;
+		if (_entries[_heap[parent]].weight <= _entries[_heap[pos]].weight)
+			return ;
+		swapHeap(pos, parent);
+		pos = parent;
+	}
+}
+
+void
+SpaceSaving::add(const void *key, unsigned keyLen, uint64_t weight)
+{
+	if (keyLen > MAX_KEY_LEN)
+		keyLen = MAX_KEY_LEN;
+	const unsigned char *bytes = static_cast<const unsigned char *>(key);
+	uint64_t hash = hashKey(bytes, keyLen);
+	int32_t slot = findSlot(bytes, keyLen, hash);
+	_total += weight;
+
+	if (_slots[slot] >= 0) {
+		uint32_t index = _slots[slot];
+		_entries[index].weight += weight;
+		siftDown(_heapPos[index]);
+		return ;
+	}
+
+	uint32_t index;
+	uint64_t error = 0;
+	if (_entries.size() < _capacity) {
+		index = _entries.size();
+		_entries.push_back(Entry());
+		_heapPos.push_back(_heap.size());
+		_heap.push_back(index);
+	} else {
+		// replace the lightest key
+		index = _heap[0];
+		Entry &min = _entries[index];
+		error = min.weight;
+		eraseSlot(findSlot(min.key, min.keyLen, min.hash));
+		slot = findSlot(bytes, keyLen, hash);
+	}
+	Entry &e = _entries[index];
+	e.weight = error + weight;
+	e.error = error;
+	e.hash = hash;
+	e.keyLen = keyLen;
+	memcpy(e.key, bytes, keyLen);
+	_slots[slot] = index;
+	if (error)
+		siftDown(_heapPos[index]);
+	else
+		siftUp(_heapPos[index]);
+}
+
+uint64_t
+SpaceSaving::getMinWeight() const
+{
+	if (_entries.size() < _capacity)
+		return 0;
+	return _entries[_heap[0]].weight;
+}
+
+void
+SpaceSaving::merge(const SpaceSaving &other)
+{
+	uint64_t myMin = getMinWeight(), otherMin = other.getMinWeight();
+	std::vector<Entry> merged(_entries);
+	// a key monitored by only one summary may have had up to the other's
+	// min weight there
+	for (unsigned i = 0; i < merged.size(); i++) {
+		if (other._slots[other.findSlot(merged[i].key, merged[i].keyLen,
+				merged[i].hash)] < 0) {
+			merged[i].weight += otherMin;
+			merged[i].error += otherMin;
+		}
+	}
+	for (unsigned i = 0; i < other._entries.size(); i++) {
+		const Entry &e = other._entries[i];
+		// merged starts out as a copy of _entries
+		int32_t index = _slots[findSlot(e.key, e.keyLen, e.hash)];
+		if (index >= 0) {
+			merged[index].weight += e.weight;
+			merged[index].error += e.error;
+		} else {
+			merged.push_back(e);
+			merged.back().weight += myMin;
+			merged.back().error += myMin;
+		}
+	}
+	// keep the heaviest _capacity keys
+	if (merged.size() > _capacity) {
+		std::nth_element(merged.begin(), merged.begin() + _capacity,
+			merged.end(), [](const Entry &a, const Entry &b) 
+				{ return a.weight > b.weight; });
+		merged.resize(_capacity);
+	}
+	uint64_t total = _total + other._total;
+	_entries.clear();
+	_heap.clear();
+	_heapPos.clear();
+	_slots.assign(_slots.size(), -1);
+	for (unsigned i = 0; i < merged.size(); i++) {
+		_slots[findSlot(merged[i].key, merged[i].keyLen, merged[i].hash)] = i;
+		_entries.push_back(merged[i]);
+		_heapPos.push_back(i);
+		_heap.push_back(i);
+	}
+	for (int32_t i = _heap.size() / 2 - 1; i >= 0; i--)
+		siftDown(i);
+	_total = total;
+}
+
+void
+SpaceSaving::getTop(unsigned k, std::vector<const Entry *> &top) const
+{
+	top.clear();
+	for (unsigned i = 0; i < _entries.size(); i++)
+		top.push_back(&_entries[i]);
+	if (k > top.size())
+		k = top.size();
+	std::partial_sort(top.begin(), top.begin() + k, top.end(), 
+		[](const Entry *a, const Entry *b) { return a->weight > b->weight; });
+	top.resize(k);
+}
@@ -0,0 +1,76 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef SPACE_SAVING_H
+#define SPACE_SAVING_H
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * A Space-Saving summary of the heaviest keys of a weighted stream, in a
+ * fixed amount of memory. It monitors up to capacity keys; a new key
+ * replaces the lightest monitored one and inherits its weight as error,
+ * so a reported weight overestimates the true weight by at most the
+ * entry's error. Any key heavier than total/capacity is monitored.
+ */
+class SpaceSaving {
+	public:
+		/// keys are up to this many bytes (an NFSv3 file handle)
+		static const unsigned MAX_KEY_LEN = 64;
+
+		struct Entry {
+			/// estimated weight (an upper bound)
+			uint64_t weight;
+			/// max overestimation of weight
+			uint64_t error;
+			uint64_t hash;
+			uint32_t keyLen;
+			unsigned char key[MAX_KEY_LEN];
+		};
+
+		/// @param[in] capacity The max number of monitored keys
+		SpaceSaving(unsigned capacity);
+		/**
+		 * adds weight to a key (keys longer than MAX_KEY_LEN are truncated)
+		 * Doesn't allocate.
+		 */
+		void add(const void *key, unsigned keyLen, uint64_t weight);
+		/// folds in another summary of the same capacity
+		void merge(const SpaceSaving &other);
+		/**
+		 * finds the heaviest keys
+		 * @param[in] k The max number of keys
+		 * @param[out] top The entries, heaviest first
+		 */
+		void getTop(unsigned k, std::vector<const Entry *> &top) const;
+		/// the total weight added (or merged) so far
+		uint64_t getTotal() const { return _total; }
+		unsigned size() const { return _entries.size(); }
+
+	private:
+		/// the weight a key that isn't monitored may have had
+		uint64_t getMinWeight() const;
+		int32_t findSlot(const unsigned char *key, unsigned keyLen, 
+			uint64_t hash) const;
+		void eraseSlot(uint32_t slot);
+		void siftDown(uint32_t pos);
+		void siftUp(uint32_t pos);
+		void swapHeap(uint32_t a, uint32_t b);
+
+		/// monitored keys (at most _capacity, reserved up front)
+		std::vector<Entry> _entries;
+		/// min-heap of indexes into _entries by weight
+		std::vector<uint32_t> _heap;
+		/// the heap position of each entry
+		std::vector<uint32_t> _heapPos;
+		/// linear probing slots holding indexes into _entries (-1 if empty)
+		std::vector<int32_t> _slots;
+		uint64_t _total;
+		unsigned _capacity;
+};
+
+#endif //SPACE_SAVING_H
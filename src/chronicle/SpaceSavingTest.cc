@@ -0,0 +1,82 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include "gtest/gtest.h"
+#include "SpaceSaving.h"
+
+static const unsigned CAPACITY = 64;
+
+/// a skewed stream: key i has weight ~1/i, plus a long tail of singletons
+static void
+addStream(SpaceSaving &summary, std::map<uint32_t, uint64_t> &exact,
+	unsigned seed)
+{
+	srand(seed);
+	for (unsigned n = 0; n < 200000; n++) {
+		uint32_t key = rand() % 2 ? 1 + rand() % 16 : 1000 + rand() % 100000;
+		summary.add(&key, sizeof(key), 3);
+		exact[key] += 3;
+	}
+}
+
+static void
+checkTop(const SpaceSaving &summary, std::map<uint32_t, uint64_t> &exact)
+{
+	std::vector<const SpaceSaving::Entry *> top;
+	summary.getTop(16, top);
+	ASSERT_EQ(16u, top.size());
+	for (unsigned i = 0; i < top.size(); i++) {
+		uint32_t key;
+		memcpy(&key, top[i]->key, sizeof(key));
+		// the 16 heavy keys come out first and are never underestimated
+		EXPECT_GE(16u, key);
+		EXPECT_LE(exact[key], top[i]->weight);
+		EXPECT_GE(exact[key], top[i]->weight - top[i]->error);
+		if (i > 0) {
+			EXPECT_GE(top[i - 1]->weight, top[i]->weight);
+		}
+	}
+}
+
+TEST(SpaceSaving, FindsHeavyHitters) {
+	SpaceSaving summary(CAPACITY);
+	std::map<uint32_t, uint64_t> exact;
+	addStream(summary, exact, 1);
+	EXPECT_EQ(CAPACITY, summary.size());
+	EXPECT_EQ(600000u, summary.getTotal());
+	checkTop(summary, exact);
+}
+
+TEST(SpaceSaving, ExactWhileNotFull) {
+	SpaceSaving summary(CAPACITY);
+	for (uint32_t key = 0; key < 10; key++)
+		for (uint32_t n = 0; n <= key; n++)
+			summary.add(&key, sizeof(key), 1);
+	std::vector<const SpaceSaving::Entry *> top;
+	summary.getTop(100, top);
+	ASSERT_EQ(10u, top.size());
+	for (unsigned i = 0; i < top.size(); i++) {
+		EXPECT_EQ(10u - i, top[i]->weight);
+		EXPECT_EQ(0u, top[i]->error);
+	}
+}
+
+TEST(SpaceSaving, Merge) {
+	SpaceSaving a(CAPACITY), b(CAPACITY);
+	std::map<uint32_t, uint64_t> exact;
+	addStream(a, exact, 1);
+	addStream(b, exact, 2);
+	a.merge(b);
+	EXPECT_EQ(CAPACITY, a.size());
+	EXPECT_EQ(1200000u, a.getTotal());
+	checkTop(a, exact);
+	// the merged summary still takes updates
+	addStream(a, exact, 3);
+	checkTop(a, exact);
+}
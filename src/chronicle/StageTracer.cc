@@ -0,0 +1,176 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "StageTracer.h"
+#include <ctime>
+#include <cstdio>
+
+unsigned StageTracer::_sampleRate = 0;
+__thread unsigned StageTracer::_countdown = 0;
+StageTracer::Sample StageTracer::_samples[TRACE_MAX_SAMPLES];
+std::atomic<unsigned> StageTracer::_nextSample(0);
+double StageTracer::_nsPerTick = 1.0;
+uint64_t StageTracer::_startTsc = 0;
+TtasLock StageTracer::_lock;
+LatencyHistogram StageTracer::_residency[StageTracer::NUM_STAGES];
+LatencyHistogram StageTracer::_total;
+uint64_t StageTracer::_missedSamples = 0;
+uint64_t StageTracer::_completed[TRACE_DUMP_SAMPLES][StageTracer::NUM_STAGES];
+uint64_t StageTracer::_numCompleted = 0;
+
+static const char *stageNames[StageTracer::NUM_STAGES] = {
+	"reader", "netparser", "rpcparser", "nfsparser", "anonymize", "checksum",
+	"output", "analytics", "release"
+};
+
+static uint64_t
+monotonicNs()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000llu + ts.tv_nsec;
+}
+
+void
+StageTracer::init(unsigned sampleRate)
+{
+	// calibrate the TSC against the monotonic clock
+	timespec nap = { 0, 20000000 };
+	uint64_t startNs = monotonicNs(), startTsc = __rdtsc();
+	nanosleep(&nap, NULL);
+	uint64_t endNs = monotonicNs(), endTsc = __rdtsc();
+	if (endTsc > startTsc)
+		_nsPerTick = static_cast<double>(endNs - startNs)
+			/ (endTsc - startTsc);
+	_startTsc = endTsc;
+	_sampleRate = sampleRate;
+	_countdown = 0;
+}
+
+const char *
+StageTracer::getStageName(unsigned stage)
+{
+	return stage < NUM_STAGES ? stageNames[stage] : "unknown";
+}
+
+uint16_t
+StageTracer::startSample()
+{
+	unsigned index = _nextSample.fetch_add(1) % TRACE_MAX_SAMPLES;
+	Sample *s = &_samples[index];
+	if (s->inUse.exchange(true)) {
+		// a packet sampled TRACE_MAX_SAMPLES samples ago is still in flight
+		_lock.lock();
+		_missedSamples++;
+		_lock.unlock();
+		return 0;
+	}
+	for (unsigned i = 1; i < NUM_STAGES; i++)
+		s->tsc[i] = 0;
+	s->tsc[STAGE_READER] = __rdtsc();
+	return index + 1;
+}
+
+void
+StageTracer::completeSample(uint16_t traceId)
+{
+	Sample *s = &_samples[traceId - 1];
+	s->tsc[STAGE_RELEASE] = __rdtsc();
+
+	_lock.lock();
+	// a stage lasts until the packet is stamped by any later stage
+	unsigned stage = STAGE_READER;
+	for (unsigned next = stage + 1; next < NUM_STAGES; next++) {
+		if (s->tsc[next] == 0)
+			continue;
+		if (s->tsc[next] >= s->tsc[stage])
+			_residency[stage].record(tscToNs(s->tsc[next] - s->tsc[stage]));
+		stage = next;
+	}
+	_total.record(tscToNs(s->tsc[STAGE_RELEASE] - s->tsc[STAGE_READER]));
+	uint64_t *c = _completed[_numCompleted++ % TRACE_DUMP_SAMPLES];
+	for (unsigned i = 0; i < NUM_STAGES; i++)
+		c[i] = s->tsc[i];
+	_lock.unlock();
+
+	s->inUse = false;
+}
+
+static void
+addHistogramStats(std::map<std::string, int64_t> &stats,
+	const std::string &objbase, const LatencyHistogram &h)
+{
+	stats[objbase + ".count"] = h.getCount();
+	if (h.getCount() == 0)
+		return;
+	stats[objbase + ".mean"] = h.getMean();
+	stats[objbase + ".p50"] = h.getQuantile(0.5);
+	stats[objbase + ".p99"] = h.getQuantile(0.99);
+	stats[objbase + ".max"] = h.getMax();
+}
+
+void
+StageTracer::getStats(std::map<std::string, int64_t> &stats)
+{
+	if (!isEnabled())
+		return;
+	LatencyHistogram *residency = new LatencyHistogram[NUM_STAGES];
+	LatencyHistogram *total = new LatencyHistogram;
+	uint64_t missed;
+	_lock.lock();
+	for (unsigned i = 0; i < NUM_STAGES; i++) {
+		residency[i].merge(_residency[i]);
+		_residency[i].reset();
+	}
+	total->merge(_total);
+	_total.reset();
+	missed = _missedSamples;
+	_lock.unlock();
+
+	std::string objbase("trace.stage.");
+	// the release stage has no residency; the packet is already free
+	for (unsigned i = 0; i < STAGE_RELEASE; i++)
+		addHistogramStats(stats, objbase + stageNames[i], residency[i]);
+	addHistogramStats(stats, "trace.total", *total);
+	stats["trace.missed"] = missed;
+	delete [] residency;
+	delete total;
+}
+
+bool
+StageTracer::dumpChromeTrace(const std::string &fileName)
+{
+	FILE *file = fopen(fileName.c_str(), "w");
+	if (file == NULL)
+		return false;
+	_lock.lock();
+	uint64_t first = _numCompleted > TRACE_DUMP_SAMPLES ?
+		_numCompleted - TRACE_DUMP_SAMPLES : 0;
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	bool firstEvent = true;
+	for (uint64_t n = first; n < _numCompleted; n++) {
+		const uint64_t *c = _completed[n % TRACE_DUMP_SAMPLES];
+		unsigned stage = STAGE_READER;
+		for (unsigned next = stage + 1; next < NUM_STAGES; next++) {
+			if (c[next] == 0)
+				continue;
+			if (c[next] >= c[stage] && c[stage] >= _startTsc) {
+				// Chrome trace timestamps are in microseconds
+				fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"chronicle\","
+					"\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,"
+					"\"dur\":%.3f}", firstEvent ? "" : ",\n",
+					stageNames[stage], n,
+					tscToNs(c[stage] - _startTsc) / 1000.0,
+					tscToNs(c[next] - c[stage]) / 1000.0);
+				firstEvent = false;
+			}
+			stage = next;
+		}
+	}
+	_lock.unlock();
+	fprintf(file, "\n]}\n");
+	return fclose(file) == 0;
+}
@@ -0,0 +1,142 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef STAGE_TRACER_H
+#define STAGE_TRACER_H
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <x86intrin.h>
+#include "ChronicleProcessRequest.h"
+#include "LatencyHistogram.h"
+#include "Lock.h"
+
+/**
+ * Samples 1 in every traceSampleRate packets and stamps them with the TSC as
+ * they enter each pipeline stage. When a sampled packet goes back to the
+ * buffer pool, the time it spent in every stage it visited (i.e., until the
+ * next stamp) is added to a per-stage histogram that the StatGatherer
+ * publishes. The last completed samples can also be dumped in the Chrome
+ * trace event format (viewable in chrome://tracing or Perfetto).
+ *
+ * Unsampled packets carry a traceId of 0, so a disabled or missed stamp costs
+ * a single predictable branch.
+ */
+class StageTracer {
+	public:
+		/// the pipeline stages, in the order a packet goes through them
+		typedef enum {
+			STAGE_READER = 0,		// buffer handed to the packet reader
+			STAGE_NET_PARSER,		// NetworkHeaderParser
+			STAGE_RPC_PARSER,		// RpcParser (incl. TCP reassembly)
+			STAGE_NFS_PARSER,		// NfsParser
+			STAGE_ANONYMIZE,		// AnonymizeModule
+			STAGE_CHECKSUM,			// ChecksumModule (incl. the workers)
+			STAGE_OUTPUT,			// DsWriter, PcapWriter, PcapPduWriter
+			STAGE_ANALYTICS,		// AnalyticsShard
+			STAGE_RELEASE,			// back in the buffer pool
+			NUM_STAGES
+		} Stage;
+
+		/**
+		 * enables tracing
+		 * @param[in] sampleRate One in sampleRate packets is traced (0
+		 * disables tracing)
+		 */
+		static void init(unsigned sampleRate);
+		static bool isEnabled() { return _sampleRate != 0; }
+		static const char *getStageName(unsigned stage);
+
+		/**
+		 * decides whether a packet fresh out of the buffer pool is traced
+		 * @returns the trace id for the packet (0 if not traced)
+		 */
+		static inline uint16_t sample() {
+			if (__builtin_expect(_sampleRate == 0, 1) || _countdown-- > 1)
+				return 0;
+			_countdown = _sampleRate;
+			return startSample();
+		}
+		/// stamps a traced packet as it enters a stage
+		static inline void stamp(PacketDescriptor *pktDesc, Stage stage) {
+			if (__builtin_expect(pktDesc->traceId != 0, 0))
+				_samples[pktDesc->traceId - 1].tsc[stage] = __rdtsc();
+		}
+		/// stamps the traced packets in a list
+		static inline void stampList(PacketDescriptor *pktDesc, Stage stage) {
+			if (__builtin_expect(_sampleRate == 0, 1))
+				return;
+			for (; pktDesc != NULL; pktDesc = pktDesc->next)
+				stamp(pktDesc, stage);
+		}
+		/**
+		 * stamps the traced packets of the PDUs in a chain (all of them,
+		 * from firstPktDesc to lastPktDesc, as any of them may be sampled)
+		 */
+		static inline void stamp(PduDescriptor *pduDesc, Stage stage) {
+			if (__builtin_expect(_sampleRate == 0, 1))
+				return;
+			for (; pduDesc != NULL; pduDesc = pduDesc->next) {
+				for (PacketDescriptor *pktDesc = pduDesc->firstPktDesc;
+						pktDesc != NULL; pktDesc = pktDesc->next) {
+					stamp(pktDesc, stage);
+					if (pktDesc == pduDesc->lastPktDesc)
+						break;
+				}
+			}
+		}
+		/// records the stage residencies of a packet going back to the pool
+		static inline void complete(PacketDescriptor *pktDesc) {
+			if (__builtin_expect(pktDesc->traceId != 0, 0)) {
+				completeSample(pktDesc->traceId);
+				pktDesc->traceId = 0;
+			}
+		}
+
+		/**
+		 * adds the per-stage residencies (in ns) of the samples completed
+		 * since the last call and starts a new interval
+		 */
+		static void getStats(std::map<std::string, int64_t> &stats);
+		/**
+		 * writes the last TRACE_DUMP_SAMPLES completed samples as Chrome
+		 * trace events (one row per packet, one slice per stage)
+		 * @returns false if the file couldn't be written
+		 */
+		static bool dumpChromeTrace(const std::string &fileName);
+
+	private:
+		struct Sample {
+			/// TSC when the packet entered each stage (0 if it didn't)
+			uint64_t tsc[NUM_STAGES];
+			std::atomic<bool> inUse;
+		} __attribute__ ((aligned (64)));
+
+		static uint16_t startSample();
+		static void completeSample(uint16_t traceId);
+		static uint64_t tscToNs(uint64_t ticks)
+			{ return static_cast<uint64_t>(ticks * _nsPerTick); }
+
+		static unsigned _sampleRate;
+		/// packets left until the reader thread samples the next one
+		static __thread unsigned _countdown;
+		static Sample _samples[TRACE_MAX_SAMPLES];
+		static std::atomic<unsigned> _nextSample;
+		static double _nsPerTick;
+		static uint64_t _startTsc;
+
+		/// protects everything below (taken once per completed sample)
+		static TtasLock _lock;
+		static LatencyHistogram _residency[NUM_STAGES];
+		static LatencyHistogram _total;
+		static uint64_t _missedSamples;
+		/// the last completed samples (for dumpChromeTrace)
+		static uint64_t _completed[TRACE_DUMP_SAMPLES][NUM_STAGES];
+		static uint64_t _numCompleted;
+};
+
+#endif //STAGE_TRACER_H
@@ -0,0 +1,128 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "gtest/gtest.h"
+#include "StageTracer.h"
+
+static void
+tracePacket(PacketDescriptor *pktDesc)
+{
+	StageTracer::stamp(pktDesc, StageTracer::STAGE_NET_PARSER);
+	StageTracer::stamp(pktDesc, StageTracer::STAGE_RPC_PARSER);
+	StageTracer::stamp(pktDesc, StageTracer::STAGE_OUTPUT);
+	StageTracer::complete(pktDesc);
+}
+
+TEST(StageTracer, DisabledTracesNothing) {
+	StageTracer::init(0);
+	PacketDescriptor pktDesc;
+	for (unsigned i = 0; i < 100; i++)
+		EXPECT_EQ(0u, StageTracer::sample());
+	tracePacket(&pktDesc);
+	std::map<std::string, int64_t> stats;
+	StageTracer::getStats(stats);
+	EXPECT_TRUE(stats.empty());
+}
+
+TEST(StageTracer, SamplesOneInN) {
+	StageTracer::init(4);
+	std::map<std::string, int64_t> stats;
+	StageTracer::getStats(stats); // drain earlier tests
+	PacketDescriptor pktDesc;
+	unsigned sampled = 0;
+	for (unsigned i = 0; i < 8; i++) {
+		pktDesc.traceId = StageTracer::sample();
+		if (pktDesc.traceId)
+			sampled++;
+		tracePacket(&pktDesc);
+		EXPECT_EQ(0u, pktDesc.traceId);
+	}
+	EXPECT_EQ(2u, sampled);
+	stats.clear();
+	StageTracer::getStats(stats);
+	EXPECT_EQ(2, stats["trace.total.count"]);
+	EXPECT_EQ(2, stats["trace.stage.reader.count"]);
+	EXPECT_EQ(2, stats["trace.stage.rpcparser.count"]);
+	// stages a packet skips have no residency
+	EXPECT_EQ(0, stats["trace.stage.nfsparser.count"]);
+	EXPECT_EQ(0, stats["trace.missed"]);
+	// stats cover a single interval
+	stats.clear();
+	StageTracer::getStats(stats);
+	EXPECT_EQ(0, stats["trace.total.count"]);
+}
+
+TEST(StageTracer, ResidencyLastsUntilNextStamp) {
+	StageTracer::init(1);
+	std::map<std::string, int64_t> stats;
+	StageTracer::getStats(stats);
+	PacketDescriptor pktDesc;
+	pktDesc.traceId = StageTracer::sample();
+	ASSERT_NE(0u, pktDesc.traceId);
+	StageTracer::stamp(&pktDesc, StageTracer::STAGE_NET_PARSER);
+	timespec nap = { 0, 2000000 };
+	nanosleep(&nap, NULL);
+	StageTracer::stamp(&pktDesc, StageTracer::STAGE_OUTPUT);
+	StageTracer::complete(&pktDesc);
+	stats.clear();
+	StageTracer::getStats(stats);
+	EXPECT_GE(stats["trace.stage.netparser.max"], 1900000);
+	EXPECT_LT(stats["trace.stage.output.max"], 1900000);
+	EXPECT_GE(stats["trace.total.max"], stats["trace.stage.netparser.max"]);
+}
+
+TEST(StageTracer, ChromeTraceDump) {
+	StageTracer::init(1);
+	PacketDescriptor pktDesc;
+	pktDesc.traceId = StageTracer::sample();
+	tracePacket(&pktDesc);
+	char fileName[] = "/tmp/stagetracerXXXXXX";
+	int fd = mkstemp(fileName);
+	ASSERT_GE(fd, 0);
+	close(fd);
+	ASSERT_TRUE(StageTracer::dumpChromeTrace(fileName));
+	std::ifstream in(fileName);
+	std::stringstream json;
+	json << in.rdbuf();
+	unlink(fileName);
+	EXPECT_EQ(0u, json.str().find("{\"displayTimeUnit\":\"ns\",\"traceEvents\""));
+	EXPECT_NE(std::string::npos, json.str().find("\"name\":\"rpcparser\""));
+	EXPECT_NE(std::string::npos, json.str().find("\"ph\":\"X\""));
+	EXPECT_EQ(json.str().size() - 3, json.str().rfind("]}"));
+}
+
+TEST(StageTracer, PduStampsReachEveryPacket) {
+	StageTracer::init(1);
+	std::map<std::string, int64_t> stats;
+	StageTracer::getStats(stats);
+	// a 4-packet PDU; only the third packet (a payload packet) is sampled
+	PacketDescriptor pktDesc[4];
+	for (unsigned i = 0; i < 4; i++)
+		pktDesc[i].next = i < 3 ? &pktDesc[i + 1] : NULL;
+	pktDesc[2].traceId = StageTracer::sample();
+	ASSERT_NE(0u, pktDesc[2].traceId);
+	BadPduDescriptor pduDesc(&pktDesc[0], &pktDesc[3]);
+	for (unsigned i = 0; i < 4; i++)
+		StageTracer::stamp(&pktDesc[i], StageTracer::STAGE_RPC_PARSER);
+	StageTracer::stamp(&pduDesc, StageTracer::STAGE_NFS_PARSER);
+	timespec nap = { 0, 2000000 };
+	nanosleep(&nap, NULL);
+	StageTracer::stamp(&pduDesc, StageTracer::STAGE_OUTPUT);
+	for (unsigned i = 0; i < 4; i++)
+		StageTracer::complete(&pktDesc[i]);
+	stats.clear();
+	StageTracer::getStats(stats);
+	EXPECT_EQ(1, stats["trace.total.count"]);
+	// the time between the PDU stamps goes to the PDU stage ...
+	EXPECT_EQ(1, stats["trace.stage.nfsparser.count"]);
+	EXPECT_GE(stats["trace.stage.nfsparser.max"], 1900000);
+	EXPECT_EQ(1, stats["trace.stage.output.count"]);
+	// ... not to the last stage that stamped the packet itself
+	EXPECT_LT(stats["trace.stage.rpcparser.max"], 1900000);
+}
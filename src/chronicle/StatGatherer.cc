@@ -14,18 +14,25 @@
 #include "PcapPduWriter.h"
 #include "DsWriter.h"
 #include "ChecksumModule.h"
+#include "AnonymizeModule.h"
+#include "ChecksumWorker.h"
 #include "NetworkHeaderParser.h"
 #include "PacketReader.h"
 #include "AnalyticsModule.h"
 #include "PcapPacketBufferPool.h"
+#include "StageTracer.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
 #include <ctime>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <iostream>
 
-#if CHRON_DEBUG(CHRONICLE_DEBUG_BUFPOOL | CHRONICLE_DEBUG_STAT) 
 static uint64_t cnt, avgAllocdBufsStandard, avgAllocdBufsJumbo;
-#endif
+static MetricCounter carbonStatsSent("carbon.sent");
+static MetricCounter carbonStatsDropped("carbon.dropped");
 
 class StatGatherer::MessageBase : public Message {
 protected:
@@ -41,16 +48,15 @@ StatGatherer::StatGatherer(StatListener *statTarget,
 	_netmapCheckNeeded(true)
 {
 	_bufPool = PcapPacketBufferPool::registerBufferPool();
-	_startTick = _lastTick = timestamp();
+	_startTick = _lastTick = _lastChecksumTick = timestamp();
 }
 
 StatGatherer::~StatGatherer()
 {
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-	printf("StatGatherer::~StatGatherer: avgAllocdBufsStandard:%lu "
-		"avgAllocdBufsJumbo:%lu\n", 
-		avgAllocdBufsStandard, avgAllocdBufsJumbo);
-	#endif
+	if (Metrics::isVerbose(Metrics::VERBOSE_BUFPOOL))
+		printf("StatGatherer::~StatGatherer: avgAllocdBufsStandard:%lu "
+			"avgAllocdBufsJumbo:%lu\n", 
+			avgAllocdBufsStandard, avgAllocdBufsJumbo);
 	if (_bufPool && _bufPool->unregisterBufferPool()) 
 		delete _bufPool;	
 }
@@ -108,11 +114,15 @@ StatGatherer::doTick()
         // go get some stats
         getInterfaceStats();
         getProcessStats();
+        getSchedulerStats();
         getMachineStats();
         getOpCounts();
 		getBufPoolStats();
-		getRpcParserStats();
+		getMetricsStats();
 		getAnalyticsModulesStats();
+        getChecksumWorkerStats();
+        getStageTracerStats();
+        flushStats();
     }
 }
 
@@ -224,6 +234,7 @@ StatGatherer::doReceiveInterfaceList(const std::list<Interface *> &il)
     }
 	if (_netmapCheckNeeded && curTime > _startTick + 30*1000000000llu)
 		_netmapCheckNeeded = false;
+    flushStats();
 }
 
 uint64_t
@@ -276,6 +287,56 @@ StatGatherer::writeProcessStats(uint64_t timestamp, Process *p)
 			   p->getId() +
                ".backlog",
                p->pendingMessages());
+
+    // message service times (in ns) and mailbox contention since the
+    // last tick
+    Process::Profile profile;
+    p->getProfile(profile);
+    objbase += p->processName() + "." + p->getId();
+    writeStats(timestamp, objbase + ".backlog.max", profile.maxPending);
+    writeStats(timestamp, objbase + ".lockwait", profile.lockWaitNs);
+    writeStats(timestamp, objbase + ".service.count", profile.service.count);
+    if (profile.service.count) {
+        writeStats(timestamp, objbase + ".service.mean",
+                   profile.service.sumNs / profile.service.count);
+        writeStats(timestamp, objbase + ".service.p50",
+                   profile.service.quantile(0.5));
+        writeStats(timestamp, objbase + ".service.p99",
+                   profile.service.quantile(0.99));
+        writeStats(timestamp, objbase + ".service.max",
+                   profile.service.maxNs);
+    }
+}
+
+void
+StatGatherer::getSchedulerStats()
+{
+    uint64_t now = timestamp();
+    const std::vector<Scheduler *> &schedulers = Scheduler::getSchedulers();
+    for (std::vector<Scheduler *>::const_iterator it = schedulers.begin();
+         it != schedulers.end(); ++it) {
+        Scheduler::Stats cur, &last = _schedulers[*it];
+        (*it)->getStats(cur);
+        uint64_t busy = cur.busyNs - last.busyNs;
+        uint64_t steal = cur.stealNs - last.stealNs;
+        uint64_t sleep = cur.sleepNs - last.sleepNs;
+        uint64_t idle = cur.idleNs - last.idleNs;
+        uint64_t total = busy + steal + sleep + idle;
+        std::string objbase("scheduler." + std::to_string((*it)->getId()));
+        // percentages of the time since the last tick
+        if (total) {
+            writeStats(now, objbase + ".busy", busy * 100 / total);
+            writeStats(now, objbase + ".steal", steal * 100 / total);
+            writeStats(now, objbase + ".sleep", sleep * 100 / total);
+            writeStats(now, objbase + ".idle", idle * 100 / total);
+        }
+        writeStats(now, objbase + ".local", cur.local - last.local);
+        writeStats(now, objbase + ".steals", cur.steals - last.steals);
+        writeStats(now, objbase + ".msgs", cur.msgs - last.msgs);
+        writeStats(now, objbase + ".lockwait",
+                   cur.runQueueLockWaitNs - last.runQueueLockWaitNs);
+        last = cur;
+    }
 }
 
 class StatGatherer::MessageAddPipeline: public MessageBase {
@@ -298,11 +359,10 @@ StatGatherer::doAddPipeline(PipelineMembers *p)
 {
     _pipelines.push_back(p);
     doAddProcess(p->rpcParser);
-	if (p->rpcParser)
-		_rpcParsers.push_back(p->rpcParser);
     doAddProcess(p->nfsParser);
 	if (p->nfsParser && !p->nfsParser->getId().compare("0"))
 		_nfsParser = p->nfsParser;
+    doAddProcess(p->anonymizeModule);
     doAddProcess(p->checksumModule);
 }
 
@@ -333,6 +393,65 @@ StatGatherer::doAddOutputModules(
 		doAddProcess(*it);
 }
 
+class StatGatherer::MessageAddChecksumWorkers: public MessageBase {
+protected:
+    std::list<ChecksumWorker *> _workers;
+public:
+    MessageAddChecksumWorkers(StatGatherer *self,
+                              const std::list<ChecksumWorker *> &workers) :
+        MessageBase(self), _workers(workers) { }
+    void run() { _self->doAddChecksumWorkers(_workers); }
+};
+
+void
+StatGatherer::addChecksumWorkers(const std::list<ChecksumWorker *> &workers)
+{
+    enqueueMessage(new MessageAddChecksumWorkers(this, workers));
+}
+
+void
+StatGatherer::doAddChecksumWorkers(const std::list<ChecksumWorker *> &workers)
+{
+    for (std::list<ChecksumWorker *>::const_iterator it = workers.begin();
+         it != workers.end(); ++it) {
+        doAddProcess(*it);
+        _checksumWorkers[*it] = 0;
+    }
+}
+
+void
+StatGatherer::getChecksumWorkerStats()
+{
+    uint64_t now = timestamp();
+    uint64_t interval = now - _lastChecksumTick;
+    _lastChecksumTick = now;
+    for (std::map<ChecksumWorker *, uint64_t>::iterator it =
+             _checksumWorkers.begin(); it != _checksumWorkers.end(); ++it) {
+        uint64_t busyNs, pdus, bytes;
+        it->first->getStats(busyNs, pdus, bytes);
+        std::string objbase("checksum.worker." + it->first->getId());
+        // percentage of the last interval spent hashing
+        writeStats(now, objbase + ".utilization",
+                   interval ? (busyNs - it->second) * 100 / interval : 0);
+        writeStats(now, objbase + ".pdus", pdus);
+        writeStats(now, objbase + ".bytes", bytes);
+        it->second = busyNs;
+    }
+}
+
+void
+StatGatherer::getStageTracerStats()
+{
+    // per-stage residency (in ns) of the packets traced since the last tick
+    std::map<std::string, int64_t> stats;
+    StageTracer::getStats(stats);
+    uint64_t now = timestamp();
+    for (std::map<std::string, int64_t>::const_iterator it = stats.begin();
+         it != stats.end(); ++it) {
+        writeStats(now, it->first, it->second);
+    }
+}
+
 void
 StatGatherer::writeStats(uint64_t nsSinceEpoch,
                          const std::string &objectPath,
@@ -343,6 +462,14 @@ StatGatherer::writeStats(uint64_t nsSinceEpoch,
     }
 }
 
+void
+StatGatherer::flushStats()
+{
+    if (_statListener) {
+        _statListener->flushStats();
+    }
+}
+
 void
 StatGatherer::getMachineStats()
 {
@@ -353,7 +480,7 @@ StatGatherer::getMachineStats()
 void
 StatGatherer::getBufPoolStats()
 {
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
+	// the allocated and nobuf counts are published with the other metrics
 	uint64_t allocatedBufsStandard, maxAllocdBufsStandard, 
 		timesNoFreeBufsStandard, allocatedBufsJumbo, 
 		maxAllocatedBufsJumbo, timesNoFreeBufsJumbo, now;
@@ -367,55 +494,21 @@ StatGatherer::getBufPoolStats()
 	avgAllocdBufsJumbo = 
 		(avgAllocdBufsJumbo * (cnt - 1) + allocatedBufsJumbo)/cnt;
 	std::string objbase("bufpool.");
-	writeStats(now, objbase + "standard.allocated", allocatedBufsStandard);
 	writeStats(now, objbase + "standard.avg", avgAllocdBufsStandard);
 	writeStats(now, objbase + "standard.max", maxAllocdBufsStandard);
-	writeStats(now, objbase + "standard.nobuf", timesNoFreeBufsStandard);
-	writeStats(now, objbase + "jumbo.allocated", allocatedBufsJumbo);
 	writeStats(now, objbase + "jumbo.avg", avgAllocdBufsJumbo);
 	writeStats(now, objbase + "jumbo.max", maxAllocatedBufsJumbo);
-	writeStats(now, objbase + "jumbo.nobuf", timesNoFreeBufsJumbo);
-	#endif
 }
 
 void
-StatGatherer::getRpcParserStats()
+StatGatherer::getMetricsStats()
 {
-	#if CHRON_DEBUG(CHRONICLE_DEBUG_STAT)
-	unsigned long goodPduCnt, badPduCnt, 
-		unmatchedCallCnt, unmatchedReplyCnt,
-		completePduCallCnt, completePduReplyCnt, 
-		completeHdrPduCallCnt, completeHdrPduReplyCnt,
-		goodPduCntSum = 0, badPduCntSum = 0, 
-		unmatchedCallCntSum = 0, unmatchedReplyCntSum = 0,
-		completePduCallCntSum = 0, completePduReplyCntSum = 0,
-		completeHdrPduCallCntSum = 0, completeHdrPduReplyCntSum = 0;
+	std::map<std::string, int64_t> stats;
+	Metrics::getStats(stats);
 	uint64_t now = timestamp();
-	for (std::list<RpcParser *>::const_iterator i = _rpcParsers.begin();
-			i != _rpcParsers.end(); i++) {
-		(*i)->getStats(goodPduCnt, badPduCnt,
-			completePduCallCnt, completePduReplyCnt,
-			completeHdrPduCallCnt, completeHdrPduReplyCnt,
-			unmatchedCallCnt, unmatchedReplyCnt);
-		goodPduCntSum += goodPduCnt;
-		badPduCntSum += badPduCnt;
-		completePduCallCntSum += completePduCallCnt;
-		completePduReplyCntSum += completePduReplyCnt;
-		completeHdrPduCallCntSum += completeHdrPduCallCnt;
-		completeHdrPduReplyCntSum += completeHdrPduReplyCnt;
-		unmatchedCallCntSum += unmatchedCallCnt;
-		unmatchedReplyCntSum += unmatchedReplyCnt;
-	}
-	std::string objbase("pdu.");
-	writeStats(now, objbase + "good", goodPduCntSum);
-	writeStats(now, objbase + "bad", badPduCntSum);
-	writeStats(now, objbase + "complete.call", completePduCallCntSum);
-	writeStats(now, objbase + "complete.reply", completePduReplyCntSum);
-	writeStats(now, objbase + "completehdr.call", completeHdrPduCallCntSum);
-	writeStats(now, objbase + "completehdr.reply", completeHdrPduReplyCntSum);
-	writeStats(now, objbase + "unmatchedcall", unmatchedCallCntSum);
-	writeStats(now, objbase + "unmatchedreply", unmatchedReplyCntSum);
-	#endif
+	for (std::map<std::string, int64_t>::const_iterator it = stats.begin();
+			it != stats.end(); ++it)
+		writeStats(now, it->first, it->second);
 }
 
 void
@@ -450,11 +543,12 @@ StatGatherer::doHandleAnalyticsModulesStats(uint64_t timestamp,
 	std::map<std::string,int64_t> stats)
 {
 	--_awaitingReplies;
-	std::string objbase("process.");
+	// process backlogs ("process.") and module results ("analytics.")
 	for (std::map<std::string,int64_t>::iterator it = stats.begin();
 			it != stats.end(); it++) {
-		writeStats(timestamp, objbase + it->first, it->second);
+		writeStats(timestamp, it->first, it->second);
 	}
+	flushStats();
 }
 
 void
@@ -565,7 +659,7 @@ StatGatherer::getOpCounts()
 
 
 CarbonSocket::CarbonSocket(StatListener *next) :
-    _socket(-1), _lastTry(0), _next(next)
+    _socket(-1), _lastTry(0), _next(next), _batchStats(0)
 {
     doConnect();
     if (_socket == -1) {
@@ -597,16 +691,58 @@ CarbonSocket::writeStats(uint64_t nsSinceEpoch,
         }
     }
 
-    std::ostringstream ss;
     // This is the format for Carbon (timestamp in sec)
-    ss << objectPath << " " << value << " "
-       << nsSinceEpoch/1000000000 << std::endl;
-    const char *buf = ss.str().c_str();
+    char line[64];
+    snprintf(line, sizeof(line), " %ld %lu\n", value,
+             nsSinceEpoch/1000000000);
+    _batch.append(objectPath).append(line);
+    _batchStats++;
+}
 
-    int rv = send(_socket, buf, strlen(buf), MSG_NOSIGNAL);
-    if (rv < (int)strlen(buf)) {
+void
+CarbonSocket::flushStats()
+{
+    if (_next) {
+        _next->flushStats();
+    }
+
+    if (_batch.empty()) {
+        return;
+    }
+    if (_socket != -1 && !_backlog.empty()) {
+        doSend(_backlog);
+    }
+    if (_socket != -1 && _backlog.empty()) {
+        // a partially sent batch is finished before a new one starts, so
+        // a batch is only ever dropped as a whole
+        _backlog.swap(_batch);
+        doSend(_backlog);
+    } else {
+        carbonStatsDropped.add(_batchStats);
+    }
+    _batch.clear();
+    _batchStats = 0;
+}
+
+bool
+CarbonSocket::doSend(std::string &buf)
+{
+    ssize_t rv = send(_socket, buf.data(), buf.size(),
+                      MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (rv < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return true;
+        }
+        // the lines not sent in full are lost with the connection
+        carbonStatsDropped.add(std::count(buf.begin(), buf.end(), '\n'));
+        buf.clear();
         doDisconnect();
+        return false;
     }
+    // a line counts as sent once its newline is written
+    carbonStatsSent.add(std::count(buf.begin(), buf.begin() + rv, '\n'));
+    buf.erase(0, rv);
+    return true;
 }
 
 void
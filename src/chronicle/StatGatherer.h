@@ -19,6 +19,7 @@ class PacketBufferPool;
 class RpcParser;
 class NfsParser;
 class AnalyticsManager;
+class ChecksumWorker;
 
 class StatListener {
 public:
@@ -26,6 +27,8 @@ public:
     virtual void writeStats(uint64_t nsSinceEpoch,
                             const std::string &objectPath,
                             int64_t value) = 0;
+    /// called after each batch of stats (e.g., once per tick)
+    virtual void flushStats() { }
 };
 
 /**
@@ -34,6 +37,12 @@ public:
  * data feed to another StatListener, allowing this one to be
  * interposed in front on an existing listener. It does not take
  * ownership of the next listener.
+ *
+ * The stats of a batch are buffered and sent with a single
+ * non-blocking send() on flushStats(). If Carbon can't keep up, the
+ * unsent part of a batch is retried on the next flush and the batches
+ * arriving in the meantime are dropped, so a slow Carbon server never
+ * stalls the StatGatherer.
  */
 class CarbonSocket : public StatListener {
 public:
@@ -42,6 +51,7 @@ public:
     virtual void writeStats(uint64_t nsSinceEpoch,
                             const std::string &objectPath,
                             int64_t value);
+    virtual void flushStats();
 
 private:
     /// The port that Carbon listens on
@@ -50,9 +60,18 @@ private:
     int _socket;
     uint64_t _lastTry;
     StatListener *_next;
+    /// the lines of the current batch
+    std::string _batch;
+    unsigned _batchStats;
+    /// the unsent tail of an earlier batch
+    std::string _backlog;
 
     void doConnect();
     void doDisconnect();
+    /// sends what it can of buf and counts the lines written as sent
+    /// @returns false if the socket had to be closed (the rest of buf
+    /// is counted as dropped)
+    bool doSend(std::string &buf);
 };
 
 class StatGatherer : public Process,
@@ -67,6 +86,7 @@ public:
     void addProcess(Process *p); // to monitor a process
     void addPipeline(PipelineMembers *p); // to monitor a pipeline
 	void addOutputModules(const std::list<ChronicleOutputModule *>); // to monitor output modules
+    void addChecksumWorkers(const std::list<ChecksumWorker *> &workers); // to monitor checksum workers
 	void handleAnalyticsModulesStats(uint64_t timestamp,
 		const std::map<std::string,int64_t> &stats); // to monitor analytics modules stats
 
@@ -85,6 +105,7 @@ private:
     class MessageAddProcess;
     class MessageAddPipeline;
 	class MessageAddOutputModules;
+    class MessageAddChecksumWorkers;
 	class MessageHandleAnalyticsStats;
 
     void doShutdown(Chronicle *src);
@@ -99,11 +120,14 @@ private:
     void doAddProcess(Process *p);
     void getProcessStats();
     void writeProcessStats(uint64_t timestamp, Process *p);
+    void getSchedulerStats();
 
     void getMachineStats();
 	void getBufPoolStats();
-	void getRpcParserStats();
+	void getMetricsStats();
 	void getAnalyticsModulesStats();
+    void getChecksumWorkerStats();
+    void getStageTracerStats();
     void getMachineCpu();
     void getMachineMemory();
 
@@ -111,11 +135,14 @@ private:
 
     void doAddPipeline(PipelineMembers *p);
 	void doAddOutputModules(const std::list<ChronicleOutputModule *> modules);
+    void doAddChecksumWorkers(const std::list<ChecksumWorker *> &workers);
 
     uint64_t timestamp();
     void writeStats(uint64_t nsSinceEpoch,
                     const std::string &objectPath,
                     int64_t value);
+    /// hands the stats written so far to the listeners as one batch
+    void flushStats();
 
     void connectSocket();
 
@@ -130,7 +157,11 @@ private:
 	PacketBufferPool *_bufPool;
     std::list<Process *> _processList;
     std::list<PipelineMembers *> _pipelines;
-	std::list<RpcParser *> _rpcParsers;
+    /// checksum workers and their busy time as of the last tick
+    std::map<ChecksumWorker *, uint64_t> _checksumWorkers;
+    uint64_t _lastChecksumTick;
+    /// libtask schedulers and their profiling counters as of the last tick
+    std::map<Scheduler *, Scheduler::Stats> _schedulers;
 	bool _netmapCheckNeeded;
 };
 
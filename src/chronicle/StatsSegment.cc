@@ -0,0 +1,155 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2013 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "StatsSegment.h"
+#include "Metrics.h"
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static MetricCounter statsSegmentFull("statsegment.full");
+
+StatsSegment::StatsSegment(const std::string &name, StatListener *next) :
+    _name(name), _next(next), _header(0), _entries(0), _inBatch(false)
+{
+    int fd = shm_open(_name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd == -1 || ftruncate(fd, getSize()) != 0) {
+        std::cerr << FONT_RED << "StatsSegment: cannot create " << _name
+                  << ": " << strerror(errno) << FONT_DEFAULT << std::endl;
+        if (fd != -1) {
+            close(fd);
+        }
+        return;
+    }
+    void *addr = mmap(NULL, getSize(), PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        std::cerr << FONT_RED << "StatsSegment: cannot map " << _name
+                  << ": " << strerror(errno) << FONT_DEFAULT << std::endl;
+        return;
+    }
+    _header = static_cast<Header *>(addr);
+    _entries = reinterpret_cast<Entry *>(_header + 1);
+    // a stale segment from an earlier run is reset
+    _header->magic = 0;
+    _header->numEntries.store(0);
+    _header->generation.store(0);
+    _header->timestamp.store(0);
+    _header->version = VERSION;
+    _header->maxEntries = STATS_SEGMENT_MAX_ENTRIES;
+    std::atomic_thread_fence(std::memory_order_release);
+    _header->magic = MAGIC;
+}
+
+StatsSegment::~StatsSegment()
+{
+    if (_header) {
+        munmap(_header, getSize());
+        shm_unlink(_name.c_str());
+    }
+}
+
+void
+StatsSegment::writeStats(uint64_t nsSinceEpoch,
+                         const std::string &objectPath,
+                         int64_t value)
+{
+    if (_next) {
+        _next->writeStats(nsSinceEpoch, objectPath, value);
+    }
+    if (_header == 0) {
+        return;
+    }
+
+    if (!_inBatch) {
+        _header->generation.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _inBatch = true;
+    }
+    uint32_t entry;
+    std::map<std::string, uint32_t>::const_iterator it =
+        _index.find(objectPath);
+    if (it != _index.end()) {
+        entry = it->second;
+    } else {
+        entry = _header->numEntries.load(std::memory_order_relaxed);
+        if (entry == STATS_SEGMENT_MAX_ENTRIES) {
+            statsSegmentFull++;
+            return;
+        }
+        strncpy(_entries[entry].name, objectPath.c_str(),
+                STATS_SEGMENT_NAME_LEN - 1);
+        _entries[entry].name[STATS_SEGMENT_NAME_LEN - 1] = '\0';
+        _index[objectPath] = entry;
+        _header->numEntries.store(entry + 1, std::memory_order_relaxed);
+    }
+    _entries[entry].value.store(value, std::memory_order_relaxed);
+    _header->timestamp.store(nsSinceEpoch, std::memory_order_relaxed);
+}
+
+void
+StatsSegment::flushStats()
+{
+    if (_next) {
+        _next->flushStats();
+    }
+    if (_inBatch) {
+        _header->generation.fetch_add(1, std::memory_order_release);
+        _inBatch = false;
+    }
+}
+
+bool
+StatsSegment::read(const std::string &name,
+                   std::map<std::string, int64_t> &stats,
+                   uint64_t *timestamp)
+{
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd == -1) {
+        return false;
+    }
+    void *addr = mmap(NULL, getSize(), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    const Header *header = static_cast<const Header *>(addr);
+    const Entry *entries = reinterpret_cast<const Entry *>(header + 1);
+    bool done = false;
+    if (header->magic == MAGIC && header->version == VERSION) {
+        // the writer only holds a batch open for a few milliseconds
+        for (unsigned tries = 0; tries < 1000 && !done; tries++) {
+            uint64_t generation =
+                header->generation.load(std::memory_order_acquire);
+            if (generation & 1) {
+                usleep(1000);
+                continue;
+            }
+            stats.clear();
+            uint32_t numEntries = std::min<uint32_t>(
+                header->numEntries.load(std::memory_order_relaxed),
+                header->maxEntries);
+            for (uint32_t i = 0; i < numEntries; i++) {
+                stats[std::string(entries[i].name,
+                                  strnlen(entries[i].name,
+                                          STATS_SEGMENT_NAME_LEN))] =
+                    entries[i].value.load(std::memory_order_relaxed);
+            }
+            if (timestamp) {
+                *timestamp =
+                    header->timestamp.load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            done = header->generation.load(std::memory_order_relaxed) ==
+                generation;
+        }
+    }
+    munmap(addr, getSize());
+    return done;
+}
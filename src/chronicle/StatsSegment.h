@@ -0,0 +1,84 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4; c-indent-tabs-mode: nil -*-
+/*
+ * Copyright (c) 2013 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef STATS_SEGMENT_H
+#define STATS_SEGMENT_H
+
+#include <atomic>
+#include <map>
+#include <string>
+#include "StatGatherer.h"
+
+/**
+ * This is a StatListener that publishes the latest value of every stat
+ * in a POSIX shared memory segment, so local tools can read the stats
+ * without any syscalls or sockets on Chronicle's side. Like
+ * CarbonSocket, it relays the data feed to the next StatListener (if
+ * any) and doesn't take ownership of it.
+ *
+ * The segment holds a Header followed by STATS_SEGMENT_MAX_ENTRIES
+ * Entries. A stat keeps its entry once it has one, and entries are
+ * only appended. The generation in the header is odd while a batch is
+ * being written, so readers (see read()) retry until they have seen
+ * the same even generation before and after copying the entries.
+ */
+class StatsSegment : public StatListener {
+public:
+    static const uint32_t MAGIC = 0x43485354; // "CHST"
+    static const uint32_t VERSION = 1;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t maxEntries;
+        std::atomic<uint32_t> numEntries;
+        std::atomic<uint64_t> generation;
+        /// time of the last stat written (ns since the epoch)
+        std::atomic<uint64_t> timestamp;
+    };
+
+    struct Entry {
+        char name[STATS_SEGMENT_NAME_LEN];
+        std::atomic<int64_t> value;
+    };
+
+    /**
+     * creates (or takes over) the shared memory segment
+     * @param[in] name The name of the segment (as in shm_open)
+     */
+    StatsSegment(const std::string &name, StatListener *next = 0);
+    ~StatsSegment();
+    bool isMapped() const { return _header != 0; }
+    virtual void writeStats(uint64_t nsSinceEpoch,
+                            const std::string &objectPath,
+                            int64_t value);
+    virtual void flushStats();
+
+    /**
+     * takes a consistent snapshot of a segment written by another
+     * process (or this one)
+     * @returns false if the segment doesn't exist or is never stable
+     */
+    static bool read(const std::string &name,
+                     std::map<std::string, int64_t> &stats,
+                     uint64_t *timestamp = 0);
+
+private:
+    static size_t getSize() {
+        return sizeof(Header) + STATS_SEGMENT_MAX_ENTRIES * sizeof(Entry);
+    }
+
+    std::string _name;
+    StatListener *_next;
+    Header *_header;
+    Entry *_entries;
+    /// the entry of each stat
+    std::map<std::string, uint32_t> _index;
+    /// whether a batch is being written (i.e., the generation is odd)
+    bool _inBatch;
+};
+
+#endif // STATS_SEGMENT_H
@@ -0,0 +1,72 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2013 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include <sstream>
+#include <unistd.h>
+#include "gtest/gtest.h"
+#include "StatsSegment.h"
+
+class CountingListener : public StatListener {
+	public:
+		CountingListener() : stats(0), flushes(0) { }
+		void writeStats(uint64_t nsSinceEpoch, const std::string &objectPath,
+			int64_t value) { stats++; }
+		void flushStats() { flushes++; }
+		unsigned stats, flushes;
+};
+
+static std::string
+segmentName()
+{
+	std::ostringstream name;
+	name << "/chronicle_stats_test_" << getpid();
+	return name.str();
+}
+
+TEST(StatsSegment, ReadsLatestValues) {
+	std::string name = segmentName();
+	StatsSegment segment(name);
+	ASSERT_TRUE(segment.isMapped());
+	segment.writeStats(1000000000, "a.b", 1);
+	segment.writeStats(2000000000, "a.c", -2);
+	segment.flushStats();
+	segment.writeStats(3000000000llu, "a.b", 3);
+	segment.flushStats();
+
+	std::map<std::string, int64_t> stats;
+	uint64_t timestamp;
+	ASSERT_TRUE(StatsSegment::read(name, stats, &timestamp));
+	EXPECT_EQ(2u, stats.size());
+	EXPECT_EQ(3, stats["a.b"]);
+	EXPECT_EQ(-2, stats["a.c"]);
+	EXPECT_EQ(3000000000llu, timestamp);
+}
+
+TEST(StatsSegment, RelaysToNextListener) {
+	CountingListener next;
+	StatsSegment segment(segmentName(), &next);
+	segment.writeStats(0, "x", 1);
+	segment.writeStats(0, "y", 2);
+	segment.flushStats();
+	EXPECT_EQ(2u, next.stats);
+	EXPECT_EQ(1u, next.flushes);
+}
+
+TEST(StatsSegment, TruncatesLongNames) {
+	std::string name = segmentName();
+	StatsSegment segment(name);
+	std::string longName(2 * STATS_SEGMENT_NAME_LEN, 'n');
+	segment.writeStats(0, longName, 7);
+	segment.flushStats();
+	std::map<std::string, int64_t> stats;
+	ASSERT_TRUE(StatsSegment::read(name, stats));
+	EXPECT_EQ(7, stats[longName.substr(0, STATS_SEGMENT_NAME_LEN - 1)]);
+}
+
+TEST(StatsSegment, MissingSegment) {
+	std::map<std::string, int64_t> stats;
+	EXPECT_FALSE(StatsSegment::read("/chronicle_stats_test_missing", stats));
+}
@@ -0,0 +1,99 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "CardinalityModule.h"
+#include "ChronicleConfig.h"
+#include "RpcParser.h"
+
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <linux/nfs3.h>
+#include <sys/time.h>
+#include <iostream>
+#include <set>
+#include <vector>
+
+unsigned numFiles = 100000;
+unsigned ioSize = 32 * 1024;
+unsigned numPdus = 1000000;
+
+static double
+getTime()
+{
+	timeval tv;
+	gettimeofday(&tv, 0);
+	double t = tv.tv_sec + tv.tv_usec/1000000.0;
+	return t;
+}
+
+int
+main(int argc, char *argv[])
+{
+	char opt;
+	while((opt = getopt(argc, argv, "f:o:s:")) > 0) {
+		switch (opt) {
+		case 'f':
+			numFiles = atoi(optarg);
+			break;
+		case 'o':
+			numPdus = atoi(optarg);
+			break;
+		case 's':
+			ioSize = atoi(optarg);
+			break;
+		default:
+			std::cout << "usage: bench_cardinality [-f files] "
+				"[-o calls] [-s io_size]" << std::endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (numFiles == 0 || numPdus == 0) {
+		std::cout << "invalid file/call count" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// a pool of READ and WRITE calls to random files and offsets
+	const unsigned poolSize = 4096;
+	std::vector<PacketDescriptor> pkts(poolSize);
+	std::vector<NfsV3PduDescriptor *> calls;
+	std::set<uint32_t> files;
+	for (unsigned i = 0; i < poolSize; i++) {
+		pkts[i].srcIP = 0x0a000000 + random() % 1000;
+		NfsV3PduDescriptor *call = new NfsV3PduDescriptor(&pkts[i], 
+			&pkts[i], 0, i, NFS3_VERSION, 
+			i % 2 ? NFS3PROC_READ : NFS3PROC_WRITE, 0, 0, 0, RPC_CALL);
+		call->rpcPduType = PduDescriptor::PDU_COMPLETE;
+		call->parsable = true;
+		call->fhLen = 32;
+		memset(call->fileHandle, 0, sizeof(call->fileHandle));
+		uint32_t file = random() % numFiles;
+		memcpy(call->fileHandle, &file, sizeof(file));
+		files.insert(file);
+		call->fileOffset = (uint64_t)(random() % 65536) * ioSize;
+		call->byteCount = ioSize;
+		calls.push_back(call);
+	}
+
+	CardinalityPartial partial;
+	double startTime = getTime();
+	for (unsigned i = 0; i < numPdus; i++)
+		partial.update(calls[i % poolSize]);
+	double endTime = getTime();
+
+	std::cout << "Cardinality benchmark"
+		<< "  io_size: " << ioSize
+		<< "  calls: " << numPdus
+		<< "  ns/call: " << (endTime - startTime) * 1e9 / numPdus
+		<< "  sketch_bytes/shard: " << partial.getSize()
+		<< "  files: " << partial.files.estimate()
+		<< "  (" << files.size() << " exact)"
+		<< std::endl;
+
+	for (unsigned i = 0; i < calls.size(); i++)
+		delete calls[i];
+	return EXIT_SUCCESS;
+}
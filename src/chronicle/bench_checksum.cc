@@ -0,0 +1,124 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "MultiBlockHasher.h"
+
+#include <unistd.h>
+#include <cstdlib>
+#include <inttypes.h>
+#include <sys/time.h>
+#include <iostream>
+#include <vector>
+
+unsigned blockSize = 512;
+unsigned numBlocks = 64;       // a 32KB READ/WRITE
+unsigned numIterations = 100000;
+MultiBlockHasher::Algorithm algorithm = MultiBlockHasher::ALG_MURMUR3;
+
+static double
+getTime()
+{
+    timeval tv;
+    gettimeofday(&tv, 0);
+    double t = tv.tv_sec + tv.tv_usec/1000000.0;
+    return t;
+}
+
+static void
+runBenchmark(MultiBlockHasher::Impl impl,
+             std::vector<const unsigned char *> &blocks)
+{
+    MultiBlockHasher hasher(blockSize, impl, algorithm);
+    if (hasher.getImpl() != impl) {
+        std::cout << MultiBlockHasher::implName(impl)
+                  << ": not supported" << std::endl;
+        return;
+    }
+    std::vector<uint64_t> out(numBlocks);
+    uint64_t sink = 0;
+    double startTime = getTime();
+    for (unsigned i = 0; i < numIterations; ++i) {
+        hasher.hash(&blocks[0], numBlocks, &out[0]);
+        sink ^= out[i % numBlocks];
+    }
+    double endTime = getTime();
+    double bytes = static_cast<double>(numIterations) * numBlocks * blockSize;
+
+    std::cout << "Checksum benchmark"
+              << "  algorithm: " << MultiBlockHasher::algorithmName(algorithm)
+              << "  impl: " << MultiBlockHasher::implName(impl)
+              << "  block_size: " << blockSize
+              << "  blocks: " << numBlocks
+              << "  time: " << endTime-startTime
+              << "  MB/s: " << bytes/(endTime-startTime)/1000000
+              << "  (" << (sink & 1) << ")"
+              << std::endl;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char opt;
+    int impl = -1;
+    while((opt = getopt(argc, argv, "a:b:i:n:o:")) > 0) {
+        switch (opt) {
+        case 'a':
+            if (!MultiBlockHasher::algorithmFromName(optarg, &algorithm) ||
+                !MultiBlockHasher::isAvailable(algorithm)) {
+                std::cout << "unsupported algorithm: " << optarg << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'b':
+            blockSize = atoi(optarg);
+            break;
+        case 'i':
+            impl = atoi(optarg);
+            break;
+        case 'n':
+            numBlocks = atoi(optarg);
+            break;
+        case 'o':
+            numIterations = atoi(optarg);
+            break;
+        default:
+            std::cout << "usage: bench_checksum "
+                "[-a algorithm (murmur3|crc32c|xxh3)] [-b block_size] "
+                "[-i impl (0:scalar 1:avx2 2:avx512 3:sse4.2)] "
+                "[-n blocks_per_op] [-o ops]" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (blockSize == 0 || blockSize % 16 || numBlocks == 0) {
+        std::cout << "invalid block size/count" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // blocks are scattered across "packet buffers" as in the pipeline
+    const unsigned stride = blockSize + 64 + 3;
+    std::vector<unsigned char> data(numBlocks * stride);
+    for (unsigned i = 0; i < data.size(); ++i) {
+        data[i] = random();
+    }
+    std::vector<const unsigned char *> blocks;
+    for (unsigned i = 0; i < numBlocks; ++i) {
+        blocks.push_back(&data[i * stride + 3]);
+    }
+
+    if (impl >= 0) {
+        runBenchmark(static_cast<MultiBlockHasher::Impl>(impl), blocks);
+    } else {
+        runBenchmark(MultiBlockHasher::IMPL_SCALAR, blocks);
+        if (algorithm == MultiBlockHasher::ALG_MURMUR3) {
+            runBenchmark(MultiBlockHasher::IMPL_AVX2, blocks);
+            runBenchmark(MultiBlockHasher::IMPL_AVX512, blocks);
+        } else if (algorithm == MultiBlockHasher::ALG_CRC32C) {
+            runBenchmark(MultiBlockHasher::IMPL_SSE42, blocks);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
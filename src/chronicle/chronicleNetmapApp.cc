@@ -15,6 +15,8 @@
 #include "Scheduler.h"
 #include "Chronicle.h"
 #include "ChronicleConfig.h"
+#include "MultiBlockHasher.h"
+#include "StageTracer.h"
 #include "NetmapInterface.h"
 
 class SupervisorCb : public Chronicle::CompletionCb {
@@ -91,7 +93,15 @@ void usage()
 		"\t[-D[dataseries_output_module_num] | -P[pcap_output_module_num]]\n"
 		"\t[-a (to_enable_analytics)]\n"
 		"\t[-o output_dir] [-b batch_size] [-l snapshot_len] [-X]\n"
-		"\t[-t num_libtask_threads] [-B (to_bind_libtask_threads)]\n";
+		"\t[-R (to_keep_read/write_payload_until_output)]\n"
+		"\t[-c murmur3|crc32c|xxh3 (read/write_checksum_algorithm)]\n"
+		"\t[-k checksum_block_size] [-w num_checksum_workers]\n"
+		"\t[-A anonymization_key_file (to_anonymize_nfs_traces)]\n"
+		"\t[-U (to_anonymize_uids/gids)] [-H (to_anonymize_file_handles)]\n"
+		"\t[-M anonymization_cache_MB]\n"
+		"\t[-t num_libtask_threads] [-B (to_bind_libtask_threads)]\n"
+		"\t[-T trace_1_in_N_packets (per-stage latency tracing)]\n"
+		"\t[-S (to_publish_stats_in_shared_memory)]\n";
 }
 
 // rounds down to the nearest power of two
@@ -128,7 +138,7 @@ int main(int argc, char **argv)
 	}
 
 	while ((option = getopt(argc, argv, 
-			"aBb:D::hi:l:n::P::p::o:t:X")) != -1) {
+			"aBb:D::hi:l:n::P::p::o:t:T:SXRc:k:w:A:UHM:")) != -1) {
 		switch (option) {
 			case 'a':	/* inline analytics */
 				enableAnalytics = true;
@@ -186,11 +196,41 @@ int main(int argc, char **argv)
 			case 't':	/* number of libtask threads */
 				threads = atoi(optarg);
 				break;
+			case 'T':	/* per-stage latency tracing */
+				traceSampleRate = atoi(optarg);
+				break;
+			case 'S':	/* stats in shared memory */
+				statsSegmentEnabled = true;
+				break;
             case 'X':   /* disable checksum & IP extents for DS pipeline */
                 dsFileSize = DS_DEFAULT_FILE_SIZE_SMALL;
                 dsExtentSize = DS_DEFAULT_EXTENT_SIZE_SMALL;
                 dsEnableIpChecksum = false;
                 break;
+			case 'R':	/* keep READ/WRITE payload packets until output */
+				pduEarlyRelease = false;
+				break;
+			case 'c':	/* READ/WRITE checksum algorithm */
+				dsChecksumAlgorithm = optarg;
+				break;
+			case 'k':	/* READ/WRITE checksum block size */
+				dsChecksumBlockSize = atoi(optarg);
+				break;
+			case 'w':	/* number of shared checksum workers */
+				dsChecksumWorkerNum = atoi(optarg);
+				break;
+			case 'A':	/* inline anonymization key file */
+				anonKeyFile = optarg;
+				break;
+			case 'U':	/* anonymize uids and gids */
+				anonIds = true;
+				break;
+			case 'H':	/* anonymize file handles */
+				anonFileHandles = true;
+				break;
+			case 'M':	/* size of the anonymization memo cache */
+				anonCacheMB = atoi(optarg);
+				break;
 			case '?':
 				usage();			
 				exit(EXIT_FAILURE);
@@ -209,6 +249,53 @@ int main(int argc, char **argv)
 		usage();
 		exit(EXIT_FAILURE);
 	}
+	MultiBlockHasher::Algorithm checksumAlg;
+	if (!MultiBlockHasher::algorithmFromName(dsChecksumAlgorithm,
+			&checksumAlg)) {
+		std::cerr << "ERROR: Unknown checksum algorithm "
+			<< dsChecksumAlgorithm << "!\n";
+		usage();
+		exit(EXIT_FAILURE);
+	}
+	if (!MultiBlockHasher::isAvailable(checksumAlg)) {
+		std::cerr << "ERROR: Chronicle was built without "
+			<< dsChecksumAlgorithm << " support!\n";
+		exit(EXIT_FAILURE);
+	}
+	if (dsChecksumBlockSize < DS_MIN_CHECKSUM_BLOCK_SIZE
+			|| dsChecksumBlockSize > DS_MAX_CHECKSUM_BLOCK_SIZE
+			|| (dsChecksumBlockSize & (dsChecksumBlockSize - 1))) {
+		std::cerr << "ERROR: The checksum block size must be a power of 2 "
+			"between " << DS_MIN_CHECKSUM_BLOCK_SIZE << " and "
+			<< DS_MAX_CHECKSUM_BLOCK_SIZE << "!\n";
+		usage();
+		exit(EXIT_FAILURE);
+	}
+	if (dsChecksumWorkerNum == 0)
+		dsChecksumWorkerNum = threads;
+	if (anonKeyFile.empty() && (anonIds || anonFileHandles)) {
+		std::cerr << "ERROR: -U and -H require an anonymization key file "
+			"(-A)!\n";
+		usage();
+		exit(EXIT_FAILURE);
+	}
+	if (!anonKeyFile.empty()) {
+		if (pipelineType != NFS_PIPELINE || outputFormat == PCAP_OUTPUT) {
+			std::cerr << "ERROR: Anonymization requires the NFS pipeline "
+				"and no pcap output!\n";
+			usage();
+			exit(EXIT_FAILURE);
+		}
+		if (access(anonKeyFile.c_str(), R_OK)) {
+			std::cerr << "ERROR: Can't read the anonymization key file "
+				<< anonKeyFile << "!\n";
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (outputFormat == PCAP_OUTPUT) {
+		// pcap traces need every packet of a PDU
+		pduEarlyRelease = false;
+	}
 	if (pipelineType == NFS_PIPELINE && outputFormat == NO_OUTPUT 
 			&& !enableAnalytics) {
 		std::cout << "=====================================\n"
@@ -217,6 +304,7 @@ int main(int argc, char **argv)
 	}
 
 	// starting Chronicle
+	StageTracer::init(traceSampleRate);
 	Scheduler::initScheduler();
 	Chronicle *chronicle = new Chronicle(netmapNics.size(), fileno(stdin), 
 		pipelineType, pipelineNum, outputFormat, numOutputModules, snapLen,
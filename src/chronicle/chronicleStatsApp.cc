@@ -0,0 +1,66 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2013 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "StatsSegment.h"
+
+#include <unistd.h>
+#include <cstdlib>
+#include <iostream>
+
+/*
+ * Prints the stats a running Chronicle (started with -S) publishes in shared
+ * memory, in the Carbon plaintext format.
+ */
+
+void usage()
+{
+	std::cerr << "./chronicle_stats [-n segment_name] [-f prefix] "
+		"[-w interval_sec]\n";
+}
+
+int main(int argc, char **argv)
+{
+	std::string name(STATS_SEGMENT_NAME), prefix;
+	unsigned interval = 0;
+	int option;
+
+	while ((option = getopt(argc, argv, "f:hn:w:")) != -1) {
+		switch (option) {
+			case 'f':	/* only print the stats starting with prefix */
+				prefix = optarg;
+				break;
+			case 'n':	/* shared memory segment */
+				name = optarg;
+				break;
+			case 'w':	/* print again every interval seconds */
+				interval = atoi(optarg);
+				break;
+			case 'h':
+			case '?':
+				usage();
+				exit(option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	do {
+		std::map<std::string, int64_t> stats;
+		uint64_t timestamp;
+		if (!StatsSegment::read(name, stats, &timestamp)) {
+			std::cerr << FONT_RED << "chronicle_stats: cannot read " << name
+				<< "!\n" << FONT_DEFAULT;
+			exit(EXIT_FAILURE);
+		}
+		for (std::map<std::string, int64_t>::const_iterator it =
+				stats.begin(); it != stats.end(); it++)
+			if (it->first.compare(0, prefix.size(), prefix) == 0)
+				std::cout << it->first << " " << it->second << " "
+					<< timestamp / 1000000000 << "\n";
+		std::cout.flush();
+		if (interval)
+			sleep(interval);
+	} while (interval);
+	return 0;
+}
@@ -7,59 +7,77 @@
 #include "DirScanner.h"
 #include "DirGatherer.h"
 #include "StatGatherer.h"
+#include "StatPool.h"
+#include "SnapshotIndex.h"
 #include "Message.h"
+#include "Scheduler.h"
+#include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <cerrno>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
+const unsigned DirScanner::MIN_CHUNK;
+const unsigned DirScanner::MAX_CHUNK;
+
 DirScanner::DirScanner(const std::string &directory,
                        StatGatherer *sg,
                        DirGatherer *dg,
-                       CompletionCb *cb) :
-    _dir(NULL), _path(directory), _sg(sg), _dg(dg), _cb(cb)
+                       CompletionCb *cb,
+                       StatPool *pool,
+                       const SnapshotIndex *index) :
+    _buf(new char[BATCH_BYTES]), _dirFd(-1), _path(directory), _sg(sg),
+    _dg(dg), _cb(cb), _index(index), _pool(pool), _requests(0),
+    _reading(false), _eof(false)
 {
-    //ssize_t len = offsetof(dirent, d_name) +
-    //    pathconf(_path.c_str(), _PC_NAME_MAX) + 1;
-    _currentEntry = new dirent;
     openDirectory();
 }
 
 DirScanner::~DirScanner()
 {
-    delete _currentEntry;
     sysCloseDir();
+    delete[] _buf;
 }
 
 int
 DirScanner::sysOpenDir()
 {
-    struct stat s;
-    stat(_path.c_str(), &s);
-    _dirIno = s.st_ino;
-    _dir = opendir(_path.c_str());
-    if (!_dir)
+    _dirFd = open(_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (0 > _dirFd)
+        return errno;
+    // the inode # of what was actually opened
+    if (fstat(_dirFd, &_dirStat))
         return errno;
-    else 
-        return 0;
+    _dirIno = _dirStat.st_ino;
+    return 0;
 }
 
-bool
+ssize_t
 DirScanner::sysReadDir()
 {
     assertValid();
-    dirent *cep;
-    int rc = readdir_r(_dir, _currentEntry, &cep);
-    if (0 != rc || cep != _currentEntry)
-        return false;
-    else
-        return true;
+    // glibc only wraps getdents64 since 2.30
+    return syscall(SYS_getdents64, _dirFd, _buf, BATCH_BYTES);
+}
+
+int
+DirScanner::sysStat(const char *name, struct stat *buf)
+{
+    return fstatat(_dirFd, name, buf, AT_SYMLINK_NOFOLLOW);
 }
 
 void
 DirScanner::sysCloseDir()
 {
-    closedir(_dir);
+    if (0 <= _dirFd) {
+        close(_dirFd);
+        _dirFd = -1;
+    }
 }
 
 class DirScanner::MessageBase : public Message {
@@ -86,71 +104,220 @@ void
 DirScanner::doOpenDirectory()
 {
     if (0 == sysOpenDir()) {
-        processEntry();
+        if (_index && _index->unchanged(_dirStat) && scanUnchanged()) {
+            finish();
+            return;
+        }
+        if (_index && _sg) {
+            _sg->addRescanned(_dirIno);
+        }
+        processBatch();
     } else {
         std::cerr << "unable to open: " << _path << std::endl;
-        if (_cb) {
-            _cb->scanner = this;
-            (*_cb)();
-        }
-        exit();
+        finish();
     }
 }
 
 
 
-class DirScanner::MessageProcessEntry : public MessageBase {
+class DirScanner::MessageProcessBatch : public MessageBase {
 public:
-    MessageProcessEntry(DirScanner *self) : MessageBase(self) { }
-    virtual void run() { _self->doProcessEntry(); }
+    MessageProcessBatch(DirScanner *self) : MessageBase(self) { }
+    virtual void run() { _self->doProcessBatch(); }
 };
 void
-DirScanner::processEntry()
+DirScanner::processBatch()
 {
     assertValid();
-    enqueueMessage(new MessageProcessEntry(this));
+    _reading = true;
+    enqueueMessage(new MessageProcessBatch(this));
 }
 void
-DirScanner::doProcessEntry()
-{
-    if (sysReadDir()) {
-        if ( 0 != strcmp(".", _currentEntry->d_name) &&
-             0 != strcmp("..", _currentEntry->d_name)) {
-            // process the entry
-            std::string fullpath = _path + "/" + _currentEntry->d_name;
-            struct stat buf;
-            int rc = lstat(fullpath.c_str(), &buf);
-            if (0 == rc) {
-                if (_sg) {
-                    _sg->addFile(_dirIno, _currentEntry->d_name, buf);
-                }
-                if (S_ISDIR(buf.st_mode)) {
-                    //std::cout << "D: " << fullpath << std::endl;
-                    // skip directories named ".snapshot"
-                    if (_dg &&
-                        0 != strcmp(".snapshot", _currentEntry->d_name)) {
-                        _dg->addDirectory(fullpath);
-                    }
-                }
-                if (S_ISLNK(buf.st_mode)) {
-                    //std::cout << "L: " << fullpath << std::endl;
-                    if (_sg) {
-                        _sg->addLink(buf.st_ino, fullpath);
-                    }
-                }
-            } else {
-                std::cerr << "Couldn't stat: " << fullpath
-                          << " " << strerror(errno) << std::endl;
-            }
+DirScanner::doProcessBatch()
+{
+    _reading = false;
+    ssize_t bytes = sysReadDir();
+    if (0 >= bytes) {
+        if (0 > bytes) {
+            std::cerr << "Couldn't read: " << _path
+                      << " " << strerror(errno) << std::endl;
         }
-        // do the next one
-        processEntry();
-    } else {
         // no more entries
-        if (_cb) {
-            _cb->scanner = this;
-            (*_cb)();
+        _eof = true;
+        if (0 == _requests)
+            finish();
+        return;
+    }
+    if (_pool) {
+        submitBatch(bytes);
+        // the next batch, unless the pool is behind
+        if (_requests < MAX_REQUESTS)
+            processBatch();
+        return;
+    }
+
+    StatGatherer::FileStatBatch *batch = new StatGatherer::FileStatBatch;
+    for (ssize_t pos = 0; pos < bytes; ) {
+        const struct dirent64 *entry =
+            reinterpret_cast<const struct dirent64 *>(_buf + pos);
+        pos += entry->d_reclen;
+        const char *name = entry->d_name;
+        if (0 == strcmp(".", name) || 0 == strcmp("..", name))
+            continue;
+
+        // process the entry
+        batch->push_back(StatGatherer::FileStat());
+        StatGatherer::FileStat &file = batch->back();
+        if (0 != sysStat(name, &file.statBuf)) {
+            std::cerr << "Couldn't stat: " << _path << "/" << name
+                      << " " << strerror(errno) << std::endl;
+            batch->pop_back();
+            continue;
+        }
+        file.filename = name;
+        addEntry(name, file.statBuf);
+    }
+
+    if (_sg && !batch->empty()) {
+        _sg->addFile(_dirIno, batch);
+    } else {
+        delete batch;
+    }
+    // do the next batch
+    processBatch();
+}
+
+void
+DirScanner::addEntry(const char *name, const struct stat &statBuf)
+{
+    // only directories and symlinks need the full path
+    if (S_ISDIR(statBuf.st_mode)) {
+        // skip directories named ".snapshot"
+        if (_dg && 0 != strcmp(".snapshot", name)) {
+            _dg->addDirectory(_path + "/" + name);
+        }
+    } else if (S_ISLNK(statBuf.st_mode)) {
+        if (_sg) {
+            _sg->addLink(statBuf.st_ino, _path + "/" + name);
+        }
+    }
+}
+
+bool
+DirScanner::scanUnchanged()
+{
+    std::vector<std::pair<std::string, ino_t> > subdirs;
+    _index->subdirectories(_dirIno, &subdirs);
+    std::vector<struct stat> stats(subdirs.size());
+    for (unsigned i = 0; i < subdirs.size(); ++i) {
+        if (0 != sysStat(subdirs[i].first.c_str(), &stats[i]) ||
+            !S_ISDIR(stats[i].st_mode) ||
+            stats[i].st_ino != subdirs[i].second) {
+            std::cerr << "Changed since the last walk: " << _path << "/"
+                      << subdirs[i].first << std::endl;
+            return false;
         }
-        exit();
     }
+
+    for (unsigned i = 0; i < subdirs.size(); ++i) {
+        // the records of the other entries are still valid
+        int64_t mtime, ctime;
+        if (_sg && (!_index->times(subdirs[i].second, &mtime, &ctime) ||
+                    mtime != stats[i].st_mtime ||
+                    ctime != stats[i].st_ctime)) {
+            _sg->addFile(_dirIno, subdirs[i].first, stats[i]);
+        }
+        addEntry(subdirs[i].first.c_str(), stats[i]);
+    }
+    return true;
+}
+
+void
+DirScanner::submitBatch(ssize_t bytes)
+{
+    std::vector<const char *> names;
+    for (ssize_t pos = 0; pos < bytes; ) {
+        const struct dirent64 *entry =
+            reinterpret_cast<const struct dirent64 *>(_buf + pos);
+        pos += entry->d_reclen;
+        if (0 != strcmp(".", entry->d_name) &&
+            0 != strcmp("..", entry->d_name)) {
+            names.push_back(entry->d_name);
+        }
+    }
+
+    // spread the entries over the stat()s the pool has in flight
+    unsigned chunk = (names.size() + _pool->getLimit() - 1) /
+        _pool->getLimit();
+    chunk = std::min(MAX_CHUNK, std::max(MIN_CHUNK, chunk));
+    for (unsigned i = 0; i < names.size(); i += chunk) {
+        StatRequest *req = new StatRequest;
+        req->owner = this;
+        req->scheduler = Scheduler::getCurrentScheduler();
+        req->dirFd = _dirFd;
+        req->batch = new StatGatherer::FileStatBatch(
+            std::min<size_t>(chunk, names.size() - i));
+        for (unsigned j = 0; j < req->batch->size(); ++j) {
+            (*req->batch)[j].filename = names[i + j];
+        }
+        ++_requests;
+        _pool->submit(req);
+    }
+}
+
+class DirScanner::MessageStatDone : public MessageBase {
+    StatRequest *_req;
+public:
+    MessageStatDone(DirScanner *self, StatRequest *req) :
+        MessageBase(self), _req(req) { }
+    virtual void run() { _self->doStatDone(_req); }
+};
+void
+DirScanner::statDone(StatRequest *req)
+{
+    // called from a StatPool thread, so there may be no current scheduler
+    enqueueMessage(new MessageStatDone(this, req), req->scheduler);
+}
+void
+DirScanner::doStatDone(StatRequest *req)
+{
+    StatGatherer::FileStatBatch *batch = req->batch;
+    unsigned kept = 0;
+    for (unsigned i = 0; i < batch->size(); ++i) {
+        StatGatherer::FileStat &file = (*batch)[i];
+        if (req->errors[i]) {
+            std::cerr << "Couldn't stat: " << _path << "/" << file.filename
+                      << " " << strerror(req->errors[i]) << std::endl;
+            continue;
+        }
+        addEntry(file.filename.c_str(), file.statBuf);
+        if (kept != i)
+            std::swap((*batch)[kept], file);
+        ++kept;
+    }
+    batch->resize(kept);
+    if (_sg && !batch->empty()) {
+        _sg->addFile(_dirIno, batch);
+    } else {
+        delete batch;
+    }
+    delete req;
+
+    --_requests;
+    if (_eof) {
+        if (0 == _requests)
+            finish();
+    } else if (!_reading && _requests < MAX_REQUESTS / 2) {
+        processBatch();
+    }
+}
+
+void
+DirScanner::finish()
+{
+    if (_cb) {
+        _cb->scanner = this;
+        (*_cb)();
+    }
+    exit();
 }
@@ -9,15 +9,35 @@
 
 #include "Process.h"
 #include <string>
-#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 
 class DirGatherer;
 class StatGatherer;
+class StatPool;
+struct StatRequest;
+class SnapshotIndex;
 
 /**
  * This process reads a directory, stat()s each entry, and provides
  * the result to downstream Process. All entries go to the
  * StatGatherer. Directories also go to the DirGatherer.
+ *
+ * The directory is read with getdents64(2) a buffer (BATCH_BYTES) at a
+ * time, and the entries are stat()ed relative to the open directory, so
+ * the file system doesn't have to resolve the full path of each one.
+ * Each buffer is handled by a single message, and its entries are passed
+ * to the StatGatherer as one batch.
+ *
+ * Given a StatPool, the entries are instead split into chunks that are
+ * stat()ed in parallel by the pool, while the scanner goes on reading
+ * the directory (up to MAX_REQUESTS chunks at a time).
+ *
+ * Given the SnapshotIndex of an earlier walk, a directory whose times
+ * show that its entries haven't changed since is not read: only its
+ * subdirectories are stat()ed (to record the ones that changed) and
+ * scanned. The directories that are read are reported to the
+ * StatGatherer as rescanned.
  */
 class DirScanner : public Process {
     /// No copy
@@ -42,34 +62,71 @@ public:
     /// @param[in] dg Downstream process to send directories to
     /// @param[in] cb A calback that will be called when the directory
     /// has been fully processed
+    /// @param[in] pool Threads to stat() the entries with, or NULL to
+    /// stat() them in the scanner
+    /// @param[in] index The directories of the earlier snapshots for an
+    /// incremental walk, or NULL for a full one
     DirScanner(const std::string &directory,
                StatGatherer *sg,
                DirGatherer *dg,
-               CompletionCb *cb);
+               CompletionCb *cb,
+               StatPool *pool = NULL,
+               const SnapshotIndex *index = NULL);
     virtual ~DirScanner();
+
+    /// Called by the StatPool when a request is done
+    void statDone(StatRequest *req);
 protected:
-    /// Opens the directory, associating _dir with _path
+    /// Size of the buffer for the directory entries
+    static const size_t BATCH_BYTES = 64*1024;
+    /// Bounds on the entries per StatPool request
+    static const unsigned MIN_CHUNK = 4;
+    static const unsigned MAX_CHUNK = 64;
+    /// Maximum StatPool requests in flight per scanner
+    static const unsigned MAX_REQUESTS = 256;
+
+    /// Opens the directory, associating _dirFd with _path, and stat()s
+    /// it into _dirStat
     /// @returns Zero on success or an errno error code on failure
     virtual int sysOpenDir();
-    /// Puts the next directory entry into _entry
-    /// @returns true if an entry was successfully fetched
-    virtual bool sysReadDir();
+    /// Reads the next batch of directory entries (linux_dirent64
+    /// records) into _buf
+    /// @returns The number of bytes read, 0 at the end of the directory,
+    /// or -1 on error (with errno set)
+    virtual ssize_t sysReadDir();
+    /// stat()s (without following symlinks) an entry of the directory
+    /// @returns Zero on success or -1 on error (with errno set)
+    virtual int sysStat(const char *name, struct stat *buf);
     /// Closes the directory
     virtual void sysCloseDir();
 
+    /// Buffer for the directory entries (BATCH_BYTES)
+    char *_buf;
+
 private:
     /// Base class for internal messages
     class MessageBase;
     class MessageOpenDir;
-    class MessageProcessEntry;
+    class MessageProcessBatch;
+    class MessageStatDone;
 
     void openDirectory();
-    void processEntry();
+    void processBatch();
     void doOpenDirectory();
-    void doProcessEntry();
+    void doProcessBatch();
+    void doStatDone(StatRequest *req);
+    /// Sends the entries of _buf to the StatPool
+    void submitBatch(ssize_t bytes);
+    /// Passes a stat()ed entry downstream
+    void addEntry(const char *name, const struct stat &statBuf);
+    /// Passes on the subdirectories of an unchanged directory
+    /// @returns false if they don't match the index
+    bool scanUnchanged();
+    /// Calls the completion callback and exits
+    void finish();
 
     /// Handle to the directory being scanned
-    DIR *_dir;
+    int _dirFd;
     /// Pathname of the directory being scanned
     std::string _path;
     /// Downstream recipient of entries
@@ -78,9 +135,20 @@ private:
     DirGatherer *_dg;
     /// Callback to use when scanning is complete
     CompletionCb *_cb;
-    dirent *_currentEntry;
     /// Inode # of the directory being scanned
     ino_t _dirIno;
+    /// stat() of the directory being scanned
+    struct stat _dirStat;
+    /// Directories of the earlier snapshots, if incremental
+    const SnapshotIndex *_index;
+    /// Threads doing the stat()s, if any
+    StatPool *_pool;
+    /// StatPool requests in flight
+    unsigned _requests;
+    /// Is a MessageProcessBatch pending?
+    bool _reading;
+    /// Has the whole directory been read?
+    bool _eof;
 };
 
 #endif // DIRWALK_H
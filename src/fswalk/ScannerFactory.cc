@@ -8,7 +8,7 @@
 #include "DirScanner.h"
 
 ScannerFactory::ScannerFactory() :
-    _sg(NULL), _dg(NULL)
+    _sg(NULL), _dg(NULL), _pool(NULL), _index(NULL)
 {
 }
 void
@@ -23,8 +23,20 @@ ScannerFactory::dirGatherer(DirGatherer *dg)
     _dg = dg;
 }
 
+void
+ScannerFactory::statPool(StatPool *pool)
+{
+    _pool = pool;
+}
+
+void
+ScannerFactory::snapshotIndex(const SnapshotIndex *index)
+{
+    _index = index;
+}
+
 DirScanner *
 ScannerFactory::newScanner(std::string &path, DirScanner::CompletionCb *cb)
 {
-    return new DirScanner(path, _sg, _dg, cb);
+    return new DirScanner(path, _sg, _dg, cb, _pool, _index);
 }
@@ -12,17 +12,23 @@
 
 class DirGatherer;
 class StatGatherer;
+class StatPool;
+class SnapshotIndex;
 
 class ScannerFactory {
 public:
     ScannerFactory();
     void statGatherer(StatGatherer *sg);
     void dirGatherer(DirGatherer *dg);
+    void statPool(StatPool *pool);
+    void snapshotIndex(const SnapshotIndex *index);
 
     DirScanner *newScanner(std::string &path, DirScanner::CompletionCb *cb);
 private:
     StatGatherer *_sg;
     DirGatherer *_dg;
+    StatPool *_pool;
+    const SnapshotIndex *_index;
 };
 
 #endif  // SCANNERFACTORY_H
@@ -53,4 +53,21 @@ const char *EXTENT_FSSNAPSHOT_SYMLINK =
     "  <field name=\"target\" type=\"variable32\"\n"
     "    comment=\"the contents (target) of the symlink\" />\n"
     "</ExtentType>\n";
+
+const char *EXTENT_FSSNAPSHOT_INFO =
+    "<ExtentType name=\"fssnapshot_info\" namespace=\"atg.netapp.com\"\n"
+    "  version=\"1.0\">\n"
+    "  <field name=\"start_time\" type=\"int64\"\n"
+    "    comment=\"when the walk started (seconds since epoch)\" />\n"
+    "  <field name=\"incremental\" type=\"bool\"\n"
+    "    comment=\"true if this is a delta against the earlier snapshots\" />\n"
+    "</ExtentType>\n";
+
+const char *EXTENT_FSSNAPSHOT_RESCANNED =
+    "<ExtentType name=\"fssnapshot_rescanned\" namespace=\"atg.netapp.com\"\n"
+    "  version=\"1.0\">\n"
+    "  <field name=\"ino\" type=\"int64\"\n"
+    "    comment=\"inode number of a directory whose entries are all in\n"
+    "    this delta\" />\n"
+    "</ExtentType>\n";
 #endif // SNAPSHOTEXTENTS_H
@@ -0,0 +1,215 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "SnapshotIndex.h"
+#include "DataSeries/TypeIndexModule.hpp"
+#include "DataSeries/BoolField.hpp"
+#include "DataSeries/Int64Field.hpp"
+#include "DataSeries/Variable32Field.hpp"
+#include <algorithm>
+
+const int64_t SnapshotIndex::CLOCK_MARGIN;
+
+bool
+SnapshotIndex::isIncremental(const std::string &filename, int64_t *startTime)
+{
+    TypeIndexModule source("fssnapshot_info");
+    source.addSource(filename);
+    ExtentSeries series;
+    Int64Field fStartTime(series, "start_time");
+    BoolField fIncremental(series, "incremental");
+    bool incremental = false;
+    if (startTime)
+        *startTime = 0;
+    // snapshots from before incremental walks have no info
+    for (Extent::Ptr extent; (extent = source.getSharedExtent()) != NULL; ) {
+        for (series.setExtent(extent); series.morerecords(); ++series) {
+            incremental = fIncremental.val();
+            if (startTime)
+                *startTime = fStartTime.val();
+        }
+    }
+    return incremental;
+}
+
+void
+SnapshotIndex::load(const std::string &filename, Changes *changes)
+{
+    Changes localChanges;
+    if (!changes)
+        changes = &localChanges;
+    changes->rescanned.clear();
+    changes->removed.clear();
+
+    int64_t scanStart;
+    bool incremental = isIncremental(filename, &scanStart);
+    if (incremental) {
+        TypeIndexModule source("fssnapshot_rescanned");
+        source.addSource(filename);
+        ExtentSeries series;
+        Int64Field fIno(series, "ino");
+        for (Extent::Ptr extent;
+             (extent = source.getSharedExtent()) != NULL; ) {
+            for (series.setExtent(extent); series.morerecords(); ++series) {
+                changes->rescanned.insert(fIno.val());
+            }
+        }
+    } else {
+        _dirs.clear();
+        _children.clear();
+    }
+
+    std::vector<DirRecord> records;
+    {
+        TypeIndexModule source("fssnapshot_stat");
+        source.addSource(filename);
+        ExtentSeries series;
+        Int64Field fPIno(series, "p_ino");
+        Variable32Field fFilename(series, "filename");
+        Int64Field fIno(series, "ino");
+        Variable32Field fType(series, "ftype");
+        Int64Field fMTime(series, "mtime");
+        Int64Field fCTime(series, "ctime");
+        for (Extent::Ptr extent;
+             (extent = source.getSharedExtent()) != NULL; ) {
+            for (series.setExtent(extent); series.morerecords(); ++series) {
+                if (fType.stringval() != "directory")
+                    continue;
+                DirRecord r;
+                r.parent = fPIno.val();
+                r.name = fFilename.stringval();
+                r.ino = fIno.val();
+                r.mtime = fMTime.val();
+                r.ctime = fCTime.val();
+                records.push_back(r);
+            }
+        }
+    }
+
+    // The old subdirectories of the rescanned directories are gone,
+    // unless they are in the delta again
+    std::vector<ino_t> candidates;
+    for (std::unordered_set<ino_t>::const_iterator i =
+             changes->rescanned.begin();
+         i != changes->rescanned.end(); ++i) {
+        std::unordered_map<ino_t, std::vector<ino_t> >::iterator c =
+            _children.find(*i);
+        if (c != _children.end()) {
+            candidates.insert(candidates.end(), c->second.begin(),
+                              c->second.end());
+            c->second.clear();
+        }
+    }
+
+    std::unordered_set<ino_t> present;
+    for (unsigned i = 0; i < records.size(); ++i) {
+        const DirRecord &r = records[i];
+        present.insert(r.ino);
+        std::unordered_map<ino_t, Dir>::iterator d = _dirs.find(r.ino);
+        bool link = true;
+        if (d != _dirs.end()) {
+            if (d->second.parent != r.parent) {
+                // moved
+                removeChild(d->second.parent, r.ino);
+            } else if (!changes->rescanned.count(r.parent)) {
+                // an update of a subdirectory of an unchanged directory
+                link = false;
+            }
+        }
+        Dir &dir = _dirs[r.ino];
+        dir.parent = r.parent;
+        dir.name = r.name;
+        dir.mtime = r.mtime;
+        dir.ctime = r.ctime;
+        dir.scanStart = scanStart;
+        if (link)
+            _children[r.parent].push_back(r.ino);
+    }
+
+    for (unsigned i = 0; i < candidates.size(); ++i) {
+        if (!present.count(candidates[i]))
+            removeTree(candidates[i], present, &changes->removed);
+    }
+}
+
+void
+SnapshotIndex::removeChild(ino_t parent, ino_t child)
+{
+    std::unordered_map<ino_t, std::vector<ino_t> >::iterator c =
+        _children.find(parent);
+    if (c != _children.end()) {
+        std::vector<ino_t>::iterator i =
+            std::find(c->second.begin(), c->second.end(), child);
+        if (i != c->second.end())
+            c->second.erase(i);
+    }
+}
+
+void
+SnapshotIndex::removeTree(ino_t dir, const std::unordered_set<ino_t> &keep,
+                          std::unordered_set<ino_t> *removed)
+{
+    std::vector<ino_t> stack(1, dir);
+    while (!stack.empty()) {
+        ino_t ino = stack.back();
+        stack.pop_back();
+        removed->insert(ino);
+        _dirs.erase(ino);
+        std::unordered_map<ino_t, std::vector<ino_t> >::iterator c =
+            _children.find(ino);
+        if (c == _children.end())
+            continue;
+        for (unsigned i = 0; i < c->second.size(); ++i) {
+            // directories moved out of the subtree are in the delta
+            if (!keep.count(c->second[i]))
+                stack.push_back(c->second[i]);
+        }
+        _children.erase(c);
+    }
+}
+
+bool
+SnapshotIndex::unchanged(const struct stat &dirStat) const
+{
+    std::unordered_map<ino_t, Dir>::const_iterator d =
+        _dirs.find(dirStat.st_ino);
+    if (d == _dirs.end())
+        return false;
+    // Any change to the entries updates both times. The walk that
+    // recorded them must also have started after the last change, or
+    // it may have missed changes made in the same second.
+    return d->second.mtime == dirStat.st_mtime &&
+        d->second.ctime == dirStat.st_ctime &&
+        dirStat.st_ctime + CLOCK_MARGIN < d->second.scanStart;
+}
+
+void
+SnapshotIndex::subdirectories(
+    ino_t dirIno, std::vector<std::pair<std::string, ino_t> > *subdirs) const
+{
+    subdirs->clear();
+    std::unordered_map<ino_t, std::vector<ino_t> >::const_iterator c =
+        _children.find(dirIno);
+    if (c == _children.end())
+        return;
+    for (unsigned i = 0; i < c->second.size(); ++i) {
+        std::unordered_map<ino_t, Dir>::const_iterator d =
+            _dirs.find(c->second[i]);
+        if (d != _dirs.end())
+            subdirs->push_back(std::make_pair(d->second.name, d->first));
+    }
+}
+
+bool
+SnapshotIndex::times(ino_t dirIno, int64_t *mtime, int64_t *ctime) const
+{
+    std::unordered_map<ino_t, Dir>::const_iterator d = _dirs.find(dirIno);
+    if (d == _dirs.end())
+        return false;
+    *mtime = d->second.mtime;
+    *ctime = d->second.ctime;
+    return true;
+}
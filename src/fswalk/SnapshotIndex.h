@@ -0,0 +1,105 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef SNAPSHOTINDEX_H
+#define SNAPSHOTINDEX_H
+
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/**
+ * The directory tree of a file system snapshot: the inode number,
+ * parent, name, and times of every directory. It is loaded from a full
+ * snapshot followed by any number of incremental ones (deltas), in the
+ * order they were taken.
+ *
+ * A delta holds all the entries of the directories that were rescanned
+ * (listed in its fssnapshot_rescanned extent), plus the updated records
+ * of the changed subdirectories of the directories that were not.
+ */
+class SnapshotIndex {
+public:
+    /// What a delta changed
+    struct Changes {
+        /// the directories whose entries were all scanned again
+        std::unordered_set<ino_t> rescanned;
+        /// the directories that are gone, including their subtrees
+        std::unordered_set<ino_t> removed;
+    };
+
+    /// Whether a snapshot file is a delta
+    /// @param[in] filename The snapshot file
+    /// @param[out] startTime When the walk started (0 if unknown)
+    static bool isIncremental(const std::string &filename,
+                              int64_t *startTime = NULL);
+
+    /// Applies a snapshot: a full snapshot replaces the tree, a delta
+    /// updates it
+    /// @param[in] filename The snapshot file
+    /// @param[out] changes If not NULL, what the delta changed
+    void load(const std::string &filename, Changes *changes = NULL);
+
+    /// Determines whether the entries of a directory are the same as
+    /// when it was last scanned
+    /// @param[in] dirStat The stat info of the directory now
+    bool unchanged(const struct stat &dirStat) const;
+
+    /// Retrieves the subdirectories of a directory
+    /// @param[in] dirIno The inode number of the directory
+    /// @param[out] subdirs Their names and inode numbers
+    void subdirectories(ino_t dirIno,
+                        std::vector<std::pair<std::string, ino_t> > *subdirs)
+        const;
+
+    /// Retrieves the times recorded for a directory
+    /// @returns false if the directory is unknown
+    bool times(ino_t dirIno, int64_t *mtime, int64_t *ctime) const;
+
+    size_t size() const { return _dirs.size(); }
+
+private:
+    /// Directories changed within this many seconds before a walk
+    /// started may have changed again during the walk without their
+    /// times showing it (times are in seconds, and the file server's
+    /// clock may be ahead of ours)
+    static const int64_t CLOCK_MARGIN = 60;
+
+    struct Dir {
+        ino_t parent;
+        std::string name;
+        int64_t mtime;
+        int64_t ctime;
+        /// when the walk that recorded the directory started
+        int64_t scanStart;
+    };
+    /// A directory record of a snapshot
+    struct DirRecord {
+        ino_t parent;
+        std::string name;
+        ino_t ino;
+        int64_t mtime;
+        int64_t ctime;
+    };
+
+    void removeChild(ino_t parent, ino_t child);
+    /// Removes a directory and its subtree, except for the directories
+    /// in keep
+    void removeTree(ino_t dir, const std::unordered_set<ino_t> &keep,
+                    std::unordered_set<ino_t> *removed);
+
+    std::unordered_map<ino_t, Dir> _dirs;
+    /// The subdirectories of each directory, including the roots of the
+    /// walk, which have no Dir of their own
+    std::unordered_map<ino_t, std::vector<ino_t> > _children;
+};
+
+#endif // SNAPSHOTINDEX_H
@@ -17,9 +17,11 @@ public:
 };
 
 StatGatherer::StatGatherer(const std::string &dsFilename,
-                           int compressionLevel) :
+                           int compressionLevel,
+                           bool incremental) :
     _statRecords(0),
     _symlinkRecords(0),
+    _rescannedRecords(0),
     _fPIno(_esStat, "p_ino"),
     _fFilename(_esStat, "filename"),
     _fIno(_esStat, "ino"),
@@ -37,26 +39,45 @@ StatGatherer::StatGatherer(const std::string &dsFilename,
     _fMTime(_esStat, "mtime"),
     _fCTime(_esStat, "ctime"),
     _fSIno(_esSymlink, "ino"),
-    _fSTarget(_esSymlink, "target")
+    _fSTarget(_esSymlink, "target"),
+    _fStartTime(_esInfo, "start_time"),
+    _fIncremental(_esInfo, "incremental"),
+    _fRIno(_esRescanned, "ino")
 {
-    openSink(dsFilename, compressionLevel);
+    clock_gettime(CLOCK_MONOTONIC, &_startTime);
+    openSink(dsFilename, compressionLevel, incremental);
 }
 
 StatGatherer::~StatGatherer()
 {
+    // the rate is of the scan, not of flushing the output
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
     if (_omStat)
         delete _omStat;
     if (_omSymlink)
         delete _omSymlink;
+    if (_omInfo)
+        delete _omInfo;
+    if (_omRescanned)
+        delete _omRescanned;
     if (_dss) {
         _dss->flushPending(); // flush so stats are accurate
         DataSeriesSink::Stats s = _dss->getStats();
         s.printText(std::cout);
         delete _dss;
     }
+    double secs = (now.tv_sec - _startTime.tv_sec) +
+        (now.tv_nsec - _startTime.tv_nsec) / 1e9;
+    std::cout << std::endl
+              << "Total stat records: " << _statRecords;
+    if (secs > 0)
+        std::cout << " (" << unsigned(_statRecords / secs) << " per second)";
     std::cout << std::endl
-              << "Total stat records: " << _statRecords << std::endl
               << "Total symlink records: " << _symlinkRecords << std::endl;
+    if (_rescannedRecords)
+        std::cout << "Directories rescanned: " << _rescannedRecords
+                  << std::endl;
 }
 
 
@@ -86,20 +107,55 @@ void
 StatGatherer::doAddFile(ino_t parentIno,
                         const std::string &filename,
                         struct stat *statBuf)
+{
+    recordFile(parentIno, filename, *statBuf);
+    delete statBuf; // allocated in addFile() and passed through the message;
+}
+
+
+
+class StatGatherer::MessageAddFileBatch : public MessageBase {
+    ino_t _parentIno;
+    FileStatBatch *_batch;
+public:
+    MessageAddFileBatch(StatGatherer *self, ino_t parentIno,
+                        FileStatBatch *batch) :
+        MessageBase(self), _parentIno(parentIno), _batch(batch) { }
+    virtual void run() { _self->doAddFileBatch(_parentIno, _batch); }
+};
+void
+StatGatherer::addFile(ino_t parentIno, FileStatBatch *batch)
+{
+    enqueueMessage(new MessageAddFileBatch(this, parentIno, batch));
+}
+void
+StatGatherer::doAddFileBatch(ino_t parentIno, FileStatBatch *batch)
+{
+    for (FileStatBatch::const_iterator i = batch->begin();
+         i != batch->end(); ++i) {
+        recordFile(parentIno, i->filename, i->statBuf);
+    }
+    delete batch;
+}
+
+void
+StatGatherer::recordFile(ino_t parentIno,
+                         const std::string &filename,
+                         const struct stat &statBuf)
 {
     /*
     std::cout << "p=" << parentIno
               << " n=" << filename
-              << " i=" << statBuf->st_ino
+              << " i=" << statBuf.st_ino
               << std::endl;
     */
     _omStat->newRecord();
     _fPIno.set(parentIno);
     _fFilename.set(filename);
-    _fIno.set(statBuf->st_ino);
-    _fDev.set(statBuf->st_dev);
-    _fMode.set(~S_IFMT & statBuf->st_mode);
-    switch(S_IFMT & statBuf->st_mode) {
+    _fIno.set(statBuf.st_ino);
+    _fDev.set(statBuf.st_dev);
+    _fMode.set(~S_IFMT & statBuf.st_mode);
+    switch(S_IFMT & statBuf.st_mode) {
     case S_IFSOCK:
         _fType.set("socket");
         break;
@@ -125,20 +181,19 @@ StatGatherer::doAddFile(ino_t parentIno,
         _fType.set("unknown");
         break;
     }
-    _fNLink.set(statBuf->st_nlink);
-    _fUid.set(statBuf->st_uid);
-    _fGid.set(statBuf->st_gid);
-    _fRDev.set(statBuf->st_rdev);
-    _fSize.set(statBuf->st_size);
-    _fBlkSize.set(statBuf->st_blksize);
-    _fBlocks.set(statBuf->st_blocks);
-    _fATime.set(statBuf->st_atime);
-    _fMTime.set(statBuf->st_mtime);
-    _fCTime.set(statBuf->st_ctime);
+    _fNLink.set(statBuf.st_nlink);
+    _fUid.set(statBuf.st_uid);
+    _fGid.set(statBuf.st_gid);
+    _fRDev.set(statBuf.st_rdev);
+    _fSize.set(statBuf.st_size);
+    _fBlkSize.set(statBuf.st_blksize);
+    _fBlocks.set(statBuf.st_blocks);
+    _fATime.set(statBuf.st_atime);
+    _fMTime.set(statBuf.st_mtime);
+    _fCTime.set(statBuf.st_ctime);
     ++_statRecords;
     if (_statRecords % 10000 == 0)
         std::cout << "." << std::flush;
-    delete statBuf; // allocated in addFile() and passed through the message;
 }
 
 
@@ -183,6 +238,28 @@ StatGatherer::doAddLink(ino_t linkIno, const std::string &filename)
 
 
 
+class StatGatherer::MessageAddRescanned : public MessageBase {
+    ino_t _dirIno;
+public:
+    MessageAddRescanned(StatGatherer *self, ino_t dirIno) :
+        MessageBase(self), _dirIno(dirIno) { }
+    virtual void run() { _self->doAddRescanned(_dirIno); }
+};
+void
+StatGatherer::addRescanned(ino_t dirIno)
+{
+    enqueueMessage(new MessageAddRescanned(this, dirIno));
+}
+void
+StatGatherer::doAddRescanned(ino_t dirIno)
+{
+    _omRescanned->newRecord();
+    _fRIno.set(dirIno);
+    ++_rescannedRecords;
+}
+
+
+
 class StatGatherer::MessageFinish : public MessageBase {
     FinishCb *_cb;
 public:
@@ -204,14 +281,26 @@ StatGatherer::doFinish(FinishCb *cb)
 }
 
 void
-StatGatherer::openSink(std::string filename, int cLevel)
+StatGatherer::openSink(std::string filename, int cLevel, bool incremental)
 {
     ExtentTypeLibrary lib;
     ExtentType::Ptr extStat(lib.registerTypePtr(EXTENT_FSSNAPSHOT_STAT));
     ExtentType::Ptr extSymlink(lib.registerTypePtr(EXTENT_FSSNAPSHOT_SYMLINK));
+    ExtentType::Ptr extInfo(lib.registerTypePtr(EXTENT_FSSNAPSHOT_INFO));
+    ExtentType::Ptr extRescanned(
+        lib.registerTypePtr(EXTENT_FSSNAPSHOT_RESCANNED));
     _dss = new DataSeriesSink(filename, cLevel);
     _dss->writeExtentLibrary(lib);
 
     _omStat = new OutputModule(*_dss, _esStat, extStat, EXTENT_SIZE);
     _omSymlink = new OutputModule(*_dss, _esSymlink, extSymlink, EXTENT_SIZE);
+    _omInfo = new OutputModule(*_dss, _esInfo, extInfo, EXTENT_SIZE);
+    _omRescanned = new OutputModule(*_dss, _esRescanned, extRescanned,
+                                    EXTENT_SIZE);
+
+    // the start of the walk, which later incremental walks compare the
+    // directory times to
+    _omInfo->newRecord();
+    _fStartTime.set(time(NULL));
+    _fIncremental.set(incremental);
 }
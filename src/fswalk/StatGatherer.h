@@ -10,10 +10,13 @@
 #include "Process.h"
 #include "DataSeries/DataSeriesFile.hpp"
 #include "DataSeries/DataSeriesModule.hpp"
+#include "DataSeries/BoolField.hpp"
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 #include <string>
+#include <vector>
 
 class StatGatherer : public Process {
 public:
@@ -25,8 +28,19 @@ public:
         virtual void operator()() = 0;
     };
 
+    /// A directory entry and its stat info
+    struct FileStat {
+        std::string filename;
+        struct stat statBuf;
+    };
+    typedef std::vector<FileStat> FileStatBatch;
+
+    /// @param[in] dsFilename The snapshot file to write
+    /// @param[in] compressionLevel DataSeries compression
+    /// @param[in] incremental True if the snapshot is a delta
     StatGatherer(const std::string &dsFilename,
-                 int compressionLevel = Extent::compress_all);
+                 int compressionLevel = Extent::compress_all,
+                 bool incremental = false);
     virtual ~StatGatherer();
 
     /// Add a file's stat info to the log
@@ -39,11 +53,22 @@ public:
                  const std::string &filename,
                  const struct stat &statBuf);
 
+    /// Add the stat info of a batch of files to the log
+    /// @param[in] parentIno The inode number of the directory
+    /// containing all the files
+    /// @param[in] batch The files; the StatGatherer takes ownership
+    void addFile(ino_t parentIno, FileStatBatch *batch);
+
     /// Add a symlink to the log
     /// @param[in] linkIno The inode number of the symlink
     /// @param[in] filename The full path to the symlink
     void addLink(ino_t linkIno, const std::string &filename);
 
+    /// Record that all the entries of a directory are in the (delta)
+    /// snapshot
+    /// @param[in] dirIno The inode number of the directory
+    void addRescanned(ino_t dirIno);
+
     /// Called when all files have been added. This causes the process
     /// to finish processing any data and exit.
     /// @param[in] cb Callback that will be called once the process is
@@ -52,21 +77,32 @@ public:
 private:
     class MessageBase;
     class MessageAddFile;
+    class MessageAddFileBatch;
     class MessageAddLink;
+    class MessageAddRescanned;
     class MessageFinish;
 
     void doAddFile(ino_t parentIno,
                    const std::string &filename,
                    struct stat *statBuf);
+    void doAddFileBatch(ino_t parentIno, FileStatBatch *batch);
+    /// Writes the record of a file
+    void recordFile(ino_t parentIno,
+                    const std::string &filename,
+                    const struct stat &statBuf);
     void doAddLink(ino_t linkIno, const std::string &filename);
+    void doAddRescanned(ino_t dirIno);
     void doFinish(FinishCb *cb);
 
-    void openSink(std::string filename, int cLevel);
+    void openSink(std::string filename, int cLevel, bool incremental);
 
     /// Target size (approximate) for DS extents
     static const unsigned EXTENT_SIZE = 16*1024*1024;
     unsigned _statRecords;
     unsigned _symlinkRecords;
+    unsigned _rescannedRecords;
+    /// When the gatherer was created, for the record rate
+    timespec _startTime;
 
     DataSeriesSink *_dss;
     OutputModule *_omSymlink;
@@ -97,6 +133,16 @@ private:
     Int64Field _fSIno;
     Variable32Field _fSTarget;
     /// @}
+    /// DataSeries variables for the "info" and "rescanned" extents
+    /// @{
+    OutputModule *_omInfo;
+    ExtentSeries _esInfo;
+    Int64Field _fStartTime;
+    BoolField _fIncremental;
+    OutputModule *_omRescanned;
+    ExtentSeries _esRescanned;
+    Int64Field _fRIno;
+    /// @}
 };
 
 #endif // STATGATHERER_H
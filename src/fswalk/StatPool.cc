@@ -0,0 +1,162 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#include "StatPool.h"
+#include "DirScanner.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <fcntl.h>
+#include <iomanip>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Latencies up to this factor above the lowest one are not queuing
+static const double LATENCY_TOLERANCE = 1.5;
+
+const unsigned StatPool::MIN_LIMIT;
+const unsigned StatPool::MIN_WINDOW;
+
+static uint64_t
+nsNow()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000llu + ts.tv_nsec;
+}
+
+StatPool::StatPool(unsigned numThreads, unsigned addedLatencyUs) :
+    _addedLatencyUs(addedLatencyUs), _active(0), _shutdown(false),
+    _limit(std::min(numThreads, MIN_LIMIT)), _latencyNs(0), _minLatencyNs(0),
+    _windowNs(0), _windowStats(0), _stats(0), _statNs(0)
+{
+    for (unsigned i = 0; i < numThreads; ++i) {
+        _threads.push_back(std::thread(&StatPool::worker, this));
+    }
+}
+
+StatPool::~StatPool()
+{
+    shutdown();
+}
+
+void
+StatPool::submit(StatRequest *req)
+{
+    std::lock_guard<std::mutex> l(_lock);
+    _queue.push_back(req);
+    _cond.notify_one();
+}
+
+void
+StatPool::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> l(_lock);
+        _shutdown = true;
+        _cond.notify_all();
+    }
+    for (unsigned i = 0; i < _threads.size(); ++i) {
+        _threads[i].join();
+    }
+    _threads.clear();
+}
+
+void
+StatPool::worker()
+{
+    std::unique_lock<std::mutex> l(_lock);
+    while (true) {
+        _cond.wait(l, [this] {
+                return _shutdown ||
+                    (!_queue.empty() && _active < _limit.load()); });
+        if (_queue.empty())
+            return; // shut down
+        StatRequest *req = _queue.front();
+        _queue.pop_front();
+        ++_active;
+        l.unlock();
+
+        StatGatherer::FileStatBatch &batch = *req->batch;
+        req->errors.assign(batch.size(), 0);
+        uint64_t start = nsNow();
+        for (unsigned i = 0; i < batch.size(); ++i) {
+            if (_addedLatencyUs)
+                usleep(_addedLatencyUs);
+            if (fstatat(req->dirFd, batch[i].filename.c_str(),
+                        &batch[i].statBuf, AT_SYMLINK_NOFOLLOW)) {
+                req->errors[i] = errno;
+            }
+        }
+        uint64_t ns = nsNow() - start;
+        unsigned stats = batch.size();
+
+        l.lock();
+        // Returned under the lock: the scanners' message queues are
+        // spinlocks, which are costly to contend for from many threads
+        // when some of them get preempted. The request belongs to the
+        // scanner from here on.
+        req->owner->statDone(req);
+        --_active;
+        _windowNs += ns;
+        _windowStats += stats;
+        _stats += stats;
+        _statNs += ns;
+        if (_windowStats >= std::max(2 * _limit.load(), MIN_WINDOW)) {
+            adapt();
+        }
+        _cond.notify_one();
+    }
+}
+
+void
+StatPool::adapt()
+{
+    double window = double(_windowNs) / _windowStats;
+    _windowNs = 0;
+    _windowStats = 0;
+    // a single slow window (e.g., a descheduled thread) is not queuing
+    double latency = _latencyNs ? (3 * _latencyNs + window) / 4 : window;
+    _latencyNs = latency;
+    if (0 == _minLatencyNs || latency < _minLatencyNs) {
+        _minLatencyNs = latency;
+    } else {
+        // let the baseline follow a file system that got slower for
+        // good, rather than shrinking the limit forever
+        _minLatencyNs += (latency - _minLatencyNs) / 64;
+    }
+
+    unsigned limit = _limit.load();
+    double gradient = LATENCY_TOLERANCE * _minLatencyNs / latency;
+    if (gradient >= 1.0) {
+        // no queuing yet: probe for more
+        limit += std::max(1u, unsigned(std::sqrt(double(limit))));
+    } else {
+        // back off gradually: by at most 10% a window
+        limit = unsigned(limit * (0.8 + 0.2 * std::max(gradient, 0.5)));
+    }
+    limit = std::max(MIN_LIMIT, limit);
+    limit = std::min(unsigned(_threads.size()), limit);
+    bool grew = limit > _limit.load();
+    _limit = limit;
+    if (grew) {
+        _cond.notify_all();
+    }
+}
+
+void
+StatPool::printStats(std::ostream &out)
+{
+    uint64_t stats = _stats.load();
+    out << "Stat pool: " << stats << " stats";
+    if (stats) {
+        out << ", " << std::fixed << std::setprecision(1)
+            << _statNs.load() / 1000.0 / stats << " us each";
+    }
+    out << ", " << _limit.load() << " of " << _threads.size()
+        << " in flight" << std::endl;
+}
@@ -0,0 +1,109 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef STATPOOL_H
+#define STATPOOL_H
+
+#include "StatGatherer.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+class DirScanner;
+class Scheduler;
+
+/**
+ * A chunk of the entries of a directory, sent by a DirScanner to the
+ * StatPool. The pool stat()s the entries in place and hands the same
+ * request back.
+ */
+struct StatRequest {
+    /// the scanner to return the request to
+    DirScanner *owner;
+    /// the scheduler to run the owner on when the request is done
+    Scheduler *scheduler;
+    /// the directory the names are relative to
+    int dirFd;
+    /// the entries, with only their names filled in
+    StatGatherer::FileStatBatch *batch;
+    /// errno of the stat() of each entry (0 on success)
+    std::vector<int> errors;
+};
+
+/**
+ * A pool of threads making the (blocking) stat() calls of the
+ * DirScanners, so a high-latency file system has many of them in flight
+ * at once, even for the entries of a single directory.
+ *
+ * The number of stat() calls in flight is adapted to the file system:
+ * it grows while their latency stays close to the lowest seen, and
+ * shrinks in proportion once they start queuing, between MIN_LIMIT and
+ * the number of threads.
+ */
+class StatPool {
+    /// No copy
+    StatPool(StatPool &);
+    /// No assignment
+    StatPool &operator=(const StatPool &);
+public:
+    /// @param[in] numThreads The maximum number of stat() calls in flight
+    /// @param[in] addedLatencyUs Latency added to each stat() call, to
+    /// emulate a remote file system (for benchmarking)
+    StatPool(unsigned numThreads, unsigned addedLatencyUs = 0);
+    ~StatPool();
+
+    /// Queue a request; it is returned to req->owner once done
+    void submit(StatRequest *req);
+    /// Terminate the threads (once the scanners are all done)
+    void shutdown();
+
+    /// The current limit on the stat() calls in flight
+    unsigned getLimit() { return _limit.load(); }
+    /// Prints the number of stat() calls, their average latency, and
+    /// the concurrency limit
+    void printStats(std::ostream &out);
+
+private:
+    /// The lowest concurrency limit
+    static const unsigned MIN_LIMIT = 4;
+    /// The fewest stat()s the latency is averaged over
+    static const unsigned MIN_WINDOW = 64;
+
+    void worker();
+    /// Adapts the limit to the latency of the last window of stat()s
+    void adapt();
+
+    std::vector<std::thread> _threads;
+    unsigned _addedLatencyUs;
+
+    std::mutex _lock;
+    std::condition_variable _cond;
+    std::deque<StatRequest *> _queue;
+    /// threads working on a request
+    unsigned _active;
+    bool _shutdown;
+
+    /// The limit on _active
+    std::atomic<unsigned> _limit;
+    /// Adaptation state, protected by _lock
+    /// @{
+    /// the moving average of the latency of the windows
+    double _latencyNs;
+    /// the lowest moving average
+    double _minLatencyNs;
+    uint64_t _windowNs;
+    unsigned _windowStats;
+    /// @}
+
+    std::atomic<uint64_t> _stats;
+    std::atomic<uint64_t> _statNs;
+};
+
+#endif // STATPOOL_H
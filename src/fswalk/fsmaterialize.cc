@@ -0,0 +1,283 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2012 Netapp, Inc.
+ * All rights reserved.
+ */
+
+/****************************** manpage text *******************************
+=head1 NAME
+
+fsmaterialize - combine an fswalk snapshot and its deltas
+
+=head1 SYNOPSIS
+
+fsmaterialize B<-o> F<outfile.ds> F<full.ds> [F<delta.ds> ...]
+
+=head1 DESCRIPTION
+
+B<fsmaterialize> combines a full snapshot taken by B<fswalk>(1) and
+the incremental snapshots (deltas) taken after it into the full
+snapshot of the tree as of the last delta. The snapshots are given in
+the order they were taken.
+
+An entry of a snapshot is kept unless a later delta rescanned its
+directory, removed its directory, or recorded it again. The symlink
+targets of the entries that are kept are taken from the latest
+snapshot that recorded them.
+
+The result records the start time of the full snapshot, so it can be
+used as the base of further incremental walks.
+
+=head1 OPTIONS
+
+=over
+
+=item B<-o> F<outfile.ds>
+
+Specifies the name of the DataSeries file to write the full snapshot
+into
+
+=back
+
+=head1 EXAMPLES
+
+=over
+
+=over
+
+=item fsmaterialize -o wed-full.ds mon.ds tue.ds wed.ds
+
+=back
+
+=back
+
+This combines the full snapshot F<mon.ds> with the deltas F<tue.ds>
+and F<wed.ds>.
+
+=head1 SEE ALSO
+
+fswalk(1)
+
+=head1 COPYRIGHT
+
+Copyright (c) 2012 NetApp, Inc.
+All rights reserved.
+
+=cut
+***************************************************************************/
+
+
+#include "SnapshotIndex.h"
+#include "SnapshotExtents.h"
+#include "RecordCopier.h"
+#include "DataSeries/DataSeriesModule.hpp"
+#include "DataSeries/TypeIndexModule.hpp"
+#include <cassert>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <unistd.h>
+
+static const unsigned EXTENT_SIZE = 16*1024*1024;
+
+/// A directory entry: the parent's inode # and the name
+typedef std::pair<ino_t, std::string> EntryKey;
+struct EntryKeyHash {
+    size_t operator()(const EntryKey &k) const {
+        return std::hash<std::string>()(k.second) * 31 + k.first;
+    }
+};
+
+/// What a snapshot supersedes in the ones before it
+struct Delta {
+    SnapshotIndex::Changes changes;
+    /// the entries recorded again outside of the rescanned directories
+    std::unordered_set<EntryKey, EntryKeyHash> replaced;
+};
+
+void
+usage(std::string progname)
+{
+    std::cout << progname
+              << " -o <outfile.ds> <full.ds> [<delta.ds> ...]"
+              << std::endl
+              << "   -o <outfile.ds> : Name of the DataSeries output file"
+              << std::endl
+              << std::endl;
+}
+
+static void
+readReplaced(const std::string &filename, Delta *delta)
+{
+    TypeIndexModule source("fssnapshot_stat");
+    source.addSource(filename);
+    ExtentSeries series;
+    Int64Field fPIno(series, "p_ino");
+    Variable32Field fFilename(series, "filename");
+    for (Extent::Ptr extent; (extent = source.getSharedExtent()) != NULL; ) {
+        for (series.setExtent(extent); series.morerecords(); ++series) {
+            if (!delta->changes.rescanned.count(fPIno.val()))
+                delta->replaced.insert(EntryKey(fPIno.val(),
+                                                fFilename.stringval()));
+        }
+    }
+}
+
+/// Whether a later snapshot than the one of the entry supersedes it
+static bool
+superseded(const std::vector<Delta> &deltas, unsigned snapshot,
+           const EntryKey &entry)
+{
+    for (unsigned j = snapshot + 1; j < deltas.size(); ++j) {
+        if (deltas[j].changes.rescanned.count(entry.first) ||
+            deltas[j].changes.removed.count(entry.first) ||
+            deltas[j].replaced.count(entry))
+            return true;
+    }
+    return false;
+}
+
+int
+main(int argc, char *argv[])
+{
+    std::string filename;
+
+    char opt;
+    while ((opt = getopt(argc, argv, "o:")) > 0) {
+        switch (opt) {
+        case 'o':
+            filename = optarg;
+            break;
+        default:
+            assert(0);
+        }
+    }
+    std::vector<std::string> snapshots(argv + optind, argv + argc);
+
+    if ("" == filename) {
+        usage(argv[0]);
+        std::cout << "Error: Must supply an output filename" << std::endl
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (snapshots.empty()) {
+        usage(argv[0]);
+        std::cout << "Error: Must supply a full snapshot" << std::endl
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // what each delta changed, as of the snapshots before it
+    int64_t startTime = 0;
+    SnapshotIndex index;
+    std::vector<Delta> deltas(snapshots.size());
+    for (unsigned i = 0; i < snapshots.size(); ++i) {
+        if ((0 == i) == SnapshotIndex::isIncremental(snapshots[i],
+                                                     i ? NULL : &startTime)) {
+            usage(argv[0]);
+            std::cout << "Error: The first snapshot must be a full one,"
+                      << " and the others its deltas" << std::endl
+                      << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        index.load(snapshots[i], &deltas[i].changes);
+        if (i)
+            readReplaced(snapshots[i], &deltas[i]);
+    }
+
+    ExtentTypeLibrary lib;
+    ExtentType::Ptr extStat(lib.registerTypePtr(EXTENT_FSSNAPSHOT_STAT));
+    ExtentType::Ptr extSymlink(lib.registerTypePtr(EXTENT_FSSNAPSHOT_SYMLINK));
+    ExtentType::Ptr extInfo(lib.registerTypePtr(EXTENT_FSSNAPSHOT_INFO));
+    DataSeriesSink sink(filename, Extent::compress_all);
+    sink.writeExtentLibrary(lib);
+
+    ExtentSeries esInfo;
+    Int64Field fStartTime(esInfo, "start_time");
+    BoolField fIncremental(esInfo, "incremental");
+    OutputModule *omInfo = new OutputModule(sink, esInfo, extInfo,
+                                            EXTENT_SIZE);
+    omInfo->newRecord();
+    fStartTime.set(startTime);
+    fIncremental.set(false);
+    delete omInfo;
+
+    // the entries that are kept, and the symlinks among them
+    uint64_t statRecords = 0;
+    std::unordered_set<ino_t> symlinks;
+    {
+        ExtentSeries in, out;
+        Int64Field fPIno(in, "p_ino");
+        Variable32Field fFilename(in, "filename");
+        Int64Field fIno(in, "ino");
+        Variable32Field fType(in, "ftype");
+        RecordCopier copier(extStat, in, out);
+        OutputModule *om = new OutputModule(sink, out, extStat, EXTENT_SIZE);
+        for (unsigned i = 0; i < snapshots.size(); ++i) {
+            TypeIndexModule source("fssnapshot_stat");
+            source.addSource(snapshots[i]);
+            for (Extent::Ptr extent;
+                 (extent = source.getSharedExtent()) != NULL; ) {
+                for (in.setExtent(extent); in.morerecords(); ++in) {
+                    EntryKey entry(fPIno.val(), fFilename.stringval());
+                    if (superseded(deltas, i, entry))
+                        continue;
+                    om->newRecord();
+                    copier.copy();
+                    ++statRecords;
+                    if (fType.stringval() == "symlink")
+                        symlinks.insert(fIno.val());
+                }
+            }
+        }
+        delete om;
+    }
+
+    // the latest target of each symlink that is kept
+    uint64_t symlinkRecords = 0;
+    {
+        std::unordered_map<ino_t, unsigned> latest;
+        ExtentSeries in, out;
+        Int64Field fIno(in, "ino");
+        for (unsigned i = 0; i < snapshots.size(); ++i) {
+            TypeIndexModule source("fssnapshot_symlink");
+            source.addSource(snapshots[i]);
+            for (Extent::Ptr extent;
+                 (extent = source.getSharedExtent()) != NULL; ) {
+                for (in.setExtent(extent); in.morerecords(); ++in) {
+                    if (symlinks.count(fIno.val()))
+                        latest[fIno.val()] = i;
+                }
+            }
+        }
+
+        RecordCopier copier(extSymlink, in, out);
+        OutputModule *om = new OutputModule(sink, out, extSymlink,
+                                            EXTENT_SIZE);
+        for (unsigned i = 0; i < snapshots.size(); ++i) {
+            TypeIndexModule source("fssnapshot_symlink");
+            source.addSource(snapshots[i]);
+            for (Extent::Ptr extent;
+                 (extent = source.getSharedExtent()) != NULL; ) {
+                for (in.setExtent(extent); in.morerecords(); ++in) {
+                    std::unordered_map<ino_t, unsigned>::iterator l =
+                        latest.find(fIno.val());
+                    if (l == latest.end() || l->second != i)
+                        continue;
+                    om->newRecord();
+                    copier.copy();
+                    ++symlinkRecords;
+                    // a symlink may have been read more than once
+                    latest.erase(l);
+                }
+            }
+        }
+        delete om;
+    }
+
+    sink.close();
+    std::cout << "Total stat records: " << statRecords << std::endl
+              << "Total symlink records: " << symlinkRecords << std::endl
+              << "Directories: " << index.size() << std::endl;
+    return EXIT_SUCCESS;
+}
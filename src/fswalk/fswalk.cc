@@ -11,7 +11,8 @@ fswalk - walk a directory tree, cataloging its structure
 
 =head1 SYNOPSIS
 
-fswalk B<-p> F<path> [B<-p> F<path> ...] [B<-t> threads] B<-o> F<outfile.ds>
+fswalk B<-p> F<path> [B<-p> F<path> ...] [B<-t> threads] [B<-w> stat_threads]
+[B<-L> usec] [B<-b> F<snapshot.ds> ...] B<-o> F<outfile.ds>
 
 =head1 DESCRIPTION
 
@@ -30,6 +31,22 @@ recreate a directory tree (excluding any actual file data).
 In addition to saving the directory tree, a symlink's "target" is also
 saved in a separate table.
 
+Given the earlier snapshots of the same tree (B<-b>), B<fswalk> only
+records what changed since: an incremental snapshot, or delta. A
+directory whose modification and status change times are the same as
+when it was last scanned, and that scan started over a minute after
+them, is not read again; only its subdirectories are. The delta
+lists the directories that were read, all of whose entries it holds,
+as well as the records of the subdirectories whose times changed in
+the directories that were not. B<fsmaterialize>(1) combines a full
+snapshot and its deltas into a full snapshot.
+
+Since the files of an unchanged directory are not stat(2)ed again, a
+delta misses the changes to files that don't change their directory
+(e.g., writes to, or chmod(2) of, an existing file). Incremental
+snapshots track the namespace of the tree, not the contents of its
+files.
+
 =head1 OPTIONS
 
 =over
@@ -56,6 +73,28 @@ parameter should be greater than one, typically in the range of 10 to
 50 to ensure the file system is kept busy, though a lower number may
 be desired to limit the load on the system.
 
+=item B<-w> I<stat_threads>
+
+Uses a separate pool of up to I<stat_threads> threads for the stat(2)
+calls, so a high-latency (e.g., NFS) file system has up to that many
+of them in flight, including for the entries of a single large
+directory. Up to I<stat_threads> directories are also scanned at a
+time. The number of calls in flight adapts to the file system: it
+grows while their latency stays low, and backs off when it rises. The
+default, 0, makes the stat(2) calls in the B<-t> threads.
+
+=item B<-L> I<usec>
+
+Adds I<usec> microseconds of latency to each stat(2) call of the B<-w>
+pool. This emulates a remote file system on a local (e.g., tmpfs) tree
+for benchmarking.
+
+=item B<-b> F<snapshot.ds>
+
+Makes this an incremental snapshot against earlier snapshots of the
+same paths: the first B<-b> names a full snapshot, and each following
+one a delta of the one before it, in the order they were taken.
+
 =back
 
 =head1 EXAMPLES
@@ -74,9 +113,34 @@ This walks the directory tree rooted at F</root/of/the/tree>, using up
 to 15 simultaneous requests and saving the result of the walk into
 F<tree.ds> in the current directory.
 
+=over
+
+=over
+
+=item fswalk -p /mnt/filer/export -t 8 -w 256 -o export.ds
+
+=back
+
+=back
+
+This walks an NFS export with up to 256 stat(2) calls in flight.
+
+=over
+
+=over
+
+=item fswalk -p /mnt/filer/export -t 8 -b mon.ds -b tue.ds -o wed.ds
+
+=back
+
+=back
+
+This records what changed in the export since the full snapshot
+F<mon.ds> and its delta F<tue.ds>.
+
 =head1 SEE ALSO
 
-chronicle(1)
+chronicle(1), fsmaterialize(1)
 
 =head1 COPYRIGHT
 
@@ -91,6 +155,9 @@ All rights reserved.
 #include "DirGatherer.h"
 #include "StatGatherer.h"
 #include "ScannerFactory.h"
+#include "StatPool.h"
+#include "SnapshotIndex.h"
+#include <algorithm>
 #include <iostream>
 #include <cstdlib>
 
@@ -98,12 +165,22 @@ void
 usage(std::string progname)
 {
     std::cout << progname
-              << " -p <path> [-p ...] [-t <threads>] -o <outfile.ds>"
+              << " -p <path> [-p ...] [-t <threads>] [-w <stat_threads>]"
+              << " [-L <usec>] [-b <snapshot.ds> ...] -o <outfile.ds>"
               << std::endl
               << "   -p <path>       : Top of directory tree to scan"
               << std::endl
               << "   -t <threads>    : Number of scanning threads"
               << std::endl
+              << "   -w <stat_threads> : Max stat() calls in flight"
+              << " (0: stat in the scanning threads)"
+              << std::endl
+              << "   -L <usec>       : Latency added to each stat() of -w"
+              << " (benchmarking)"
+              << std::endl
+              << "   -b <snapshot.ds> : Earlier snapshot to record the changes"
+              << " since (full, then deltas)"
+              << std::endl
               << "   -o <outfile.ds> : Name of the DataSeries output file"
               << std::endl
               << std::endl;
@@ -123,10 +200,13 @@ main(int argc, char *argv[])
 {
     std::list<std::string> initialPaths;
     unsigned threads = Scheduler::numProcessors();
+    unsigned statThreads = 0;
+    unsigned addedLatencyUs = 0;
     std::string filename;
+    std::list<std::string> baseFiles;
 
     char opt;
-    while ((opt = getopt(argc, argv, "p:t:o:")) > 0) {
+    while ((opt = getopt(argc, argv, "p:t:o:w:L:b:")) > 0) {
         switch (opt) {
         case 'o':
             filename = optarg;
@@ -137,6 +217,15 @@ main(int argc, char *argv[])
         case 't':
             threads = atoi(optarg);
             break;
+        case 'w':
+            statThreads = atoi(optarg);
+            break;
+        case 'L':
+            addedLatencyUs = atoi(optarg);
+            break;
+        case 'b':
+            baseFiles.push_back(optarg);
+            break;
         default:
             assert(0);
         }
@@ -155,14 +244,38 @@ main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    SnapshotIndex *index = NULL;
+    if (!baseFiles.empty()) {
+        index = new SnapshotIndex;
+        for (std::list<std::string>::const_iterator i = baseFiles.begin();
+             i != baseFiles.end(); ++i) {
+            if ((i == baseFiles.begin()) == SnapshotIndex::isIncremental(*i)) {
+                usage(argv[0]);
+                std::cout << "Error: The first snapshot must be a full one,"
+                          << " and the others its deltas" << std::endl
+                          << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            index->load(*i);
+        }
+        std::cout << "Directories in the earlier snapshots: "
+                  << index->size() << std::endl;
+    }
+
     Scheduler::initScheduler();
     ScannerFactory f;
     DirGatherer *d = new DirGatherer(&f);
     f.dirGatherer(d);
-    sg = new StatGatherer(filename);
+    sg = new StatGatherer(filename, Extent::compress_all, NULL != index);
     f.statGatherer(sg);
+    f.snapshotIndex(index);
+    StatPool *pool = NULL;
+    if (statThreads) {
+        pool = new StatPool(statThreads, addedLatencyUs);
+        f.statPool(pool);
+    }
 
-    d->maxScanners(threads);
+    d->maxScanners(std::max(threads, statThreads));
     for (std::list<std::string>::const_iterator i = initialPaths.begin();
          i != initialPaths.end(); ++i) {
         d->addDirectory(*i);
@@ -170,6 +283,12 @@ main(int argc, char *argv[])
     DGComplete dgcb;
     d->start(&dgcb);
     Scheduler::startSchedulers(threads, d, false);
+    if (pool) {
+        pool->shutdown();
+        pool->printStats(std::cout);
+        delete pool;
+    }
+    delete index;
     std::cout << "all done" << std::endl;
     return EXIT_SUCCESS;
 }
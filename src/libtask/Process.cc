@@ -14,7 +14,8 @@ TtasLock Process::_msgPrintLock("MsgPrintLock");
 
 Process::Process(std::string name) :
     _msg_queue_lock("ProcMsgQ"),
-    _exited(false), _currScheduler(NULL), _processName(name), _messageLog(0)
+    _exited(false), _currScheduler(NULL), _processName(name),
+    _maxPending(0), _lockWaitNs(0), _messageLog(0)
 {
     __sync_fetch_and_add(&_alive, 1);
 #ifdef DEBUG
@@ -53,8 +54,11 @@ Process::enqueueMessage(Message *m, Scheduler *s)
 {
     assertValid();
     assert(!hasExited());
-    _msg_queue_lock.lock();
+    TaskProfile::lockTimed(_msg_queue_lock, _lockWaitNs);
     _msg_queue.push_back(m);
+    if (_msg_queue.size() > _maxPending.load(std::memory_order_relaxed)) {
+        _maxPending.store(_msg_queue.size(), std::memory_order_relaxed);
+    }
     if (NULL == _currScheduler && NULL != s) {
         _currScheduler = s;
         s->enqueueProcess(this);
@@ -122,7 +126,7 @@ Message *
 Process::getNextMessage()
 {
     Message *m = NULL;
-    _msg_queue_lock.lock();
+    TaskProfile::lockTimed(_msg_queue_lock, _lockWaitNs);
     if (!_msg_queue.empty()) {
         m = _msg_queue.front();
         _msg_queue.pop_front();
@@ -165,3 +169,11 @@ Process::logMessageCount()
         _messageLog->add(pendingMessages());
     }
 }
+
+void
+Process::getProfile(Profile &profile)
+{
+    _serviceTime.drain(profile.service);
+    profile.maxPending = _maxPending.exchange(0, std::memory_order_relaxed);
+    profile.lockWaitNs = _lockWaitNs.exchange(0, std::memory_order_relaxed);
+}
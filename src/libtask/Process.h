@@ -10,6 +10,7 @@
 #include "Lintel/Stats.hpp"
 #include "Lock.h"
 #include "Scheduler.h"
+#include "TaskProfile.h"
 #include <deque>
 #include <atomic>
 #include <string>
@@ -88,6 +89,26 @@ public:
     /// Record the current count of pending messages
     void logMessageCount();
 
+    /// Profiling data of a process since the last getProfile() call
+    struct Profile {
+        /// Service times of the messages executed
+        ServiceTimeHistogram::Snapshot service;
+        /// The longest the message queue has been
+        unsigned maxPending;
+        /// Time spent waiting for the message queue lock
+        uint64_t lockWaitNs;
+    };
+
+    /// Record the time the Scheduler took to execute one of our
+    /// messages. This should only be used by the Scheduler!
+    /// @param[in] ns The service time in nanoseconds
+    void recordServiceTime(uint64_t ns) { _serviceTime.record(ns); }
+
+    /// Retrieve (and reset) the profiling data of this process. This
+    /// is safe to call from any thread.
+    /// @param[out] profile The profiling data
+    void getProfile(Profile &profile);
+
 	/// Returns a unique string that identifies the process
 	virtual std::string getId() 
 		{ return std::to_string(reinterpret_cast<uint64_t>(this)); }
@@ -120,6 +141,16 @@ private:
     /// Text name of the process
     std::string _processName;
 
+    /// Service times of the messages executed by this process
+    ServiceTimeHistogram _serviceTime;
+
+    /// The longest the message queue has been (updated under
+    /// _msg_queue_lock)
+    std::atomic<unsigned> _maxPending;
+
+    /// Time spent waiting for _msg_queue_lock by senders and schedulers
+    std::atomic<uint64_t> _lockWaitNs;
+
     Stats *_messageLog;
     static TtasLock _msgPrintLock;
 
@@ -67,3 +67,28 @@ TEST(Process, processCanExit) {
     p.exit();
     ASSERT_TRUE(p.hasExited());
 }
+
+TEST(Process, profileTracksMailboxAndServiceTime) {
+    Process p;
+    for (unsigned i = 0; i < 3; i++) {
+        p.enqueueMessage(new CountingMsg, NULL);
+    }
+    while (p.runOneMessage()) { }
+    p.recordServiceTime(1000);
+    p.recordServiceTime(3000);
+
+    Process::Profile profile;
+    p.getProfile(profile);
+    EXPECT_EQ(3u, profile.maxPending);
+    EXPECT_EQ(2u, profile.service.count);
+    EXPECT_EQ(4000u, profile.service.sumNs);
+    EXPECT_EQ(3000u, profile.service.maxNs);
+    EXPECT_EQ(1023u, profile.service.quantile(0.5));
+    EXPECT_EQ(3000u, profile.service.quantile(0.99));
+
+    // the profile is reset on every read
+    p.getProfile(profile);
+    EXPECT_EQ(0u, profile.maxPending);
+    EXPECT_EQ(0u, profile.service.count);
+    EXPECT_EQ(0u, profile.service.quantile(0.5));
+}
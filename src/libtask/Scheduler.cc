@@ -7,6 +7,7 @@
 #include "Scheduler.h"
 #include "Process.h"
 #include "FDWatcher.h"
+#include "TaskProfile.h"
 #ifdef USE_TOPOLOGY
 #include "TopologyMap.h"
 #endif // USE_TOPOLOGY
@@ -28,6 +29,7 @@
 pthread_key_t Scheduler::_currSchedKey;
 pthread_key_t Scheduler::_isSchedKey;
 pthread_once_t Scheduler::_currSchedKeyOnce = PTHREAD_ONCE_INIT;
+std::vector<Scheduler *> Scheduler::_schedulers;
 
 static const unsigned MSGS_TO_RUN = 100;
 
@@ -245,9 +247,10 @@ Scheduler::allocSchedKey()
     pthread_setspecific(_isSchedKey, NULL);
 }
 
-Scheduler::Scheduler() :
-    _run_queue_lock("SchedRunQ"), _currentProcess(NULL),
-    _local(0), _steals(0), _msgs(0)
+Scheduler::Scheduler(unsigned id) :
+    _id(id), _run_queue_lock("SchedRunQ"), _currentProcess(NULL),
+    _local(0), _steals(0), _msgs(0), _busyNs(0), _stealNs(0), _sleepNs(0),
+    _idleNs(0), _runQueueLockWaitNs(0), _mark(TaskProfile::nowNs())
 {
     _magicNumber = SCHEDULER_MAGIC;
     _neighbor_fd = eventfd(0, 0);
@@ -261,7 +264,38 @@ Scheduler::~Scheduler()
               << (100.0*_local)/(_local+_steals) << "% local)"
               << " \tmessages: " << _msgs
               << " (" << 1.0*_msgs/(_local + _steals) << " per proc)"
-              << std::endl;
+              << " \tbusy: "
+              << (100.0*_busyNs)/(_busyNs + _stealNs + _sleepNs + _idleNs)
+              << "%" << std::endl;
+}
+
+const std::vector<Scheduler *> &
+Scheduler::getSchedulers()
+{
+    return _schedulers;
+}
+
+void
+Scheduler::getStats(Stats &stats) const
+{
+    stats.busyNs = _busyNs.load(std::memory_order_relaxed);
+    stats.stealNs = _stealNs.load(std::memory_order_relaxed);
+    stats.sleepNs = _sleepNs.load(std::memory_order_relaxed);
+    stats.idleNs = _idleNs.load(std::memory_order_relaxed);
+    stats.runQueueLockWaitNs =
+        _runQueueLockWaitNs.load(std::memory_order_relaxed);
+    stats.local = _local.load(std::memory_order_relaxed);
+    stats.steals = _steals.load(std::memory_order_relaxed);
+    stats.msgs = _msgs.load(std::memory_order_relaxed);
+}
+
+uint64_t
+Scheduler::account(std::atomic<uint64_t> &counter)
+{
+    uint64_t now = TaskProfile::nowNs();
+    TaskProfile::add(counter, now - _mark);
+    _mark = now;
+    return now;
 }
 
 void
@@ -275,7 +309,7 @@ Scheduler::getNextProcess()
 {
     Process *p = NULL;
 
-    _run_queue_lock.lock();
+    TaskProfile::lockTimed(_run_queue_lock, _runQueueLockWaitNs);
     if (!_run_queue.empty()) {
         p = _run_queue.front();
         _run_queue.pop_front();
@@ -300,9 +334,10 @@ Scheduler::getNextGlobalProcess()
 
         // check locally
         if (NULL != (p = getNextProcess())) {
-            ++_local;
+            TaskProfile::add(_local, 1);
             break;
         }
+        account(_idleNs);
         // check globally
         for (SchedList::iterator i = _stealList.begin();
              i != _stealList.end(); ++i) {
@@ -311,8 +346,9 @@ Scheduler::getNextGlobalProcess()
                 break;
             }
         }
+        account(_stealNs);
         if (p) { // steal was successful
-            ++_steals;
+            TaskProfile::add(_steals, 1);
             break;
         }
 
@@ -326,6 +362,7 @@ Scheduler::getNextGlobalProcess()
         } else {
             read(n->_neighbor_fd, &efd_val, sizeof(efd_val));
         }
+        account(_sleepNs);
     }
 
     if (wasSleeping) {
@@ -344,7 +381,7 @@ Scheduler::enqueueProcess(Process *p)
 
     bool needToWakeSelf = !isInSchedulerContext();
 
-    _run_queue_lock.lock();
+    TaskProfile::lockTimed(_run_queue_lock, _runQueueLockWaitNs);
     bool isFirstEntry = _run_queue.empty();
     _run_queue.push_back(p);
     _run_queue_lock.unlock();
@@ -370,6 +407,7 @@ Scheduler::run()
 {
     setCurrentScheduler(this);
     setInSchedulerContext(true);
+    _mark = TaskProfile::nowNs();
     while (0 < Process::numProcesses()) {
         _currentProcess = getNextGlobalProcess();
         if (_currentProcess) {
@@ -379,7 +417,19 @@ Scheduler::run()
 			//unsigned numToRun = MIN_MSGS_TO_RUN +
             //    (_currentProcess->pendingMessages() >> 1);
             unsigned numToRun = MSGS_TO_RUN;
-            while(numToRun-- && _currentProcess->runOneMessage()) { ++_msgs; }
+            unsigned msgs = 0;
+            // one clock read per message: each message's service time
+            // starts where the previous one ended
+            uint64_t start = account(_idleNs);
+            while(numToRun-- && _currentProcess->runOneMessage()) {
+                uint64_t end = TaskProfile::nowNs();
+                _currentProcess->recordServiceTime(end - start);
+                start = end;
+                ++msgs;
+            }
+            TaskProfile::add(_busyNs, start - _mark);
+            _mark = start;
+            TaskProfile::add(_msgs, msgs);
             if (_currentProcess->hasExited()) {
                 delete _currentProcess;
                 _currentProcess = NULL;
@@ -448,8 +498,9 @@ Scheduler::startSchedulers(unsigned num, Process *initial, bool bindCpu)
     std::list<pthread_t> threads;
 
     for (unsigned i=0; i < num; ++i) {
-        schedulers.push_back(new Scheduler());
+        schedulers.push_back(new Scheduler(i));
     }
+    _schedulers = schedulers;
 
 #ifdef USE_TOPOLOGY
     // Create CPU list structure for building steal lists
@@ -540,6 +591,7 @@ Scheduler::startSchedulers(unsigned num, Process *initial, bool bindCpu)
         pthread_join(threads.front(), NULL);
         threads.pop_front();
     }
+    _schedulers.clear();
     for (std::vector<Scheduler *>::iterator i = schedulers.begin();
          i != schedulers.end(); i++) {
         delete *i;
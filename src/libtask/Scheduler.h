@@ -8,9 +8,12 @@
 #define SCHEDULER_H
 
 #include "Lock.h"
+#include <atomic>
 #include <deque>
 #include <list>
 #include <pthread.h>
+#include <stdint.h>
+#include <vector>
 
 class Process;
 
@@ -27,9 +30,31 @@ class Scheduler {
 public:
     typedef std::list<Scheduler *> SchedList;
 
+    /// Cumulative profiling counters of a Scheduler. The times add up
+    /// to the time the Scheduler has been running.
+    struct Stats {
+        /// Time spent executing messages
+        uint64_t busyNs;
+        /// Time spent looking for work on the other Schedulers
+        uint64_t stealNs;
+        /// Time spent blocked waiting for work
+        uint64_t sleepNs;
+        /// Time spent on everything else (checking the local run
+        /// queue, polling the FDWatcher, switching processes)
+        uint64_t idleNs;
+        /// Time spent by any thread waiting for the run queue lock
+        uint64_t runQueueLockWaitNs;
+        /// Number of processes taken from the local run queue
+        uint64_t local;
+        /// Number of processes stolen from other Schedulers
+        uint64_t steals;
+        /// Number of messages executed
+        uint64_t msgs;
+    };
+
     static bool initScheduler();
 
-    Scheduler();
+    Scheduler(unsigned id = 0);
     ~Scheduler();
 
     /// Start the requested number of schedulers, assigning them to
@@ -43,6 +68,19 @@ public:
                                 Process *initial,
                                 bool bindCpu = true);
 
+    /// Retrieve the Schedulers started by startSchedulers(). The list
+    /// stays valid as long as the schedulers are running.
+    /// @returns the running Schedulers, in the order of their IDs
+    static const std::vector<Scheduler *> &getSchedulers();
+
+    /// Retrieve the index of this Scheduler in getSchedulers()
+    unsigned getId() const { return _id; }
+
+    /// Retrieve the profiling counters of this Scheduler. This is safe
+    /// to call from any thread.
+    /// @param[out] stats The counters
+    void getStats(Stats &stats) const;
+
     /// Retrieve the number of available processors in the server.
     /// @returns the number of processors
     static unsigned numProcessors();
@@ -107,6 +145,7 @@ private:
 
     static const unsigned SCHEDULER_MAGIC = 0xfdb97531;
     unsigned _magicNumber;
+    unsigned _id;
     /// Lock protecting the scheduler's run queue
     TtasLock _run_queue_lock;
     /// The scheduler's run queue
@@ -119,9 +158,21 @@ private:
     SchedList _stealList;
     /// The Process that the Scheduler is executing
     Process *_currentProcess;
-    unsigned _local;
-    unsigned _steals;
-    unsigned _msgs;
+    /// The running Schedulers (see getSchedulers())
+    static std::vector<Scheduler *> _schedulers;
+
+    /// Profiling counters (see Stats); only the scheduler thread
+    /// updates them, except _runQueueLockWaitNs
+    std::atomic<uint64_t> _local;
+    std::atomic<uint64_t> _steals;
+    std::atomic<uint64_t> _msgs;
+    std::atomic<uint64_t> _busyNs;
+    std::atomic<uint64_t> _stealNs;
+    std::atomic<uint64_t> _sleepNs;
+    std::atomic<uint64_t> _idleNs;
+    std::atomic<uint64_t> _runQueueLockWaitNs;
+    /// The end of the last period accounted in the counters above
+    uint64_t _mark;
 
     static void allocSchedKey();
     /// pthread start function.
@@ -131,6 +182,11 @@ private:
     /// Try to get the next process within the scheduling group
     /// @returns the next available Process or NULL if none are waiting
     Process *getNextGlobalProcess();
+
+    /// Add the time since the last call to a profiling counter
+    /// @param[in,out] counter The counter to charge
+    /// @returns the current time
+    uint64_t account(std::atomic<uint64_t> &counter);
 };
 
 #endif // SCHEDULER_H
@@ -53,3 +53,20 @@ TEST(Scheduler, runReturnsAfterLastProcess) {
     s.enqueueProcess(p);
     s.run();
 }
+
+TEST(Scheduler, runProfilesMessagesAndTime) {
+    Scheduler s(3);
+    ASSERT_EQ(3u, s.getId());
+    Process *p = new Process;
+    p->enqueueMessage(new NullMessage, NULL);
+    p->enqueueMessage(new ExitMsg(p), NULL);
+    s.enqueueProcess(p);
+    s.run();
+    Scheduler::Stats stats;
+    s.getStats(stats);
+    EXPECT_EQ(1u, stats.local);
+    EXPECT_EQ(0u, stats.steals);
+    EXPECT_EQ(2u, stats.msgs);
+    EXPECT_EQ(0u, stats.sleepNs);
+    EXPECT_LT(0u, stats.busyNs + stats.idleNs);
+}
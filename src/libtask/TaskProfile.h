@@ -0,0 +1,150 @@
+// -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-
+/*
+ * Copyright (c) 2013 Netapp, Inc.
+ * All rights reserved.
+ */
+
+#ifndef TASK_PROFILE_H
+#define TASK_PROFILE_H
+
+#include "Lock.h"
+#include <atomic>
+#include <cmath>
+#include <stdint.h>
+#include <time.h>
+
+/// Helpers for the always-on Scheduler and Process profiling. They
+/// are meant to stay cheap enough to leave on in production: one
+/// clock read per message, and locks are only timed when they are
+/// contended.
+namespace TaskProfile {
+
+/// Read the monotonic clock (a vDSO call, no syscall).
+/// @returns the current time in nanoseconds
+static inline uint64_t
+nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+/// Acquire a lock, adding the time spent waiting for it to waitNs if
+/// it was held by someone else.
+/// @param[in] l The lock to acquire
+/// @param[in,out] waitNs The accumulated wait time
+static inline void
+lockTimed(TtasLock &l, std::atomic<uint64_t> &waitNs)
+{
+    if (l.tryLock()) {
+        return;
+    }
+    uint64_t start = nowNs();
+    l.lock();
+    waitNs.fetch_add(nowNs() - start, std::memory_order_relaxed);
+}
+
+/// Add to a counter that only one thread updates at a time (no
+/// locked instruction needed).
+static inline void
+add(std::atomic<uint64_t> &counter, uint64_t value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+}
+
+}
+
+/**
+ * A histogram of durations with power-of-2 buckets (bucket i holds
+ * the values in [2^(i-1), 2^i) ns). Recording is wait-free, and a
+ * reader on another thread can drain the histogram to get the values
+ * recorded since its last read.
+ */
+class ServiceTimeHistogram {
+public:
+    static const unsigned NUM_BUCKETS = 64;
+
+    /// A private copy of the histogram (see drain())
+    struct Snapshot {
+        Snapshot() : count(0), sumNs(0), maxNs(0) {
+            for (unsigned i = 0; i < NUM_BUCKETS; i++) {
+                buckets[i] = 0;
+            }
+        }
+
+        /// Estimate a quantile as the upper bound of its bucket
+        /// (capped by the max).
+        /// @param[in] q The quantile in [0, 1]
+        /// @returns the estimate in nanoseconds (0 if empty)
+        uint64_t quantile(double q) const {
+            if (count == 0) {
+                return 0;
+            }
+            // nearest rank
+            uint64_t rank = static_cast<uint64_t>(ceil(q * count));
+            if (rank == 0) {
+                rank = 1;
+            }
+            uint64_t seen = 0;
+            for (unsigned i = 0; i < NUM_BUCKETS; i++) {
+                seen += buckets[i];
+                if (seen >= rank) {
+                    uint64_t upper = (i == 0) ? 0 :
+                        (i == NUM_BUCKETS - 1) ? ~0ull : (1ull << i) - 1;
+                    return upper < maxNs ? upper : maxNs;
+                }
+            }
+            return maxNs;
+        }
+
+        uint64_t count;
+        uint64_t sumNs;
+        uint64_t maxNs;
+        uint64_t buckets[NUM_BUCKETS];
+    };
+
+    ServiceTimeHistogram() : _count(0), _sumNs(0), _maxNs(0) {
+        for (unsigned i = 0; i < NUM_BUCKETS; i++) {
+            _buckets[i] = 0;
+        }
+    }
+
+    /// Record a duration.
+    /// @param[in] ns The duration in nanoseconds
+    void record(uint64_t ns) {
+        unsigned bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+        if (bucket >= NUM_BUCKETS) {
+            bucket = NUM_BUCKETS - 1;
+        }
+        _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        _sumNs.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t max = _maxNs.load(std::memory_order_relaxed);
+        while (ns > max &&
+               !_maxNs.compare_exchange_weak(max, ns,
+                                             std::memory_order_relaxed)) {
+        }
+        _count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Move the recorded values into a snapshot and reset the
+    /// histogram. Values recorded concurrently end up in either this
+    /// snapshot or the next one.
+    /// @param[out] s The snapshot
+    void drain(Snapshot &s) {
+        s.count = _count.exchange(0, std::memory_order_relaxed);
+        s.sumNs = _sumNs.exchange(0, std::memory_order_relaxed);
+        s.maxNs = _maxNs.exchange(0, std::memory_order_relaxed);
+        for (unsigned i = 0; i < NUM_BUCKETS; i++) {
+            s.buckets[i] = _buckets[i].exchange(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _sumNs;
+    std::atomic<uint64_t> _maxNs;
+    std::atomic<uint64_t> _buckets[NUM_BUCKETS];
+};
+
+#endif // TASK_PROFILE_H